@@ -13,13 +13,20 @@
 // #include <stdio.h> // DEBUG
 // #include <ncurses.h>
 
+#define _GNU_SOURCE // posix_openpt(), ptsname_r(), cfmakeraw()
+
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdio.h> // fflush
 #include <fcntl.h>
+#include <termios.h>
+#include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <errno.h>
+#include <poll.h>
 #include <string.h> // memset
 #include <stdbool.h>
 #include <math.h>
@@ -55,6 +62,7 @@ void reset_16c750(tl16c750_t *uart)
     uart->data_rx_fifo_write = 0;
     uart->data_tx_fifo_read = 0;
     uart->data_tx_fifo_write = 0;
+    uart->tx_shifting = false;
 }
 
 
@@ -65,11 +73,59 @@ void reset_16c750(tl16c750_t *uart)
  */
 void init_16c750(tl16c750_t *uart)
 {
+    memset(uart->regs, 0, sizeof(uart->regs));
     reset_16c750(uart);
 
+    uart->backend = UART_BACKEND_TCP;
     uart->sock_fd = -1;
+    uart->pty_slave_fd = -1;
+    uart->pty_name[0] = '\0';
+    uart->file_in_fd = -1;
+    uart->file_out_fd = -1;
+    uart->unpaced = false;
+    uart->buf_in = NULL;
+    uart->buf_in_len = 0;
     uart->sock_timeout = 1000; // in ms
-    uart->data_socket = -1;
+    io_init_port(&uart->port);
+
+    uart->io = NULL;
+    uart->irq_line = 0;
+    uart->sched = NULL;
+    uart->cpu_hz = UART_DEFAULT_CPU_HZ;
+    uart->rx_log = NULL;
+}
+
+
+/**
+ * Hand the listener (or stream) in uart->sock_fd over to the I/O thread
+ * 
+ * @param *uart The UART whose port to start
+ * @param stream True if sock_fd is read and written directly
+ * @return errno Describing the error encountered
+ */
+static int _start_io_16c750(tl16c750_t *uart, bool stream)
+{
+    bool added;
+
+    io_stop(uart->io);
+    if (stream) {
+        added = io_add_stream_port(uart->io, &uart->port, uart->sock_fd);
+    }
+    else {
+        added = io_add_port(uart->io, &uart->port, uart->sock_fd);
+    }
+    if (!added) {
+        io_start(uart->io);
+        return EBUSY;
+    }
+    if (!io_start(uart->io)) {
+        return errno;
+    }
+    
+    uart->enabled = false;
+    uart->tx_empty_edge = false;
+
+    return 0;
 }
 
 
@@ -144,191 +200,332 @@ int init_port_16c750(tl16c750_t *uart, uint16_t port)
     if (ret < 0) {
         return errno;
     }
+
+    uart->backend = UART_BACKEND_TCP;
+    return _start_io_16c750(uart, false);
+}
+
+
+/**
+ * Initialize a UART with a listener on a Unix domain stream socket.
+ * A stale socket file left at the path is replaced.
+ * This closes any open ports (file descriptors)
+ * 
+ * @param *uart The UART to set up
+ * @param *path The file system path to listen on
+ * @return errno Describing the error encountered
+ */
+int init_unix_16c750(tl16c750_t *uart, const char *path)
+{
+    struct stat st;
+
+    stop_16c750(uart);
+
+    if (strlen(path) >= sizeof(uart->unix_name.sun_path)) {
+        return ENAMETOOLONG;
+    }
+
+    memset(&(uart->unix_name), 0, sizeof(uart->unix_name));
+    uart->unix_name.sun_family = AF_UNIX;
+    strcpy(uart->unix_name.sun_path, path);
+
+    uart->sock_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (uart->sock_fd < 0) {
+        return errno;
+    }
+
+    // Only ever remove sockets, never a file which happens to be there
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+
+    if (bind(uart->sock_fd, (const struct sockaddr *) &(uart->unix_name), sizeof(uart->unix_name)) < 0) {
+        return errno;
+    }
+
+    // Set before listen() so a failure below still removes the file
+    uart->backend = UART_BACKEND_UNIX;
+
+    if (listen(uart->sock_fd, UART_MAX_CONNECTIONS) < 0) {
+        return errno;
+    }
+
+    return _start_io_16c750(uart, false);
+}
+
+
+/**
+ * Initialize a UART on a new pseudo-terminal. Terminal programs open
+ * the slave side, whose name is stored in uart->pty_name. The slave is
+ * kept open by the UART as well, in raw mode, so nothing is lost or
+ * echoed while no program has it open.
+ * This closes any open ports (file descriptors)
+ * 
+ * @param *uart The UART to set up
+ * @return errno Describing the error encountered
+ */
+int init_pty_16c750(tl16c750_t *uart)
+{
+    struct termios tio;
+
+    stop_16c750(uart);
+
+    uart->sock_fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+
+    if (uart->sock_fd < 0) {
+        return errno;
+    }
+
+    if (grantpt(uart->sock_fd) < 0 || unlockpt(uart->sock_fd) < 0) {
+        return errno;
+    }
+
+    int err = ptsname_r(uart->sock_fd, uart->pty_name, sizeof(uart->pty_name));
+    if (err) {
+        return err;
+    }
+
+    uart->pty_slave_fd = open(uart->pty_name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+
+    if (uart->pty_slave_fd < 0) {
+        return errno;
+    }
+
+    if (tcgetattr(uart->pty_slave_fd, &tio) < 0) {
+        return errno;
+    }
+    cfmakeraw(&tio);
+    if (tcsetattr(uart->pty_slave_fd, TCSANOW, &tio) < 0) {
+        return errno;
+    }
+
+    uart->backend = UART_BACKEND_PTY;
+    return _start_io_16c750(uart, true);
+}
     
-    uart->data_socket = -1;
+
+/**
+ * Initialize a UART which reads its RX data from a file and writes its
+ * TX data to a file, without any connection. Both are done on the CPU
+ * thread in chunks of up to IO_RING_LEN bytes, through the port's rings.
+ * This closes any open ports (file descriptors)
+ * 
+ * @param *uart The UART to set up
+ * @param *in_path The file to receive from ("-" = stdin)
+ * @param *out_path The file to send to, truncated if it exists ("-" = stdout)
+ * @param unpaced True to move chars as soon as the CPU reads or writes
+ *                them, false to pace them by the baud rate
+ * @return errno Describing the error encountered
+ */
+int init_file_16c750(tl16c750_t *uart, const char *in_path, const char *out_path, bool unpaced)
+{
+    struct stat st;
+
+    stop_16c750(uart);
+
+    // Set first so a failure below still closes what was opened
+    uart->backend = UART_BACKEND_FILE;
+
+    if (strcmp(in_path, "-") == 0) {
+        uart->file_in_fd = STDIN_FILENO;
+    }
+    else if ((uart->file_in_fd = open(in_path, O_RDONLY | O_CLOEXEC)) < 0) {
+        return errno;
+    }
+
+    if (strcmp(out_path, "-") == 0) {
+        uart->file_out_fd = STDOUT_FILENO;
+    }
+    else if ((uart->file_out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+        return errno;
+    }
+
+    // Reading a regular file never has to wait, anything else is
+    // checked with poll() first so the CPU thread never blocks on it
+    if (fstat(uart->file_in_fd, &st) < 0) {
+        return errno;
+    }
+    uart->file_in_poll = !S_ISREG(st.st_mode);
+    uart->file_in_eof = false;
+    uart->unpaced = unpaced;
+
+    io_port_clear(&uart->port);
+    atomic_store(&uart->port.connected, true);
+
     uart->enabled = false;
     uart->tx_empty_edge = false;
 
     return 0;
 }
-    
 
-/*
- * Close network connections
+
+/**
+ * Connect a UART to buffers in memory instead of the host, e.g. to feed
+ * generated input to the firmware. Received chars are taken from the
+ * buffer given to feed_16c750(), transmitted chars are dropped.
  * 
- * @param *uart The UART to close
+ * @param *uart The UART to set up
+ * @param unpaced True to move chars as soon as the CPU reads or writes
+ *                them, false to pace them by the baud rate
  */
-void stop_16c750(tl16c750_t *uart)
+void init_buffer_16c750(tl16c750_t *uart, bool unpaced)
 {
-    if (uart->data_socket >= 0) {
-        close(uart->data_socket);
-    }
-    if (uart->sock_fd >= 0) {
-        close(uart->sock_fd);
-    }
+    stop_16c750(uart);
+
+    uart->backend = UART_BACKEND_BUFFER;
+    uart->unpaced = unpaced;
+
+    io_port_clear(&uart->port);
+    atomic_store(&uart->port.connected, true);
+
+    uart->enabled = false;
+    uart->tx_empty_edge = false;
 }
 
 
 /**
- * Cycle the UART to update its memory locations.
- * @note This makes the assumption that a max of one memory location
- *       will be modified between calls to this function
+ * Set the chars a UART with the buffer backend receives next. The
+ * buffer is not copied, it has to stay valid until it is used up or
+ * replaced.
  * 
- * @param *uart The UART to update
- * @param *mem The memory that the UART is shadowing
- * @return True if an interrupt is active, false if no interrupts are active.
+ * @param *uart The UART to feed (buffer backend)
+ * @param *data The chars
+ * @param len Number of chars
  */
-bool step_16c750(tl16c750_t *uart, memory_t *mem)
+void feed_16c750(tl16c750_t *uart, const uint8_t *data, size_t len)
 {
-    bool irq = false;
-    bool sock_closed = false;
-
-    // Attempt to accept an incomming connection if one is
-    // not already established
-    if (uart->data_socket < 0) {
-        uart->data_socket = accept(uart->sock_fd, NULL, NULL);
-
-        // If the accept was successfult, attempt to set the socket
-        // into a nonblocking mode
-        if (uart->data_socket >= 0) {
-            // endwin(); fprintf(stdout, "Accepted\n"); refresh(); // THIS LINE DEBUG
-            int flags = fcntl(uart->data_socket, F_GETFL, 0);
-            if (flags != -1) {
-                fcntl(uart->data_socket, F_SETFL, flags | O_NONBLOCK);
-            }
-        }
+    uart->buf_in = data;
+    uart->buf_in_len = len;
+}
+
+
+/**
+ * Read the next chunk of the input file of a UART into its RX ring,
+ * if the ring is empty and there is input waiting
+ * 
+ * @param *uart The UART to read for (file backend)
+ */
+static void _file_fill_16c750(tl16c750_t *uart)
+{
+    if (uart->file_in_eof || io_ring_used(&uart->port.rx) > 0) {
+        return;
     }
-    
-    // Check the socket for characters
-    // But be sure to not overflow the RX buffer
-    if (uart->data_socket >= 0 && abs(uart->data_rx_fifo_write - uart->data_rx_fifo_read) < UART_FIFO_LEN - 1) {
-        char buf;
-        int read_len = read(uart->data_socket, &buf, 1);
-
-        if (read_len > 0) {
-            uart->data_rx_buf[uart->data_rx_fifo_write] = buf;
-            uart->data_rx_fifo_write += 1;
-            uart->data_rx_fifo_write %= UART_FIFO_LEN;
-        }
-        else if (read_len == -1 && errno != EAGAIN && errno != EWOULDBLOCK) { // Error
-            sock_closed = true;
+
+    if (uart->file_in_poll) {
+        struct pollfd pfd = { .fd = uart->file_in_fd, .events = POLLIN };
+
+        if (poll(&pfd, 1, 0) <= 0) {
+            return;
         }
     }
-        
-    // SCR is scratch reg, ignore its contents
 
-    // Keep a local copy of the IER
-    uart->regs[TL_IER] = _get_mem_byte(mem, uart->addr + TLA_IER, false);
+    ssize_t len = io_port_read(&uart->port, uart->file_in_fd);
+
+    if (len == 0 || (len < 0 && errno != EINTR && errno != EAGAIN)) {
+        uart->file_in_eof = true;
+    }
+}
 
-    // LCR
-    uart->regs[TL_LCR] = _get_mem_byte(mem, uart->addr + TLA_LCR, false);
 
-    // MCR
-    uart->regs[TL_MCR] = _get_mem_byte(mem, uart->addr + TLA_MCR, false);
+/**
+ * Write the TX ring of a UART to its output file
+ * 
+ * @param *uart The UART to write for (file backend)
+ */
+static void _file_flush_16c750(tl16c750_t *uart)
+{
+    if (io_ring_used(&uart->port.tx) == 0) {
+        return;
+    }
 
-    // Disable TX empty flag if the CPU read the IIR
-    // (can be enabled if TX is written to this cycle)
-    if (_test_and_reset_mem_flags(mem, uart->addr + TLA_IIR, MEM_FLAG_R).R == 1) {
-        uart->tx_empty_edge = false;
+    // Keep the order of anything the simulator printed itself
+    if (uart->file_out_fd == STDOUT_FILENO) {
+        fflush(stdout);
     }
-    
-    // Handle writing to divisor latches
-    if (uart->regs[TL_LCR] & (1u << LCR_DLAB)) {
-        if (_test_and_reset_mem_flags(mem, uart->addr + TLA_DLL, MEM_FLAG_W).W == 1) {
-            uart->regs[TL_DLL] = _get_mem_byte(mem, uart->addr + TLA_DLL, false);
-        } else {
-            _set_mem_byte(mem, uart->addr + TLA_DLL, uart->regs[TL_DLL], false);
+    io_port_write(&uart->port, uart->file_out_fd);
+}
+
+
+/*
+ * Close network connections (or the pty). Characters still waiting in the TX FIFO
+ * are sent first, as the line would finish shifting them out.
+ * 
+ * @param *uart The UART to close
+ */
+void stop_16c750(tl16c750_t *uart)
+{
+    if (uart->port.listen_fd >= 0 || uart->port.stream) {
+        while (uart->data_tx_fifo_read != uart->data_tx_fifo_write &&
+               io_port_putc(&uart->port, uart->data_tx_buf[uart->data_tx_fifo_read])) {
+            uart->data_tx_fifo_read += 1;
+            uart->data_tx_fifo_read %= UART_FIFO_LEN;
         }
-        if (_test_and_reset_mem_flags(mem, uart->addr + TLA_DLM, MEM_FLAG_W).W == 1) {
-            uart->regs[TL_DLM] = _get_mem_byte(mem, uart->addr + TLA_DLM, false);
-        } else {
-            _set_mem_byte(mem, uart->addr + TLA_DLM, uart->regs[TL_DLM], false);
+
+        // Stopping the I/O thread sends what is left
+        io_stop(uart->io);
+        io_remove_port(uart->io, &uart->port);
+        if (uart->io->port_count > 0) {
+            io_start(uart->io);
         }
     }
-    // Otherwise, handle communication with the rx/tx regs
-    else {
-        // THR
-        if (_test_and_reset_mem_flags(mem, uart->addr + TLA_THR, MEM_FLAG_W).W == 1) {
-
-            uart->tx_empty_edge = false; // Write into TX reg resets IRQ for empty tx
-            
-            // Loopback
-            if (uart->regs[TL_MCR] & (1u << MCR_LOOP)) {
-                // Add value to queue
-                uart->data_rx_buf[uart->data_rx_fifo_write] = _get_mem_byte(mem, uart->addr + TLA_THR, false);
-                uart->data_rx_fifo_write += 1;
-                uart->data_rx_fifo_write %= UART_FIFO_LEN;
-            }
-            else {
-                // SEND CHAR OVER SOCKET?
-                uint8_t val = _get_mem_byte(mem, uart->addr + TLA_THR, false);
-                if (uart->data_socket >= 0 && !sock_closed) {
-                    if (send(uart->data_socket, &val, 1, MSG_NOSIGNAL) == -1) {
-                        // If the pipe was closed, errno should be EPIPE
-                        sock_closed = true;
-                    }
+    if (uart->backend == UART_BACKEND_FILE) {
+        while (uart->data_tx_fifo_read != uart->data_tx_fifo_write) {
+            if (io_ring_free(&uart->port.tx) == 0) {
+                _file_flush_16c750(uart);
+                if (io_ring_free(&uart->port.tx) == 0) {
+                    break; // The output would block
                 }
             }
-
-            // If tx buffer is empty, enable signaling of TX empty IRQ
-            if (uart->data_tx_fifo_read == uart->data_tx_fifo_write) {
-                uart->tx_empty_edge = true;
-            }
+            io_port_putc(&uart->port, uart->data_tx_buf[uart->data_tx_fifo_read]);
+            uart->data_tx_fifo_read += 1;
+            uart->data_tx_fifo_read %= UART_FIFO_LEN;
         }
+        _file_flush_16c750(uart);
+        io_port_clear(&uart->port);
+        atomic_store(&uart->port.connected, false);
 
-        // RHR
-        // Always keep the last char from the RX FIFO available
-        if (abs(uart->data_rx_fifo_write - uart->data_rx_fifo_read) == 0) {
-            // Reading the RHR after all characters have been read
-            // in will result in just reading the last char received.
-            // This is accomplished by "subtracting 1" from the index
-            // and performing wrapping on it
-            _set_mem_byte(
-                mem,
-                uart->addr + TLA_RBR,
-                uart->data_rx_buf[(uart->data_rx_fifo_read + UART_FIFO_LEN - 1) % UART_FIFO_LEN],
-                false
-                );
-        } else {
-            _set_mem_byte(
-                mem,
-                uart->addr + TLA_RBR,
-                uart->data_rx_buf[uart->data_rx_fifo_read],
-                false
-                );
+        if (uart->file_in_fd > STDERR_FILENO) {
+            close(uart->file_in_fd);
         }
-        
-        if (_test_and_reset_mem_flags(mem, uart->addr + TLA_RBR, MEM_FLAG_R).R == 1) {
-            
-            // Update read buffer pointer
-            if (abs(uart->data_rx_fifo_write - uart->data_rx_fifo_read) > 0) {
-                uart->data_rx_fifo_read += 1;
-                uart->data_rx_fifo_read %= UART_FIFO_LEN;
-            }
-
+        if (uart->file_out_fd > STDERR_FILENO) {
+            close(uart->file_out_fd);
         }
+        uart->file_in_fd = -1;
+        uart->file_out_fd = -1;
+    }
+    if (uart->sock_fd >= 0) {
+        close(uart->sock_fd);
+        uart->sock_fd = -1;
+    }
+    if (uart->pty_slave_fd >= 0) {
+        close(uart->pty_slave_fd);
+        uart->pty_slave_fd = -1;
     }
+    if (uart->backend == UART_BACKEND_UNIX) {
+        unlink(uart->unix_name.sun_path);
+    }
+    if (uart->backend == UART_BACKEND_BUFFER) {
+        atomic_store(&uart->port.connected, false);
+        uart->buf_in = NULL;
+        uart->buf_in_len = 0;
+    }
+    uart->backend = UART_BACKEND_TCP;
+    uart->pty_name[0] = '\0';
+    uart->unpaced = false;
+}
 
-    // If the FIFO Control Register was updated, keep a local copy
-    if (_test_and_reset_mem_flags(mem, uart->addr + TLA_FCR, MEM_FLAG_W).W == 1) {
-        uart->regs[TL_FCR] = _get_mem_byte(mem, uart->addr + TLA_FCR, false);
 
-        // Changing the FIFO ENable bit clears the FIFOs
-        if (uart->regs[TL_FCR] & (1u << FCR_FIFOEN)) {
-            uart->data_rx_fifo_read = 0;
-            uart->data_tx_fifo_read = 0;
-            uart->data_rx_fifo_write = 0;
-            uart->data_tx_fifo_write = 0;
-        }
-        else if (uart->regs[TL_FCR] & (1u << FCR_RXFRST)) {
-            uart->data_rx_fifo_read = 0;
-            uart->data_rx_fifo_write = 0;
-        }
-        else if (uart->regs[TL_FCR] & (1u << FCR_TXFRST)) {
-            uart->data_tx_fifo_read = 0;
-            uart->data_tx_fifo_write = 0;
-        }
-    }
+/**
+ * Update the status registers (LSR, IIR and MSR) of a UART
+ * from the state of its FIFOs and connection
+ * 
+ * @param *uart The UART to update
+ * @return True if an interrupt is active, false if no interrupts are active.
+ */
+static bool _update_16c750(tl16c750_t *uart)
+{
+    bool irq = false;
 
     // LSR
     // If RX FIFO is empty
@@ -340,13 +537,18 @@ bool step_16c750(tl16c750_t *uart, memory_t *mem)
     
     // If TX FIFO is empty
     if (uart->data_tx_fifo_read == uart->data_tx_fifo_write) {
-        uart->regs[TL_LSR] |= ((1u << LSR_THRE) | (1u << LSR_TEMT));
+        uart->regs[TL_LSR] |= (1u << LSR_THRE);
     } else {
-        uart->regs[TL_LSR] &= ~((1u << LSR_THRE) | (1u << LSR_TEMT));
+        uart->regs[TL_LSR] &= ~(1u << LSR_THRE);
     }
-    uart->regs[TL_LSR] &= ~((1u << LSR_OE) | (1u << LSR_PE) | (1u << LSR_FE) | (1u << LSR_BI) | (1u << LSR_ERFIFO));
 
-    _set_mem_byte(mem, uart->addr + TLA_LSR, uart->regs[TL_LSR], false);
+    // If the transmitter is completely empty (FIFO and shift register)
+    if (uart->data_tx_fifo_read == uart->data_tx_fifo_write && !uart->tx_shifting) {
+        uart->regs[TL_LSR] |= (1u << LSR_TEMT);
+    } else {
+        uart->regs[TL_LSR] &= ~(1u << LSR_TEMT);
+    }
+    uart->regs[TL_LSR] &= ~((1u << LSR_OE) | (1u << LSR_PE) | (1u << LSR_FE) | (1u << LSR_BI) | (1u << LSR_ERFIFO));
 
     // IIR
     // If there is received data available, set bit 2
@@ -402,25 +604,635 @@ bool step_16c750(tl16c750_t *uart, memory_t *mem)
         uart->regs[TL_IIR] |= (1u << IIR_IPN);  // Set bit
     }
     
-    // Update the state of the Interrupt Identification Register
-    _set_mem_byte(mem, uart->addr + TLA_IIR, uart->regs[TL_IIR], false);
-
     // MSR
-    if (uart->data_socket != -1) {
+    if (atomic_load(&uart->port.connected)) {
         uart->regs[TL_MSR] |= 1u << MSR_DCD; // DELTA DCD not implemented! TODO
     } else {
         uart->regs[TL_MSR] &= ~(1u << MSR_DCD);
     }
-    
-    _set_mem_byte(mem, uart->addr + TLA_MSR, uart->regs[TL_MSR], false);
 
-    // Allow new connections
-    if (sock_closed) {
-        close(uart->data_socket);
-        uart->data_socket = -1;
+    return irq;
+}
+
+
+/**
+ * Update the status registers of a UART and drive its IRQ line
+ * (which is ORed with those of the other devices on the scheduler)
+ * 
+ * @param *uart The UART to update
+ */
+static void _irq_16c750(tl16c750_t *uart)
+{
+    bool irq = _update_16c750(uart);
+
+    if (uart->sched) {
+        sched_set_irq(uart->sched, uart->irq_line, irq);
     }
+}
 
-    return irq;
+
+/**
+ * Check if a UART is repeating a part of a run which was already run,
+ * and whose output was already sent to the host
+ * 
+ * @param *uart The UART to check
+ * @return True if chars shifted out now are dropped
+ */
+static bool _replaying_16c750(tl16c750_t *uart)
+{
+    return uart->rx_log && uart->sched && uart->sched->cpu &&
+        uart->sched->cpu->cycles < uart->rx_log->replay_until;
 }
 
 
+/**
+ * Shift the next char of the TX FIFO out onto the serial line (or into
+ * the RX FIFO in loopback mode). Stalls while the I/O thread (or the
+ * output file) has no room for it.
+ * 
+ * @param *uart The UART to shift
+ * @return True if a char was shifted out
+ */
+static bool _shift_tx_16c750(tl16c750_t *uart)
+{
+    io_port_t *port = &uart->port;
+    bool replaying = _replaying_16c750(uart);
+
+    if (uart->data_tx_fifo_read == uart->data_tx_fifo_write) {
+        return false;
+    }
+    if (io_ring_free(&port->tx) == 0 && uart->backend != UART_BACKEND_BUFFER && !replaying) {
+        if (uart->backend != UART_BACKEND_FILE) {
+            return false;
+        }
+        _file_flush_16c750(uart);
+        if (io_ring_free(&port->tx) == 0) {
+            return false;
+        }
+    }
+
+    uint8_t val = uart->data_tx_buf[uart->data_tx_fifo_read];
+    uart->data_tx_fifo_read += 1;
+    uart->data_tx_fifo_read %= UART_FIFO_LEN;
+
+    // Loopback
+    if (uart->regs[TL_MCR] & (1u << MCR_LOOP)) {
+        // Add value to queue
+        uart->data_rx_buf[uart->data_rx_fifo_write] = val;
+        uart->data_rx_fifo_write += 1;
+        uart->data_rx_fifo_write %= UART_FIFO_LEN;
+    }
+    else if (uart->backend != UART_BACKEND_BUFFER && !replaying) {
+        io_port_putc(port, val); // Dropped by the I/O thread if there is no client
+    }
+
+    // If tx buffer is empty, enable signaling of TX empty IRQ
+    if (uart->data_tx_fifo_read == uart->data_tx_fifo_write) {
+        uart->tx_empty_edge = true;
+    }
+    return true;
+}
+
+
+/**
+ * Add a char taken from the host to the RX log of a UART. If the log
+ * cannot grow the char is not recorded.
+ * 
+ * @param *log The log to add to
+ * @param seq The attempt the char was taken at
+ * @param val The char
+ */
+static void _log_rx_16c750(uart_rx_log_t *log, uint64_t seq, uint8_t val)
+{
+    if (log->len == log->cap) {
+        size_t cap = log->cap ? 2 * log->cap : 256;
+        uart_rx_entry_t *entry = realloc(log->entry, cap * sizeof(*entry));
+
+        if (!entry) {
+            return;
+        }
+        log->entry = entry;
+        log->cap = cap;
+    }
+
+    log->entry[log->len].seq = seq;
+    log->entry[log->len].val = val;
+    log->pos = ++log->len;
+}
+
+
+/**
+ * Shift the next received char into the RX FIFO
+ * But be sure to not overflow the RX buffer
+ * 
+ * @param *uart The UART to shift
+ * @return True if a char was shifted in
+ */
+static bool _shift_rx_16c750(tl16c750_t *uart)
+{
+    uint8_t val;
+
+    if ((uart->data_rx_fifo_write + 1) % UART_FIFO_LEN == uart->data_rx_fifo_read) {
+        return false;
+    }
+    if (uart->backend == UART_BACKEND_BUFFER) {
+        if (!uart->buf_in_len) {
+            return false;
+        }
+        val = *uart->buf_in++;
+        --uart->buf_in_len;
+    }
+    else {
+        uart_rx_log_t *log = uart->rx_log;
+        uint64_t seq = log ? log->seq++ : 0;
+
+        if (log && log->pos < log->len) {
+            // Repeating a run, the char comes at the same attempt as before
+            if (log->entry[log->pos].seq > seq) {
+                return false;
+            }
+            val = log->entry[log->pos++].val;
+        }
+        else {
+            if (uart->backend == UART_BACKEND_FILE) {
+                _file_fill_16c750(uart);
+            }
+            if (!io_port_getc(uart->io, &uart->port, &val)) {
+                return false;
+            }
+            if (log) {
+                _log_rx_16c750(log, seq, val);
+            }
+        }
+    }
+
+    uart->data_rx_buf[uart->data_rx_fifo_write] = val;
+    uart->data_rx_fifo_write += 1;
+    uart->data_rx_fifo_write %= UART_FIFO_LEN;
+    return true;
+}
+
+
+/**
+ * Memory mapped read of a UART register
+ * 
+ * @param *dev The UART being read
+ * @param addr The address being read
+ * @param setacc True if the read is done by the CPU (pops the RX
+ *               FIFO and acknowledges interrupts), false to only peek
+ * @return The value of the register
+ */
+static uint8_t _read_16c750(void *dev, uint32_t addr, bool setacc)
+{
+    tl16c750_t *uart = dev;
+    bool dlab = uart->regs[TL_LCR] & (1u << LCR_DLAB);
+    uint8_t val;
+
+    switch (addr - uart->addr) {
+    case TLA_RBR: // Also TLA_DLL
+        if (dlab) {
+            return uart->regs[TL_DLL];
+        }
+
+        // Always keep the last char from the RX FIFO available
+        if (uart->data_rx_fifo_write == uart->data_rx_fifo_read) {
+            // Reading the RHR after all characters have been read
+            // in will result in just reading the last char received.
+            // This is accomplished by "subtracting 1" from the index
+            // and performing wrapping on it
+            return uart->data_rx_buf[(uart->data_rx_fifo_read + UART_FIFO_LEN - 1) % UART_FIFO_LEN];
+        }
+
+        val = uart->data_rx_buf[uart->data_rx_fifo_read];
+
+        // Update read buffer pointer
+        if (setacc) {
+            uart->data_rx_fifo_read += 1;
+            uart->data_rx_fifo_read %= UART_FIFO_LEN;
+            if (uart->unpaced) {
+                _shift_rx_16c750(uart); // Refill right away
+            }
+            _irq_16c750(uart);
+        }
+        return val;
+    case TLA_IER: // Also TLA_DLM
+        return dlab ? uart->regs[TL_DLM] : uart->regs[TL_IER];
+    case TLA_IIR:
+        _update_16c750(uart);
+        val = uart->regs[TL_IIR];
+
+        // Disable TX empty flag if the CPU read the IIR
+        if (setacc) {
+            uart->tx_empty_edge = false;
+            _irq_16c750(uart);
+        }
+        return val;
+    case TLA_LCR:
+        return uart->regs[TL_LCR];
+    case TLA_MCR:
+        return uart->regs[TL_MCR];
+    case TLA_LSR:
+        _update_16c750(uart);
+        return uart->regs[TL_LSR];
+    case TLA_MSR:
+        _update_16c750(uart);
+        return uart->regs[TL_MSR];
+    case TLA_SCR:
+        return uart->regs[TL_SCR];
+    }
+    return 0;
+}
+
+
+/**
+ * Memory mapped write of a UART register
+ * 
+ * @param *dev The UART being written
+ * @param addr The address being written
+ * @param val The value written
+ * @param setacc True if the write is done by the CPU (sends data and
+ *               resets FIFOs), false to only update the register
+ */
+static void _write_16c750(void *dev, uint32_t addr, uint8_t val, bool setacc)
+{
+    tl16c750_t *uart = dev;
+    bool dlab = uart->regs[TL_LCR] & (1u << LCR_DLAB);
+
+    switch (addr - uart->addr) {
+    case TLA_THR: // Also TLA_DLL
+        if (dlab) {
+            uart->regs[TL_DLL] = val;
+            break;
+        }
+        if (!setacc) {
+            break;
+        }
+
+        uart->tx_empty_edge = false; // Write into TX reg resets IRQ for empty tx
+
+        // Queue the char, it is shifted out one character time
+        // at a time by _event_16c750(). Overruns are dropped.
+        if ((uart->data_tx_fifo_write + 1) % UART_FIFO_LEN != uart->data_tx_fifo_read) {
+            uart->data_tx_buf[uart->data_tx_fifo_write] = val;
+            uart->data_tx_fifo_write += 1;
+            uart->data_tx_fifo_write %= UART_FIFO_LEN;
+        }
+        if (uart->unpaced) {
+            while (_shift_tx_16c750(uart)) {} // Sent right away
+        }
+        _irq_16c750(uart);
+        break;
+    case TLA_IER: // Also TLA_DLM
+        uart->regs[dlab ? TL_DLM : TL_IER] = val;
+        if (setacc && !dlab) {
+            _irq_16c750(uart); // Interrupts may have been (un)masked
+        }
+        break;
+    case TLA_FCR:
+        uart->regs[TL_FCR] = val;
+        if (!setacc) {
+            break;
+        }
+
+        // Changing the FIFO ENable bit clears the FIFOs
+        if (uart->regs[TL_FCR] & (1u << FCR_FIFOEN)) {
+            uart->data_rx_fifo_read = 0;
+            uart->data_tx_fifo_read = 0;
+            uart->data_rx_fifo_write = 0;
+            uart->data_tx_fifo_write = 0;
+        }
+        else if (uart->regs[TL_FCR] & (1u << FCR_RXFRST)) {
+            uart->data_rx_fifo_read = 0;
+            uart->data_rx_fifo_write = 0;
+        }
+        else if (uart->regs[TL_FCR] & (1u << FCR_TXFRST)) {
+            uart->data_tx_fifo_read = 0;
+            uart->data_tx_fifo_write = 0;
+        }
+        _irq_16c750(uart);
+        break;
+    case TLA_LCR:
+        uart->regs[TL_LCR] = val;
+        break;
+    case TLA_MCR:
+        uart->regs[TL_MCR] = val;
+        break;
+    case TLA_SCR:
+        uart->regs[TL_SCR] = val;
+        break;
+    default:
+        // LSR and MSR are read only
+        break;
+    }
+}
+
+
+/**
+ * Get the time it takes to shift one character in or out of a UART
+ * at its current baud rate and line settings
+ * 
+ * @param *uart The UART to check
+ * @return The time of one character in CPU cycles
+ */
+static uint64_t _char_cycles_16c750(tl16c750_t *uart)
+{
+    uint8_t lcr = uart->regs[TL_LCR];
+    uint64_t divisor = (uart->regs[TL_DLM] << 8) | uart->regs[TL_DLL];
+    int data_bits = 5 + (lcr & 0x3);
+
+    // Counted in half bits for 1.5 stop bits
+    uint64_t half_bits = 2 * (1 + data_bits); // Start + data
+    if (lcr & (1u << LCR_PEN)) {
+        half_bits += 2;
+    }
+    if (!(lcr & (1u << LCR_STB))) {
+        half_bits += 2;
+    } else {
+        half_bits += data_bits == 5 ? 3 : 4;
+    }
+
+    // A divisor of 0 is not valid, run as fast as possible
+    if (divisor == 0) {
+        divisor = 1;
+    }
+
+    // The baud clock is the crystal divided by 16 * divisor
+    uint64_t cycles = half_bits * 16 * divisor * uart->cpu_hz / (2 * UART_XTAL_HZ);
+    return cycles ? cycles : 1;
+}
+
+
+/**
+ * Shift one character in and out of a UART, then schedule the
+ * next character time. The socket side is run by the I/O thread,
+ * this only moves bytes between the FIFOs and its rings. An unpaced
+ * UART moves as many chars as fit instead.
+ * 
+ * @param *dev The UART to update
+ * @param now The current CPU cycle count
+ */
+static void _event_16c750(void *dev, uint64_t now)
+{
+    tl16c750_t *uart = dev;
+    io_port_t *port = &uart->port;
+
+    io_port_wait_end(port);
+
+    if (uart->unpaced) {
+        while (_shift_tx_16c750(uart)) {}
+        while (_shift_rx_16c750(uart)) {}
+        uart->tx_shifting = false;
+    }
+    else {
+        uart->tx_shifting = _shift_tx_16c750(uart);
+        _shift_rx_16c750(uart);
+    }
+
+    // Send in batches: once enough has built up or the line goes idle
+    // (files are only written once the ring is full, or on idle)
+    uint32_t tx_len = io_ring_used(&port->tx);
+    if (uart->backend != UART_BACKEND_FILE &&
+        (tx_len >= UART_TX_BATCH || (tx_len > 0 && !uart->tx_shifting))) {
+        io_port_kick_tx(uart->io, port);
+    }
+
+    _irq_16c750(uart);
+
+    sched_add(uart->sched, now + _char_cycles_16c750(uart), _event_16c750, uart);
+}
+
+
+/**
+ * Check if a UART can make progress without the I/O thread
+ * 
+ * @param *uart The UART to check
+ * @return True if there are chars to shift in or out
+ */
+static bool _busy_16c750(tl16c750_t *uart)
+{
+    io_port_t *port = &uart->port;
+    bool rx_room = (uart->data_rx_fifo_write + 1) % UART_FIFO_LEN != uart->data_rx_fifo_read;
+    bool tx_queued = uart->data_tx_fifo_read != uart->data_tx_fifo_write;
+
+    return uart->tx_shifting ||
+        (tx_queued && io_ring_free(&port->tx) > 0) ||
+        (rx_room && io_ring_used(&port->rx) > 0) ||
+        (io_ring_used(&port->tx) > 0 && !atomic_load(&port->tx_kicked));
+}
+
+
+/**
+ * Tell the scheduler what an idle UART with the file backend is
+ * waiting on. Its output is written out first, since the host may
+ * block for a long time.
+ * 
+ * @param *uart The UART to check
+ * @param *pfd Set to the input file if it is not ready yet, or to
+ *             no file if no more input can be taken
+ * @return True if the UART still has chars to shift in or out
+ */
+static bool _file_idle_16c750(tl16c750_t *uart, struct pollfd *pfd)
+{
+    bool rx_room = (uart->data_rx_fifo_write + 1) % UART_FIFO_LEN != uart->data_rx_fifo_read;
+
+    _file_flush_16c750(uart);
+
+    if (uart->tx_shifting || uart->data_tx_fifo_read != uart->data_tx_fifo_write ||
+        (rx_room && io_ring_used(&uart->port.rx) > 0)) {
+        return true;
+    }
+    if (!rx_room || uart->file_in_eof) {
+        return false; // Nothing can arrive which the UART could take
+    }
+    if (!uart->file_in_poll) {
+        return true; // The next chunk can be read right away
+    }
+
+    pfd->fd = uart->file_in_fd;
+    pfd->events = POLLIN;
+    return false;
+}
+
+
+/**
+ * Tell the scheduler what an idle UART is waiting on
+ * 
+ * @param *dev The UART to check
+ * @param *pfd Set to the eventfd the I/O thread signals when it has
+ *             received data (or made room to send more)
+ * @return True if the UART still has chars to shift in or out
+ */
+static bool _idle_16c750(void *dev, struct pollfd *pfd)
+{
+    tl16c750_t *uart = dev;
+
+    if (uart->rx_log && uart->rx_log->pos < uart->rx_log->len) {
+        return true; // Repeating chars taken from the host before
+    }
+    if (uart->backend == UART_BACKEND_FILE) {
+        return _file_idle_16c750(uart, pfd);
+    }
+    if (uart->backend == UART_BACKEND_BUFFER) {
+        // Nothing arrives once the buffer is used up
+        bool rx_room = (uart->data_rx_fifo_write + 1) % UART_FIFO_LEN != uart->data_rx_fifo_read;
+        return uart->tx_shifting || uart->data_tx_fifo_read != uart->data_tx_fifo_write ||
+            (rx_room && uart->buf_in_len > 0);
+    }
+
+    if (_busy_16c750(uart) || uart->port.wake_fd < 0) {
+        return true;
+    }
+
+    // Check again after announcing the wait, in case the I/O
+    // thread made progress in between
+    io_port_wait_begin(&uart->port);
+    if (_busy_16c750(uart)) {
+        io_port_wait_end(&uart->port);
+        return true;
+    }
+
+    pfd->fd = uart->port.wake_fd;
+    pfd->events = POLLIN;
+    return false;
+}
+
+
+/**
+ * Map the registers of a UART into memory at its base address and
+ * start its serial line on the scheduler
+ * 
+ * @param *uart The UART to map (uart->addr and uart->sched must be set)
+ * @param *mem The memory to map the UART into
+ * @return True if attached, false if the region could not be mapped
+ *         or the scheduler is full
+ */
+bool attach_16c750(tl16c750_t *uart, memory_t *mem)
+{
+    uint64_t now = uart->sched->cpu ? uart->sched->cpu->cycles : 0;
+
+    if (!_map_mem_io(mem, uart->addr, uart->addr + TLA_SCR, uart, _read_16c750, _write_16c750)) {
+        return false;
+    }
+    if (!sched_add(uart->sched, now + _char_cycles_16c750(uart), _event_16c750, uart) ||
+        !sched_add_idle(uart->sched, uart, _idle_16c750)) {
+        detach_16c750(uart, mem);
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Remove the registers of a UART from memory and stop its serial line
+ * 
+ * @param *uart The UART to unmap
+ * @param *mem The memory the UART was mapped into
+ */
+void detach_16c750(tl16c750_t *uart, memory_t *mem)
+{
+    _unmap_mem_io(mem, uart);
+
+    if (uart->sched) {
+        sched_cancel(uart->sched, uart);
+        sched_set_irq(uart->sched, uart->irq_line, false);
+    }
+}
+
+
+/**
+ * Save the registers and FIFOs of a UART (what the CPU can observe,
+ * not its connection on the host)
+ * 
+ * @param *uart The UART to save
+ * @param *buf Receives UART_STATE_LEN bytes
+ */
+void save_16c750(tl16c750_t *uart, uint8_t *buf)
+{
+    memcpy(buf, uart->regs, sizeof(uart->regs));
+    buf += sizeof(uart->regs);
+    *buf++ = uart->data_rx_fifo_read;
+    *buf++ = uart->data_rx_fifo_write;
+    memcpy(buf, uart->data_rx_buf, UART_FIFO_LEN);
+    buf += UART_FIFO_LEN;
+    *buf++ = uart->data_tx_fifo_read;
+    *buf++ = uart->data_tx_fifo_write;
+    memcpy(buf, uart->data_tx_buf, UART_FIFO_LEN);
+    buf += UART_FIFO_LEN;
+    *buf++ = uart->tx_empty_edge | (uart->tx_shifting << 1);
+    for (int i = 0; i < 4; ++i) {
+        *buf++ = uart->cpu_hz >> (8 * i);
+    }
+
+    // So a restored UART shifts its next char at the same cycle
+    uint64_t delay = 0;
+    if (uart->sched) {
+        sched_find(uart->sched, uart, &delay);
+    }
+    for (int i = 0; i < 8; ++i) {
+        *buf++ = delay >> (8 * i);
+    }
+}
+
+
+/**
+ * Check a UART state saved by save_16c750() before it is loaded
+ * 
+ * @param *buf UART_STATE_LEN bytes
+ * @return False if the state is not valid (its FIFO indices are out of range)
+ */
+bool check_16c750(const uint8_t *buf)
+{
+    const uint8_t *rx = buf + UART_REG_COUNT;
+    const uint8_t *tx = rx + 2 + UART_FIFO_LEN;
+
+    return rx[0] < UART_FIFO_LEN && rx[1] < UART_FIFO_LEN &&
+        tx[0] < UART_FIFO_LEN && tx[1] < UART_FIFO_LEN;
+}
+
+
+/**
+ * Restore the registers and FIFOs of a UART saved by save_16c750(),
+ * reschedule its next character and drive its IRQ line to match. The
+ * connection is left as it is.
+ * 
+ * @param *uart The UART to restore
+ * @param *buf UART_STATE_LEN bytes
+ * @return False if the state is not valid (the UART is left unchanged)
+ */
+bool load_16c750(tl16c750_t *uart, const uint8_t *buf)
+{
+    const uint8_t *rx = buf + sizeof(uart->regs);
+    const uint8_t *tx = rx + 2 + UART_FIFO_LEN;
+    const uint8_t *rest = tx + 2 + UART_FIFO_LEN;
+
+    if (!check_16c750(buf)) {
+        return false;
+    }
+
+    memcpy(uart->regs, buf, sizeof(uart->regs));
+    uart->data_rx_fifo_read = rx[0];
+    uart->data_rx_fifo_write = rx[1];
+    memcpy(uart->data_rx_buf, rx + 2, UART_FIFO_LEN);
+    uart->data_tx_fifo_read = tx[0];
+    uart->data_tx_fifo_write = tx[1];
+    memcpy(uart->data_tx_buf, tx + 2, UART_FIFO_LEN);
+    uart->tx_empty_edge = rest[0] & 1;
+    uart->tx_shifting = (rest[0] >> 1) & 1;
+    uart->cpu_hz = rest[1] | (rest[2] << 8) | (rest[3] << 16) | ((uint32_t)rest[4] << 24);
+    if (uart->cpu_hz == 0) {
+        uart->cpu_hz = UART_DEFAULT_CPU_HZ;
+    }
+
+    if (uart->sched) {
+        uint64_t delay = 0;
+        for (int i = 0; i < 8; ++i) {
+            delay |= (uint64_t)rest[5 + i] << (8 * i);
+        }
+        sched_cancel(uart->sched, uart);
+        sched_add_delay(uart->sched, delay, _event_16c750, uart);
+        sched_add_idle(uart->sched, uart, _idle_16c750);
+    }
+
+    _irq_16c750(uart);
+    return true;
+}
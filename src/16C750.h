@@ -7,6 +7,11 @@
 #define UART_16C750_H
 
 #include <netinet/in.h>
+#include <sys/un.h>
+
+#include "65816.h"
+#include "scheduler.h"
+#include "iothread.h"
 
 // Not sure how/why this would not be 1
 // for this particular use case
@@ -14,6 +19,36 @@
 
 #define UART_FIFO_LEN 64
 
+// Entries of the regs[] array (see tl16c750_regs_t)
+#define UART_REG_COUNT 12
+
+// Number of chars queued for the I/O thread before it is told to send
+// them (it is also told when the line goes idle)
+#define UART_TX_BATCH 256
+
+// Crystal frequency the baud rate divisor (DLL/DLM) is applied to
+#define UART_XTAL_HZ 1843200
+
+// CPU clock frequency used to convert character times to CPU cycles
+#define UART_DEFAULT_CPU_HZ 8000000
+
+// Bytes of UART state written by save_16c750(): the registers, both
+// FIFOs with their indices, the transmitter flags, the clock and the
+// time to the next character
+#define UART_STATE_LEN (UART_REG_COUNT + 2 * (2 + UART_FIFO_LEN) + 1 + 4 + 8)
+
+// Max length of a pty slave's path (including the terminator)
+#define UART_PTY_NAME_LEN 64
+
+// What the serial line of a UART is connected to on the host
+typedef enum uart_backend_t {
+    UART_BACKEND_TCP,  // TCP listener, one client at a time
+    UART_BACKEND_UNIX, // Unix domain stream socket listener
+    UART_BACKEND_PTY,  // Pseudo-terminal, always connected
+    UART_BACKEND_FILE, // RX read from a file, TX written to a file
+    UART_BACKEND_BUFFER // RX taken from a buffer (see feed_16c750()), TX dropped
+} uart_backend_t;
+
 // IER
 enum {
     IER_ERBI = 0,
@@ -134,28 +169,75 @@ typedef enum tl16c750_regs_t {
     TLA_DLM = 1
 } tl16c750_regs_t;
 
+// A char a UART took from the host. seq counts the times the UART
+// tried to take a char (which happen at the same points of a run when
+// it is repeated), so the char can be handed over at the same attempt.
+typedef struct uart_rx_entry_t {
+    uint64_t seq;
+    uint8_t val;
+} uart_rx_entry_t;
+
+// The chars a UART took from the host, so a run can be repeated (see
+// timeline.h). While pos is before the end of the log, chars come
+// from the log instead of the host.
+typedef struct uart_rx_log_t {
+    uart_rx_entry_t *entry;
+    size_t len;
+    size_t cap;
+    size_t pos;            // Next entry to hand over again
+    uint64_t seq;          // Attempts to take a char so far
+    uint64_t replay_until; // Chars sent before this cycle count were sent already
+} uart_rx_log_t;
+
 typedef struct tl16c750_t {
     bool enabled;
     uint32_t addr;    // Base address
-    uint8_t regs[12]; // tl16c750_regs_t is index
-    int sock_fd;
+    uint8_t regs[UART_REG_COUNT]; // tl16c750_regs_t is index
+    uart_backend_t backend;
+    int sock_fd;      // Listener, or pty master
     unsigned int sock_timeout;
     struct sockaddr_in sock_name;
-    int data_socket;
+    struct sockaddr_un unix_name;
+    int pty_slave_fd;
+    char pty_name[UART_PTY_NAME_LEN];
+    int file_in_fd;   // File backend: read into port.rx in chunks
+    int file_out_fd;  // File backend: port.tx is written out when full
+    bool file_in_poll; // The input may block (not a regular file)
+    bool file_in_eof;
+    bool unpaced;     // Move chars as soon as the CPU accesses the FIFOs
+    const uint8_t *buf_in; // Buffer backend: chars still to be received
+    size_t buf_in_len;
     int data_rx_fifo_read;
     int data_rx_fifo_write;
     uint8_t data_rx_buf[UART_FIFO_LEN];
     bool tx_empty_edge;
+    bool tx_shifting; // A char is in the transmitter shift register
     int data_tx_fifo_read;
     int data_tx_fifo_write;
     uint8_t data_tx_buf[UART_FIFO_LEN];
+    io_thread_t *io;    // Runs the socket I/O
+    io_port_t port;     // Bytes to and from the socket
+    scheduler_t *sched; // Paces the serial line and drives the CPU's IRQ
+    int irq_line;       // Which of the scheduler's IRQ lines is driven
+    uint32_t cpu_hz;
+
+    uart_rx_log_t *rx_log; // Records (or replays) received chars (NULL = none)
 } tl16c750_t;
 
 void reset_16c750(tl16c750_t *);
 void init_16c750(tl16c750_t *);
 int init_port_16c750(tl16c750_t *, uint16_t);
+int init_unix_16c750(tl16c750_t *, const char *);
+int init_pty_16c750(tl16c750_t *);
+int init_file_16c750(tl16c750_t *, const char *, const char *, bool);
+void init_buffer_16c750(tl16c750_t *, bool);
+void feed_16c750(tl16c750_t *, const uint8_t *, size_t);
 void stop_16c750(tl16c750_t *);
-bool step_16c750(tl16c750_t *, memory_t *);
+bool attach_16c750(tl16c750_t *, memory_t *);
+void detach_16c750(tl16c750_t *, memory_t *);
+void save_16c750(tl16c750_t *, uint8_t *);
+bool check_16c750(const uint8_t *);
+bool load_16c750(tl16c750_t *, const uint8_t *);
 
 #endif
 
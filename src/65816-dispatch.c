@@ -0,0 +1,265 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+// Table-driven dispatch engines.
+//
+// The instruction handlers in 65816-ops.c are compiled again here as
+// static, always inlined functions. Every opcode then gets its own
+// small handler which calls them with the addressing mode, size and
+// cycle count as constants, so the compiler can fold away the mode
+// tests inside the generic handlers.
+//
+// This is done once with the register width tests left as they are
+// (cpu_dispatch_table, used when CPU_DISPATCH_TABLE is defined) and
+// once per register width mode with the width tests replaced by
+// constants (cpu_width_dispatch_table, used when CPU_DISPATCH_WIDTH
+// is defined). The width engine picks the table from cpu->width_mode,
+// which only changes when REP, SEP, PLP, RTI or XCE change the flags.
+
+#include "65816.h"
+#include "65816-util.h"
+#include "65816-ops.h"
+#include "65816-dispatch.h"
+
+#ifdef __GNUC__
+#define OPS_DEF static inline __attribute__((always_inline))
+#else
+#define OPS_DEF static inline
+#endif
+
+#define OPS_CAT_(a, b) a##_##b
+#define OPS_CAT(a, b) OPS_CAT_(a, b)
+#define OPS_NAME(name) OPS_CAT(OPS_PREFIX, name)
+
+// Rename the handlers so they do not collide with the
+// (extern) reference versions declared in 65816-ops.h
+#define i_adc OPS_NAME(adc)
+#define i_and OPS_NAME(and)
+#define i_asl OPS_NAME(asl)
+#define i_bcc OPS_NAME(bcc)
+#define i_bcs OPS_NAME(bcs)
+#define i_beq OPS_NAME(beq)
+#define i_bit OPS_NAME(bit)
+#define i_bmi OPS_NAME(bmi)
+#define i_bne OPS_NAME(bne)
+#define i_bpl OPS_NAME(bpl)
+#define i_bra OPS_NAME(bra)
+#define i_brk OPS_NAME(brk)
+#define i_brl OPS_NAME(brl)
+#define i_bvc OPS_NAME(bvc)
+#define i_bvs OPS_NAME(bvs)
+#define i_clc OPS_NAME(clc)
+#define i_cld OPS_NAME(cld)
+#define i_cli OPS_NAME(cli)
+#define i_clv OPS_NAME(clv)
+#define i_cmp OPS_NAME(cmp)
+#define i_cop OPS_NAME(cop)
+#define i_cpx OPS_NAME(cpx)
+#define i_cpy OPS_NAME(cpy)
+#define i_dea OPS_NAME(dea)
+#define i_dec OPS_NAME(dec)
+#define i_dex OPS_NAME(dex)
+#define i_dey OPS_NAME(dey)
+#define i_eor OPS_NAME(eor)
+#define i_ina OPS_NAME(ina)
+#define i_inc OPS_NAME(inc)
+#define i_inx OPS_NAME(inx)
+#define i_iny OPS_NAME(iny)
+#define i_jmp OPS_NAME(jmp)
+#define i_jsr OPS_NAME(jsr)
+#define i_jsl OPS_NAME(jsl)
+#define i_lda OPS_NAME(lda)
+#define i_ldx OPS_NAME(ldx)
+#define i_ldy OPS_NAME(ldy)
+#define i_lsr OPS_NAME(lsr)
+#define i_mvn OPS_NAME(mvn)
+#define i_mvp OPS_NAME(mvp)
+#define i_nop OPS_NAME(nop)
+#define i_ora OPS_NAME(ora)
+#define i_pea OPS_NAME(pea)
+#define i_pei OPS_NAME(pei)
+#define i_per OPS_NAME(per)
+#define i_pha OPS_NAME(pha)
+#define i_phb OPS_NAME(phb)
+#define i_phk OPS_NAME(phk)
+#define i_phd OPS_NAME(phd)
+#define i_php OPS_NAME(php)
+#define i_phx OPS_NAME(phx)
+#define i_phy OPS_NAME(phy)
+#define i_pla OPS_NAME(pla)
+#define i_plb OPS_NAME(plb)
+#define i_pld OPS_NAME(pld)
+#define i_plp OPS_NAME(plp)
+#define i_plx OPS_NAME(plx)
+#define i_ply OPS_NAME(ply)
+#define i_rep OPS_NAME(rep)
+#define i_rol OPS_NAME(rol)
+#define i_ror OPS_NAME(ror)
+#define i_rti OPS_NAME(rti)
+#define i_rtl OPS_NAME(rtl)
+#define i_rts OPS_NAME(rts)
+#define i_sbc OPS_NAME(sbc)
+#define i_sec OPS_NAME(sec)
+#define i_sed OPS_NAME(sed)
+#define i_sei OPS_NAME(sei)
+#define i_sep OPS_NAME(sep)
+#define i_stp OPS_NAME(stp)
+#define i_sta OPS_NAME(sta)
+#define i_stx OPS_NAME(stx)
+#define i_sty OPS_NAME(sty)
+#define i_stz OPS_NAME(stz)
+#define i_tax OPS_NAME(tax)
+#define i_tay OPS_NAME(tay)
+#define i_tcs OPS_NAME(tcs)
+#define i_tcd OPS_NAME(tcd)
+#define i_tdc OPS_NAME(tdc)
+#define i_trb OPS_NAME(trb)
+#define i_tsb OPS_NAME(tsb)
+#define i_tsc OPS_NAME(tsc)
+#define i_tsx OPS_NAME(tsx)
+#define i_txa OPS_NAME(txa)
+#define i_txs OPS_NAME(txs)
+#define i_txy OPS_NAME(txy)
+#define i_tya OPS_NAME(tya)
+#define i_tyx OPS_NAME(tyx)
+#define i_wai OPS_NAME(wai)
+#define i_wdm OPS_NAME(wdm)
+#define i_xba OPS_NAME(xba)
+#define i_xce OPS_NAME(xce)
+
+// Per opcode handlers, named after the current OPS_PREFIX
+#define OP_I(op, fn) \
+    static void OPS_NAME(op_##op)(CPU_t *cpu, memory_t *mem) { fn(cpu); }
+#define OP_S(op, fn) \
+    static void OPS_NAME(op_##op)(CPU_t *cpu, memory_t *mem) { fn(cpu, mem); }
+#define OP_A(op, fn, size, cycles, mode) \
+    static void OPS_NAME(op_##op)(CPU_t *cpu, memory_t *mem) { fn(cpu, mem, size, cycles, mode, 0); }
+#define OP_M(op, fn, size, cycles, mode, addr_fn) \
+    static void OPS_NAME(op_##op)(CPU_t *cpu, memory_t *mem) { fn(cpu, mem, size, cycles, mode, addr_fn(cpu, mem, cpu->setacc)); }
+#define OP_J(op, fn, cycles, mode, addr_fn) \
+    static void OPS_NAME(op_##op)(CPU_t *cpu, memory_t *mem) { fn(cpu, mem, cycles, mode, addr_fn(cpu, mem, cpu->setacc)); }
+
+// Generic widths (65816-ops.c provides the width tests)
+#define OPS_PREFIX d
+#include "65816-ops.c"
+#include "65816-optable.h"
+#undef OPS_PREFIX
+#undef OPS_E
+#undef OPS_M8
+#undef OPS_X8
+
+// Emulation mode
+#define OPS_PREFIX e
+#define OPS_E(cpu) 1
+#define OPS_M8(cpu) 1
+#define OPS_X8(cpu) 1
+#include "65816-ops.c"
+#include "65816-optable.h"
+#undef OPS_PREFIX
+#undef OPS_E
+#undef OPS_M8
+#undef OPS_X8
+
+// Native mode, 8-bit A, 8-bit X/Y
+#define OPS_PREFIX m8x8
+#define OPS_E(cpu) 0
+#define OPS_M8(cpu) 1
+#define OPS_X8(cpu) 1
+#include "65816-ops.c"
+#include "65816-optable.h"
+#undef OPS_PREFIX
+#undef OPS_E
+#undef OPS_M8
+#undef OPS_X8
+
+// Native mode, 8-bit A, 16-bit X/Y
+#define OPS_PREFIX m8x16
+#define OPS_E(cpu) 0
+#define OPS_M8(cpu) 1
+#define OPS_X8(cpu) 0
+#include "65816-ops.c"
+#include "65816-optable.h"
+#undef OPS_PREFIX
+#undef OPS_E
+#undef OPS_M8
+#undef OPS_X8
+
+// Native mode, 16-bit A, 8-bit X/Y
+#define OPS_PREFIX m16x8
+#define OPS_E(cpu) 0
+#define OPS_M8(cpu) 0
+#define OPS_X8(cpu) 1
+#include "65816-ops.c"
+#include "65816-optable.h"
+#undef OPS_PREFIX
+#undef OPS_E
+#undef OPS_M8
+#undef OPS_X8
+
+// Native mode, 16-bit A, 16-bit X/Y
+#define OPS_PREFIX m16x16
+#define OPS_E(cpu) 0
+#define OPS_M8(cpu) 0
+#define OPS_X8(cpu) 0
+#include "65816-ops.c"
+#include "65816-optable.h"
+#undef OPS_PREFIX
+#undef OPS_E
+#undef OPS_M8
+#undef OPS_X8
+
+#undef OP_I
+#undef OP_S
+#undef OP_A
+#undef OP_M
+#undef OP_J
+
+// The dispatch tables themselves
+#define OP_I(op, ...) [op] = OPS_NAME(op_##op),
+#define OP_S(op, ...) [op] = OPS_NAME(op_##op),
+#define OP_A(op, ...) [op] = OPS_NAME(op_##op),
+#define OP_M(op, ...) [op] = OPS_NAME(op_##op),
+#define OP_J(op, ...) [op] = OPS_NAME(op_##op),
+
+#define OPS_PREFIX d
+const CPU_Op_Handler_t cpu_dispatch_table[256] = {
+#include "65816-optable.h"
+};
+#undef OPS_PREFIX
+
+// Keep in the order of CPU_Width_Mode_t
+const CPU_Op_Handler_t cpu_width_dispatch_table[CPU_WIDTH_COUNT][256] = {
+#define OPS_PREFIX e
+    {
+#include "65816-optable.h"
+    },
+#undef OPS_PREFIX
+#define OPS_PREFIX m8x8
+    {
+#include "65816-optable.h"
+    },
+#undef OPS_PREFIX
+#define OPS_PREFIX m8x16
+    {
+#include "65816-optable.h"
+    },
+#undef OPS_PREFIX
+#define OPS_PREFIX m16x8
+    {
+#include "65816-optable.h"
+    },
+#undef OPS_PREFIX
+#define OPS_PREFIX m16x16
+    {
+#include "65816-optable.h"
+    },
+#undef OPS_PREFIX
+};
+
+#undef OP_I
+#undef OP_S
+#undef OP_A
+#undef OP_M
+#undef OP_J
@@ -0,0 +1,18 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+#ifndef DISPATCH_65816_H
+#define DISPATCH_65816_H
+
+#include "65816.h"
+
+// A fully decoded instruction: the addressing mode, operand size and
+// cycle count of the opcode are baked into the handler itself
+typedef void (*CPU_Op_Handler_t)(CPU_t *, memory_t *);
+
+extern const CPU_Op_Handler_t cpu_dispatch_table[256];
+extern const CPU_Op_Handler_t cpu_width_dispatch_table[CPU_WIDTH_COUNT][256];
+
+#endif
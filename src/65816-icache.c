@@ -0,0 +1,169 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "65816-icache.h"
+#include "65816-util.h"
+
+/**
+ * Drop the entries of the instructions which include a byte that is
+ * about to be written (see mem_watch_t)
+ * @param dev The cache
+ * @param addr The address being written
+ * @return True to keep watching the page
+ */
+static bool _icache_watch(void *dev, uint32_t addr)
+{
+    icache_t *ic = dev;
+    uint32_t page_num = addr >> MEM_PAGE_BITS;
+
+    // Entries hold the 4 bytes from the opcode on, which never wrap
+    // around the bank
+    for (uint32_t i = 0; i < 4 && i <= (addr & 0xffff); ++i)
+    {
+        uint32_t pc = addr - i;
+        icache_entry_t *page = ic->pages[pc >> MEM_PAGE_BITS];
+
+        if (page && page[pc & MEM_PAGE_MASK].mode)
+        {
+            page[pc & MEM_PAGE_MASK].mode = 0;
+            ++ic->invalidations;
+
+            // The instruction may be writing to itself, so the rest
+            // of its operand reads have to see the new bytes
+            ic->cpu->predecoded = false;
+        }
+    }
+
+    // Also watched for the instructions reaching in from the page before
+    return ic->pages[page_num] || (page_num && ic->pages[page_num - 1]);
+}
+
+/**
+ * Set up an instruction cache. Set CPU_t.icache to run a CPU with it.
+ * @param ic The cache to set up
+ * @param cpu The CPU which runs the instructions
+ * @param mem The memory the CPU runs from
+ * @return False if memory could not be allocated
+ */
+bool icache_init(icache_t *ic, CPU_t *cpu, memory_t *mem)
+{
+    memset(ic, 0, sizeof(*ic));
+    ic->cpu = cpu;
+    ic->mem = mem;
+    ic->pages = calloc(MEM_PAGE_COUNT, sizeof(*ic->pages));
+    ic->watch_id = -1;
+
+    if (!ic->pages || (ic->watch_id = _add_mem_watcher(mem, ic, _icache_watch)) < 0)
+    {
+        icache_free(ic);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Release an instruction cache and stop watching its memory
+ * @param ic The cache to free
+ */
+void icache_free(icache_t *ic)
+{
+    if (ic->pages)
+    {
+        icache_flush(ic);
+        free(ic->pages);
+        ic->pages = NULL;
+    }
+    if (ic->watch_id >= 0)
+    {
+        _remove_mem_watcher(ic->mem, ic->watch_id);
+        ic->watch_id = -1;
+    }
+}
+
+/**
+ * Drop every cached instruction
+ * @param ic The cache to empty
+ */
+void icache_flush(icache_t *ic)
+{
+    for (uint32_t i = 0; i < MEM_PAGE_COUNT; ++i)
+    {
+        free(ic->pages[i]);
+        ic->pages[i] = NULL;
+    }
+    if (ic->watch_id >= 0)
+    {
+        _unwatch_mem_pages(ic->mem, ic->watch_id);
+    }
+    ic->page_count = 0;
+    ++ic->flushes;
+}
+
+/**
+ * Decode an instruction into the cache for the register width mode of
+ * the CPU (on a miss of the lookup in _stepCPU())
+ * @param ic The cache
+ * @param pc The 24-bit address of the instruction
+ * @return The entry, or NULL if the instruction can not be cached
+ */
+const icache_entry_t *icache_fill(icache_t *ic, uint32_t pc)
+{
+    memory_t *mem = ic->mem;
+    uint32_t page_num = pc >> MEM_PAGE_BITS;
+
+    // Reading I/O registers has side effects, leave them to _stepCPU()
+    if (!mem->rd[page_num])
+    {
+        return NULL;
+    }
+
+    uint8_t op = _get_mem_byte(mem, pc, false);
+    uint8_t mode = ic->cpu->width_mode;
+    uint32_t last_page = (pc + 3) >> MEM_PAGE_BITS;
+
+    // The operand is always 3 bytes, so it is still right if a handler
+    // reads further than the length of its instruction
+    if ((pc & 0xffff) + 4 > 0x10000 || !mem->rd[last_page])
+    {
+        return NULL;
+    }
+
+    if (!ic->pages[page_num])
+    {
+        if (ic->page_count >= ICACHE_MAX_PAGES)
+        {
+            icache_flush(ic);
+        }
+        ic->pages[page_num] = calloc(MEM_PAGE_SIZE, sizeof(icache_entry_t));
+        if (!ic->pages[page_num])
+        {
+            return NULL;
+        }
+        ++ic->page_count;
+    }
+    _watch_mem_page(mem, ic->watch_id, page_num);
+    _watch_mem_page(mem, ic->watch_id, last_page);
+
+    icache_entry_t *e = &ic->pages[page_num][pc & MEM_PAGE_MASK];
+
+    e->op = op;
+    e->len = _cpu_get_inst_len(op, mode);
+    e->operand = _get_mem_byte(mem, pc + 1, false);
+    e->operand |= (uint32_t)_get_mem_byte(mem, pc + 2, false) << 8;
+    e->operand |= (uint32_t)_get_mem_byte(mem, pc + 3, false) << 16;
+#if defined(CPU_DISPATCH_WIDTH)
+    e->fn = cpu_width_dispatch_table[mode][op];
+#elif defined(CPU_DISPATCH_TABLE)
+    e->fn = cpu_dispatch_table[op];
+#else
+    e->fn = NULL;
+#endif
+    e->mode = mode + 1;
+    ++ic->fills;
+    return e;
+}
@@ -0,0 +1,58 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+#ifndef ICACHE_65816_H
+#define ICACHE_65816_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "65816.h"
+#include "65816-dispatch.h"
+
+// Max number of memory pages with cached instructions. When one
+// more is needed, the whole cache is dropped.
+#define ICACHE_MAX_PAGES 64
+
+// A decoded instruction
+typedef struct icache_entry_t {
+    CPU_Op_Handler_t fn;   // Handler of the dispatch engine (NULL with the switch engine)
+    uint32_t operand;      // The 3 bytes after the opcode, little endian
+    uint8_t op;            // The opcode
+    uint8_t len;           // Length including the opcode
+    uint8_t mode;          // Width mode it was decoded for + 1 (0 = empty)
+} icache_entry_t;
+
+// Cache of decoded instructions, indexed by their address. An entry
+// holds everything _stepCPU() would fetch and decode: the opcode, the
+// operand bytes (see CPU_t.predecoded), the length and the handler for
+// the register width mode of the CPU.
+//
+// The pages holding cached instructions are watched
+// (_watch_mem_page()), and writing one of the 4 bytes from the opcode
+// of a cached instruction on drops its entry. Instructions on I/O
+// pages, or in the last 3 bytes of a bank, are never cached. While
+// tracking memory accesses (memory_t.track with CPU_t.setacc), the
+// cache is not used.
+typedef struct icache_t {
+    CPU_t *cpu;                // The CPU the instructions are decoded for
+    memory_t *mem;             // The memory they are read from
+    int watch_id;              // Watcher id of the cached pages in mem
+    int page_count;            // Pages in use
+    icache_entry_t **pages;    // MEM_PAGE_COUNT arrays of MEM_PAGE_SIZE entries (NULL = none)
+
+    // Statistics
+    uint64_t fills;            // Instructions decoded into the cache
+    uint64_t invalidations;    // Entries dropped by writes
+    uint64_t flushes;          // Times the whole cache was dropped
+} icache_t;
+
+
+bool icache_init(icache_t *ic, CPU_t *cpu, memory_t *mem);
+void icache_free(icache_t *ic);
+void icache_flush(icache_t *ic);
+const icache_entry_t *icache_fill(icache_t *ic, uint32_t pc);
+
+#endif
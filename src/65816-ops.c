@@ -4,11 +4,29 @@
  */
 
 #include "65816-ops.h"
+#include "prof.h"
 
+// This file is also included by 65816-dispatch.c to build the
+// handlers of the table-driven dispatch engine. That file renames
+// the i_* functions and predefines OPS_DEF so that each copy is
+// static and can be inlined into its opcode specific caller.
+#ifndef OPS_DEF
+#define OPS_DEF
+#endif
 
-void i_adc(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+// Register width tests. 65816-dispatch.c replaces these with
+// constants for the width specialized copies of the handlers.
+// Only use them to test the widths the instruction started with.
+#ifndef OPS_E
+#define OPS_E(cpu) ((cpu)->P.E)
+#define OPS_M8(cpu) ((cpu)->P.E || (cpu)->P.M)
+#define OPS_X8(cpu) ((cpu)->P.E || (cpu)->P.XB)
+#endif
+
+
+OPS_DEF void i_adc(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
-    if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+    if (OPS_M8(cpu)) // 8-bit
     {
         uint8_t val = _get_mem_byte(mem, addr, cpu->setacc);
         uint16_t al;
@@ -40,8 +58,7 @@ void i_adc(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
         // 1f
         cpu->C = (cpu->C & 0xff00) | (al & 0xff);
         cpu->P.C = (al >= 0x100) ? 1 : 0;
-        cpu->P.N = (al & 0x80) ? 1 : 0;
-        cpu->P.Z = ((al & 0xff) == 0) ? 1 : 0;
+        cpu->nz = CPU_NZ8(al);
     }
     else // 16-bit
     {
@@ -98,8 +115,7 @@ void i_adc(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
         // 1f
         cpu->C = al & 0xffff;
         cpu->P.C = (al >= 0x10000) ? 1 : 0;
-        cpu->P.N = (al & 0x8000) ? 1 : 0;
-        cpu->P.Z = ((al & 0xffff) == 0) ? 1 : 0;
+        cpu->nz = CPU_NZ16(al);
 
         cpu->cycles += 1;
         if (mode == CPU_ADDR_IMMD)
@@ -139,21 +155,19 @@ void i_adc(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     cpu->cycles += cycles;
 }
 
-void i_and(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_and(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
     if (mode == CPU_ADDR_DP || mode == CPU_ADDR_DPX)
     {
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             cpu->C = (cpu->C & 0xff00) | ((cpu->C & 0xff) & _get_mem_byte(mem, addr, cpu->setacc));
-            cpu->P.N = (cpu->C & 0x80) ? 1 : 0;
-            cpu->P.Z = (cpu->C & 0xff) ? 0 : 1;
+            cpu->nz = CPU_NZ8(cpu->C);
         }
         else // 16-bit
         {
             cpu->C = cpu->C & _get_mem_word_bank_wrap(mem, addr, cpu->setacc);
-            cpu->P.N = (cpu->C & 0x8000) ? 1 : 0;
-            cpu->P.Z = cpu->C ? 0 : 1;
+            cpu->nz = CPU_NZ16(cpu->C);
             cpu->cycles += 1;
         }
 
@@ -170,17 +184,15 @@ void i_and(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
              mode == CPU_ADDR_INDDPY || mode == CPU_ADDR_INDDPLY ||
              mode == CPU_ADDR_SRINDY)
     {
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             cpu->C = (cpu->C & 0xff00) | ((cpu->C & 0xff) & _get_mem_byte(mem, addr, cpu->setacc));
-            cpu->P.N = (cpu->C & 0x80) ? 1 : 0;
-            cpu->P.Z = (cpu->C & 0xff) ? 0 : 1;
+            cpu->nz = CPU_NZ8(cpu->C);
         }
         else // 16-bit
         {
             cpu->C = cpu->C & _get_mem_word(mem, addr, cpu->setacc);
-            cpu->P.N = (cpu->C & 0x8000) ? 1 : 0;
-            cpu->P.Z = cpu->C ? 0 : 1;
+            cpu->nz = CPU_NZ16(cpu->C);
             cpu->cycles += 1;
         }
 
@@ -213,17 +225,15 @@ void i_and(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     }
     else if (mode == CPU_ADDR_IMMD || mode == CPU_ADDR_SR)
     {
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             cpu->C = (cpu->C & 0xff00) | ((cpu->C & 0xff) & _get_mem_byte(mem, addr, cpu->setacc));
-            cpu->P.N = (cpu->C & 0x80) ? 1 : 0;
-            cpu->P.Z = (cpu->C & 0xff) ? 0 : 1;
+            cpu->nz = CPU_NZ8(cpu->C);
         }
         else // 16-bit
         {
             cpu->C = cpu->C & _get_mem_word_bank_wrap(mem, addr, cpu->setacc);
-            cpu->P.N = (cpu->C & 0x8000) ? 1 : 0;
-            cpu->P.Z = cpu->C ? 0 : 1;
+            cpu->nz = CPU_NZ16(cpu->C);
             cpu->cycles += 1;
         }
     }
@@ -231,7 +241,7 @@ void i_and(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     _cpu_update_pc(cpu, size);
 }
 
-void i_asl(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_asl(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
     uint16_t post_data = 0;
     uint16_t pre_data = 0;
@@ -241,7 +251,7 @@ void i_asl(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
         case CPU_ADDR_DPX:
             pre_data = _get_mem_word_bank_wrap(mem, addr, cpu->setacc);
 
-            if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+            if (OPS_M8(cpu)) // 8-bit
             {
                 post_data = ((pre_data << 1) & 0xff);
                 _set_mem_byte(mem, addr, (uint8_t)post_data, cpu->setacc);
@@ -263,7 +273,7 @@ void i_asl(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
         case CPU_ADDR_ABSX:
             pre_data = _get_mem_word(mem, addr, cpu->setacc);
 
-            if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+            if (OPS_M8(cpu)) // 8-bit
             {
                 post_data = ((pre_data << 1) & 0xff);
                 _set_mem_byte(mem, addr, (uint8_t)post_data, cpu->setacc);
@@ -278,7 +288,7 @@ void i_asl(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
         case CPU_ADDR_IMPD:
             pre_data = cpu->C;
 
-            if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+            if (OPS_M8(cpu)) // 8-bit
             {
                 post_data = ((pre_data << 1) & 0xff);
                 cpu->C = (cpu->C & 0xff00) | post_data;
@@ -294,24 +304,22 @@ void i_asl(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
             break;
     }
 
-    if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+    if (OPS_M8(cpu)) // 8-bit
     {
         cpu->C = (pre_data & 0x80) ? 1 : 0;
-        cpu->P.N = (cpu->C & 0x80) ? 1 : 0;
-        cpu->P.Z = (cpu->C & 0xff) ? 0 : 1;
+        cpu->nz = CPU_NZ8(cpu->C);
     }
     else // 16-bit
     {
         cpu->P.C = (pre_data & 0x8000) ? 1 : 0;
-        cpu->P.N = (cpu->C & 0x8000) ? 1 : 0;
-        cpu->P.Z = cpu->C ? 0 : 1;
+        cpu->nz = CPU_NZ16(cpu->C);
     }
 
     cpu->cycles += cycles;
     _cpu_update_pc(cpu, size);
 }
 
-void i_bcc(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_bcc(CPU_t *cpu, memory_t *mem)
 {
     if (!cpu->P.C)
     {
@@ -319,7 +327,7 @@ void i_bcc(CPU_t *cpu, memory_t *mem)
         cpu->cycles += 1;
 
         // Add a cycle if page boundary crossed in emulation mode
-        if (cpu->P.E && ((new_PC & 0xff00) != (cpu->PC & 0xff00)))
+        if (OPS_E(cpu) && ((new_PC & 0xff00) != (cpu->PC & 0xff00)))
         {
             cpu->cycles += 1;
         }
@@ -332,7 +340,7 @@ void i_bcc(CPU_t *cpu, memory_t *mem)
     cpu->cycles += 2;
 }
 
-void i_bcs(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_bcs(CPU_t *cpu, memory_t *mem)
 {
     if (cpu->P.C)
     {
@@ -340,7 +348,7 @@ void i_bcs(CPU_t *cpu, memory_t *mem)
         cpu->cycles += 1;
 
         // Add a cycle if page boundary crossed in emulation mode
-        if (cpu->P.E && ((new_PC & 0xff00) != (cpu->PC & 0xff00)))
+        if (OPS_E(cpu) && ((new_PC & 0xff00) != (cpu->PC & 0xff00)))
         {
             cpu->cycles += 1;
         }
@@ -353,15 +361,15 @@ void i_bcs(CPU_t *cpu, memory_t *mem)
     cpu->cycles += 2;
 }
 
-void i_beq(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_beq(CPU_t *cpu, memory_t *mem)
 {
-    if (cpu->P.Z)
+    if (CPU_NZ_GET_Z(cpu->nz))
     {
         int32_t new_PC = _addrCPU_getRelative8(cpu, mem, cpu->setacc);
         cpu->cycles += 1;
 
         // Add a cycle if page boundary crossed in emulation mode
-        if (cpu->P.E && ((new_PC & 0xff00) != (cpu->PC & 0xff00)))
+        if (OPS_E(cpu) && ((new_PC & 0xff00) != (cpu->PC & 0xff00)))
         {
             cpu->cycles += 1;
         }
@@ -374,22 +382,20 @@ void i_beq(CPU_t *cpu, memory_t *mem)
     cpu->cycles += 2;
 }
 
-void i_bit(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_bit(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
     if (mode == CPU_ADDR_DP || mode == CPU_ADDR_DPX)
     {
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             uint8_t val = _get_mem_byte(mem, addr, cpu->setacc);
-            cpu->P.Z = ((cpu->C & 0xff) & val) ? 0 : 1;
-            cpu->P.N = (val & 0x80) ? 1 : 0;
+            cpu->nz = CPU_NZ(val & 0x80, !((cpu->C & 0xff) & val));
             cpu->P.V = (val & 0x40) ? 1 : 0;
         }
         else // 16-bit
         {
             uint16_t val = _get_mem_word_bank_wrap(mem, addr, cpu->setacc);
-            cpu->P.Z = (cpu->C & val) ? 0 : 1;
-            cpu->P.N = (val & 0x8000) ? 1 : 0;
+            cpu->nz = CPU_NZ(val & 0x8000, !(cpu->C & val));
             cpu->P.V = (val & 0x4000) ? 1 : 0;
             cpu->cycles += 1;
         }
@@ -402,18 +408,16 @@ void i_bit(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     }
     else if (mode == CPU_ADDR_ABS || mode == CPU_ADDR_ABSX)
     {
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             uint8_t val = _get_mem_byte(mem, addr, cpu->setacc);
-            cpu->P.Z = ((cpu->C & 0xff) & val) ? 0 : 1;
-            cpu->P.N = (val & 0x80) ? 1 : 0;
+            cpu->nz = CPU_NZ(val & 0x80, !((cpu->C & 0xff) & val));
             cpu->P.V = (val & 0x40) ? 1 : 0;
         }
         else // 16-bit
         {
             uint16_t val = _get_mem_word(mem, addr, cpu->setacc);
-            cpu->P.Z = (cpu->C & val) ? 0 : 1;
-            cpu->P.N = (val & 0x8000) ? 1 : 0;
+            cpu->nz = CPU_NZ(val & 0x8000, !(cpu->C & val));
             cpu->P.V = (val & 0x4000) ? 1 : 0;
             cpu->cycles += 1;
         }
@@ -427,15 +431,15 @@ void i_bit(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     }
     else if (mode == CPU_ADDR_IMMD)
     {
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             uint8_t val = _get_mem_byte(mem, addr, cpu->setacc);
-            cpu->P.Z = ((cpu->C & 0xff) & val) ? 0 : 1; // Only Z for immediate addressing
+            cpu->nz = CPU_NZ(CPU_NZ_GET_N(cpu->nz), !((cpu->C & 0xff) & val)); // Only Z for immediate addressing
         }
         else // 16-bit
         {
             uint16_t val = _get_mem_word_bank_wrap(mem, addr, cpu->setacc);
-            cpu->P.Z = (cpu->C & val) ? 0 : 1;
+            cpu->nz = CPU_NZ(CPU_NZ_GET_N(cpu->nz), !(cpu->C & val));
             cpu->cycles += 1;
             size += 1;
         }
@@ -444,15 +448,15 @@ void i_bit(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     _cpu_update_pc(cpu, size);
 }
 
-void i_bmi(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_bmi(CPU_t *cpu, memory_t *mem)
 {
-    if (cpu->P.N)
+    if (CPU_NZ_GET_N(cpu->nz))
     {
         int32_t new_PC = _addrCPU_getRelative8(cpu, mem, cpu->setacc);
         cpu->cycles += 1;
 
         // Add a cycle if page boundary crossed in emulation mode
-        if (cpu->P.E && ((new_PC & 0xff00) != (cpu->PC & 0xff00)))
+        if (OPS_E(cpu) && ((new_PC & 0xff00) != (cpu->PC & 0xff00)))
         {
             cpu->cycles += 1;
         }
@@ -465,15 +469,15 @@ void i_bmi(CPU_t *cpu, memory_t *mem)
     cpu->cycles += 2;
 }
 
-void i_bne(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_bne(CPU_t *cpu, memory_t *mem)
 {
-    if (!cpu->P.Z)
+    if (!CPU_NZ_GET_Z(cpu->nz))
     {
         int32_t new_PC = _addrCPU_getRelative8(cpu, mem, cpu->setacc);
         cpu->cycles += 1;
 
         // Add a cycle if page boundary crossed in emulation mode
-        if (cpu->P.E && ((new_PC & 0xff00) != (cpu->PC & 0xff00)))
+        if (OPS_E(cpu) && ((new_PC & 0xff00) != (cpu->PC & 0xff00)))
         {
             cpu->cycles += 1;
         }
@@ -486,15 +490,15 @@ void i_bne(CPU_t *cpu, memory_t *mem)
     cpu->cycles += 2;
 }
 
-void i_bpl(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_bpl(CPU_t *cpu, memory_t *mem)
 {
-    if (!cpu->P.N)
+    if (!CPU_NZ_GET_N(cpu->nz))
     {
         int32_t new_PC = _addrCPU_getRelative8(cpu, mem, cpu->setacc);
         cpu->cycles += 1;
 
         // Add a cycle if page boundary crossed in emulation mode
-        if (cpu->P.E && ((new_PC & 0xff00) != (cpu->PC & 0xff00)))
+        if (OPS_E(cpu) && ((new_PC & 0xff00) != (cpu->PC & 0xff00)))
         {
             cpu->cycles += 1;
         }
@@ -507,24 +511,24 @@ void i_bpl(CPU_t *cpu, memory_t *mem)
     cpu->cycles += 2;
 }
 
-void i_bra(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_bra(CPU_t *cpu, memory_t *mem)
 {
     uint16_t new_PC = _addrCPU_getRelative8(cpu, mem, cpu->setacc);
     cpu->cycles += 3;
 
     // Add a cycle if page boundary crossed in emulation mode
-    if (cpu->P.E && ((new_PC & 0xff00) != (cpu->PC & 0xff00)))
+    if (OPS_E(cpu) && ((new_PC & 0xff00) != (cpu->PC & 0xff00)))
     {
         cpu->cycles += 1;
     }
     cpu->PC = new_PC;
 }
 
-void i_brk(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_brk(CPU_t *cpu, memory_t *mem)
 {
     _cpu_update_pc(cpu, 2);
 
-    if (cpu->P.E)
+    if (OPS_E(cpu))
     {
         _stackCPU_pushWord(cpu, mem, cpu->PC, CPU_ESTACK_ENABLE, cpu->setacc);
         _stackCPU_pushByte(cpu, mem, _cpu_get_sr(cpu) | 0x10, cpu->setacc); // B flag is set for BRK in emulation mode
@@ -545,15 +549,20 @@ void i_brk(CPU_t *cpu, memory_t *mem)
 
     cpu->P.D = 0; // Binary mode (65C02)
     cpu->P.I = 1;
+
+    if (cpu->prof)
+    {
+        prof_call(cpu->prof, cpu, OPS_E(cpu) ? 3 : 4, PROF_BRK);
+    }
 }
 
-void i_brl(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_brl(CPU_t *cpu, memory_t *mem)
 {
     cpu->PC = _addrCPU_getRelative16(cpu, mem, cpu->setacc);
     cpu->cycles += 4;
 }
 
-void i_bvc(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_bvc(CPU_t *cpu, memory_t *mem)
 {
     if (!cpu->P.V)
     {
@@ -561,7 +570,7 @@ void i_bvc(CPU_t *cpu, memory_t *mem)
         cpu->cycles += 1;
 
         // Add a cycle if page boundary crossed in emulation mode
-        if (cpu->P.E && ((new_PC & 0xff00) != (cpu->PC & 0xff00)))
+        if (OPS_E(cpu) && ((new_PC & 0xff00) != (cpu->PC & 0xff00)))
         {
             cpu->cycles += 1;
         }
@@ -574,7 +583,7 @@ void i_bvc(CPU_t *cpu, memory_t *mem)
     cpu->cycles += 2;
 }
 
-void i_bvs(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_bvs(CPU_t *cpu, memory_t *mem)
 {
     if (cpu->P.V)
     {
@@ -582,7 +591,7 @@ void i_bvs(CPU_t *cpu, memory_t *mem)
         cpu->cycles += 1;
 
         // Add a cycle if page boundary crossed in emulation mode
-        if (cpu->P.E && ((new_PC & 0xff00) != (cpu->PC & 0xff00)))
+        if (OPS_E(cpu) && ((new_PC & 0xff00) != (cpu->PC & 0xff00)))
         {
             cpu->cycles += 1;
         }
@@ -595,44 +604,43 @@ void i_bvs(CPU_t *cpu, memory_t *mem)
     cpu->cycles += 2;
 }
 
-void i_clc(CPU_t *cpu)
+OPS_DEF void i_clc(CPU_t *cpu)
 {
     cpu->P.C = 0;
     _cpu_update_pc(cpu, 1);
     cpu->cycles += 2;
 }
 
-void i_cld(CPU_t *cpu)
+OPS_DEF void i_cld(CPU_t *cpu)
 {
     cpu->P.D = 0;
     _cpu_update_pc(cpu, 1);
     cpu->cycles += 2;
 }
 
-void i_cli(CPU_t *cpu)
+OPS_DEF void i_cli(CPU_t *cpu)
 {
     cpu->P.I = 0;
     _cpu_update_pc(cpu, 1);
     cpu->cycles += 2;
 }
 
-void i_clv(CPU_t *cpu)
+OPS_DEF void i_clv(CPU_t *cpu)
 {
     cpu->P.V = 0;
     _cpu_update_pc(cpu, 1);
     cpu->cycles += 2;
 }
 
-void i_cmp(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_cmp(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
     if (mode == CPU_ADDR_DP || mode == CPU_ADDR_DPX ||
         mode == CPU_ADDR_IMMD || mode == CPU_ADDR_SR)
     {
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             uint8_t res = (cpu->C & 0xff) - _get_mem_byte(mem, addr, cpu->setacc);
-            cpu->P.N = (res & 0x80) ? 1 : 0;
-            cpu->P.Z = res ? 0 : 1;
+            cpu->nz = CPU_NZ8(res);
             cpu->P.C = ((cpu->C & 0xff) < res) ? 0 : 1;
             
         }
@@ -640,8 +648,7 @@ void i_cmp(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
         {
             uint16_t res = _get_mem_word_bank_wrap(mem, addr, cpu->setacc);
             res = cpu->C - res;
-            cpu->P.N = (res & 0x8000) ? 1 : 0;
-            cpu->P.Z = res ? 0 : 1;
+            cpu->nz = CPU_NZ16(res);
             cpu->P.C = (cpu->C < res) ? 0 : 1;
             cpu->cycles += 1;
             if (mode == CPU_ADDR_IMMD)
@@ -664,19 +671,17 @@ void i_cmp(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
              mode == CPU_ADDR_DPINDX || mode == CPU_ADDR_INDDPLY ||
              mode == CPU_ADDR_SRINDY)
     {
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             uint8_t res = (cpu->C & 0xff) - _get_mem_byte(mem, addr, cpu->setacc);
-            cpu->P.N = (res & 0x80) ? 1 : 0;
-            cpu->P.Z = res ? 0 : 1;
+            cpu->nz = CPU_NZ8(res);
             cpu->P.C = ((cpu->C & 0xff) < res) ? 0 : 1;
             
         }
         else // 16-bit
         {
             uint16_t res = cpu->C - _get_mem_word(mem, addr, cpu->setacc);
-            cpu->P.N = (res & 0x8000) ? 1 : 0;
-            cpu->P.Z = res ? 0 : 1;
+            cpu->nz = CPU_NZ16(res);
             cpu->P.C = (cpu->C < res) ? 0 : 1;
             cpu->cycles += 1;
         }
@@ -711,7 +716,7 @@ void i_cmp(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     cpu->cycles += cycles;
 }
 
-void i_cop(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_cop(CPU_t *cpu, memory_t *mem)
 {
     // Only needed with cop_vect_enable optional feature
     uint8_t immd = _cpu_get_immd_byte(cpu, mem, cpu->setacc);
@@ -719,7 +724,7 @@ void i_cop(CPU_t *cpu, memory_t *mem)
     // We will push the return address
     _cpu_update_pc(cpu, 2);
 
-    if (cpu->P.E)
+    if (OPS_E(cpu))
     {
         _stackCPU_pushWord(cpu, mem, cpu->PC, CPU_ESTACK_ENABLE, cpu->setacc);
         _stackCPU_pushByte(cpu, mem, _cpu_get_sr(cpu) & 0xef, cpu->setacc); // ??? Unknown: the state of the B flag in ISR for COP (assumed to be 0)
@@ -748,17 +753,21 @@ void i_cop(CPU_t *cpu, memory_t *mem)
         // setacc=false since the CPU would not normally access this word
         cpu->PC = _get_mem_word(mem, cpu->PC + ((immd << 1) & 0xff), false);
     }
+
+    if (cpu->prof)
+    {
+        prof_call(cpu->prof, cpu, OPS_E(cpu) ? 3 : 4, PROF_COP);
+    }
 }
 
-void i_cpx(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_cpx(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
     if (mode == CPU_ADDR_DP || mode == CPU_ADDR_IMMD)
     {
-        if (cpu->P.E || (!cpu->P.E && cpu->P.XB)) // 8-bit
+        if (OPS_X8(cpu)) // 8-bit
         {
             uint8_t res = (cpu->X & 0xff) - _get_mem_byte(mem, addr, cpu->setacc);
-            cpu->P.N = (res & 0x80) ? 1 : 0;
-            cpu->P.Z = res ? 0 : 1;
+            cpu->nz = CPU_NZ8(res);
             cpu->P.C = ((cpu->X & 0xff) < res) ? 0 : 1;
             
         }
@@ -766,8 +775,7 @@ void i_cpx(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
         {
             uint16_t res = _get_mem_word_bank_wrap(mem, addr, cpu->setacc);
             res = cpu->X - res;
-            cpu->P.N = (res & 0x8000) ? 1 : 0;
-            cpu->P.Z = res ? 0 : 1;
+            cpu->nz = CPU_NZ16(res);
             cpu->P.C = (cpu->X < res) ? 0 : 1;
             cpu->cycles += 1;
             if (mode == CPU_ADDR_IMMD)
@@ -783,19 +791,17 @@ void i_cpx(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     }
     else if (mode == CPU_ADDR_ABS)
     {
-        if (cpu->P.E || (!cpu->P.E && cpu->P.XB)) // 8-bit
+        if (OPS_X8(cpu)) // 8-bit
         {
             uint8_t res = (cpu->X & 0xff) - _get_mem_byte(mem, addr, cpu->setacc);
-            cpu->P.N = (res & 0x80) ? 1 : 0;
-            cpu->P.Z = res ? 0 : 1;
+            cpu->nz = CPU_NZ8(res);
             cpu->P.C = ((cpu->X & 0xff) < res) ? 0 : 1;
             
         }
         else // 16-bit
         {
             uint16_t res = cpu->X - _get_mem_word(mem, addr, cpu->setacc);
-            cpu->P.N = (res & 0x8000) ? 1 : 0;
-            cpu->P.Z = res ? 0 : 1;
+            cpu->nz = CPU_NZ16(res);
             cpu->P.C = (cpu->X < res) ? 0 : 1;
             cpu->cycles += 1;
         }
@@ -804,23 +810,21 @@ void i_cpx(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     cpu->cycles += cycles;
 }
 
-void i_cpy(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_cpy(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
     if (mode == CPU_ADDR_DP || mode == CPU_ADDR_IMMD)
     {
-        if (cpu->P.E || (!cpu->P.E && cpu->P.XB)) // 8-bit
+        if (OPS_X8(cpu)) // 8-bit
         {
             uint8_t res = (cpu->Y & 0xff) - _get_mem_byte(mem, addr, cpu->setacc);
-            cpu->P.N = (res & 0x80) ? 1 : 0;
-            cpu->P.Z = res ? 0 : 1;
+            cpu->nz = CPU_NZ8(res);
             cpu->P.C = ((cpu->Y & 0xff) < res) ? 0 : 1;
         }
         else // 16-bit
         {
             uint16_t res = _get_mem_word_bank_wrap(mem, addr, cpu->setacc);
             res = cpu->Y - res;
-            cpu->P.N = (res & 0x8000) ? 1 : 0;
-            cpu->P.Z = res ? 0 : 1;
+            cpu->nz = CPU_NZ16(res);
             cpu->P.C = (cpu->Y < res) ? 0 : 1;
             cpu->cycles += 1;
             if (mode == CPU_ADDR_IMMD)
@@ -836,18 +840,16 @@ void i_cpy(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     }
     else if (mode == CPU_ADDR_ABS)
     {
-        if (cpu->P.E || (!cpu->P.E && cpu->P.XB)) // 8-bit
+        if (OPS_X8(cpu)) // 8-bit
         {
             uint8_t res = (cpu->Y & 0xff) - _get_mem_byte(mem, addr, cpu->setacc);
-            cpu->P.N = (res & 0x80) ? 1 : 0;
-            cpu->P.Z = res ? 0 : 1;
+            cpu->nz = CPU_NZ8(res);
             cpu->P.C = ((cpu->Y & 0xff) < res) ? 0 : 1;
         }
         else // 16-bit
         {
             uint16_t res = cpu->Y - _get_mem_word(mem, addr, cpu->setacc);
-            cpu->P.N = (res & 0x8000) ? 1 : 0;
-            cpu->P.Z = res ? 0 : 1;
+            cpu->nz = CPU_NZ16(res);
             cpu->P.C = (cpu->Y < res) ? 0 : 1;
             cpu->cycles += 1;
         }
@@ -856,35 +858,32 @@ void i_cpy(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     cpu->cycles += cycles;
 }
 
-void i_dea(CPU_t *cpu)
+OPS_DEF void i_dea(CPU_t *cpu)
 {
-    if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+    if (OPS_M8(cpu)) // 8-bit
     {
         cpu->C = ((cpu->C - 1) & 0xff) | (cpu->C & 0xff00);
-        cpu->P.N = cpu->C & 0x80 ? 1 : 0;
-        cpu->P.Z = cpu->C & 0xff ? 0 : 1;
+        cpu->nz = CPU_NZ8(cpu->C);
     }
     else // 16-bit
     {
         cpu->C = (cpu->C - 1) & 0xffff;
-        cpu->P.N = cpu->C & 0x8000 ? 1 : 0;
-        cpu->P.Z = cpu->C ? 0 : 1;
+        cpu->nz = CPU_NZ16(cpu->C);
     }
 
     _cpu_update_pc(cpu, 1);
     cpu->cycles += 2;
 }
 
-void i_dec(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_dec(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
     if (mode == CPU_ADDR_DP || mode == CPU_ADDR_DPX)
     {
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M))
+        if (OPS_M8(cpu))
         {
             uint8_t val = _get_mem_byte(mem, addr, cpu->setacc) - 1;
             _set_mem_byte(mem, addr, val, cpu->setacc);
-            cpu->P.N = val & 0x80 ? 1 : 0;
-            cpu->P.Z = val ? 0 : 1;
+            cpu->nz = CPU_NZ8(val);
         }
         else // 16-bit
         {
@@ -893,8 +892,7 @@ void i_dec(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
             val |= _get_mem_byte(mem, addr_high, cpu->setacc) << 8;
             val -= 1;
             _set_mem_word_bank_wrap(mem, addr, val, cpu->setacc);
-            cpu->P.N = val & 0x8000 ? 1 : 0;
-            cpu->P.Z = val ? 0 : 1;
+            cpu->nz = CPU_NZ16(val);
             cpu->cycles += 2;
         }
         if (cpu->D & 0xff)
@@ -904,19 +902,17 @@ void i_dec(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     }
     else if (mode == CPU_ADDR_ABS || mode == CPU_ADDR_ABSX)
     {
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M))
+        if (OPS_M8(cpu))
         {
             uint8_t val = _get_mem_byte(mem, addr, cpu->setacc) - 1;
             _set_mem_byte(mem, addr, val, cpu->setacc);
-            cpu->P.N = val & 0x80 ? 1 : 0;
-            cpu->P.Z = val ? 0 : 1;
+            cpu->nz = CPU_NZ8(val);
         }
         else // 16-bit
         {
             uint16_t val = _get_mem_word(mem, addr, cpu->setacc) - 1;
             _set_mem_word(mem, addr, val, cpu->setacc);
-            cpu->P.N = val & 0x8000 ? 1 : 0;
-            cpu->P.Z = val ? 0 : 1;
+            cpu->nz = CPU_NZ16(val);
             cpu->cycles += 2;
         }
     }
@@ -925,49 +921,45 @@ void i_dec(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     cpu->cycles += cycles;
 }
 
-void i_dex(CPU_t *cpu)
+OPS_DEF void i_dex(CPU_t *cpu)
 {
-    if (cpu->P.E || (!cpu->P.E && cpu->P.XB))
+    if (OPS_X8(cpu))
     {
         cpu->X = (cpu->X - 1) & 0xff;
-        cpu->P.N = cpu->X & 0x80 ? 1 : 0;
-        cpu->P.Z = cpu->X & 0xff ? 0 : 1;
+        cpu->nz = CPU_NZ8(cpu->X);
     }
     else // 16-bit
     {
         cpu->X = (cpu->X - 1) & 0xffff;
-        cpu->P.N = cpu->X & 0x8000 ? 1 : 0;
-        cpu->P.Z = cpu->X ? 0 : 1;
+        cpu->nz = CPU_NZ16(cpu->X);
     }
 
     _cpu_update_pc(cpu, 1);
     cpu->cycles += 2;
 }
 
-void i_dey(CPU_t *cpu)
+OPS_DEF void i_dey(CPU_t *cpu)
 {
-    if (cpu->P.E || (!cpu->P.E && cpu->P.XB))
+    if (OPS_X8(cpu))
     {
         cpu->Y = (cpu->Y - 1) & 0xff;
-        cpu->P.N = cpu->Y & 0x80 ? 1 : 0;
-        cpu->P.Z = cpu->Y & 0xff ? 0 : 1;
+        cpu->nz = CPU_NZ8(cpu->Y);
     }
     else // 16-bit
     {
         cpu->Y = (cpu->Y - 1) & 0xffff;
-        cpu->P.N = cpu->Y & 0x8000 ? 1 : 0;
-        cpu->P.Z = cpu->Y ? 0 : 1;
+        cpu->nz = CPU_NZ16(cpu->Y);
     }
 
     _cpu_update_pc(cpu, 1);
     cpu->cycles += 2;
 }
 
-void i_eor(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_eor(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
     if (mode == CPU_ADDR_DP || mode == CPU_ADDR_DPX)
     {
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             cpu->C = (cpu->C & 0xff00) | ((cpu->C & 0xff) ^ _get_mem_byte(mem, addr, cpu->setacc));
         }
@@ -989,7 +981,7 @@ void i_eor(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
              mode == CPU_ADDR_INDDPY || mode == CPU_ADDR_INDDPLY ||
              mode == CPU_ADDR_SRINDY)
     {
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             cpu->C = (cpu->C & 0xff00) | ((cpu->C & 0xff) ^ _get_mem_byte(mem, addr, cpu->setacc));
         }
@@ -1028,7 +1020,7 @@ void i_eor(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     }
     else if (mode == CPU_ADDR_IMMD || mode == CPU_ADDR_SR)
     {
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             cpu->C = (cpu->C & 0xff00) | ((cpu->C & 0xff) ^ _get_mem_byte(mem, addr, cpu->setacc));
         }
@@ -1038,50 +1030,45 @@ void i_eor(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
         }
     }
 
-    if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+    if (OPS_M8(cpu)) // 8-bit
     {
-        cpu->P.N = (cpu->C & 0x80) ? 1 : 0;
-        cpu->P.Z = (cpu->C & 0xff) ? 0 : 1;
+        cpu->nz = CPU_NZ8(cpu->C);
     }
     else // 16-bit
     {
-        cpu->P.N = (cpu->C & 0x8000) ? 1 : 0;
-        cpu->P.Z = cpu->C ? 0 : 1;
+        cpu->nz = CPU_NZ16(cpu->C);
         cpu->cycles += 1;
     }
     cpu->cycles += cycles;
     _cpu_update_pc(cpu, size);
 }
 
-void i_ina(CPU_t *cpu)
+OPS_DEF void i_ina(CPU_t *cpu)
 {
-    if (cpu->P.E || (!cpu->P.E && cpu->P.M))
+    if (OPS_M8(cpu))
     {
         cpu->C = ((cpu->C + 1) & 0xff) | (cpu->C & 0xff00);
-        cpu->P.N = cpu->C & 0x80 ? 1 : 0;
-        cpu->P.Z = cpu->C & 0xff ? 0 : 1;
+        cpu->nz = CPU_NZ8(cpu->C);
     }
     else // 16-bit
     {
         cpu->C = (cpu->C + 1) & 0xffff;
-        cpu->P.N = cpu->C & 0x8000 ? 1 : 0;
-        cpu->P.Z = cpu->C ? 0 : 1;
+        cpu->nz = CPU_NZ16(cpu->C);
     }
 
     _cpu_update_pc(cpu, 1);
     cpu->cycles += 2;
 }
 
-void i_inc(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_inc(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
     if (mode == CPU_ADDR_DP || mode == CPU_ADDR_DPX)
     {
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             uint8_t val = _get_mem_byte(mem, addr, cpu->setacc) + 1;
             _set_mem_byte(mem, addr, val, cpu->setacc);
-            cpu->P.N = val & 0x80 ? 1 : 0;
-            cpu->P.Z = val ? 0 : 1;
+            cpu->nz = CPU_NZ8(val);
         }
         else // 16-bit
         {
@@ -1090,8 +1077,7 @@ void i_inc(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
             val |= _get_mem_byte(mem, addr_high, cpu->setacc) << 8;
             val += 1;
             _set_mem_word_bank_wrap(mem, addr, val, cpu->setacc);
-            cpu->P.N = val & 0x8000 ? 1 : 0;
-            cpu->P.Z = val ? 0 : 1;
+            cpu->nz = CPU_NZ16(val);
             cpu->cycles += 2;
         }
         if (cpu->D & 0xff)
@@ -1101,19 +1087,17 @@ void i_inc(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     }
     else if (mode == CPU_ADDR_ABS || mode == CPU_ADDR_ABSX)
     {
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             uint8_t val = _get_mem_byte(mem, addr, cpu->setacc) + 1;
             _set_mem_byte(mem, addr, val, cpu->setacc);
-            cpu->P.N = val & 0x80 ? 1 : 0;
-            cpu->P.Z = val ? 0 : 1;
+            cpu->nz = CPU_NZ8(val);
         }
         else // 16-bit
         {
             uint16_t val = _get_mem_word(mem, addr, cpu->setacc) + 1;
             _set_mem_word(mem, addr, val, cpu->setacc);
-            cpu->P.N = val & 0x8000 ? 1 : 0;
-            cpu->P.Z = val ? 0 : 1;
+            cpu->nz = CPU_NZ16(val);
             cpu->cycles += 2;
         }
     }
@@ -1122,45 +1106,41 @@ void i_inc(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     cpu->cycles += cycles;
 }
 
-void i_inx(CPU_t *cpu)
+OPS_DEF void i_inx(CPU_t *cpu)
 {
-    if (cpu->P.E || (!cpu->P.E && cpu->P.XB)) // 8-bit
+    if (OPS_X8(cpu)) // 8-bit
     {
         cpu->X = (cpu->X + 1) & 0xff;
-        cpu->P.N = cpu->X & 0x80 ? 1 : 0;
-        cpu->P.Z = cpu->X & 0xff ? 0 : 1;
+        cpu->nz = CPU_NZ8(cpu->X);
     }
     else // 16-bit
     {
         cpu->X = (cpu->X + 1) & 0xffff;
-        cpu->P.N = cpu->X & 0x8000 ? 1 : 0;
-        cpu->P.Z = cpu->X ? 0 : 1;
+        cpu->nz = CPU_NZ16(cpu->X);
     }
 
     _cpu_update_pc(cpu, 1);
     cpu->cycles += 2;
 }
 
-void i_iny(CPU_t *cpu)
+OPS_DEF void i_iny(CPU_t *cpu)
 {
-    if (cpu->P.E || (!cpu->P.E && cpu->P.XB)) // 8-bit
+    if (OPS_X8(cpu)) // 8-bit
     {
         cpu->Y = (cpu->Y + 1) & 0xff;
-        cpu->P.N = cpu->Y & 0x80 ? 1 : 0;
-        cpu->P.Z = cpu->Y & 0xff ? 0 : 1;
+        cpu->nz = CPU_NZ8(cpu->Y);
     }
     else // 16-bit
     {
         cpu->Y = (cpu->Y + 1) & 0xffff;
-        cpu->P.N = cpu->Y & 0x8000 ? 1 : 0;
-        cpu->P.Z = cpu->Y ? 0 : 1;
+        cpu->nz = CPU_NZ16(cpu->Y);
     }
 
     _cpu_update_pc(cpu, 1);
     cpu->cycles += 2;
 }
 
-void i_jmp(CPU_t *cpu, memory_t *mem, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_jmp(CPU_t *cpu, memory_t *mem, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
     if (mode == CPU_ADDR_ABSL)
     {
@@ -1170,7 +1150,7 @@ void i_jmp(CPU_t *cpu, memory_t *mem, uint8_t cycles, CPU_Addr_Mode_t mode, uint
     cpu->cycles += cycles;
 }
 
-void i_jsr(CPU_t *cpu, memory_t *mem, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_jsr(CPU_t *cpu, memory_t *mem, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
     _stackCPU_pushWord(
         cpu,
@@ -1181,20 +1161,30 @@ void i_jsr(CPU_t *cpu, memory_t *mem, uint8_t cycles, CPU_Addr_Mode_t mode, uint
         );
     cpu->PC = addr;
     cpu->cycles += cycles;
+
+    if (cpu->prof)
+    {
+        prof_call(cpu->prof, cpu, 2, PROF_CALL);
+    }
 }
 
-void i_jsl(CPU_t *cpu, memory_t *mem, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_jsl(CPU_t *cpu, memory_t *mem, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
     uint32_t ret_addr = _addr_add_val_bank_wrap(_cpu_get_effective_pc(cpu), 3);
     _stackCPU_push24(cpu, mem, ret_addr, cpu->setacc);
     cpu->PBR = _get_mem_byte(mem, (addr >> 16) & 0xff, cpu->setacc);
     cpu->PC = addr & 0xffff;
     cpu->cycles += cycles;
+
+    if (cpu->prof)
+    {
+        prof_call(cpu->prof, cpu, 3, PROF_CALL);
+    }
 }
 
-void i_lda(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_lda(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
-    if (mode == CPU_ADDR_IMMD && !cpu->P.E && !cpu->P.M) // 16-bit immediate, add a byte
+    if (mode == CPU_ADDR_IMMD && !OPS_M8(cpu)) // 16-bit immediate, add a byte
     {
         size += 1;
     }
@@ -1210,7 +1200,7 @@ void i_lda(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
         /* Fallthrough! */
     case CPU_ADDR_IMMD:
     case CPU_ADDR_SR:
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M))
+        if (OPS_M8(cpu))
         {
             cpu->C = (cpu->C & 0xff00) | _get_mem_byte(mem, addr, cpu->setacc);
         }
@@ -1241,7 +1231,7 @@ void i_lda(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     case CPU_ADDR_ABSL:
     case CPU_ADDR_ABSLX:
     case CPU_ADDR_SRINDY:
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M))
+        if (OPS_M8(cpu))
         {
             cpu->C = (cpu->C & 0xff00) | _get_mem_byte(mem, addr, cpu->setacc);
         }
@@ -1258,7 +1248,7 @@ void i_lda(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
         {
             cpu->cycles += 1;
         }
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M))
+        if (OPS_M8(cpu))
         {
             cpu->C = (cpu->C & 0xff00) | _get_mem_byte(mem, addr, cpu->setacc);
         }
@@ -1272,15 +1262,13 @@ void i_lda(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
         break;
     }
 
-    if (cpu->P.E || (!cpu->P.E && cpu->P.M))
+    if (OPS_M8(cpu))
     {
-        cpu->P.Z = ((cpu->C & 0xff) == 0);
-        cpu->P.N = ((cpu->C & 0x80) == 0x80);
+        cpu->nz = CPU_NZ8(cpu->C);
     }
     else // 16-bit
     {
-        cpu->P.Z = (cpu->C == 0);
-        cpu->P.N = ((cpu->C & 0x8000) == 0x8000);
+        cpu->nz = CPU_NZ16(cpu->C);
         cpu->cycles += 1;
     }
 
@@ -1288,29 +1276,26 @@ void i_lda(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     cpu->cycles += cycles;
 }
 
-void i_ldx(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_ldx(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
     if (mode == CPU_ADDR_DP || mode == CPU_ADDR_DPY)
     {
-        if (cpu->P.E)
+        if (OPS_E(cpu))
         {
             cpu->X = _get_mem_byte(mem, addr, cpu->setacc);
-            cpu->P.Z = ((cpu->X & 0xff) == 0);
-            cpu->P.N = ((cpu->X & 0x80) == 0x80);
+            cpu->nz = CPU_NZ8(cpu->X);
         }
         else
         {
-            if (cpu->P.XB)
+            if (OPS_X8(cpu))
             {
                 cpu->X = _get_mem_byte(mem, addr, cpu->setacc);
-                cpu->P.Z = ((cpu->X & 0xff) == 0);
-                cpu->P.N = ((cpu->X & 0x80) == 0x80);
+                cpu->nz = CPU_NZ8(cpu->X);
             }
             else
             {
                 cpu->X = _get_mem_word_bank_wrap(mem, addr, cpu->setacc);
-                cpu->P.Z = (cpu->X == 0);
-                cpu->P.N = ((cpu->X & 0x8000) == 0x8000);
+                cpu->nz = CPU_NZ16(cpu->X);
                 cpu->cycles += 1;
             }
         }
@@ -1321,25 +1306,22 @@ void i_ldx(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     }
     else if (mode == CPU_ADDR_ABS || mode == CPU_ADDR_ABSY)
     {
-        if (cpu->P.E)
+        if (OPS_E(cpu))
         {
             cpu->X = _get_mem_byte(mem, addr, cpu->setacc);
-            cpu->P.Z = ((cpu->X & 0xff) == 0);
-            cpu->P.N = ((cpu->X & 0x80) == 0x80);
+            cpu->nz = CPU_NZ8(cpu->X);
         }
         else
         {
-            if (cpu->P.XB)
+            if (OPS_X8(cpu))
             {
                 cpu->X = _get_mem_byte(mem, addr, cpu->setacc);
-                cpu->P.Z = ((cpu->X & 0xff) == 0);
-                cpu->P.N = ((cpu->X & 0x80) == 0x80);
+                cpu->nz = CPU_NZ8(cpu->X);
             }
             else
             {
                 cpu->X = _get_mem_word(mem, addr, cpu->setacc);
-                cpu->P.Z = (cpu->X == 0);
-                cpu->P.N = ((cpu->X & 0x8000) == 0x8000);
+                cpu->nz = CPU_NZ16(cpu->X);
                 cpu->cycles += 1;
             }
         }
@@ -1352,25 +1334,22 @@ void i_ldx(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     }
     else if (mode == CPU_ADDR_IMMD)
     {
-        if (cpu->P.E)
+        if (OPS_E(cpu))
         {
             cpu->X = _get_mem_byte(mem, addr, cpu->setacc);
-            cpu->P.Z = ((cpu->X & 0xff) == 0);
-            cpu->P.N = ((cpu->X & 0x80) == 0x80);
+            cpu->nz = CPU_NZ8(cpu->X);
         }
         else
         {
-            if (cpu->P.XB)
+            if (OPS_X8(cpu))
             {
                 cpu->X = _get_mem_byte(mem, addr, cpu->setacc);
-                cpu->P.Z = ((cpu->X & 0xff) == 0);
-                cpu->P.N = ((cpu->X & 0x80) == 0x80);
+                cpu->nz = CPU_NZ8(cpu->X);
             }
             else
             {
                 cpu->X = _get_mem_word_bank_wrap(mem, addr, cpu->setacc);
-                cpu->P.Z = (cpu->X == 0);
-                cpu->P.N = ((cpu->X & 0x8000) == 0x8000);
+                cpu->nz = CPU_NZ16(cpu->X);
                 size += 1;
                 cpu->cycles += 1;
             }
@@ -1380,29 +1359,26 @@ void i_ldx(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     _cpu_update_pc(cpu, size);
 }
 
-void i_ldy(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_ldy(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
     if (mode == CPU_ADDR_DP || mode == CPU_ADDR_DPX)
     {
-        if (cpu->P.E)
+        if (OPS_E(cpu))
         {
             cpu->Y = _get_mem_byte(mem, addr, cpu->setacc);
-            cpu->P.Z = ((cpu->Y & 0xff) == 0);
-            cpu->P.N = ((cpu->Y & 0x80) == 0x80);
+            cpu->nz = CPU_NZ8(cpu->Y);
         }
         else
         {
-            if (cpu->P.XB)
+            if (OPS_X8(cpu))
             {
                 cpu->Y = _get_mem_byte(mem, addr, cpu->setacc);
-                cpu->P.Z = ((cpu->Y & 0xff) == 0);
-                cpu->P.N = ((cpu->Y & 0x80) == 0x80);
+                cpu->nz = CPU_NZ8(cpu->Y);
             }
             else
             {
                 cpu->Y = _get_mem_word_bank_wrap(mem, addr, cpu->setacc);
-                cpu->P.Z = (cpu->Y == 0);
-                cpu->P.N = ((cpu->Y & 0x8000) == 0x8000);
+                cpu->nz = CPU_NZ16(cpu->Y);
                 cpu->cycles += 1;
             }
         }
@@ -1413,25 +1389,22 @@ void i_ldy(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     }
     else if (mode == CPU_ADDR_ABS || mode == CPU_ADDR_ABSX)
     {
-        if (cpu->P.E)
+        if (OPS_E(cpu))
         {
             cpu->Y = _get_mem_byte(mem, addr, cpu->setacc);
-            cpu->P.Z = ((cpu->Y & 0xff) == 0);
-            cpu->P.N = ((cpu->Y & 0x80) == 0x80);
+            cpu->nz = CPU_NZ8(cpu->Y);
         }
         else
         {
-            if (cpu->P.XB)
+            if (OPS_X8(cpu))
             {
                 cpu->Y = _get_mem_byte(mem, addr, cpu->setacc);
-                cpu->P.Z = ((cpu->Y & 0xff) == 0);
-                cpu->P.N = ((cpu->Y & 0x80) == 0x80);
+                cpu->nz = CPU_NZ8(cpu->Y);
             }
             else
             {
                 cpu->Y = _get_mem_word(mem, addr, cpu->setacc);
-                cpu->P.Z = (cpu->Y == 0);
-                cpu->P.N = ((cpu->Y & 0x8000) == 0x8000);
+                cpu->nz = CPU_NZ16(cpu->Y);
                 cpu->cycles += 1;
             }
         }
@@ -1445,25 +1418,22 @@ void i_ldy(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     }
     else if (mode == CPU_ADDR_IMMD)
     {
-        if (cpu->P.E)
+        if (OPS_E(cpu))
         {
             cpu->Y = _get_mem_byte(mem, addr, cpu->setacc);
-            cpu->P.Z = ((cpu->Y & 0xff) == 0);
-            cpu->P.N = ((cpu->Y & 0x80) == 0x80);
+            cpu->nz = CPU_NZ8(cpu->Y);
         }
         else
         {
-            if (cpu->P.XB)
+            if (OPS_X8(cpu))
             {
                 cpu->Y = _get_mem_byte(mem, addr, cpu->setacc);
-                cpu->P.Z = ((cpu->Y & 0xff) == 0);
-                cpu->P.N = ((cpu->Y & 0x80) == 0x80);
+                cpu->nz = CPU_NZ8(cpu->Y);
             }
             else
             {
                 cpu->Y =  _get_mem_word_bank_wrap(mem, addr, cpu->setacc);
-                cpu->P.Z = (cpu->Y == 0);
-                cpu->P.N = ((cpu->Y & 0x8000) == 0x8000);
+                cpu->nz = CPU_NZ16(cpu->Y);
                 size += 1;
                 cpu->cycles += 1;
             }
@@ -1473,7 +1443,7 @@ void i_ldy(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     _cpu_update_pc(cpu, size);
 }
 
-void i_lsr(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_lsr(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
     uint16_t post_data = 0;
     uint16_t pre_data = 0;
@@ -1483,7 +1453,7 @@ void i_lsr(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     case CPU_ADDR_DPX:
         pre_data = _get_mem_word_bank_wrap(mem, addr, cpu->setacc);
 
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             post_data = ((pre_data >> 1) & 0xff);
             _set_mem_byte(mem, addr, (uint8_t)post_data, cpu->setacc);
@@ -1505,7 +1475,7 @@ void i_lsr(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     case CPU_ADDR_ABSX:
         pre_data = _get_mem_word(mem, addr, cpu->setacc);
 
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             post_data = ((pre_data >> 1) & 0xff);
             _set_mem_byte(mem, addr, (uint8_t)post_data, cpu->setacc);
@@ -1520,7 +1490,7 @@ void i_lsr(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     case CPU_ADDR_IMPD:
         pre_data = cpu->C;
 
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             post_data = ((pre_data >> 1) & 0xff);
             cpu->C = (cpu->C & 0xff00) | post_data;
@@ -1536,24 +1506,22 @@ void i_lsr(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
         break;
     }
 
-    if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+    if (OPS_M8(cpu)) // 8-bit
     {
         cpu->C = (pre_data & 0x80) ? 1 : 0;
-        cpu->P.N = (cpu->C & 0x80) ? 1 : 0;
-        cpu->P.Z = (cpu->C & 0xff) ? 0 : 1;
+        cpu->nz = CPU_NZ8(cpu->C);
     }
     else // 16-bit
     {
         cpu->P.C = (pre_data & 0x8000) ? 1 : 0;
-        cpu->P.N = (cpu->C & 0x8000) ? 1 : 0;
-        cpu->P.Z = cpu->C ? 0 : 1;
+        cpu->nz = CPU_NZ16(cpu->C);
     }
 
     cpu->cycles += cycles;
     _cpu_update_pc(cpu, size);
 }
 
-void i_mvn(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_mvn(CPU_t *cpu, memory_t *mem)
 {
     uint32_t operand_addr = _addrCPU_getImmediate(cpu, mem, cpu->setacc);
 
@@ -1565,16 +1533,16 @@ void i_mvn(CPU_t *cpu, memory_t *mem)
     uint32_t dst_addr = (dst_bank << 16) | cpu->Y;
     uint32_t src_addr = (src_bank << 16) | cpu->X;
 
-    // Perform copy
-    uint8_t tmp = _get_mem_byte(mem, src_addr, cpu->setacc);
-    _set_mem_byte(mem, dst_addr, tmp, cpu->setacc);
+    // Perform copy, several bytes per step (see _cpu_get_mv_count)
+    uint32_t count = _cpu_get_mv_count(cpu, dst_bank, false);
+    _move_mem_block(mem, dst_addr, src_addr, count, false, cpu->setacc);
 
     // Update regs for next byte
-    cpu->Y += 1;
-    cpu->X += 1;
+    cpu->Y += count;
+    cpu->X += count;
     cpu->DBR = dst_bank;
 
-    cpu->C -= 1;
+    cpu->C -= count;
 
     // Are we done yet?
     if (cpu->C == (uint16_t)-1)
@@ -1582,10 +1550,10 @@ void i_mvn(CPU_t *cpu, memory_t *mem)
         // Done, move to next instruction
         _cpu_update_pc(cpu, 3);
     }
-    cpu->cycles += 7; // 7 cycles per byte moved
+    cpu->cycles += 7 * count; // 7 cycles per byte moved
 }
 
-void i_mvp(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_mvp(CPU_t *cpu, memory_t *mem)
 {
     uint32_t operand_addr = _addrCPU_getImmediate(cpu, mem, cpu->setacc);
 
@@ -1597,16 +1565,16 @@ void i_mvp(CPU_t *cpu, memory_t *mem)
     uint32_t dst_addr = (dst_bank << 16) | cpu->Y;
     uint32_t src_addr = (src_bank << 16) | cpu->X;
 
-    // Perform copy
-    uint8_t tmp = _get_mem_byte(mem, src_addr, cpu->setacc);
-    _set_mem_byte(mem, dst_addr, tmp, cpu->setacc);
+    // Perform copy, several bytes per step (see _cpu_get_mv_count)
+    uint32_t count = _cpu_get_mv_count(cpu, dst_bank, true);
+    _move_mem_block(mem, dst_addr, src_addr, count, true, cpu->setacc);
 
     // Update regs for next byte
-    cpu->Y -= 1;
-    cpu->X -= 1;
+    cpu->Y -= count;
+    cpu->X -= count;
     cpu->DBR = dst_bank;
 
-    cpu->C -= 1;
+    cpu->C -= count;
 
     // Are we done yet?
     if (cpu->C == (uint16_t)-1)
@@ -1614,20 +1582,20 @@ void i_mvp(CPU_t *cpu, memory_t *mem)
         // Done, move to next instruction
         _cpu_update_pc(cpu, 3);
     }
-    cpu->cycles += 7; // 7 cycles per byte moved
+    cpu->cycles += 7 * count; // 7 cycles per byte moved
 }
 
-void i_nop(CPU_t *cpu)
+OPS_DEF void i_nop(CPU_t *cpu)
 {
     _cpu_update_pc(cpu, 1);
     cpu->cycles += 2;
 }
 
-void i_ora(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_ora(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
     if (mode == CPU_ADDR_DP || mode == CPU_ADDR_DPX)
     {
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             cpu->C = (cpu->C & 0xff00) | ((cpu->C & 0xff) | _get_mem_byte(mem, addr, cpu->setacc));
         }
@@ -1649,7 +1617,7 @@ void i_ora(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
              mode == CPU_ADDR_INDDPY || mode == CPU_ADDR_INDDPLY ||
              mode == CPU_ADDR_SRINDY)
     {
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             cpu->C = (cpu->C & 0xff00) | ((cpu->C & 0xff) | _get_mem_byte(mem, addr, cpu->setacc));
         }
@@ -1688,7 +1656,7 @@ void i_ora(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     }
     else if (mode == CPU_ADDR_IMMD || mode == CPU_ADDR_SR)
     {
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             cpu->C = (cpu->C & 0xff00) | ((cpu->C & 0xff) | _get_mem_byte(mem, addr, cpu->setacc));
         }
@@ -1698,22 +1666,20 @@ void i_ora(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
         }
     }
 
-    if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+    if (OPS_M8(cpu)) // 8-bit
     {
-        cpu->P.N = (cpu->C & 0x80) ? 1 : 0;
-        cpu->P.Z = (cpu->C & 0xff) ? 0 : 1;
+        cpu->nz = CPU_NZ8(cpu->C);
     }
     else // 16-bit
     {
-        cpu->P.N = (cpu->C & 0x8000) ? 1 : 0;
-        cpu->P.Z = cpu->C ? 0 : 1;
+        cpu->nz = CPU_NZ16(cpu->C);
         cpu->cycles += 1;
     }
     cpu->cycles += cycles;
     _cpu_update_pc(cpu, size);
 }
 
-void i_pea(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_pea(CPU_t *cpu, memory_t *mem)
 {
     _stackCPU_pushWord(
         cpu,
@@ -1726,7 +1692,7 @@ void i_pea(CPU_t *cpu, memory_t *mem)
     _cpu_update_pc(cpu, 3);
 }
 
-void i_pei(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_pei(CPU_t *cpu, memory_t *mem)
 {
     uint32_t addr_dp = _addr_add_val_bank_wrap(
         (cpu->D & 0xffff),
@@ -1744,7 +1710,7 @@ void i_pei(CPU_t *cpu, memory_t *mem)
     }
 }
 
-void i_per(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_per(CPU_t *cpu, memory_t *mem)
 {
     int16_t displacement = _cpu_get_immd_word(cpu, mem, cpu->setacc);
     _cpu_update_pc(cpu, 3);
@@ -1759,9 +1725,9 @@ void i_per(CPU_t *cpu, memory_t *mem)
     cpu->cycles += 6;
 }
 
-void i_pha(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_pha(CPU_t *cpu, memory_t *mem)
 {
-    if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit A
+    if (OPS_M8(cpu)) // 8-bit A
     {
         _stackCPU_pushByte(cpu, mem, cpu->C, cpu->setacc);
         cpu->cycles += 3;
@@ -1775,37 +1741,37 @@ void i_pha(CPU_t *cpu, memory_t *mem)
     _cpu_update_pc(cpu, 1);
 }
 
-void i_phb(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_phb(CPU_t *cpu, memory_t *mem)
 {
     _stackCPU_pushByte(cpu, mem, cpu->DBR, cpu->setacc);
     cpu->cycles += 3;
     _cpu_update_pc(cpu, 1);
 }
 
-void i_phk(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_phk(CPU_t *cpu, memory_t *mem)
 {
     _stackCPU_pushByte(cpu, mem, cpu->PBR, cpu->setacc);
     cpu->cycles += 3;
     _cpu_update_pc(cpu, 1);
 }
 
-void i_phd(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_phd(CPU_t *cpu, memory_t *mem)
 {
     _stackCPU_pushWord(cpu, mem, cpu->D, CPU_ESTACK_DISABLE, cpu->setacc);
     cpu->cycles += 4;
     _cpu_update_pc(cpu, 1);
 }
 
-void i_php(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_php(CPU_t *cpu, memory_t *mem)
 {
     _stackCPU_pushByte(cpu, mem, _cpu_get_sr(cpu), cpu->setacc);
     cpu->cycles += 3;
     _cpu_update_pc(cpu, 1);
 }
 
-void i_phx(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_phx(CPU_t *cpu, memory_t *mem)
 {
-    if (cpu->P.E || (!cpu->P.E && cpu->P.XB)) // 8-bit X
+    if (OPS_X8(cpu)) // 8-bit X
     {
         _stackCPU_pushByte(cpu, mem, cpu->X, cpu->setacc);
         cpu->cycles += 3;
@@ -1819,9 +1785,9 @@ void i_phx(CPU_t *cpu, memory_t *mem)
     _cpu_update_pc(cpu, 1);
 }
 
-void i_phy(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_phy(CPU_t *cpu, memory_t *mem)
 {
-    if (cpu->P.E || (!cpu->P.E && cpu->P.XB)) // 8-bit X
+    if (OPS_X8(cpu)) // 8-bit X
     {
         _stackCPU_pushByte(cpu, mem, cpu->Y, cpu->setacc);
         cpu->cycles += 3;
@@ -1835,51 +1801,47 @@ void i_phy(CPU_t *cpu, memory_t *mem)
     _cpu_update_pc(cpu, 1);
 }
 
-void i_pla(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_pla(CPU_t *cpu, memory_t *mem)
 {
-    if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit A
+    if (OPS_M8(cpu)) // 8-bit A
     {
         cpu->C = _stackCPU_popByte(cpu, mem, CPU_ESTACK_ENABLE, cpu->setacc);
         cpu->cycles += 4;
-        cpu->P.Z = ((cpu->C & 0xff) == 0);
-        cpu->P.N = ((cpu->C & 0x80) == 0x80);
+        cpu->nz = CPU_NZ8(cpu->C);
     }
     else // 16-bit A
     {
         cpu->C = _stackCPU_popWord(cpu, mem, CPU_ESTACK_ENABLE, cpu->setacc);
         cpu->cycles += 5;
-        cpu->P.Z = (cpu->C == 0);
-        cpu->P.N = ((cpu->C & 0x8000) == 0x8000);
+        cpu->nz = CPU_NZ16(cpu->C);
     }
 
     _cpu_update_pc(cpu, 1);
 }
 
-void i_plb(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_plb(CPU_t *cpu, memory_t *mem)
 {
     cpu->DBR = _stackCPU_popByte(cpu, mem, CPU_ESTACK_DISABLE, cpu->setacc);
     cpu->cycles += 4;
-    cpu->P.Z = (cpu->DBR == 0);
-    cpu->P.N = ((cpu->DBR & 0x80) == 0x80);
+    cpu->nz = CPU_NZ8(cpu->DBR);
 
     _cpu_update_pc(cpu, 1);
 }
 
-void i_pld(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_pld(CPU_t *cpu, memory_t *mem)
 {
     cpu->D = _stackCPU_popWord(cpu, mem, CPU_ESTACK_DISABLE, cpu->setacc);
     cpu->cycles += 5;
-    cpu->P.Z = (cpu->D == 0);
-    cpu->P.N = ((cpu->D & 0x8000) == 0x8000);
+    cpu->nz = CPU_NZ16(cpu->D);
 
     _cpu_update_pc(cpu, 1);
 }
 
-void i_plp(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_plp(CPU_t *cpu, memory_t *mem)
 {
     uint8_t sr = _cpu_get_sr(cpu);
     uint8_t val = _stackCPU_popByte(cpu, mem, CPU_ESTACK_ENABLE, cpu->setacc);
-    if (cpu->P.E)
+    if (OPS_E(cpu))
     {
         _cpu_set_sr(cpu, (sr & 0x20) | (val & 0xdf)); // Bit 5 is unaffected by operation in emulation mode
     }
@@ -1892,53 +1854,49 @@ void i_plp(CPU_t *cpu, memory_t *mem)
     _cpu_update_pc(cpu, 1);
 }
 
-void i_plx(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_plx(CPU_t *cpu, memory_t *mem)
 {
-    if (cpu->P.E || (!cpu->P.E && cpu->P.XB)) // 8-bit X
+    if (OPS_X8(cpu)) // 8-bit X
     {
         cpu->X = _stackCPU_popByte(cpu, mem, CPU_ESTACK_ENABLE, cpu->setacc);
         cpu->cycles += 4;
-        cpu->P.Z = ((cpu->X & 0xff) == 0);
-        cpu->P.N = ((cpu->X & 0x80) == 0x80);
+        cpu->nz = CPU_NZ8(cpu->X);
     }
     else // 16-bit X
     {
 
         cpu->X = _stackCPU_popWord(cpu, mem, CPU_ESTACK_ENABLE, cpu->setacc);
         cpu->cycles += 5;
-        cpu->P.Z = (cpu->X == 0);
-        cpu->P.N = ((cpu->X & 0x8000) == 0x8000);
+        cpu->nz = CPU_NZ16(cpu->X);
     }
 
     _cpu_update_pc(cpu, 1);
 }
 
-void i_ply(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_ply(CPU_t *cpu, memory_t *mem)
 {
-    if (cpu->P.E || (!cpu->P.E && cpu->P.XB)) // 8-bit X
+    if (OPS_X8(cpu)) // 8-bit X
     {
         cpu->Y = _stackCPU_popByte(cpu, mem, CPU_ESTACK_ENABLE, cpu->setacc);
         cpu->cycles += 4;
-        cpu->P.Z = ((cpu->Y & 0xff) == 0);
-        cpu->P.N = ((cpu->Y & 0x80) == 0x80);
+        cpu->nz = CPU_NZ8(cpu->Y);
     }
     else // 16-bit X
     {
         cpu->Y = _stackCPU_popWord(cpu, mem, CPU_ESTACK_ENABLE, cpu->setacc);
         cpu->cycles += 5;
-        cpu->P.Z = (cpu->Y == 0);
-        cpu->P.N = ((cpu->Y & 0x8000) == 0x8000);
+        cpu->nz = CPU_NZ16(cpu->Y);
     }
 
     _cpu_update_pc(cpu, 1);
 }
 
-void i_rep(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_rep(CPU_t *cpu, memory_t *mem)
 {
     uint8_t sr = _cpu_get_sr(cpu);
     uint8_t val = _cpu_get_immd_byte(cpu, mem, cpu->setacc);
 
-    if (cpu->P.E)
+    if (OPS_E(cpu))
     {
         _cpu_set_sr(cpu, sr & ((~val) | 0x30)); // Bits 4 and 5 are unaffected by operation in emulation mode
     }
@@ -1957,7 +1915,7 @@ void i_rep(CPU_t *cpu, memory_t *mem)
     cpu->cycles += 3;
 }
 
-void i_rol(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_rol(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
     uint16_t post_data = 0;
     uint16_t pre_data = 0;
@@ -1967,7 +1925,7 @@ void i_rol(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     case CPU_ADDR_DPX:
         pre_data = _get_mem_word_bank_wrap(mem, addr, cpu->setacc);
 
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             post_data = ((pre_data << 1) & 0xff) | cpu->P.C;
             _set_mem_byte(mem, addr, (uint8_t)post_data, cpu->setacc);
@@ -1989,7 +1947,7 @@ void i_rol(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     case CPU_ADDR_ABSX:
         pre_data = _get_mem_word(mem, addr, cpu->setacc);
 
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             post_data = ((pre_data << 1) & 0xff) | cpu->P.C;
             _set_mem_byte(mem, addr, (uint8_t)post_data, cpu->setacc);
@@ -2004,7 +1962,7 @@ void i_rol(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     case CPU_ADDR_IMPD:
         pre_data = cpu->C;
 
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             post_data = ((pre_data << 1) & 0xff) | cpu->P.C;
             cpu->C = (cpu->C & 0xff00) | post_data;
@@ -2020,24 +1978,22 @@ void i_rol(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
         break;
     }
 
-    if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+    if (OPS_M8(cpu)) // 8-bit
     {
         cpu->C = (pre_data & 0x80) ? 1 : 0;
-        cpu->P.N = (cpu->C & 0x80) ? 1 : 0;
-        cpu->P.Z = (cpu->C & 0xff) ? 0 : 1;
+        cpu->nz = CPU_NZ8(cpu->C);
     }
     else // 16-bit
     {
         cpu->P.C = (pre_data & 0x8000) ? 1 : 0;
-        cpu->P.N = (cpu->C & 0x8000) ? 1 : 0;
-        cpu->P.Z = cpu->C ? 0 : 1;
+        cpu->nz = CPU_NZ16(cpu->C);
     }
 
     cpu->cycles += cycles;
     _cpu_update_pc(cpu, size);
 }
 
-void i_ror(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_ror(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
     uint16_t post_data = 0;
     uint16_t pre_data = 0;
@@ -2047,7 +2003,7 @@ void i_ror(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     case CPU_ADDR_DPX:
         pre_data = _get_mem_word_bank_wrap(mem, addr, cpu->setacc);
 
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             post_data = ((pre_data >> 1) & 0xff) | (cpu->P.C << 7);
             _set_mem_byte(mem, addr, (uint8_t)post_data, cpu->setacc);
@@ -2069,7 +2025,7 @@ void i_ror(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     case CPU_ADDR_ABSX:
         pre_data = _get_mem_word(mem, addr, cpu->setacc);
 
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             post_data = ((pre_data >> 1) & 0xff) | (cpu->P.C << 7);
             _set_mem_byte(mem, addr, (uint8_t)post_data, cpu->setacc);
@@ -2084,7 +2040,7 @@ void i_ror(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     case CPU_ADDR_IMPD:
         pre_data = cpu->C;
 
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+        if (OPS_M8(cpu)) // 8-bit
         {
             post_data = ((pre_data >> 1) & 0xff) | (cpu->P.C << 7);
             cpu->C = (cpu->C & 0xff00) | post_data;
@@ -2100,29 +2056,27 @@ void i_ror(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
         break;
     }
 
-    if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+    if (OPS_M8(cpu)) // 8-bit
     {
         cpu->C = (pre_data & 0x80) ? 1 : 0;
-        cpu->P.N = (cpu->C & 0x80) ? 1 : 0;
-        cpu->P.Z = (cpu->C & 0xff) ? 0 : 1;
+        cpu->nz = CPU_NZ8(cpu->C);
     }
     else // 16-bit
     {
         cpu->P.C = (pre_data & 0x8000) ? 1 : 0;
-        cpu->P.N = (cpu->C & 0x8000) ? 1 : 0;
-        cpu->P.Z = cpu->C ? 0 : 1;
+        cpu->nz = CPU_NZ16(cpu->C);
     }
 
     cpu->cycles += cycles;
     _cpu_update_pc(cpu, size);
 }
 
-void i_rti(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_rti(CPU_t *cpu, memory_t *mem)
 {
     uint8_t sr = _cpu_get_sr(cpu);
     uint8_t val = _stackCPU_popByte(cpu, mem, CPU_ESTACK_ENABLE, cpu->setacc);
 
-    if (cpu->P.E)
+    if (OPS_E(cpu))
     {
         _cpu_set_sr(cpu, (sr & 0x30) | (val & 0xcf)); // Bits 4 and 5 are unaffected by operation in emulation mode
         cpu->PC = _stackCPU_popWord(cpu, mem, CPU_ESTACK_ENABLE, cpu->setacc);
@@ -2136,26 +2090,41 @@ void i_rti(CPU_t *cpu, memory_t *mem)
         cpu->PC = data & 0xffff;
         cpu->cycles += 7;
     }
+
+    if (cpu->prof)
+    {
+        prof_return(cpu->prof, cpu);
+    }
 }
 
-void i_rtl(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_rtl(CPU_t *cpu, memory_t *mem)
 {
     uint32_t addr = _stackCPU_pop24(cpu, mem, cpu->setacc);
     cpu->PC = _addr_add_val_bank_wrap(addr & 0xffff, 1);
     cpu->PBR = (addr >> 16) & 0xff;
     cpu->cycles += 6;
+
+    if (cpu->prof)
+    {
+        prof_return(cpu->prof, cpu);
+    }
 }
 
-void i_rts(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_rts(CPU_t *cpu, memory_t *mem)
 {
     cpu->PC = _addr_add_val_bank_wrap(
         _stackCPU_popWord(cpu, mem, CPU_ESTACK_ENABLE, cpu->setacc), 1);
     cpu->cycles += 6;
+
+    if (cpu->prof)
+    {
+        prof_return(cpu->prof, cpu);
+    }
 }
 
-void i_sbc(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_sbc(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
-    if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+    if (OPS_M8(cpu)) // 8-bit
     {
         uint8_t val = _get_mem_byte(mem, addr, cpu->setacc);
         uint16_t al, alb;
@@ -2188,8 +2157,7 @@ void i_sbc(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
 
         // Update flags
         cpu->C = (cpu->C & 0xff00) | (al & 0xff);
-        cpu->P.N = (al & 0x80) ? 1 : 0;
-        cpu->P.Z = ((al & 0xff) == 0) ? 1 : 0;
+        cpu->nz = CPU_NZ8(al);
 
         // C and V are based on the binary result
         cpu->P.V = ((int16_t)alb < -128 || (int16_t)alb > 127) ? 1 : 0;
@@ -2253,8 +2221,7 @@ void i_sbc(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
 
         // Update flags
         cpu->C = al & 0xffff;
-        cpu->P.N = (al & 0x8000) ? 1 : 0;
-        cpu->P.Z = ((al & 0xffff) == 0) ? 1 : 0;
+        cpu->nz = CPU_NZ16(al);
 
         // C and V are based on the binary result
         cpu->P.V = ((int32_t)alb < -32768 || (int32_t)alb > 32767) ? 1 : 0;
@@ -2298,33 +2265,33 @@ void i_sbc(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     cpu->cycles += cycles;
 }
 
-void i_sec(CPU_t *cpu)
+OPS_DEF void i_sec(CPU_t *cpu)
 {
     cpu->P.C = 1;
     _cpu_update_pc(cpu, 1);
     cpu->cycles += 2;
 }
 
-void i_sed(CPU_t *cpu)
+OPS_DEF void i_sed(CPU_t *cpu)
 {
     cpu->P.D = 1;
     _cpu_update_pc(cpu, 1);
     cpu->cycles += 2;
 }
 
-void i_sei(CPU_t *cpu)
+OPS_DEF void i_sei(CPU_t *cpu)
 {
     cpu->P.I = 1;
     _cpu_update_pc(cpu, 1);
     cpu->cycles += 2;
 }
 
-void i_sep(CPU_t *cpu, memory_t *mem)
+OPS_DEF void i_sep(CPU_t *cpu, memory_t *mem)
 {
     uint8_t sr = _cpu_get_sr(cpu);
     uint8_t val = _get_mem_byte(mem, _addr_add_val_bank_wrap(cpu->PC, 1), cpu->setacc);
 
-    if (cpu->P.E)
+    if (OPS_E(cpu))
     {
         _cpu_set_sr(cpu, sr | (val & 0xcf)); // Bits 4 and 5 are unaffected by operation in emulation mode
     }
@@ -2343,14 +2310,14 @@ void i_sep(CPU_t *cpu, memory_t *mem)
     cpu->cycles += 3;
 }
 
-void i_stp(CPU_t *cpu)
+OPS_DEF void i_stp(CPU_t *cpu)
 {
     //_cpu_update_pc(cpu, 1); // ???
     cpu->cycles += 3;
     cpu->P.STP = 1;
 }
 
-void i_sta(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_sta(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
     switch (mode)
     {
@@ -2363,7 +2330,7 @@ void i_sta(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
         /* Fallthrough! */
     case CPU_ADDR_IMMD:
     case CPU_ADDR_SR:
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M))
+        if (OPS_M8(cpu))
         {
             _set_mem_byte(mem, addr, (uint8_t)cpu->C, cpu->setacc);
         }
@@ -2394,7 +2361,7 @@ void i_sta(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     case CPU_ADDR_ABSL:
     case CPU_ADDR_ABSLX:
     case CPU_ADDR_SRINDY:
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M))
+        if (OPS_M8(cpu))
         {
             _set_mem_byte(mem, addr, (uint8_t)cpu->C, cpu->setacc);
         }
@@ -2411,7 +2378,7 @@ void i_sta(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
         {
             cpu->cycles += 1;
         }
-        if (cpu->P.E || (!cpu->P.E && cpu->P.M))
+        if (OPS_M8(cpu))
         {
             _set_mem_byte(mem, addr, (uint8_t)cpu->C, cpu->setacc);
         }
@@ -2425,7 +2392,7 @@ void i_sta(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
         break;
     }
 
-    if (!(cpu->P.E || (!cpu->P.E && cpu->P.M)))
+    if (!OPS_M8(cpu))
     {
         cpu->cycles += 1;
     }
@@ -2434,12 +2401,12 @@ void i_sta(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     cpu->cycles += cycles;
 }
 
-void i_stx(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_stx(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
     if (mode == CPU_ADDR_DP || mode == CPU_ADDR_DPY)
     {
         _set_mem_byte(mem, addr, cpu->X & 0xff, cpu->setacc);
-        if (!cpu->P.E && !cpu->P.XB) // 16-bit
+        if (!OPS_X8(cpu)) // 16-bit
         {
             _set_mem_byte(mem, _addr_add_val_bank_wrap(addr, 1), (cpu->X >> 8) & 0xff, cpu->setacc); // Bank wrapping
             cpu->cycles += 1;
@@ -2452,7 +2419,7 @@ void i_stx(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     else if (mode == CPU_ADDR_ABS)
     {
         _set_mem_byte(mem, addr, cpu->X & 0xff, cpu->setacc);
-        if (!cpu->P.E && !cpu->P.XB) // 16-bit
+        if (!OPS_X8(cpu)) // 16-bit
         {
             _set_mem_byte(mem, addr + 1, (cpu->X >> 8) & 0xff, cpu->setacc); // No bank wrapping
             cpu->cycles += 1;
@@ -2463,12 +2430,12 @@ void i_stx(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     _cpu_update_pc(cpu, size);
 }
 
-void i_sty(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_sty(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
     if (mode == CPU_ADDR_DP || mode == CPU_ADDR_DPX)
     {
         _set_mem_byte(mem, addr, cpu->Y & 0xff, cpu->setacc);
-        if (!cpu->P.E && !cpu->P.XB) // 16-bit
+        if (!OPS_X8(cpu)) // 16-bit
         {
             _set_mem_byte(mem, _addr_add_val_bank_wrap(addr, 1), (cpu->Y >> 8) & 0xff, cpu->setacc); // Bank wrapping
             cpu->cycles += 1;
@@ -2481,7 +2448,7 @@ void i_sty(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     else if (mode == CPU_ADDR_ABS)
     {
         _set_mem_byte(mem, addr, cpu->Y & 0xff, cpu->setacc);
-        if (!cpu->P.E && !cpu->P.XB) // 16-bit
+        if (!OPS_X8(cpu)) // 16-bit
         {
             _set_mem_byte(mem, addr + 1, (cpu->Y >> 8) & 0xff, cpu->setacc); // No bank wrapping
             cpu->cycles += 1;
@@ -2492,7 +2459,7 @@ void i_sty(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     _cpu_update_pc(cpu, size);
 }
 
-void i_stz(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_stz(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
     if (mode == CPU_ADDR_DP || mode == CPU_ADDR_DPX)
     {
@@ -2521,27 +2488,24 @@ void i_stz(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     _cpu_update_pc(cpu, size);
 }
 
-void i_tax(CPU_t *cpu)
+OPS_DEF void i_tax(CPU_t *cpu)
 {
-    if (cpu->P.E)
+    if (OPS_E(cpu))
     {
         cpu->X = cpu->C & 0xff;
-        cpu->P.Z = ((cpu->X & 0xff) == 0);
-        cpu->P.N = ((cpu->X & 0x80) == 0x80);
+        cpu->nz = CPU_NZ8(cpu->X);
     }
     else
     {
-        if (cpu->P.XB)
+        if (OPS_X8(cpu))
         {
             cpu->X = cpu->C & 0xff;
-            cpu->P.Z = ((cpu->X & 0xff) == 0);
-            cpu->P.N = ((cpu->X & 0x80) == 0x80);
+            cpu->nz = CPU_NZ8(cpu->X);
         }
         else // 16-bit X
         {
             cpu->X = cpu->C;
-            cpu->P.Z = (cpu->X == 0);
-            cpu->P.N = ((cpu->X & 0x8000) == 0x8000);
+            cpu->nz = CPU_NZ16(cpu->X);
         }
     }
 
@@ -2549,27 +2513,24 @@ void i_tax(CPU_t *cpu)
     cpu->cycles += 2;
 }
 
-void i_tay(CPU_t *cpu)
+OPS_DEF void i_tay(CPU_t *cpu)
 {
-    if (cpu->P.E)
+    if (OPS_E(cpu))
     {
         cpu->Y = cpu->C & 0xff;
-        cpu->P.Z = ((cpu->Y & 0xff) == 0);
-        cpu->P.N = ((cpu->Y & 0x80) == 0x80);
+        cpu->nz = CPU_NZ8(cpu->Y);
     }
     else
     {
-        if (cpu->P.XB)
+        if (OPS_X8(cpu))
         {
             cpu->Y = cpu->C & 0xff;
-            cpu->P.Z = ((cpu->Y & 0xff) == 0);
-            cpu->P.N = ((cpu->X & 0x80) == 0x80);
+            cpu->nz = CPU_NZ(cpu->X & 0x80, (cpu->Y & 0xff) == 0);
         }
         else // 16-bit X
         {
             cpu->Y = cpu->C;
-            cpu->P.Z = (cpu->Y == 0);
-            cpu->P.N = ((cpu->Y & 0x8000) == 0x8000);
+            cpu->nz = CPU_NZ16(cpu->Y);
         }
     }
 
@@ -2577,9 +2538,9 @@ void i_tay(CPU_t *cpu)
     cpu->cycles += 2;
 }
 
-void i_tcs(CPU_t *cpu)
+OPS_DEF void i_tcs(CPU_t *cpu)
 {
-    if (cpu->P.E)
+    if (OPS_E(cpu))
     {
         cpu->SP = (cpu->C & 0xff) | 0x0100;
     }
@@ -2592,37 +2553,35 @@ void i_tcs(CPU_t *cpu)
     cpu->cycles += 2;
 }
 
-void i_tcd(CPU_t *cpu)
+OPS_DEF void i_tcd(CPU_t *cpu)
 {
     // 16-bit transfer
     cpu->D = cpu->C;
-    cpu->P.Z = (cpu->D == 0);
-    cpu->P.N = ((cpu->D & 0x8000) == 0x8000);
+    cpu->nz = CPU_NZ16(cpu->D);
 
     _cpu_update_pc(cpu, 1);
     cpu->cycles += 2;
 }
 
-void i_tdc(CPU_t *cpu)
+OPS_DEF void i_tdc(CPU_t *cpu)
 {
     // 16-bit transfer
     cpu->C = cpu->D;
-    cpu->P.Z = (cpu->C == 0);
-    cpu->P.N = ((cpu->C & 0x8000) == 0x8000);
+    cpu->nz = CPU_NZ16(cpu->C);
 
     _cpu_update_pc(cpu, 1);
     cpu->cycles += 2;
 }
 
-void i_trb(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_trb(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
-    if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+    if (OPS_M8(cpu)) // 8-bit
     {
         uint8_t val = _get_mem_byte(mem, addr, cpu->setacc);
 
         _set_mem_byte(mem, addr, val & (cpu->C ^ 0xff), cpu->setacc);
 
-        cpu->P.Z = ((cpu->C & 0xff) & val) ? 0 : 1;
+        cpu->nz = CPU_NZ(CPU_NZ_GET_N(cpu->nz), !((cpu->C & 0xff) & val));
     }
     else // 16-bit
     {
@@ -2641,7 +2600,7 @@ void i_trb(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
             _set_mem_word(mem, addr, val & (cpu->C ^ 0xffff), cpu->setacc);
         }
 
-        cpu->P.Z = (cpu->C & val) ? 0 : 1;
+        cpu->nz = CPU_NZ(CPU_NZ_GET_N(cpu->nz), !(cpu->C & val));
 
         cpu->cycles += 2;  // Two! (read + write op)
     }
@@ -2656,15 +2615,15 @@ void i_trb(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     cpu->cycles += cycles;
 }
 
-void i_tsb(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
+OPS_DEF void i_tsb(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mode_t mode, uint32_t addr)
 {
-    if (cpu->P.E || (!cpu->P.E && cpu->P.M)) // 8-bit
+    if (OPS_M8(cpu)) // 8-bit
     {
         uint8_t val = _get_mem_byte(mem, addr, cpu->setacc);
 
         _set_mem_byte(mem, addr, val | (cpu->C & 0xff), cpu->setacc);
 
-        cpu->P.Z = ((cpu->C & 0xff) & val) ? 0 : 1;
+        cpu->nz = CPU_NZ(CPU_NZ_GET_N(cpu->nz), !((cpu->C & 0xff) & val));
     }
     else // 16-bit
     {
@@ -2683,7 +2642,7 @@ void i_tsb(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
             _set_mem_word(mem, addr, val | cpu->C, cpu->setacc);
         }
 
-        cpu->P.Z = (cpu->C & val) ? 0 : 1;
+        cpu->nz = CPU_NZ(CPU_NZ_GET_N(cpu->nz), !(cpu->C & val));
 
         cpu->cycles += 2; // Two! (read + write op)
     }
@@ -2698,9 +2657,9 @@ void i_tsb(CPU_t *cpu, memory_t *mem, uint8_t size, uint8_t cycles, CPU_Addr_Mod
     cpu->cycles += cycles;
 }
 
-void i_tsc(CPU_t *cpu)
+OPS_DEF void i_tsc(CPU_t *cpu)
 {
-    if (cpu->P.E)
+    if (OPS_E(cpu))
     {
         cpu->C = (cpu->SP & 0xff) | 0x0100;
     }
@@ -2709,34 +2668,30 @@ void i_tsc(CPU_t *cpu)
         cpu->C = cpu->SP;
     }
 
-    cpu->P.N = ((cpu->C & 0x8000) == 0x8000);
-    cpu->P.Z = (cpu->C == 0);
+    cpu->nz = CPU_NZ16(cpu->C);
 
     _cpu_update_pc(cpu, 1);
     cpu->cycles += 2;
 }
 
-void i_tsx(CPU_t *cpu)
+OPS_DEF void i_tsx(CPU_t *cpu)
 {
-    if (cpu->P.E)
+    if (OPS_E(cpu))
     {
         cpu->X = cpu->SP & 0xff;
-        cpu->P.Z = ((cpu->X & 0xff) == 0);
-        cpu->P.N = ((cpu->X & 0x80) == 0x80);
+        cpu->nz = CPU_NZ8(cpu->X);
     }
     else
     {
-        if (cpu->P.XB)
+        if (OPS_X8(cpu))
         {
             cpu->X = cpu->SP & 0xff;
-            cpu->P.Z = ((cpu->X & 0xff) == 0);
-            cpu->P.N = ((cpu->X & 0x80) == 0x80);
+            cpu->nz = CPU_NZ8(cpu->X);
         }
         else
         {
             cpu->X = cpu->SP & 0xffff;
-            cpu->P.Z = (cpu->X == 0);
-            cpu->P.N = ((cpu->X & 0x8000) == 0x8000);
+            cpu->nz = CPU_NZ16(cpu->X);
         }
     }
 
@@ -2744,33 +2699,29 @@ void i_tsx(CPU_t *cpu)
     cpu->cycles += 2;
 }
 
-void i_txa(CPU_t *cpu)
+OPS_DEF void i_txa(CPU_t *cpu)
 {
-    if (cpu->P.E)
+    if (OPS_E(cpu))
     {
         cpu->C = cpu->X & 0xff;
-        cpu->P.Z = ((cpu->C & 0xff) == 0);
-        cpu->P.N = ((cpu->C & 0x80) == 0x80);
+        cpu->nz = CPU_NZ8(cpu->C);
     }
     else
     {
-        if (cpu->P.M) // 8-bit A and 8/16-bit X
+        if (OPS_M8(cpu)) // 8-bit A and 8/16-bit X
         {
             cpu->C = (cpu->X & 0xff) | (cpu->C & 0xff00);
-            cpu->P.Z = ((cpu->C & 0xff) == 0);
-            cpu->P.N = ((cpu->C & 0x80) == 0x80);
+            cpu->nz = CPU_NZ8(cpu->C);
         }
-        else if (cpu->P.XB && !cpu->P.M) // 8-bit X, 16-bit A
+        else if (OPS_X8(cpu) && !OPS_M8(cpu)) // 8-bit X, 16-bit A
         {
             cpu->C = cpu->X & 0xff;
-            cpu->P.Z = ((cpu->C & 0xff) == 0);
-            cpu->P.N = ((cpu->C & 0x80) == 0x80);
+            cpu->nz = CPU_NZ8(cpu->C);
         }
         else // 16-bit A and X
         {
             cpu->C = cpu->X;
-            cpu->P.Z = (cpu->C == 0);
-            cpu->P.N = ((cpu->C & 0x8000) == 0x8000);
+            cpu->nz = CPU_NZ16(cpu->C);
         }
     }
 
@@ -2778,15 +2729,15 @@ void i_txa(CPU_t *cpu)
     cpu->cycles += 2;
 }
 
-void i_txs(CPU_t *cpu)
+OPS_DEF void i_txs(CPU_t *cpu)
 {
-    if (cpu->P.E)
+    if (OPS_E(cpu))
     {
         cpu->SP = (cpu->X & 0xff) | 0x0100;
     }
     else
     {
-        if (cpu->P.XB)
+        if (OPS_X8(cpu))
         {
             cpu->SP = (cpu->X & 0xff); // Zero high byte of SP
         }
@@ -2799,60 +2750,53 @@ void i_txs(CPU_t *cpu)
     cpu->cycles += 2;
 }
 
-void i_txy(CPU_t *cpu)
+OPS_DEF void i_txy(CPU_t *cpu)
 {
-    if (cpu->P.E)
+    if (OPS_E(cpu))
     {
         cpu->Y = cpu->X & 0xff;
-        cpu->P.Z = ((cpu->Y & 0xff) == 0);
-        cpu->P.N = ((cpu->Y & 0x80) == 0x80);
+        cpu->nz = CPU_NZ8(cpu->Y);
     }
     else
     {
-        if (cpu->P.XB)
+        if (OPS_X8(cpu))
         {
             cpu->Y = cpu->X & 0xff;
-            cpu->P.Z = ((cpu->Y & 0xff) == 0);
-            cpu->P.N = ((cpu->Y & 0x80) == 0x80);
+            cpu->nz = CPU_NZ8(cpu->Y);
         }
         else // 16-bit
         {
             cpu->Y = cpu->X;
-            cpu->P.Z = (cpu->Y == 0);
-            cpu->P.N = ((cpu->Y & 0x8000) == 0x8000);
+            cpu->nz = CPU_NZ16(cpu->Y);
         }
     }
     _cpu_update_pc(cpu, 1);
     cpu->cycles += 2;
 }
 
-void i_tya(CPU_t *cpu)
+OPS_DEF void i_tya(CPU_t *cpu)
 {
-    if (cpu->P.E)
+    if (OPS_E(cpu))
     {
         cpu->C = cpu->Y & 0xff;
-        cpu->P.Z = ((cpu->C & 0xff) == 0);
-        cpu->P.N = ((cpu->C & 0x80) == 0x80);
+        cpu->nz = CPU_NZ8(cpu->C);
     }
     else
     {
-        if (cpu->P.M) // 8-bit A and 8/16-bit X
+        if (OPS_M8(cpu)) // 8-bit A and 8/16-bit X
         {
             cpu->C = (cpu->Y & 0xff) | (cpu->C & 0xff00);
-            cpu->P.Z = ((cpu->C & 0xff) == 0);
-            cpu->P.N = ((cpu->C & 0x80) == 0x80);
+            cpu->nz = CPU_NZ8(cpu->C);
         }
-        else if (cpu->P.XB && !cpu->P.M) // 8-bit X, 16-bit A
+        else if (OPS_X8(cpu) && !OPS_M8(cpu)) // 8-bit X, 16-bit A
         {
             cpu->C = cpu->Y & 0xff;
-            cpu->P.Z = ((cpu->C & 0xff) == 0);
-            cpu->P.N = ((cpu->C & 0x80) == 0x80);
+            cpu->nz = CPU_NZ8(cpu->C);
         }
         else // 16-bit A and X
         {
             cpu->C = cpu->Y;
-            cpu->P.Z = (cpu->C == 0);
-            cpu->P.N = ((cpu->C & 0x8000) == 0x8000);
+            cpu->nz = CPU_NZ16(cpu->C);
         }
     }
 
@@ -2860,34 +2804,31 @@ void i_tya(CPU_t *cpu)
     cpu->cycles += 2;
 }
 
-void i_tyx(CPU_t *cpu)
+OPS_DEF void i_tyx(CPU_t *cpu)
 {
-    if (cpu->P.E)
+    if (OPS_E(cpu))
     {
         cpu->X = cpu->Y & 0xff;
-        cpu->P.Z = ((cpu->X & 0xff) == 0);
-        cpu->P.N = ((cpu->X & 0x80) == 0x80);
+        cpu->nz = CPU_NZ8(cpu->X);
     }
     else
     {
-        if (cpu->P.XB)
+        if (OPS_X8(cpu))
         {
             cpu->X = cpu->Y & 0xff;
-            cpu->P.Z = ((cpu->X & 0xff) == 0);
-            cpu->P.N = ((cpu->X & 0x80) == 0x80);
+            cpu->nz = CPU_NZ8(cpu->X);
         }
         else // 16-bit
         {
             cpu->X = cpu->Y;
-            cpu->P.Z = (cpu->X == 0);
-            cpu->P.N = ((cpu->X & 0x8000) == 0x8000);
+            cpu->nz = CPU_NZ16(cpu->X);
         }
     }
     _cpu_update_pc(cpu, 1);
     cpu->cycles += 2;
 }
 
-void i_wai(CPU_t *cpu)
+OPS_DEF void i_wai(CPU_t *cpu)
 {
     if (cpu->P.NMI || cpu->P.IRQ)
     {
@@ -2897,22 +2838,21 @@ void i_wai(CPU_t *cpu)
     }
 }
 
-void i_wdm(CPU_t *cpu)
+OPS_DEF void i_wdm(CPU_t *cpu)
 {
     _cpu_update_pc(cpu, 2);
     cpu->cycles += 2; // http://www.6502.org/tutorials/65c816opcodes.html#6.7
 }
 
-void i_xba(CPU_t *cpu)
+OPS_DEF void i_xba(CPU_t *cpu)
 {
     cpu->C = ((cpu->C << 8) | ((cpu->C >> 8) & 0xff)) & 0xffff;
-    cpu->P.N = cpu->C & 0x80 ? 1 : 0;
-    cpu->P.Z = cpu->C & 0xff ? 0 : 1;
+    cpu->nz = CPU_NZ8(cpu->C);
     _cpu_update_pc(cpu, 1);
     cpu->cycles += 3;
 }
 
-void i_xce(CPU_t *cpu)
+OPS_DEF void i_xce(CPU_t *cpu)
 {
     unsigned char temp = cpu->P.E;
     cpu->P.E = cpu->P.C;
@@ -2930,6 +2870,7 @@ void i_xce(CPU_t *cpu)
         cpu->P.M = 1; // ??? when staying in native mode
         cpu->P.XB = 1; // ??? when staying in native mode
     }
+    _cpu_update_width(cpu);
 
     _cpu_update_pc(cpu, 1);
     cpu->cycles += 2;
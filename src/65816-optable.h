@@ -0,0 +1,273 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+// Opcode table for the table-driven dispatch engine (65816-dispatch.c).
+// This file has no include guard on purpose: it is expanded once per
+// use with the OP_* macros below defined by the includer.
+//
+// Each entry mirrors the matching case of the reference switch in
+// stepCPU() (KEEP IN SYNC with 65816.c):
+//  OP_I(opcode, handler)                              -> handler(cpu)
+//  OP_S(opcode, handler)                              -> handler(cpu, mem)
+//  OP_A(opcode, handler, size, cycles, mode)          -> handler(cpu, mem, size, cycles, mode, 0)
+//  OP_M(opcode, handler, size, cycles, mode, addr_fn) -> handler(cpu, mem, size, cycles, mode, addr_fn(...))
+//  OP_J(opcode, handler, cycles, mode, addr_fn)       -> handler(cpu, mem, cycles, mode, addr_fn(...))
+
+OP_S(0x00, i_brk)
+OP_M(0x01, i_ora, 2, 6, CPU_ADDR_DPINDX, _addrCPU_getDirectPageIndexedIndirectX)
+OP_S(0x02, i_cop)
+OP_M(0x03, i_ora, 2, 4, CPU_ADDR_SR, _addrCPU_getStackRelative)
+OP_M(0x04, i_tsb, 2, 5, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0x05, i_ora, 2, 3, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0x06, i_asl, 2, 5, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0x07, i_ora, 2, 6, CPU_ADDR_DPINDL, _addrCPU_getDirectPageIndirectLong)
+OP_S(0x08, i_php)
+OP_M(0x09, i_ora, 2, 2, CPU_ADDR_IMMD, _addrCPU_getImmediate)
+OP_A(0x0a, i_asl, 1, 2, CPU_ADDR_IMPD)
+OP_S(0x0b, i_phd)
+OP_M(0x0c, i_tsb, 3, 6, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0x0d, i_ora, 3, 4, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0x0e, i_asl, 3, 6, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0x0f, i_ora, 4, 5, CPU_ADDR_ABSL, _addrCPU_getLong)
+OP_S(0x10, i_bpl)
+OP_M(0x11, i_ora, 2, 5, CPU_ADDR_INDDPY, _addrCPU_getDirectPageIndirectIndexedY)
+OP_M(0x12, i_ora, 2, 5, CPU_ADDR_DPIND, _addrCPU_getDirectPageIndirect)
+OP_M(0x13, i_ora, 2, 7, CPU_ADDR_SRINDY, _addrCPU_getStackRelativeIndirectIndexedY)
+OP_M(0x14, i_tsb, 2, 5, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0x15, i_ora, 2, 4, CPU_ADDR_DPX, _addrCPU_getDirectPageIndexedX)
+OP_M(0x16, i_asl, 2, 6, CPU_ADDR_DPX, _addrCPU_getDirectPageIndexedX)
+OP_M(0x17, i_ora, 2, 6, CPU_ADDR_INDDPLY, _addrCPU_getDirectPageIndirectLongIndexedY)
+OP_I(0x18, i_clc)
+OP_M(0x19, i_ora, 3, 4, CPU_ADDR_ABSY, _addrCPU_getAbsoluteIndexedY)
+OP_I(0x1a, i_ina)
+OP_I(0x1b, i_tcs)
+OP_M(0x1c, i_trb, 3, 6, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0x1d, i_ora, 3, 4, CPU_ADDR_ABSX, _addrCPU_getAbsoluteIndexedX)
+OP_M(0x1e, i_asl, 3, 7, CPU_ADDR_ABSX, _addrCPU_getAbsoluteIndexedX)
+OP_M(0x1f, i_ora, 4, 5, CPU_ADDR_ABSLX, _addrCPU_getLongIndexedX)
+OP_J(0x20, i_jsr, 6, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0x21, i_and, 2, 6, CPU_ADDR_DPINDX, _addrCPU_getDirectPageIndexedIndirectX)
+OP_J(0x22, i_jsl, 6, CPU_ADDR_ABS, _addrCPU_getLong)
+OP_M(0x23, i_and, 2, 4, CPU_ADDR_SR, _addrCPU_getStackRelative)
+OP_M(0x24, i_bit, 2, 3, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0x25, i_and, 2, 3, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0x26, i_rol, 2, 5, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0x27, i_and, 2, 6, CPU_ADDR_DPINDL, _addrCPU_getDirectPageIndirectLong)
+OP_S(0x28, i_plp)
+OP_M(0x29, i_and, 2, 2, CPU_ADDR_IMMD, _addrCPU_getImmediate)
+OP_A(0x2a, i_rol, 1, 2, CPU_ADDR_IMPD)
+OP_S(0x2b, i_pld)
+OP_M(0x2c, i_bit, 3, 4, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0x2d, i_and, 3, 4, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0x2e, i_rol, 3, 6, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0x2f, i_and, 4, 5, CPU_ADDR_ABSL, _addrCPU_getLong)
+OP_S(0x30, i_bmi)
+OP_M(0x31, i_and, 2, 5, CPU_ADDR_INDDPY, _addrCPU_getDirectPageIndirectIndexedY)
+OP_M(0x32, i_and, 2, 5, CPU_ADDR_DPIND, _addrCPU_getDirectPageIndirect)
+OP_M(0x33, i_and, 2, 7, CPU_ADDR_SRINDY, _addrCPU_getStackRelativeIndirectIndexedY)
+OP_M(0x34, i_bit, 2, 4, CPU_ADDR_DPX, _addrCPU_getDirectPageIndexedX)
+OP_M(0x35, i_and, 2, 4, CPU_ADDR_DPX, _addrCPU_getDirectPageIndexedX)
+OP_M(0x36, i_rol, 2, 6, CPU_ADDR_DPX, _addrCPU_getDirectPageIndexedX)
+OP_M(0x37, i_and, 2, 6, CPU_ADDR_INDDPLY, _addrCPU_getDirectPageIndirectLongIndexedY)
+OP_I(0x38, i_sec)
+OP_M(0x39, i_and, 3, 4, CPU_ADDR_ABSY, _addrCPU_getAbsoluteIndexedY)
+OP_I(0x3a, i_dea)
+OP_I(0x3b, i_tsc)
+OP_M(0x3c, i_bit, 3, 4, CPU_ADDR_ABSX, _addrCPU_getAbsoluteIndexedX)
+OP_M(0x3d, i_and, 3, 4, CPU_ADDR_ABSX, _addrCPU_getAbsoluteIndexedX)
+OP_M(0x3e, i_rol, 3, 7, CPU_ADDR_ABSX, _addrCPU_getAbsoluteIndexedX)
+OP_M(0x3f, i_and, 4, 5, CPU_ADDR_ABSLX, _addrCPU_getLongIndexedX)
+OP_S(0x40, i_rti)
+OP_M(0x41, i_eor, 2, 6, CPU_ADDR_DPINDX, _addrCPU_getDirectPageIndexedIndirectX)
+OP_I(0x42, i_wdm)
+OP_M(0x43, i_eor, 2, 4, CPU_ADDR_SR, _addrCPU_getStackRelative)
+OP_S(0x44, i_mvp)
+OP_M(0x45, i_eor, 2, 3, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0x46, i_lsr, 2, 5, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0x47, i_eor, 2, 6, CPU_ADDR_DPINDL, _addrCPU_getDirectPageIndirectLong)
+OP_S(0x48, i_pha)
+OP_M(0x49, i_eor, 2, 2, CPU_ADDR_IMMD, _addrCPU_getImmediate)
+OP_A(0x4a, i_lsr, 1, 2, CPU_ADDR_IMPD)
+OP_S(0x4b, i_phk)
+OP_J(0x4c, i_jmp, 3, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0x4d, i_eor, 3, 4, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0x4e, i_lsr, 3, 6, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0x4f, i_eor, 4, 5, CPU_ADDR_ABSL, _addrCPU_getLong)
+OP_S(0x50, i_bvc)
+OP_M(0x51, i_eor, 2, 5, CPU_ADDR_INDDPY, _addrCPU_getDirectPageIndexedY)
+OP_M(0x52, i_eor, 2, 5, CPU_ADDR_DPIND, _addrCPU_getDirectPageIndirect)
+OP_M(0x53, i_eor, 2, 7, CPU_ADDR_SRINDY, _addrCPU_getStackRelativeIndirectIndexedY)
+OP_S(0x54, i_mvn)
+OP_M(0x55, i_eor, 2, 4, CPU_ADDR_DPX, _addrCPU_getDirectPageIndexedX)
+OP_M(0x56, i_lsr, 2, 5, CPU_ADDR_DPX, _addrCPU_getDirectPageIndexedX)
+OP_M(0x57, i_eor, 2, 6, CPU_ADDR_INDDPLY, _addrCPU_getDirectPageIndirectLongIndexedY)
+OP_I(0x58, i_cli)
+OP_M(0x59, i_eor, 3, 4, CPU_ADDR_ABSY, _addrCPU_getAbsoluteIndexedY)
+OP_S(0x5a, i_phy)
+OP_I(0x5b, i_tcd)
+OP_J(0x5c, i_jmp, 4, CPU_ADDR_ABSL, _addrCPU_getLong)
+OP_M(0x5d, i_eor, 3, 4, CPU_ADDR_ABSX, _addrCPU_getAbsoluteIndexedX)
+OP_M(0x5e, i_lsr, 3, 7, CPU_ADDR_ABSX, _addrCPU_getAbsoluteIndexedX)
+OP_M(0x5f, i_eor, 4, 5, CPU_ADDR_ABSLX, _addrCPU_getLongIndexedX)
+OP_S(0x60, i_rts)
+OP_M(0x61, i_adc, 2, 6, CPU_ADDR_DPINDX, _addrCPU_getDirectPageIndexedIndirectX)
+OP_S(0x62, i_per)
+OP_M(0x63, i_adc, 2, 4, CPU_ADDR_SR, _addrCPU_getStackRelative)
+OP_M(0x64, i_stz, 2, 3, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0x65, i_adc, 2, 3, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0x66, i_ror, 2, 5, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0x67, i_adc, 2, 6, CPU_ADDR_DPINDL, _addrCPU_getDirectPageIndirectLong)
+OP_S(0x68, i_pla)
+OP_M(0x69, i_adc, 2, 2, CPU_ADDR_IMMD, _addrCPU_getImmediate)
+OP_A(0x6a, i_ror, 1, 2, CPU_ADDR_IMPD)
+OP_S(0x6b, i_rtl)
+OP_J(0x6c, i_jmp, 5, CPU_ADDR_INDABS, _addrCPU_getAbsoluteIndirect)
+OP_M(0x6d, i_adc, 3, 4, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0x6e, i_ror, 3, 6, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0x6f, i_adc, 4, 5, CPU_ADDR_ABSL, _addrCPU_getLong)
+OP_S(0x70, i_bvs)
+OP_M(0x71, i_adc, 2, 5, CPU_ADDR_INDDPY, _addrCPU_getDirectPageIndirectIndexedY)
+OP_M(0x72, i_adc, 2, 5, CPU_ADDR_DPIND, _addrCPU_getDirectPageIndirect)
+OP_M(0x73, i_adc, 2, 7, CPU_ADDR_SRINDY, _addrCPU_getStackRelativeIndirectIndexedY)
+OP_M(0x74, i_stz, 2, 4, CPU_ADDR_DPX, _addrCPU_getDirectPageIndexedX)
+OP_M(0x75, i_adc, 2, 4, CPU_ADDR_DPINDX, _addrCPU_getDirectPageIndexedX)
+OP_M(0x76, i_ror, 3, 6, CPU_ADDR_DPX, _addrCPU_getDirectPageIndexedX)
+OP_M(0x77, i_adc, 2, 6, CPU_ADDR_INDDPLY, _addrCPU_getDirectPageIndirectLongIndexedY)
+OP_I(0x78, i_sei)
+OP_M(0x79, i_adc, 3, 4, CPU_ADDR_ABSY, _addrCPU_getAbsoluteIndexedY)
+OP_S(0x7a, i_ply)
+OP_I(0x7b, i_tdc)
+OP_J(0x7c, i_jmp, 6, CPU_ADDR_ABSINDX, _addrCPU_getAbsoluteIndexedIndirectX)
+OP_M(0x7d, i_adc, 3, 4, CPU_ADDR_ABSX, _addrCPU_getAbsoluteIndexedX)
+OP_M(0x7e, i_ror, 3, 7, CPU_ADDR_ABSX, _addrCPU_getAbsoluteIndexedX)
+OP_M(0x7f, i_adc, 4, 5, CPU_ADDR_ABSLX, _addrCPU_getLongIndexedX)
+OP_S(0x80, i_bra)
+OP_M(0x81, i_sta, 2, 6, CPU_ADDR_DPINDX, _addrCPU_getDirectPageIndexedIndirectX)
+OP_S(0x82, i_brl)
+OP_M(0x83, i_sta, 2, 4, CPU_ADDR_SR, _addrCPU_getStackRelative)
+OP_M(0x84, i_sty, 2, 3, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0x85, i_sta, 2, 3, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0x86, i_stx, 2, 3, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0x87, i_sta, 2, 6, CPU_ADDR_DPINDL, _addrCPU_getDirectPageIndirectLong)
+OP_I(0x88, i_dey)
+OP_M(0x89, i_bit, 2, 2, CPU_ADDR_IMMD, _addrCPU_getImmediate)
+OP_I(0x8a, i_txa)
+OP_S(0x8b, i_phb)
+OP_M(0x8c, i_sty, 3, 4, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0x8d, i_sta, 3, 4, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0x8e, i_stx, 3, 4, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0x8f, i_sta, 4, 5, CPU_ADDR_ABSL, _addrCPU_getLong)
+OP_S(0x90, i_bcc)
+OP_M(0x91, i_sta, 2, 6, CPU_ADDR_INDDPY, _addrCPU_getDirectPageIndirectIndexedY)
+OP_M(0x92, i_sta, 2, 5, CPU_ADDR_DPIND, _addrCPU_getDirectPageIndexedY)
+OP_M(0x93, i_sta, 2, 7, CPU_ADDR_SRINDY, _addrCPU_getStackRelativeIndirectIndexedY)
+OP_M(0x94, i_sty, 2, 4, CPU_ADDR_DPX, _addrCPU_getDirectPageIndexedX)
+OP_M(0x95, i_sta, 2, 4, CPU_ADDR_DPX, _addrCPU_getDirectPageIndexedX)
+OP_M(0x96, i_stx, 2, 4, CPU_ADDR_DPY, _addrCPU_getDirectPageIndexedY)
+OP_M(0x97, i_sta, 2, 6, CPU_ADDR_INDDPLY, _addrCPU_getDirectPageIndirectLongIndexedY)
+OP_I(0x98, i_tya)
+OP_M(0x99, i_sta, 3, 5, CPU_ADDR_ABSY, _addrCPU_getAbsoluteIndexedY)
+OP_I(0x9a, i_txs)
+OP_I(0x9b, i_txy)
+OP_M(0x9c, i_stz, 3, 4, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0x9d, i_sta, 3, 5, CPU_ADDR_ABSX, _addrCPU_getAbsoluteIndexedX)
+OP_M(0x9e, i_stz, 3, 5, CPU_ADDR_ABSX, _addrCPU_getAbsoluteIndexedX)
+OP_M(0x9f, i_sta, 4, 5, CPU_ADDR_ABSLX, _addrCPU_getLongIndexedX)
+OP_M(0xa0, i_ldy, 2, 2, CPU_ADDR_IMMD, _addrCPU_getImmediate)
+OP_M(0xa1, i_lda, 2, 6, CPU_ADDR_DPINDX, _addrCPU_getDirectPageIndexedIndirectX)
+OP_M(0xa2, i_ldx, 2, 2, CPU_ADDR_IMMD, _addrCPU_getImmediate)
+OP_M(0xa3, i_lda, 2, 4, CPU_ADDR_SR, _addrCPU_getStackRelative)
+OP_M(0xa4, i_ldy, 2, 3, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0xa5, i_lda, 2, 3, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0xa6, i_ldx, 2, 3, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0xa7, i_lda, 2, 6, CPU_ADDR_DPINDL, _addrCPU_getDirectPageIndirectLong)
+OP_I(0xa8, i_tay)
+OP_M(0xa9, i_lda, 2, 2, CPU_ADDR_IMMD, _addrCPU_getImmediate)
+OP_I(0xaa, i_tax)
+OP_S(0xab, i_plb)
+OP_M(0xac, i_ldy, 3, 4, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0xad, i_lda, 3, 4, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0xae, i_ldx, 3, 4, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0xaf, i_lda, 4, 5, CPU_ADDR_ABSL, _addrCPU_getLong)
+OP_S(0xb0, i_bcs)
+OP_M(0xb1, i_lda, 2, 5, CPU_ADDR_INDDPY, _addrCPU_getDirectPageIndirectIndexedY)
+OP_M(0xb2, i_lda, 2, 5, CPU_ADDR_DPIND, _addrCPU_getDirectPageIndirect)
+OP_M(0xb3, i_lda, 2, 7, CPU_ADDR_SRINDY, _addrCPU_getStackRelativeIndirectIndexedY)
+OP_M(0xb4, i_ldy, 2, 4, CPU_ADDR_DPX, _addrCPU_getDirectPageIndexedX)
+OP_M(0xb5, i_lda, 2, 4, CPU_ADDR_DPX, _addrCPU_getDirectPageIndexedX)
+OP_M(0xb6, i_ldx, 2, 4, CPU_ADDR_DPY, _addrCPU_getDirectPageIndexedY)
+OP_M(0xb7, i_lda, 2, 6, CPU_ADDR_INDDPLY, _addrCPU_getDirectPageIndirectLongIndexedY)
+OP_I(0xb8, i_clv)
+OP_M(0xb9, i_lda, 3, 4, CPU_ADDR_ABSY, _addrCPU_getAbsoluteIndexedY)
+OP_I(0xba, i_tsx)
+OP_I(0xbb, i_tyx)
+OP_M(0xbc, i_ldy, 3, 4, CPU_ADDR_ABSX, _addrCPU_getAbsoluteIndexedX)
+OP_M(0xbd, i_lda, 3, 4, CPU_ADDR_ABSX, _addrCPU_getAbsoluteIndexedX)
+OP_M(0xbe, i_ldx, 3, 4, CPU_ADDR_ABSY, _addrCPU_getAbsoluteIndexedY)
+OP_M(0xbf, i_lda, 4, 5, CPU_ADDR_ABSLX, _addrCPU_getLongIndexedX)
+OP_M(0xc0, i_cpy, 2, 2, CPU_ADDR_IMMD, _addrCPU_getImmediate)
+OP_M(0xc1, i_cmp, 2, 6, CPU_ADDR_DPINDX, _addrCPU_getDirectPageIndexedIndirectX)
+OP_S(0xc2, i_rep)
+OP_M(0xc3, i_cmp, 2, 4, CPU_ADDR_SR, _addrCPU_getStackRelative)
+OP_M(0xc4, i_cpy, 2, 3, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0xc5, i_cmp, 2, 3, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0xc6, i_dec, 2, 5, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0xc7, i_cmp, 2, 6, CPU_ADDR_DPINDL, _addrCPU_getDirectPageIndirectLong)
+OP_I(0xc8, i_iny)
+OP_M(0xc9, i_cmp, 2, 2, CPU_ADDR_IMMD, _addrCPU_getImmediate)
+OP_I(0xca, i_dex)
+OP_I(0xcb, i_wai)
+OP_M(0xcc, i_cpy, 3, 4, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0xcd, i_cmp, 3, 4, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0xce, i_dec, 3, 6, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0xcf, i_cmp, 4, 5, CPU_ADDR_ABSL, _addrCPU_getLong)
+OP_S(0xd0, i_bne)
+OP_M(0xd1, i_cmp, 2, 5, CPU_ADDR_INDDPY, _addrCPU_getDirectPageIndirectIndexedY)
+OP_M(0xd2, i_cmp, 2, 5, CPU_ADDR_DPIND, _addrCPU_getDirectPageIndirect)
+OP_M(0xd3, i_cmp, 2, 7, CPU_ADDR_SRINDY, _addrCPU_getStackRelativeIndirectIndexedY)
+OP_S(0xd4, i_pei)
+OP_M(0xd5, i_cmp, 2, 4, CPU_ADDR_DPX, _addrCPU_getDirectPageIndexedX)
+OP_M(0xd6, i_dec, 2, 6, CPU_ADDR_DPX, _addrCPU_getDirectPageIndexedX)
+OP_M(0xd7, i_cmp, 2, 6, CPU_ADDR_INDDPLY, _addrCPU_getDirectPageIndirectLongIndexedY)
+OP_I(0xd8, i_cld)
+OP_M(0xd9, i_cmp, 3, 4, CPU_ADDR_ABSY, _addrCPU_getAbsoluteIndexedY)
+OP_S(0xda, i_phx)
+OP_I(0xdb, i_stp)
+OP_J(0xdc, i_jmp, 6, CPU_ADDR_ABSINDL, _addrCPU_getAbsoluteIndirectLong)
+OP_M(0xdd, i_cmp, 3, 4, CPU_ADDR_ABSX, _addrCPU_getAbsoluteIndexedX)
+OP_M(0xde, i_dec, 3, 7, CPU_ADDR_ABSX, _addrCPU_getAbsoluteIndexedX)
+OP_M(0xdf, i_cmp, 4, 5, CPU_ADDR_ABSLX, _addrCPU_getLongIndexedX)
+OP_M(0xe0, i_cpx, 2, 2, CPU_ADDR_IMMD, _addrCPU_getImmediate)
+OP_M(0xe1, i_sbc, 2, 6, CPU_ADDR_DPINDX, _addrCPU_getDirectPageIndexedIndirectX)
+OP_S(0xe2, i_sep)
+OP_M(0xe3, i_sbc, 2, 4, CPU_ADDR_SR, _addrCPU_getStackRelative)
+OP_M(0xe4, i_cpx, 2, 3, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0xe5, i_sbc, 2, 3, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0xe6, i_inc, 2, 5, CPU_ADDR_DP, _addrCPU_getDirectPage)
+OP_M(0xe7, i_sbc, 2, 6, CPU_ADDR_DPINDL, _addrCPU_getDirectPageIndirectLong)
+OP_I(0xe8, i_inx)
+OP_M(0xe9, i_sbc, 2, 2, CPU_ADDR_IMMD, _addrCPU_getImmediate)
+OP_I(0xea, i_nop)
+OP_I(0xeb, i_xba)
+OP_M(0xec, i_cpx, 3, 4, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0xed, i_sbc, 3, 4, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0xee, i_inc, 3, 6, CPU_ADDR_ABS, _addrCPU_getAbsolute)
+OP_M(0xef, i_sbc, 4, 5, CPU_ADDR_ABSL, _addrCPU_getLong)
+OP_S(0xf0, i_beq)
+OP_M(0xf1, i_sbc, 2, 5, CPU_ADDR_INDDPY, _addrCPU_getDirectPageIndirectIndexedY)
+OP_M(0xf2, i_sbc, 2, 5, CPU_ADDR_DPIND, _addrCPU_getDirectPageIndirect)
+OP_M(0xf3, i_sbc, 2, 7, CPU_ADDR_SRINDY, _addrCPU_getStackRelativeIndirectIndexedY)
+OP_S(0xf4, i_pea)
+OP_M(0xf5, i_sbc, 2, 4, CPU_ADDR_DPX, _addrCPU_getDirectPageIndexedX)
+OP_M(0xf6, i_inc, 2, 6, CPU_ADDR_DPX, _addrCPU_getDirectPageIndexedX)
+OP_M(0xf7, i_sbc, 2, 6, CPU_ADDR_INDDPLY, _addrCPU_getDirectPageIndirectLongIndexedY)
+OP_I(0xf8, i_sed)
+OP_M(0xf9, i_sbc, 3, 4, CPU_ADDR_ABSY, _addrCPU_getAbsoluteIndexedY)
+OP_S(0xfa, i_plx)
+OP_I(0xfb, i_xce)
+OP_J(0xfc, i_jsr, 8, CPU_ADDR_ABS, _addrCPU_getAbsoluteIndexedIndirectX)
+OP_M(0xfd, i_sbc, 3, 4, CPU_ADDR_ABSX, _addrCPU_getAbsoluteIndexedX)
+OP_M(0xfe, i_inc, 3, 7, CPU_ADDR_ABSX, _addrCPU_getAbsoluteIndexedX)
+OP_M(0xff, i_sbc, 4, 5, CPU_ADDR_ABSLX, _addrCPU_getLongIndexedX)
@@ -4,8 +4,31 @@
  */
 
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "65816-util.h"
+#include "prof.h"
+
+// Instruction lengths by opcode, m/x = immediate operand with the
+// width of the accumulator/index registers
+static const char cpu_inst_len[256 + 1] =
+    "222222221m113334" // 0x
+    "2222222213113334" // 1x
+    "324222221m113334" // 2x
+    "2222222213113334" // 3x
+    "122232221m113334" // 4x
+    "2222322213114334" // 5x
+    "123222221m113334" // 6x
+    "2222222213113334" // 7x
+    "223222221m113334" // 8x
+    "2222222213113334" // 9x
+    "x2x222221m113334" // ax
+    "2222222213113334" // bx
+    "x22222221m113334" // cx
+    "2222222213113334" // dx
+    "x22222221m113334" // ex
+    "2222322213113334";// fx
 
 /**
  * Add a value to the given CPU's PC (Bank wraps)
@@ -24,7 +47,11 @@ void _cpu_update_pc(CPU_t *cpu, uint16_t offset)
  */
 uint8_t _cpu_get_sr(CPU_t *cpu)
 {
-    return *(uint8_t *) &(cpu->P);
+    uint8_t sr = *(uint8_t *) &(cpu->P) & 0x7d;
+
+    sr |= CPU_NZ_GET_N(cpu->nz) ? 0x80 : 0;
+    sr |= CPU_NZ_GET_Z(cpu->nz) ? 0x02 : 0;
+    return sr;
 }
 
 /**
@@ -35,6 +62,29 @@ uint8_t _cpu_get_sr(CPU_t *cpu)
 void _cpu_set_sr(CPU_t *cpu, uint8_t sr)
 {
     *(uint8_t *) &(cpu->P) = sr;
+    cpu->nz = CPU_NZ(sr & 0x80, sr & 0x02);
+    _cpu_update_width(cpu);
+}
+
+/**
+ * Recalculate which register width mode the CPU is in.
+ * This must be called whenever the E, M or X flags are changed.
+ * @param cpu The CPU to update
+ */
+void _cpu_update_width(CPU_t *cpu)
+{
+    if (cpu->P.E)
+    {
+        cpu->width_mode = CPU_WIDTH_E;
+    }
+    else if (cpu->P.M)
+    {
+        cpu->width_mode = cpu->P.XB ? CPU_WIDTH_M8X8 : CPU_WIDTH_M8X16;
+    }
+    else
+    {
+        cpu->width_mode = cpu->P.XB ? CPU_WIDTH_M16X8 : CPU_WIDTH_M16X16;
+    }
 }
 
 /**
@@ -86,8 +136,75 @@ uint32_t _cpu_get_effective_pc(CPU_t *cpu)
     return _cpu_get_pbr(cpu) | cpu->PC;
 }
 
+/**
+ * Get the length of an instruction
+ * @param op The opcode
+ * @param width_mode The register width mode (CPU_Width_Mode_t) it runs in
+ * @return The length in bytes including the opcode
+ */
+uint32_t _cpu_get_inst_len(uint8_t op, uint8_t width_mode)
+{
+    switch (cpu_inst_len[op])
+    {
+    case 'm':
+        return width_mode == CPU_WIDTH_M16X8 || width_mode == CPU_WIDTH_M16X16 ? 3 : 2;
+    case 'x':
+        return width_mode == CPU_WIDTH_M8X16 || width_mode == CPU_WIDTH_M16X16 ? 3 : 2;
+    default:
+        return cpu_inst_len[op] - '0';
+    }
+}
+
+/**
+ * Get the number of bytes a block move step can copy at once: the
+ * rest of the block, up to the end of the bank of either index
+ * register (they wrap within the bank) and at most CPU_MV_CHUNK.
+ * The step also ends after a byte of the instruction itself is
+ * overwritten, since it is fetched again for the next byte.
+ * @param cpu The CPU running the block move
+ * @param dst_bank The destination bank operand of the instruction
+ * @param down True for MVP (X and Y decrement), false for MVN
+ * @return The number of bytes to move (at least 1)
+ */
+uint32_t _cpu_get_mv_count(CPU_t *cpu, uint8_t dst_bank, bool down)
+{
+    uint32_t count = (uint32_t)cpu->C + 1;
+    uint32_t x_room = down ? (uint32_t)cpu->X + 1 : 0x10000 - cpu->X;
+    uint32_t y_room = down ? (uint32_t)cpu->Y + 1 : 0x10000 - cpu->Y;
+
+    if (count > x_room)
+    {
+        count = x_room;
+    }
+    if (count > y_room)
+    {
+        count = y_room;
+    }
+    if (count > CPU_MV_CHUNK)
+    {
+        count = CPU_MV_CHUNK;
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        uint32_t addr = _addr_add_val_bank_wrap(_cpu_get_effective_pc(cpu), i);
+        uint16_t offs = (addr & 0xffff) - cpu->Y;
+
+        if (down)
+        {
+            offs = cpu->Y - (addr & 0xffff);
+        }
+        if ((addr >> 16) == dst_bank && offs < count)
+        {
+            count = offs + 1;
+        }
+    }
+    return count;
+}
+
 /**
  * Get the byte in memory at the address CPU PC+1
+ * (from the instruction cache if the CPU is running a cached instruction)
  * @note This will BANK WRAP
  * @param cpu The CPU from which to retrieve the PC
  * @param mem The memory from which to pull the value
@@ -96,6 +213,11 @@ uint32_t _cpu_get_effective_pc(CPU_t *cpu)
  */
 uint8_t _cpu_get_immd_byte(CPU_t *cpu, memory_t *mem, bool setacc)
 {
+    if (cpu->predecoded)
+    {
+        return (uint8_t)cpu->operand;
+    }
+
     uint32_t addr = _cpu_get_effective_pc(cpu);
     addr = _addr_add_val_bank_wrap(addr, 1);
     return _get_mem_byte(mem, addr, setacc);
@@ -111,6 +233,11 @@ uint8_t _cpu_get_immd_byte(CPU_t *cpu, memory_t *mem, bool setacc)
  */
 uint16_t _cpu_get_immd_word(CPU_t *cpu, memory_t *mem, bool setacc)
 {
+    if (cpu->predecoded)
+    {
+        return (uint16_t)cpu->operand;
+    }
+
     uint32_t addr = _cpu_get_effective_pc(cpu);
     addr = _addr_add_val_bank_wrap(addr, 1);
     uint16_t val = _get_mem_byte(mem, addr, setacc);
@@ -128,6 +255,11 @@ uint16_t _cpu_get_immd_word(CPU_t *cpu, memory_t *mem, bool setacc)
  */
 uint32_t _cpu_get_immd_long(CPU_t *cpu, memory_t *mem, bool setacc)
 {
+    if (cpu->predecoded)
+    {
+        return cpu->operand & 0xffffff;
+    }
+
     uint32_t addr = _cpu_get_effective_pc(cpu);
     addr = _addr_add_val_bank_wrap(addr, 1);
     uint32_t val = _get_mem_byte(mem, addr, setacc);
@@ -170,19 +302,656 @@ void _cpu_crash(CPU_t *cpu)
     cpu->P.CRASH = 1;
 }
 
+/**
+ * Enter the handler of a pending interrupt: the NMI if one is
+ * pending, else the IRQ if it is asserted and not masked
+ * @note Called after each instruction (see _stepCPU())
+ * @param cpu The CPU to interrupt
+ * @param mem The memory array which is connected to the CPU
+ */
+void _cpu_interrupt(CPU_t *cpu, memory_t *mem)
+{
+    if (cpu->P.NMI)
+    {
+        cpu->P.NMI = 0;
+
+        if (cpu->P.E)
+        {
+            _stackCPU_pushWord(cpu, mem, cpu->PC, CPU_ESTACK_ENABLE, cpu->setacc);
+            _stackCPU_pushByte(cpu, mem, _cpu_get_sr(cpu) & 0xef, cpu->setacc); // B gets reset on the stack
+            cpu->PC = _get_mem_byte(mem, CPU_VEC_EMU_NMI, cpu->setacc);
+            cpu->PC |= _get_mem_byte(mem, CPU_VEC_EMU_NMI + 1, cpu->setacc) << 8;
+            cpu->PBR = 0;
+            cpu->cycles += 7;
+        }
+        else
+        {
+            _stackCPU_push24(cpu, mem, _cpu_get_effective_pc(cpu), cpu->setacc);
+            _stackCPU_pushByte(cpu, mem, _cpu_get_sr(cpu), cpu->setacc);
+            cpu->PC = _get_mem_byte(mem, CPU_VEC_NATIVE_NMI, cpu->setacc);
+            cpu->PC |= _get_mem_byte(mem, CPU_VEC_NATIVE_NMI + 1, cpu->setacc) << 8;
+            cpu->PBR = 0;
+            cpu->cycles += 8;
+        }
+
+        cpu->P.D = 0; // Binary mode (65C02)
+        // cpu->P.I = 1; // IRQ flag is not set: https://softpixel.com/~cwright/sianse/docs/65816NFO.HTM#7.00
+
+        if (cpu->prof)
+        {
+            prof_call(cpu->prof, cpu, cpu->P.E ? 3 : 4, PROF_NMI);
+        }
+        return;
+    }
+    if (cpu->P.IRQ && !cpu->P.I)
+    {
+        cpu->P.IRQ = 0; // Not actually how the '816 works, but being "edge triggered" is convenient for the sim
+
+        if (cpu->P.E)
+        {
+            _stackCPU_pushWord(cpu, mem, cpu->PC, CPU_ESTACK_ENABLE, cpu->setacc);
+            _stackCPU_pushByte(cpu, mem, _cpu_get_sr(cpu) & 0xef, cpu->setacc); // B gets reset on the stack
+            cpu->PC = _get_mem_byte(mem, CPU_VEC_EMU_IRQ, cpu->setacc);
+            cpu->PC |= _get_mem_byte(mem, CPU_VEC_EMU_IRQ + 1, cpu->setacc) << 8;
+            cpu->PBR = 0;
+            cpu->cycles += 7;
+        }
+        else
+        {
+            _stackCPU_push24(cpu, mem, _cpu_get_effective_pc(cpu), cpu->setacc);
+            _stackCPU_pushByte(cpu, mem, _cpu_get_sr(cpu), cpu->setacc);
+            cpu->PC = _get_mem_byte(mem, CPU_VEC_NATIVE_IRQ, cpu->setacc);
+            cpu->PC |= _get_mem_byte(mem, CPU_VEC_NATIVE_IRQ + 1, cpu->setacc) << 8;
+            cpu->PBR = 0;
+            cpu->cycles += 8;
+        }
+
+        cpu->P.D = 0; // Binary mode (65C02)
+        cpu->P.I = 1;
+
+        if (cpu->prof)
+        {
+            prof_call(cpu->prof, cpu, cpu->P.E ? 3 : 4, PROF_IRQ);
+        }
+    }
+}
+
+// A page of a checkpoint, shared by all checkpoints it is the same in
+typedef struct mem_ckpt_page_t {
+    uint32_t refs;
+    uint8_t data[MEM_PAGE_SIZE];
+} mem_ckpt_page_t;
+
+// MEM_CKPT_CHUNK_PAGES pages of a checkpoint (NULL = untouched), shared
+// by all checkpoints none of them changed in, so a checkpoint only
+// takes a reference to each chunk rather than to each page
+typedef struct mem_ckpt_chunk_t {
+    uint32_t refs;
+    mem_ckpt_page_t *page[MEM_CKPT_CHUNK_PAGES];
+} mem_ckpt_chunk_t;
+
+/**
+ * Check if a page may have changed since the last checkpoint
+ * @param mem The memory to check
+ * @param page_num The page
+ * @return True if it is dirty
+ */
+static inline bool _mem_is_dirty(const memory_t *mem, uint32_t page_num)
+{
+    return mem->dirty[page_num / MEM_CKPT_CHUNK_PAGES] & (1ull << (page_num % MEM_CKPT_CHUNK_PAGES));
+}
+
+/**
+ * Mark a page as changed since the last checkpoint
+ * @param mem The memory to modify
+ * @param page_num The page
+ */
+static inline void _mem_set_dirty(memory_t *mem, uint32_t page_num)
+{
+    mem->dirty[page_num / MEM_CKPT_CHUNK_PAGES] |= 1ull << (page_num % MEM_CKPT_CHUNK_PAGES);
+}
+
+/**
+ * Mark every untouched page as changed since the last checkpoint (e.g.
+ * when what they read as changes)
+ * @param mem The memory to modify
+ */
+static void _mem_dirty_untouched(memory_t *mem)
+{
+    for (uint32_t i = 0; i < MEM_PAGE_COUNT; ++i) {
+        if (!mem->page[i]) {
+            _mem_set_dirty(mem, i);
+        }
+    }
+}
+
+/**
+ * Drop a reference to a page of a checkpoint
+ * @param page The page (NULL is ignored)
+ */
+static void _mem_ckpt_page_release(mem_ckpt_page_t *page)
+{
+    if (page && --page->refs == 0) {
+        free(page);
+    }
+}
+
+/**
+ * Drop a reference to a chunk of a checkpoint, and to its pages if it
+ * was the last one
+ * @param chunk The chunk (NULL is ignored)
+ */
+static void _mem_ckpt_chunk_release(mem_ckpt_chunk_t *chunk)
+{
+    if (chunk && --chunk->refs == 0) {
+        for (int i = 0; i < MEM_CKPT_CHUNK_PAGES; ++i) {
+            _mem_ckpt_page_release(chunk->page[i]);
+        }
+        free(chunk);
+    }
+}
+
+/**
+ * Allocate the page tables of a system memory
+ * @note No pages are allocated until they are written to. Until
+ *       then, all data bytes read as 0 (see _set_mem_fill())
+ * @param mem The memory to initialize
+ * @param track True to record R/W access flags for CPUs with setacc
+ * @return True if the memory was allocated, false otherwise
+ */
+bool _init_mem(memory_t *mem, bool track)
+{
+    mem->rd = malloc(MEM_PAGE_COUNT * sizeof(*mem->rd));
+    mem->wr = calloc(MEM_PAGE_COUNT, sizeof(*mem->wr));
+    mem->page = calloc(MEM_PAGE_COUNT, sizeof(*mem->page));
+    mem->fill_page = calloc(MEM_PAGE_SIZE, sizeof(*mem->fill_page));
+    mem->flags = calloc(MEM_PAGE_COUNT, sizeof(*mem->flags));
+    mem->watch = calloc(MEM_PAGE_COUNT, sizeof(*mem->watch));
+    mem->dirty = calloc(MEM_CKPT_CHUNKS, sizeof(*mem->dirty));
+    mem->synced = calloc(MEM_CKPT_CHUNKS, sizeof(*mem->synced));
+    mem->gen = 0;
+    mem->track = track;
+    mem->fill = 0;
+    mem->io_count = 0;
+    memset(mem->watchers, 0, sizeof(mem->watchers));
+    mem->base = NULL;
+
+    if (!mem->rd || !mem->wr || !mem->page || !mem->fill_page || !mem->flags || !mem->watch ||
+        !mem->dirty || !mem->synced) {
+        _free_mem(mem);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < MEM_PAGE_COUNT; ++i) {
+        mem->rd[i] = mem->fill_page;
+    }
+    return true;
+}
+
+/**
+ * Free a system memory and all of its pages
+ * @param mem The memory to free
+ */
+void _free_mem(memory_t *mem)
+{
+    for (uint32_t i = 0; i < MEM_PAGE_COUNT; ++i) {
+        if (mem->page) {
+            free(mem->page[i]);
+        }
+        if (mem->flags) {
+            free(mem->flags[i]);
+        }
+    }
+    for (uint32_t i = 0; i < MEM_CKPT_CHUNKS && mem->synced; ++i) {
+        _mem_ckpt_chunk_release(mem->synced[i]);
+    }
+    free(mem->rd);
+    free(mem->wr);
+    free(mem->page);
+    free(mem->fill_page);
+    free(mem->flags);
+    free(mem->watch);
+    free(mem->dirty);
+    free(mem->synced);
+    mem->rd = NULL;
+    mem->wr = NULL;
+    mem->page = NULL;
+    mem->fill_page = NULL;
+    mem->flags = NULL;
+    mem->watch = NULL;
+    mem->dirty = NULL;
+    mem->synced = NULL;
+    mem->io_count = 0;
+}
+
+/**
+ * Set the value which is read from pages that have not been
+ * written to yet (e.g., to emulate an open bus)
+ * @note Only affects pages which are still untouched
+ * @param mem The memory to modify
+ * @param fill The new fill value
+ */
+void _set_mem_fill(memory_t *mem, uint8_t fill)
+{
+    mem->fill = fill;
+    memset(mem->fill_page, fill, MEM_PAGE_SIZE);
+    _mem_dirty_untouched(mem);
+}
+
+/**
+ * Find the I/O region containing an address
+ * @param mem The memory to search
+ * @param addr The address to find
+ * @return The region, or NULL if the address is not memory mapped I/O
+ */
+static mem_io_t *_mem_find_io(memory_t *mem, uint32_t addr)
+{
+    for (int i = 0; i < mem->io_count; ++i) {
+        if (addr >= mem->io[i].start && addr <= mem->io[i].end) {
+            return &mem->io[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Get the data an untouched page reads as: the page of the base
+ * memory if it has one (see _share_mem()), or else the fill page
+ * @param mem The memory to use
+ * @param page_num The page
+ * @return The data of the page
+ */
+static uint8_t *_mem_clean_page(memory_t *mem, uint32_t page_num)
+{
+    if (mem->base && mem->base->page[page_num]) {
+        return mem->base->page[page_num];
+    }
+    return mem->fill_page;
+}
+
+/**
+ * Recompute the fast access pointers of a page
+ * @param mem The memory to update
+ * @param page_num The page to update
+ */
+static void _mem_update_page(memory_t *mem, uint32_t page_num)
+{
+    uint32_t start = page_num << MEM_PAGE_BITS;
+    uint32_t end = start + MEM_PAGE_MASK;
+
+    for (int i = 0; i < mem->io_count; ++i) {
+        if (mem->io[i].start <= end && mem->io[i].end >= start) {
+            // I/O page, everything takes the slow path
+            mem->rd[page_num] = NULL;
+            mem->wr[page_num] = NULL;
+            return;
+        }
+    }
+
+    if (mem->page[page_num]) {
+        // A clean page takes the slow path once, to mark it dirty
+        mem->rd[page_num] = mem->page[page_num];
+        mem->wr[page_num] = mem->watch[page_num] || !_mem_is_dirty(mem, page_num) ? NULL : mem->page[page_num];
+    }
+    else {
+        mem->rd[page_num] = _mem_clean_page(mem, page_num);
+        mem->wr[page_num] = NULL;
+    }
+}
+
+/**
+ * Let a memory read the pages of a base memory (e.g. a ROM image
+ * loaded once) wherever it has not been written itself. The first
+ * write to such a page gives the memory its own copy of it, so many
+ * memories can share one base, even from several threads.
+ * @note The base must not be written to (or freed) while it is shared,
+ *       and only its data pages are shared (not its I/O or flags)
+ * @param mem The memory to modify
+ * @param base The memory to share the pages of (NULL to stop sharing)
+ */
+void _share_mem(memory_t *mem, const memory_t *base)
+{
+    mem->base = base;
+    _mem_dirty_untouched(mem);
+    for (uint32_t i = 0; i < MEM_PAGE_COUNT; ++i) {
+        _mem_update_page(mem, i);
+    }
+}
+
+/**
+ * Map a device's read and write callbacks onto a range of addresses.
+ * CPU accesses to the range are passed to the device instead of RAM.
+ * 
+ * @param mem The memory to map the device into
+ * @param start The first address of the range
+ * @param end The last address of the range (inclusive)
+ * @param dev The device, passed to the callbacks
+ * @param read Called to read a byte from the range
+ * @param write Called to write a byte to the range
+ * @return True if mapped, false if the range is invalid or there
+ *         are already MEM_IO_MAX regions
+ */
+bool _map_mem_io(memory_t *mem, uint32_t start, uint32_t end, void *dev, mem_io_read_t read, mem_io_write_t write)
+{
+    if (start > end || end >= CPU_MEM_SIZE || mem->io_count >= MEM_IO_MAX) {
+        return false;
+    }
+
+    mem_io_t *io = &mem->io[mem->io_count++];
+    io->start = start;
+    io->end = end;
+    io->dev = dev;
+    io->read = read;
+    io->write = write;
+
+    for (uint32_t i = start >> MEM_PAGE_BITS; i <= end >> MEM_PAGE_BITS; ++i) {
+        _mem_update_page(mem, i);
+    }
+    return true;
+}
+
+/**
+ * Remove all I/O regions belonging to a device
+ * 
+ * @param mem The memory to remove the device from
+ * @param dev The device which was passed to _map_mem_io()
+ */
+void _unmap_mem_io(memory_t *mem, void *dev)
+{
+    int i = 0;
+
+    while (i < mem->io_count) {
+        if (mem->io[i].dev != dev) {
+            ++i;
+            continue;
+        }
+
+        mem_io_t io = mem->io[i];
+
+        // Keep the remaining regions packed
+        memmove(&mem->io[i], &mem->io[i + 1], (mem->io_count - i - 1) * sizeof(*mem->io));
+        --mem->io_count;
+
+        for (uint32_t j = io.start >> MEM_PAGE_BITS; j <= io.end >> MEM_PAGE_BITS; ++j) {
+            _mem_update_page(mem, j);
+        }
+    }
+}
+
+/**
+ * Add a watcher which is told about writes to the pages it watches
+ * (see _watch_mem_page())
+ * 
+ * @param mem The memory to watch
+ * @param dev The watcher, passed to fn
+ * @param fn Called before a watched byte changes
+ * @return The watcher's id, or -1 if there are already MEM_WATCH_MAX
+ */
+int _add_mem_watcher(memory_t *mem, void *dev, mem_watch_t fn)
+{
+    for (int i = 0; i < MEM_WATCH_MAX; ++i) {
+        if (!mem->watchers[i].fn) {
+            mem->watchers[i].dev = dev;
+            mem->watchers[i].fn = fn;
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Remove a watcher and stop watching all of its pages
+ * 
+ * @param mem The memory being watched
+ * @param id The id returned by _add_mem_watcher()
+ */
+void _remove_mem_watcher(memory_t *mem, int id)
+{
+    _unwatch_mem_pages(mem, id);
+    mem->watchers[id].dev = NULL;
+    mem->watchers[id].fn = NULL;
+}
+
+/**
+ * Start watching a page. Writes to it take the slow path until every
+ * watcher of the page has stopped watching it.
+ * 
+ * @param mem The memory being watched
+ * @param id The id returned by _add_mem_watcher()
+ * @param page_num The page to watch
+ */
+void _watch_mem_page(memory_t *mem, int id, uint32_t page_num)
+{
+    uint8_t old = mem->watch[page_num];
+
+    mem->watch[page_num] |= 1 << id;
+    if (!old) {
+        _mem_update_page(mem, page_num);
+    }
+}
+
+/**
+ * Stop watching all pages of a watcher
+ * 
+ * @param mem The memory being watched
+ * @param id The id returned by _add_mem_watcher()
+ */
+void _unwatch_mem_pages(memory_t *mem, int id)
+{
+    for (uint32_t i = 0; i < MEM_PAGE_COUNT; ++i) {
+        if (mem->watch[i] & (1 << id)) {
+            mem->watch[i] &= ~(1 << id);
+            if (!mem->watch[i]) {
+                _mem_update_page(mem, i);
+            }
+        }
+    }
+}
+
+/**
+ * Tell the watchers of an address's page that it is about to change,
+ * and drop the ones which stop watching it
+ * 
+ * @param mem The memory being watched
+ * @param addr The address which changes
+ */
+static void _mem_hit_watch(memory_t *mem, uint32_t addr)
+{
+    uint32_t page_num = addr >> MEM_PAGE_BITS;
+    uint8_t watch = mem->watch[page_num];
+
+    for (int i = 0; i < MEM_WATCH_MAX; ++i) {
+        if ((watch & (1 << i)) && !mem->watchers[i].fn(mem->watchers[i].dev, addr)) {
+            watch &= ~(1 << i);
+        }
+    }
+
+    // A callback may have changed the watches itself
+    watch &= mem->watch[page_num];
+    if (watch != mem->watch[page_num]) {
+        mem->watch[page_num] = watch;
+        if (!watch) {
+            _mem_update_page(mem, page_num);
+        }
+    }
+}
+
+/**
+ * Get the backing page holding an address to write to it, allocating
+ * it if needed, and mark it dirty
+ * @param mem The memory to use
+ * @param addr Any address in the page
+ * @return The page, or NULL if it could not be allocated
+ */
+static uint8_t *_mem_data_page(memory_t *mem, uint32_t addr)
+{
+    uint32_t page_num = addr >> MEM_PAGE_BITS;
+    uint8_t *page = mem->page[page_num];
+
+    if (!page) {
+        page = malloc(MEM_PAGE_SIZE);
+        if (!page) {
+            return NULL;
+        }
+        memcpy(page, _mem_clean_page(mem, page_num), MEM_PAGE_SIZE);
+        mem->page[page_num] = page;
+    }
+    else if (_mem_is_dirty(mem, page_num)) {
+        return page;
+    }
+    _mem_set_dirty(mem, page_num);
+    _mem_update_page(mem, page_num);
+    return page;
+}
+
+/**
+ * Get the flag page holding an address, allocating it if needed
+ * @param mem The memory to use
+ * @param addr Any address in the page
+ * @return The page, or NULL if it could not be allocated
+ */
+static mem_flag_t *_mem_flag_page(memory_t *mem, uint32_t addr)
+{
+    mem_flag_t **page = &mem->flags[addr >> MEM_PAGE_BITS];
+
+    if (!*page) {
+        *page = calloc(MEM_PAGE_SIZE, sizeof(**page));
+    }
+    return *page;
+}
+
+/**
+ * Read a data byte through the slow path (I/O pages)
+ * @param mem The memory to read
+ * @param addr The address to read
+ * @param setacc True if the access should have side effects on devices
+ * @return The byte at addr
+ */
+static uint8_t _mem_read_slow(memory_t *mem, uint32_t addr, bool setacc)
+{
+    mem_io_t *io = _mem_find_io(mem, addr);
+
+    if (io) {
+        return io->read(io->dev, addr, setacc);
+    }
+
+    uint8_t *page = mem->page[addr >> MEM_PAGE_BITS];
+
+    if (page) {
+        return page[addr & MEM_PAGE_MASK];
+    }
+    return _mem_clean_page(mem, addr >> MEM_PAGE_BITS)[addr & MEM_PAGE_MASK];
+}
+
+/**
+ * Write a data byte through the slow path (untouched or I/O pages)
+ * @note The write is dropped if its page cannot be allocated
+ * @param mem The memory to write
+ * @param addr The address to write
+ * @param val The byte to store
+ * @param setacc True if the access should have side effects on devices
+ */
+static void _mem_write_slow(memory_t *mem, uint32_t addr, uint8_t val, bool setacc)
+{
+    if (mem->watch[addr >> MEM_PAGE_BITS]) {
+        _mem_hit_watch(mem, addr);
+    }
+
+    mem_io_t *io = _mem_find_io(mem, addr);
+
+    if (io) {
+        io->write(io->dev, addr, val, setacc);
+        return;
+    }
+
+    uint8_t *page = _mem_data_page(mem, addr);
+    if (page) {
+        page[addr & MEM_PAGE_MASK] = val;
+    }
+}
+
+/**
+ * Read a data byte without touching any flags
+ * @param mem The memory to read
+ * @param addr The address to read
+ * @param setacc True if the access should have side effects on devices
+ * @return The byte at addr
+ */
+static inline uint8_t _mem_read(memory_t *mem, uint32_t addr, bool setacc)
+{
+    uint8_t *page = mem->rd[addr >> MEM_PAGE_BITS];
+
+    if (page) {
+        return page[addr & MEM_PAGE_MASK];
+    }
+    return _mem_read_slow(mem, addr, setacc);
+}
+
+/**
+ * Write a data byte without touching any flags
+ * @param mem The memory to write
+ * @param addr The address to write
+ * @param val The byte to store
+ * @param setacc True if the access should have side effects on devices
+ */
+static inline void _mem_write(memory_t *mem, uint32_t addr, uint8_t val, bool setacc)
+{
+    uint8_t *page = mem->wr[addr >> MEM_PAGE_BITS];
+
+    if (page) {
+        page[addr & MEM_PAGE_MASK] = val;
+        return;
+    }
+    _mem_write_slow(mem, addr, val, setacc);
+}
+
+/**
+ * Load a little-endian word from a page
+ * @note The two shifts and the or are combined into a single
+ *       (unaligned) load by the compiler on little-endian hosts
+ * @param p The address of the low byte
+ * @return The word at p and p+1
+ */
+static inline uint16_t _mem_load_word(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+/**
+ * Load a little-endian long (24-bit) from a page
+ * @param p The address of the low byte
+ * @return The long at p, p+1, and p+2
+ */
+static inline uint32_t _mem_load_long(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16);
+}
+
+/**
+ * Store a little-endian word into a page
+ * @param p The address of the low byte
+ * @param val The word to store
+ */
+static inline void _mem_store_word(uint8_t *p, uint16_t val)
+{
+    p[0] = val & 0xff;
+    p[1] = val >> 8;
+}
+
 /**
  * Get a byte from memory
  * @param mem The memory array to use as system memory
  * @param addr The address in memory to read
  * @param setacc True to set the "accessed flag" on used memory data
+ *               (and to let I/O devices see the access)
  * @return The byte in memory at the specified address
  */
 uint8_t _get_mem_byte(memory_t *mem, uint32_t addr, bool setacc)
 {
-    if (setacc) {
-        mem[addr].acc.R = 1;
+    if (setacc && mem->track) {
+        _set_mem_flags(mem, addr, MEM_FLAG_R);
     }
-    return mem[addr].val; // Yes, this is simple...
+    return _mem_read(mem, addr, setacc);
 }
 
 /**
@@ -198,11 +967,20 @@ uint8_t _get_mem_byte(memory_t *mem, uint32_t addr, bool setacc)
  */
 uint16_t _get_mem_word(memory_t *mem, uint32_t addr, bool setacc)
 {
-    if (setacc) {
-        mem[addr].acc.R = 1;
-        mem[(addr+1) & 0x00ffffff].acc.R = 1;
+    uint32_t addr_hi = (addr + 1) & 0x00ffffff;
+    uint8_t *page = mem->rd[addr >> MEM_PAGE_BITS];
+
+    if (setacc && mem->track) {
+        _set_mem_flags(mem, addr, MEM_FLAG_R);
+        _set_mem_flags(mem, addr_hi, MEM_FLAG_R);
+    }
+    if (page && (addr & MEM_PAGE_MASK) != MEM_PAGE_MASK) {
+        return _mem_load_word(page + (addr & MEM_PAGE_MASK));
     }
-    return mem[addr].val | (mem[(addr+1) & 0x00ffffff].val << 8);
+
+    uint16_t val = _mem_read(mem, addr, setacc);
+    val |= _mem_read(mem, addr_hi, setacc) << 8;
+    return val;
 }
 
 /**
@@ -214,6 +992,10 @@ uint16_t _get_mem_word(memory_t *mem, uint32_t addr, bool setacc)
  */
 uint16_t _get_mem_word_page_wrap(memory_t *mem, uint32_t addr, bool setacc)
 {
+    if ((addr & 0xff) != 0xff) {
+        return _get_mem_word(mem, addr, setacc);
+    }
+
     uint16_t val = _get_mem_byte(mem, addr, setacc);
     val |= _get_mem_byte(mem, _addr_add_val_page_wrap(addr, 1), setacc) << 8;
     return val;
@@ -228,6 +1010,10 @@ uint16_t _get_mem_word_page_wrap(memory_t *mem, uint32_t addr, bool setacc)
  */
 uint16_t _get_mem_word_bank_wrap(memory_t *mem, uint32_t addr, bool setacc)
 {
+    if ((addr & 0xffff) != 0xffff) {
+        return _get_mem_word(mem, addr, setacc);
+    }
+
     uint16_t val = _get_mem_byte(mem, addr, setacc);
     val |= _get_mem_byte(mem, _addr_add_val_bank_wrap(addr, 1), setacc) << 8;
     return val;
@@ -242,6 +1028,18 @@ uint16_t _get_mem_word_bank_wrap(memory_t *mem, uint32_t addr, bool setacc)
  */
 uint32_t _get_mem_long_bank_wrap(memory_t *mem, uint32_t addr, bool setacc)
 {
+    uint8_t *page = mem->rd[addr >> MEM_PAGE_BITS];
+
+    // Pages never cross a bank, so this also excludes bank wrapping
+    if (page && (addr & MEM_PAGE_MASK) < MEM_PAGE_MASK - 1) {
+        if (setacc && mem->track) {
+            _set_mem_flags(mem, addr, MEM_FLAG_R);
+            _set_mem_flags(mem, addr + 1, MEM_FLAG_R);
+            _set_mem_flags(mem, addr + 2, MEM_FLAG_R);
+        }
+        return _mem_load_long(page + (addr & MEM_PAGE_MASK));
+    }
+
     uint32_t val = _get_mem_byte(mem, addr, setacc);
     val |= _get_mem_byte(mem, _addr_add_val_bank_wrap(addr, 1), setacc) << 8;
     val |= _get_mem_byte(mem, _addr_add_val_bank_wrap(addr, 2), setacc) << 16;
@@ -250,17 +1048,19 @@ uint32_t _get_mem_long_bank_wrap(memory_t *mem, uint32_t addr, bool setacc)
 
 /**
  * Set a byte in memory
+ * @note The byte's page is allocated if it has not been written yet
  * @param mem The memory array to use as system memory
  * @param addr The address in memory to write
  * @param setacc True to set the "accessed flag" on used memory data
+ *               (and to let I/O devices see the access)
  * @param val The data value to store
  */
 void _set_mem_byte(memory_t *mem, uint32_t addr, uint8_t val, bool setacc)
 {
-    if (setacc) {
-        mem[addr].acc.W = 1;
+    if (setacc && mem->track) {
+        _set_mem_flags(mem, addr, MEM_FLAG_W);
     }
-    mem[addr].val = val; // Yes, this is simple...
+    _mem_write(mem, addr, val, setacc);
 }
 
 /**
@@ -276,12 +1076,20 @@ void _set_mem_byte(memory_t *mem, uint32_t addr, uint8_t val, bool setacc)
  */
 void _set_mem_word(memory_t *mem, uint32_t addr, uint16_t val, bool setacc)
 {
-    if (setacc) {
-        mem[addr].acc.W = 1;
-        mem[(addr + 1) & 0x00ffffff].acc.W = 1;
+    uint32_t addr_hi = (addr + 1) & 0x00ffffff;
+    uint8_t *page = mem->wr[addr >> MEM_PAGE_BITS];
+
+    if (setacc && mem->track) {
+        _set_mem_flags(mem, addr, MEM_FLAG_W);
+        _set_mem_flags(mem, addr_hi, MEM_FLAG_W);
+    }
+    if (page && (addr & MEM_PAGE_MASK) != MEM_PAGE_MASK) {
+        _mem_store_word(page + (addr & MEM_PAGE_MASK), val);
+    }
+    else {
+        _mem_write(mem, addr, val & 0xff, setacc);
+        _mem_write(mem, addr_hi, val >> 8, setacc);
     }
-    mem[addr].val = val & 0xff;
-    mem[(addr + 1) & 0x00ffffff].val = val >> 8;
 }
 
 /**
@@ -293,6 +1101,11 @@ void _set_mem_word(memory_t *mem, uint32_t addr, uint16_t val, bool setacc)
  */
 void _set_mem_word_bank_wrap(memory_t *mem, uint32_t addr, uint16_t val, bool setacc)
 {
+    if ((addr & 0xffff) != 0xffff) {
+        _set_mem_word(mem, addr, val, setacc);
+        return;
+    }
+
     _set_mem_byte(mem, addr, val, setacc);
     _set_mem_byte(mem, _addr_add_val_bank_wrap(addr, 1), val >> 8, setacc);
 }
@@ -300,7 +1113,8 @@ void _set_mem_word_bank_wrap(memory_t *mem, uint32_t addr, uint16_t val, bool se
 /**
  * Initialize the memory array with a source array
  * 
- * @note This does not modify flag data
+ * @note This does not modify flag data, and it writes to the RAM
+ *       underneath any I/O regions (devices are not accessed)
  * @param *mem The memory array to save the source data in
  * @param *src The source data to copy into system memory
  * @param base_addr The starting address to copy (for system memory)
@@ -308,25 +1122,408 @@ void _set_mem_word_bank_wrap(memory_t *mem, uint32_t addr, uint16_t val, bool se
  */
 void _init_mem_arr(memory_t *mem, uint8_t *src, uint32_t base_addr, uint32_t count)
 {
-    for (uint32_t i = base_addr, j = 0; j < count; ++i, ++j) {
-        mem[i].val = src[j];
+    while (count > 0) {
+        uint32_t offs = base_addr & MEM_PAGE_MASK;
+        uint32_t len = MEM_PAGE_SIZE - offs;
+        uint8_t *page = _mem_data_page(mem, base_addr);
+
+        if (len > count) {
+            len = count;
+        }
+        for (uint32_t i = 0; i < len && mem->watch[base_addr >> MEM_PAGE_BITS]; ++i) {
+            _mem_hit_watch(mem, base_addr + i);
+        }
+        if (page) {
+            memcpy(page + offs, src, len);
+        }
+
+        src += len;
+        base_addr += len;
+        count -= len;
     }
 }
 
 /**
  * Copy data from memory into a destination buffer
  * 
- * @note this does not copy flag data
+ * @note this does not copy flag data. I/O regions are read
+ *       without side effects on their devices.
  * @param *mem The memory to copy from
- * @param *dst The destination buffer
+ * @param *dst The destination buffer (dst[0] receives base_addr)
  * @param base_addr The starting address to copy
  * @param count The number of addresses to copy
- * @return 
  */
 void _save_mem_arr(memory_t *mem, uint8_t *dst, uint32_t base_addr, uint32_t count)
 {
-    for (uint32_t i = base_addr, j = 0; j < count; ++i, ++j) {
-        dst[i] = mem[i].val;
+    while (count > 0) {
+        uint32_t offs = base_addr & MEM_PAGE_MASK;
+        uint32_t len = MEM_PAGE_SIZE - offs;
+        uint8_t *page = mem->rd[base_addr >> MEM_PAGE_BITS];
+
+        if (len > count) {
+            len = count;
+        }
+        if (page) {
+            memcpy(dst, page + offs, len);
+        }
+        else {
+            for (uint32_t i = 0; i < len; ++i) {
+                dst[i] = _mem_read_slow(mem, base_addr + i, false);
+            }
+        }
+
+        dst += len;
+        base_addr += len;
+        count -= len;
+    }
+}
+
+/**
+ * Get the RAM data of a whole page (e.g. to save it), without side
+ * effects on I/O devices mapped over it
+ * @param mem The memory to read
+ * @param page_num The page
+ * @return MEM_PAGE_SIZE bytes, or NULL if the page is untouched and
+ *         reads as the fill value
+ */
+const uint8_t *_get_mem_page(memory_t *mem, uint32_t page_num)
+{
+    if (mem->page[page_num]) {
+        return mem->page[page_num];
+    }
+    if (mem->base && mem->base->page[page_num]) {
+        return mem->base->page[page_num];
+    }
+    return NULL;
+}
+
+/**
+ * Get the flags of a whole page, one byte per address (MEM_FLAG_R,
+ * MEM_FLAG_W and MEM_FLAG_B)
+ * @param mem The memory to read
+ * @param page_num The page
+ * @return MEM_PAGE_SIZE bytes, or NULL if no flag was ever set on it
+ */
+const uint8_t *_get_mem_flag_page(memory_t *mem, uint32_t page_num)
+{
+    return (const uint8_t *)mem->flags[page_num];
+}
+
+/**
+ * Replace the flags of a whole page (see _get_mem_flag_page())
+ * @note If the flag page can not be allocated, no flags are set
+ * @param mem The memory to modify
+ * @param page_num The page
+ * @param src MEM_PAGE_SIZE bytes of flags
+ */
+void _set_mem_flag_page(memory_t *mem, uint32_t page_num, const uint8_t *src)
+{
+    uint32_t addr = page_num << MEM_PAGE_BITS;
+    mem_flag_t *page = _mem_flag_page(mem, addr);
+
+    for (uint32_t i = 0; i < MEM_PAGE_SIZE && mem->watch[page_num]; ++i) {
+        if (src[i] & MEM_FLAG_B) {
+            _mem_hit_watch(mem, addr + i);
+        }
+    }
+    if (page) {
+        memcpy(page, src, MEM_PAGE_SIZE);
+    }
+}
+
+/**
+ * Make every page untouched again, with all of its flags clear (as
+ * after _init_mem()). I/O regions, watchers, the fill value and a
+ * shared base memory are kept.
+ * @param mem The memory to clear
+ */
+void _clear_mem(memory_t *mem)
+{
+    for (uint32_t i = 0; i < MEM_PAGE_COUNT; ++i) {
+        if (mem->page[i]) {
+            // The data of the page changes back to the fill (or base)
+            for (uint32_t j = 0; j < MEM_PAGE_SIZE && mem->watch[i]; ++j) {
+                _mem_hit_watch(mem, (i << MEM_PAGE_BITS) + j);
+            }
+            free(mem->page[i]);
+            mem->page[i] = NULL;
+            _mem_set_dirty(mem, i);
+            _mem_update_page(mem, i);
+        }
+        free(mem->flags[i]);
+        mem->flags[i] = NULL;
+    }
+}
+
+/**
+ * Copy the dirty pages of a chunk into the chunk of the next checkpoint
+ * and mark them clean. The chunk is copied first if a checkpoint holds
+ * it, and a page which was written back to its old data is kept.
+ * @param mem The memory
+ * @param c The chunk
+ * @return False if out of memory (pages which could not be copied stay dirty)
+ */
+static bool _mem_sync_chunk(memory_t *mem, uint32_t c)
+{
+    mem_ckpt_chunk_t *old = mem->synced[c];
+    mem_ckpt_chunk_t *chunk = old;
+    uint32_t first = c * MEM_CKPT_CHUNK_PAGES;
+    uint64_t done = 0;
+    bool ok = true;
+
+    if (!old || old->refs > 1) {
+        chunk = malloc(sizeof(*chunk));
+        if (!chunk) {
+            return false;
+        }
+        chunk->refs = 1;
+        for (int j = 0; j < MEM_CKPT_CHUNK_PAGES; ++j) {
+            chunk->page[j] = old ? old->page[j] : NULL;
+            if (chunk->page[j]) {
+                ++chunk->page[j]->refs;
+            }
+        }
+    }
+
+    for (uint32_t j = 0; j < MEM_CKPT_CHUNK_PAGES; ++j) {
+        if (!(mem->dirty[c] & (1ull << j))) {
+            continue;
+        }
+
+        uint8_t *data = mem->page[first + j];
+        mem_ckpt_page_t *have = chunk->page[j];
+
+        if (!data) {
+            chunk->page[j] = NULL;
+            _mem_ckpt_page_release(have);
+        }
+        else if (!have || memcmp(have->data, data, MEM_PAGE_SIZE) != 0) {
+            mem_ckpt_page_t *copy = malloc(sizeof(*copy));
+            if (!copy) {
+                ok = false;
+                break;
+            }
+            copy->refs = 1;
+            memcpy(copy->data, data, MEM_PAGE_SIZE);
+            chunk->page[j] = copy;
+            _mem_ckpt_page_release(have);
+        }
+        done |= 1ull << j;
+    }
+
+    if (chunk != old) {
+        mem->synced[c] = chunk;
+        _mem_ckpt_chunk_release(old);
+    }
+
+    // Writes take the slow path again, to mark the pages dirty
+    mem->dirty[c] &= ~done;
+    for (uint32_t j = 0; done; ++j, done >>= 1) {
+        if (done & 1) {
+            _mem_update_page(mem, first + j);
+        }
+    }
+    return ok;
+}
+
+/**
+ * Take a checkpoint of the data of a memory. Only the pages written
+ * since the last checkpoint (its dirty pages) are copied, the rest is
+ * shared with the last checkpoint. Flags, I/O regions, the fill value
+ * and a shared base memory are not part of a checkpoint.
+ * @note The pages of checkpoints are reference counted without locks,
+ *       so a memory and its checkpoints must stay on one thread
+ * @param mem The memory to take a checkpoint of
+ * @param ckpt Receives the checkpoint (free it with _free_mem_checkpoint())
+ * @return False if out of memory (ckpt is not set)
+ */
+bool _save_mem_checkpoint(memory_t *mem, mem_checkpoint_t *ckpt)
+{
+    for (uint32_t c = 0; c < MEM_CKPT_CHUNKS; ++c) {
+        if (mem->dirty[c] && !_mem_sync_chunk(mem, c)) {
+            return false;
+        }
+    }
+
+    for (uint32_t c = 0; c < MEM_CKPT_CHUNKS; ++c) {
+        ckpt->chunk[c] = mem->synced[c];
+        if (ckpt->chunk[c]) {
+            ++ckpt->chunk[c]->refs;
+        }
+    }
+    ckpt->gen = ++mem->gen;
+    return true;
+}
+
+/**
+ * Rewrite a page with the data of a checkpoint, telling the watchers
+ * of the page about each byte which changes
+ * @param mem The memory
+ * @param page_num The page
+ * @param want The data (NULL = untouched)
+ * @return False if the page could not be allocated
+ */
+static bool _mem_restore_page(memory_t *mem, uint32_t page_num, const mem_ckpt_page_t *want)
+{
+    const uint8_t *src = want ? want->data : _mem_clean_page(mem, page_num);
+
+    if (mem->watch[page_num]) {
+        const uint8_t *cur = mem->page[page_num] ? mem->page[page_num] : _mem_clean_page(mem, page_num);
+        for (uint32_t j = 0; j < MEM_PAGE_SIZE; ++j) {
+            if (cur[j] != src[j]) {
+                _mem_hit_watch(mem, (page_num << MEM_PAGE_BITS) + j);
+            }
+        }
+    }
+
+    if (want) {
+        if (!mem->page[page_num] && !(mem->page[page_num] = malloc(MEM_PAGE_SIZE))) {
+            return false;
+        }
+        memcpy(mem->page[page_num], src, MEM_PAGE_SIZE);
+    }
+    else {
+        free(mem->page[page_num]);
+        mem->page[page_num] = NULL;
+    }
+    return true;
+}
+
+/**
+ * Restore the data of a memory from a checkpoint. Only the pages which
+ * are dirty, or differ between the checkpoint and the last checkpoint
+ * of the memory, are rewritten, and watchers are told about each byte
+ * which changes. Flags and I/O regions are left as they are.
+ * @note The checkpoint may have been taken of another memory, as long
+ *       as both have the same fill value and base memory
+ * @param mem The memory to restore
+ * @param ckpt The checkpoint
+ * @return False if out of memory (pages which could not be allocated
+ *         are left as they were)
+ */
+bool _load_mem_checkpoint(memory_t *mem, const mem_checkpoint_t *ckpt)
+{
+    bool ok = true;
+
+    for (uint32_t c = 0; c < MEM_CKPT_CHUNKS; ++c) {
+        mem_ckpt_chunk_t *want = ckpt->chunk[c];
+        mem_ckpt_chunk_t *have = mem->synced[c];
+
+        if (want == have && !mem->dirty[c]) {
+            continue;
+        }
+
+        for (uint32_t j = 0; j < MEM_CKPT_CHUNK_PAGES; ++j) {
+            uint32_t i = c * MEM_CKPT_CHUNK_PAGES + j;
+            mem_ckpt_page_t *want_page = want ? want->page[j] : NULL;
+
+            if (want_page == (have ? have->page[j] : NULL) && !_mem_is_dirty(mem, i)) {
+                continue;
+            }
+            if (!_mem_restore_page(mem, i, want_page)) {
+                ok = false; // Stays dirty
+                continue;
+            }
+            mem->dirty[c] &= ~(1ull << j);
+            _mem_update_page(mem, i);
+        }
+
+        if (want) {
+            ++want->refs;
+        }
+        mem->synced[c] = want;
+        _mem_ckpt_chunk_release(have);
+    }
+    return ok;
+}
+
+/**
+ * Free a checkpoint (pages shared with other checkpoints are kept
+ * until the last of them is freed)
+ * @param ckpt The checkpoint
+ */
+void _free_mem_checkpoint(mem_checkpoint_t *ckpt)
+{
+    for (uint32_t c = 0; c < MEM_CKPT_CHUNKS; ++c) {
+        _mem_ckpt_chunk_release(ckpt->chunk[c]);
+        ckpt->chunk[c] = NULL;
+    }
+}
+
+/**
+ * Copy bytes within memory with the same result as copying them one
+ * at a time in order (like MVN/MVP), so overlapping ranges repeat
+ * the source pattern. Runs within RAM pages are copied with memmove,
+ * I/O regions are accessed one byte at a time.
+ * 
+ * @note The caller has to keep both ranges from wrapping around the
+ *       end (or start) of the address space
+ * @param *mem The memory to copy within
+ * @param dst The address the first byte is copied to
+ * @param src The address the first byte is copied from
+ * @param count The number of bytes to copy
+ * @param down True to copy downwards from dst and src (MVP),
+ *             false to copy upwards (MVN)
+ * @param setacc True to set the "accessed flag" on used memory data
+ *               (and to let I/O devices see the access)
+ */
+void _move_mem_block(memory_t *mem, uint32_t dst, uint32_t src, uint32_t count, bool down, bool setacc)
+{
+    bool track = setacc && mem->track;
+
+    while (count > 0) {
+        uint32_t len = count;
+        uint32_t src_room = down ? (src & MEM_PAGE_MASK) + 1 : MEM_PAGE_SIZE - (src & MEM_PAGE_MASK);
+        uint32_t dst_room = down ? (dst & MEM_PAGE_MASK) + 1 : MEM_PAGE_SIZE - (dst & MEM_PAGE_MASK);
+        uint8_t *src_page = mem->rd[src >> MEM_PAGE_BITS];
+        uint8_t *dst_page = mem->wr[dst >> MEM_PAGE_BITS];
+
+        // Untouched RAM page, allocate it (I/O pages have no rd pointer,
+        // watched pages are written through the slow path)
+        if (!dst_page && mem->rd[dst >> MEM_PAGE_BITS] && !mem->watch[dst >> MEM_PAGE_BITS]) {
+            dst_page = _mem_data_page(mem, dst);
+
+            // The source may have been the shared page just copied
+            src_page = mem->rd[src >> MEM_PAGE_BITS];
+        }
+
+        if (!src_page || !dst_page) {
+            // I/O, watched (or out of memory), take the byte at a time path
+            _set_mem_byte(mem, dst, _get_mem_byte(mem, src, setacc), setacc);
+            len = 1;
+        }
+        else {
+            if (len > src_room) {
+                len = src_room;
+            }
+            if (len > dst_room) {
+                len = dst_room;
+            }
+
+            // Copying towards the bytes not read yet repeats the
+            // pattern, which memmove would not do
+            if ((src >> MEM_PAGE_BITS) == (dst >> MEM_PAGE_BITS)) {
+                uint32_t dist = down ? src - dst : dst - src;
+                if (dist > 0 && dist < len) {
+                    len = dist;
+                }
+            }
+
+            uint32_t src_lo = down ? src - (len - 1) : src;
+            uint32_t dst_lo = down ? dst - (len - 1) : dst;
+
+            if (track) {
+                for (uint32_t i = 0; i < len; ++i) {
+                    _set_mem_flags(mem, src_lo + i, MEM_FLAG_R);
+                    _set_mem_flags(mem, dst_lo + i, MEM_FLAG_W);
+                }
+            }
+            memmove(dst_page + (dst_lo & MEM_PAGE_MASK), src_page + (src_lo & MEM_PAGE_MASK), len);
+        }
+
+        src = down ? src - len : src + len;
+        dst = down ? dst - len : dst + len;
+        count -= len;
     }
 }
 
@@ -339,7 +1536,12 @@ void _save_mem_arr(memory_t *mem, uint8_t *dst, uint32_t base_addr, uint32_t cou
  */
 mem_flag_t _test_mem_flags(memory_t *mem, uint32_t addr)
 {
-    return mem[addr].acc;
+    mem_flag_t *page = mem->flags[addr >> MEM_PAGE_BITS];
+
+    if (!page) {
+        return (mem_flag_t){0};
+    }
+    return page[addr & MEM_PAGE_MASK];
 }
 
 /**
@@ -355,7 +1557,7 @@ mem_flag_t _test_mem_flags(memory_t *mem, uint32_t addr)
  */
 mem_flag_t _test_and_reset_mem_flags(memory_t *mem, uint32_t addr, uint8_t mask)
 {
-    mem_flag_t t = mem[addr].acc;
+    mem_flag_t t = _test_mem_flags(mem, addr);
 
     // Flag resetting
     _reset_mem_flags(mem, addr, mask);
@@ -376,13 +1578,22 @@ mem_flag_t _test_and_reset_mem_flags(memory_t *mem, uint32_t addr, uint8_t mask)
  */
 void _reset_mem_flags(memory_t *mem, uint32_t addr, uint8_t mask)
 {
+    mem_flag_t *page = mem->flags[addr >> MEM_PAGE_BITS];
+
+    if (!page) {
+        return; // Nothing is set
+    }
+
     // Flag resetting
-    *(uint8_t *)&(mem[addr].acc) = (~mask) & *(uint8_t *) &(mem[addr].acc);
+    addr &= MEM_PAGE_MASK;
+    *(uint8_t *)&(page[addr]) = (~mask) & *(uint8_t *) &(page[addr]);
 }
 
 /**
  * Set the values of the flags on an address
  * 
+ * @note The address's flag page is allocated if needed. If that
+ *       fails, no flags are set.
  * @param *mem The memory to modify
  * @param addr The address in memory to access
  * @param mask A mask to determine which flags are set
@@ -390,12 +1601,22 @@ void _reset_mem_flags(memory_t *mem, uint32_t addr, uint8_t mask)
  *             bit 1: Write flag
  *             bit 2: Break flag
  *             bit 3..7: Unused
- * @return The flag data present at address prior to calling this function
  */
 void _set_mem_flags(memory_t *mem, uint32_t addr, uint8_t mask)
 {
-    // Flag resetting
-    *(uint8_t *)&(mem[addr].acc) = (mask) | *(uint8_t *) &(mem[addr].acc);
+    mem_flag_t *page = mem->flags[addr >> MEM_PAGE_BITS];
+
+    if ((mask & MEM_FLAG_B) && mem->watch[addr >> MEM_PAGE_BITS]) {
+        _mem_hit_watch(mem, addr);
+    }
+
+    if (!page && !(page = _mem_flag_page(mem, addr))) {
+        return;
+    }
+
+    // Flag setting
+    addr &= MEM_PAGE_MASK;
+    *(uint8_t *)&(page[addr]) = (mask) | *(uint8_t *) &(page[addr]);
 }
 
 
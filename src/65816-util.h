@@ -16,10 +16,13 @@
 void _cpu_update_pc(CPU_t *, uint16_t);
 uint8_t _cpu_get_sr(CPU_t *);
 void _cpu_set_sr(CPU_t *, uint8_t);
+void _cpu_update_width(CPU_t *);
 void _cpu_set_sp(CPU_t *, uint16_t);
 uint32_t _cpu_get_pbr(CPU_t *);
 uint32_t _cpu_get_dbr(CPU_t *);
 uint32_t _cpu_get_effective_pc(CPU_t *);
+uint32_t _cpu_get_inst_len(uint8_t, uint8_t);
+uint32_t _cpu_get_mv_count(CPU_t *, uint8_t, bool);
 void _cpu_update_pc(CPU_t *, uint16_t);
 uint8_t _cpu_get_immd_byte(CPU_t *, memory_t *, bool);
 uint16_t _cpu_get_immd_word(CPU_t *, memory_t *, bool);
@@ -27,12 +30,24 @@ uint32_t _cpu_get_immd_long(CPU_t *, memory_t *, bool);
 uint32_t _addr_add_val_page_wrap(uint32_t, uint32_t);
 uint32_t _addr_add_val_bank_wrap(uint32_t, uint32_t);
 void _cpu_crash(CPU_t *);
+void _cpu_interrupt(CPU_t *, memory_t *);
 
 // Memory-related functions
 // These are THE ONLY functions which should directly
 // access data within the memory_t datastructure
+bool _init_mem(memory_t *, bool);
+void _free_mem(memory_t *);
+void _set_mem_fill(memory_t *, uint8_t);
+void _share_mem(memory_t *, const memory_t *);
+bool _map_mem_io(memory_t *, uint32_t, uint32_t, void *, mem_io_read_t, mem_io_write_t);
+void _unmap_mem_io(memory_t *, void *);
+int _add_mem_watcher(memory_t *, void *, mem_watch_t);
+void _remove_mem_watcher(memory_t *, int);
+void _watch_mem_page(memory_t *, int, uint32_t);
+void _unwatch_mem_pages(memory_t *, int);
 uint8_t _get_mem_byte(memory_t *, uint32_t, bool);
 uint16_t _get_mem_word(memory_t *, uint32_t, bool);
+uint16_t _get_mem_word_page_wrap(memory_t *, uint32_t, bool);
 uint16_t _get_mem_word_bank_wrap(memory_t *, uint32_t, bool);
 uint32_t _get_mem_long_bank_wrap(memory_t *, uint32_t, bool);
 void _set_mem_byte(memory_t *, uint32_t, uint8_t, bool);
@@ -40,6 +55,14 @@ void _set_mem_word(memory_t *, uint32_t, uint16_t, bool);
 void _set_mem_word_bank_wrap(memory_t *, uint32_t, uint16_t, bool);
 void _init_mem_arr(memory_t *, uint8_t *, uint32_t, uint32_t);
 void _save_mem_arr(memory_t *, uint8_t *, uint32_t, uint32_t);
+const uint8_t *_get_mem_page(memory_t *, uint32_t);
+const uint8_t *_get_mem_flag_page(memory_t *, uint32_t);
+void _set_mem_flag_page(memory_t *, uint32_t, const uint8_t *);
+void _clear_mem(memory_t *);
+bool _save_mem_checkpoint(memory_t *, mem_checkpoint_t *);
+bool _load_mem_checkpoint(memory_t *, const mem_checkpoint_t *);
+void _free_mem_checkpoint(mem_checkpoint_t *);
+void _move_mem_block(memory_t *, uint32_t, uint32_t, uint32_t, bool, bool);
 mem_flag_t _test_mem_flags(memory_t *, uint32_t);
 mem_flag_t _test_and_reset_mem_flags(memory_t *, uint32_t, uint8_t);
 void _reset_mem_flags(memory_t *, uint32_t, uint8_t);
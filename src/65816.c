@@ -11,6 +11,11 @@
 #include "65816.h"
 #include "65816-ops.h"
 #include "65816-util.h"
+#include "65816-dispatch.h"
+#include "65816-icache.h"
+#include "jit.h"
+#include "trace.h"
+#include "prof.h"
 
 
 /**
@@ -33,8 +38,8 @@ CPU_Error_Code_t tostrCPU(CPU_t *cpu, char *buf)
     sprintf(buf, "{C:%04x,X:%04x,Y:%04x,SP:%04x,D:%04x,DBR:%02x,PBR:%02x,PC:%04x,RST:%d,IRQ:%d,NMI:%d,STP:%d,CRASH:%d,PSC:%d,PSZ:%d,PSI:%d,PSD:%d,PSXB:%d,PSM:%d,PSV:%d,PSN:%d,PSE:%d,cycles:%" PRIu64 "}",
             cpu->C, cpu->X, cpu->Y, cpu->SP, cpu->D, cpu->DBR, cpu->PBR,
             cpu->PC, cpu->P.RST, cpu->P.IRQ, cpu->P.NMI, cpu->P.STP,
-            cpu->P.CRASH, cpu->P.C, cpu->P.Z, cpu->P.I, cpu->P.D,
-            cpu->P.XB, cpu->P.M, cpu->P.V, cpu->P.N, cpu->P.E,
+            cpu->P.CRASH, cpu->P.C, CPU_NZ_GET_Z(cpu->nz), cpu->P.I, cpu->P.D,
+            cpu->P.XB, cpu->P.M, cpu->P.V, CPU_NZ_GET_N(cpu->nz), cpu->P.E,
             cpu->cycles);
 
     return CPU_ERR_OK;
@@ -71,14 +76,14 @@ CPU_Error_Code_t fromstrCPU(CPU_t *cpu, char *buf)
     cpu->P.STP = stp;
     cpu->P.CRASH = crash;
     cpu->P.C = prc;
-    cpu->P.Z = prz;
     cpu->P.I = pri;
     cpu->P.D = prd;
     cpu->P.XB = prxb;
     cpu->P.M = prm;
     cpu->P.V = prv;
-    cpu->P.N = prn;
+    cpu->nz = CPU_NZ(prn, prz);
     cpu->P.E = pre;
+    _cpu_update_width(cpu);
 
     // Make sure all elements were scanned
     if (num != 23) {
@@ -107,6 +112,10 @@ CPU_Error_Code_t initCPU(CPU_t *cpu)
 #endif
 
     cpu->cop_vect_enable = false;
+    cpu->jit = NULL;
+    cpu->icache = NULL;
+    cpu->trace = NULL;
+    cpu->prof = NULL;
     
     return resetCPU(cpu);
 }
@@ -137,6 +146,7 @@ CPU_Error_Code_t resetCPU(CPU_t *cpu)
     cpu->P.D = 0;
     cpu->P.I = 1;
     cpu->P.E = 1;
+    _cpu_update_width(cpu);
 
     // SIM extra state vars
     cpu->cycles = 0;
@@ -144,6 +154,7 @@ CPU_Error_Code_t resetCPU(CPU_t *cpu)
     cpu->P.STP = 0;
     cpu->P.IRQ = 0;
     cpu->P.NMI = 0;
+    cpu->predecoded = false;
 
     // Internal use only, tell the sim that the CPU just reset
     cpu->P.RST = 1;
@@ -152,19 +163,30 @@ CPU_Error_Code_t resetCPU(CPU_t *cpu)
 }
 
 /**
- * Steps a CPU by one machine cycle
- * @param cpu The CPU to be stepped
- * @param mem The memory array which is to be connected to the CPU
+ * Find the cached instruction at the PC of a CPU, decoding it into
+ * the cache on a miss
+ * @param cpu The CPU, which has an instruction cache
+ * @return The entry, or NULL if the instruction can not be cached
  */
-CPU_Error_Code_t stepCPU(CPU_t *cpu, memory_t *mem)
+static inline const icache_entry_t *_cpu_icache_lookup(CPU_t *cpu)
 {
-#ifdef CPU_DEBUG_CHECK_NULL
-    if (cpu == NULL)
+    uint32_t pc = _cpu_get_effective_pc(cpu);
+    icache_entry_t *page = cpu->icache->pages[pc >> MEM_PAGE_BITS];
+
+    if (page && page[pc & MEM_PAGE_MASK].mode == cpu->width_mode + 1)
     {
-        return CPU_ERR_NULL_CPU;
+        return &page[pc & MEM_PAGE_MASK];
     }
-#endif
+    return icache_fill(cpu->icache, pc);
+}
 
+/**
+ * Steps a CPU by one instruction (shared by stepCPU() and runCPU())
+ * @param cpu The CPU to be stepped
+ * @param mem The memory array which is to be connected to the CPU
+ */
+static inline CPU_Error_Code_t _stepCPU(CPU_t *cpu, memory_t *mem)
+{
     if (cpu->P.CRASH == 1)
     {
         return CPU_ERR_CRASH;
@@ -183,8 +205,33 @@ CPU_Error_Code_t stepCPU(CPU_t *cpu, memory_t *mem)
         return CPU_ERR_STP;
     }
 
-    // Fetch, decode, execute instruction
-    switch (_get_mem_byte(mem, _cpu_get_effective_pc(cpu), cpu->setacc))
+    // Fetch and decode the instruction, unless it is cached
+    const icache_entry_t *dec = NULL;
+    uint8_t op;
+
+    if (cpu->icache && !(mem->track && cpu->setacc))
+    {
+        dec = _cpu_icache_lookup(cpu);
+    }
+    if (dec)
+    {
+        op = dec->op;
+        cpu->operand = dec->operand;
+        cpu->predecoded = true;
+    }
+    else
+    {
+        op = _get_mem_byte(mem, _cpu_get_effective_pc(cpu), cpu->setacc);
+    }
+
+    // Execute instruction
+#if defined(CPU_DISPATCH_WIDTH)
+    (dec ? dec->fn : cpu_width_dispatch_table[cpu->width_mode][op])(cpu, mem);
+#elif defined(CPU_DISPATCH_TABLE)
+    (dec ? dec->fn : cpu_dispatch_table[op])(cpu, mem);
+#else
+    // Reference implementation (KEEP IN SYNC with 65816-optable.h)
+    switch (op)
     {
     case 0x00: i_brk(cpu, mem); break;
     case 0x01: i_ora(cpu, mem, 2, 6, CPU_ADDR_DPINDX, _addrCPU_getDirectPageIndexedIndirectX(cpu, mem, cpu->setacc)); break;
@@ -443,8 +490,11 @@ CPU_Error_Code_t stepCPU(CPU_t *cpu, memory_t *mem)
     case 0xfe: i_inc(cpu, mem, 3, 7, CPU_ADDR_ABSX, _addrCPU_getAbsoluteIndexedX(cpu, mem, cpu->setacc)); break;
     case 0xff: i_sbc(cpu, mem, 4, 5, CPU_ADDR_ABSLX, _addrCPU_getLongIndexedX(cpu, mem, cpu->setacc)); break;
     default:
+        cpu->predecoded = false;
         return CPU_ERR_UNKNOWN_OPCODE;
     }
+#endif
+    cpu->predecoded = false;
 
     // Make sure opcode handling did not result in an invalid state
     if (cpu->P.CRASH == 1)
@@ -453,63 +503,162 @@ CPU_Error_Code_t stepCPU(CPU_t *cpu, memory_t *mem)
     }
 
     // Handle any interrupts that are pending
-    if (cpu->P.NMI)
+    if (cpu->P.NMI || (cpu->P.IRQ && !cpu->P.I))
+    {
+        _cpu_interrupt(cpu, mem);
+    }
+
+    return CPU_ERR_OK;
+}
+
+/**
+ * Steps a CPU by one machine cycle
+ * @param cpu The CPU to be stepped
+ * @param mem The memory array which is to be connected to the CPU
+ */
+CPU_Error_Code_t stepCPU(CPU_t *cpu, memory_t *mem)
+{
+#ifdef CPU_DEBUG_CHECK_NULL
+    if (cpu == NULL)
     {
-        cpu->P.NMI = 0;
+        return CPU_ERR_NULL_CPU;
+    }
+#endif
 
-        if (cpu->P.E)
+    return _stepCPU(cpu, mem);
+}
+
+/**
+ * Runs a CPU until it stops or uses up one of its budgets, with
+ * translated code if the CPU has a JIT (see CPU_t.jit) and is not
+ * being traced or profiled (see CPU_t.trace and CPU_t.prof)
+ * 
+ * @note Loading the reset vector after a reset does not count as
+ *       an instruction, and a WAI which is still waiting for an
+ *       interrupt is not counted until it finishes
+ * @param cpu The CPU to run
+ * @param mem The memory array which is to be connected to the CPU
+ * @param max_cycles Return after this many cycles have been run (0 = no limit)
+ * @param max_inst Return after this many instructions have been run (0 = no limit)
+ * @param stop Set to the reason the CPU stopped running (may be NULL)
+ * @return The number of instructions executed
+ */
+uint64_t runCPU(CPU_t *cpu, memory_t *mem, uint64_t max_cycles, uint64_t max_inst, CPU_Stop_Reason_t *stop)
+{
+    if (cpu->jit && !cpu->trace && !cpu->prof)
+    {
+        return jit_run(cpu->jit, cpu, mem, max_cycles, max_inst, stop);
+    }
+    return interpretCPU(cpu, mem, max_cycles, max_inst, stop);
+}
+
+/**
+ * Runs a CPU like runCPU(), one instruction at a time
+ * (even if the CPU has a JIT)
+ */
+uint64_t interpretCPU(CPU_t *cpu, memory_t *mem, uint64_t max_cycles, uint64_t max_inst, CPU_Stop_Reason_t *stop)
+{
+    uint64_t end_cycles = cpu->cycles + max_cycles;
+    uint64_t count = 0;
+    CPU_Stop_Reason_t reason;
+
+#ifdef CPU_DEBUG_CHECK_NULL
+    if (cpu == NULL)
+    {
+        if (stop)
         {
-            _stackCPU_pushWord(cpu, mem, cpu->PC, CPU_ESTACK_ENABLE, cpu->setacc);
-            _stackCPU_pushByte(cpu, mem, _cpu_get_sr(cpu) & 0xef, cpu->setacc); // B gets reset on the stack
-            cpu->PC = _get_mem_byte(mem, CPU_VEC_EMU_NMI, cpu->setacc);
-            cpu->PC |= _get_mem_byte(mem, CPU_VEC_EMU_NMI + 1, cpu->setacc) << 8;
-            cpu->PBR = 0;
-            cpu->cycles += 7;
+            *stop = CPU_STOP_CRASH;
         }
-        else
+        return 0;
+    }
+#endif
+
+    for (;;)
+    {
+        if (max_inst && count >= max_inst)
         {
-            _stackCPU_push24(cpu, mem, _cpu_get_effective_pc(cpu), cpu->setacc);
-            _stackCPU_pushByte(cpu, mem, _cpu_get_sr(cpu), cpu->setacc);
-            cpu->PC = _get_mem_byte(mem, CPU_VEC_NATIVE_NMI, cpu->setacc);
-            cpu->PC |= _get_mem_byte(mem, CPU_VEC_NATIVE_NMI + 1, cpu->setacc) << 8;
-            cpu->PBR = 0;
-            cpu->cycles += 8;
+            reason = CPU_STOP_INSTRUCTIONS;
+            break;
+        }
+        if (max_cycles && cpu->cycles >= end_cycles)
+        {
+            reason = CPU_STOP_CYCLES;
+            break;
         }
 
-        cpu->P.D = 0; // Binary mode (65C02)
-        // cpu->P.I = 1; // IRQ flag is not set: https://softpixel.com/~cwright/sianse/docs/65816NFO.HTM#7.00
+        uint32_t pc = _cpu_get_effective_pc(cpu);
+        bool rst = cpu->P.RST;
+        trace_rec_t *rec = NULL;
 
-        return CPU_ERR_OK;
-    }
-    if (cpu->P.IRQ && !cpu->P.I)
-    {
-        cpu->P.IRQ = 0; // Not actually how the '816 works, but being "edge triggered" is convenient for the sim
+        if (cpu->trace && !rst && !cpu->P.STP && !cpu->P.CRASH)
+        {
+            rec = trace_begin(cpu->trace, cpu, mem, pc);
+        }
+
+        // Every instruction when counting exactly, else once per sample
+        if (cpu->prof && !rst && cpu->cycles >= cpu->prof->next)
+        {
+            prof_step(cpu->prof, pc, cpu->cycles);
+        }
+
+        CPU_Error_Code_t err = _stepCPU(cpu, mem);
+
+        // An instruction which crashes the CPU is recorded too, since it
+        // is usually the one the trace was taken for
+        if (rec && (err == CPU_ERR_CRASH || err == CPU_ERR_UNKNOWN_OPCODE || cpu->P.CRASH))
+        {
+            trace_end(cpu->trace, rec, mem);
+        }
 
-        if (cpu->P.E)
+        if (err == CPU_ERR_CRASH || cpu->P.CRASH)
         {
-            _stackCPU_pushWord(cpu, mem, cpu->PC, CPU_ESTACK_ENABLE, cpu->setacc);
-            _stackCPU_pushByte(cpu, mem, _cpu_get_sr(cpu) & 0xef, cpu->setacc); // B gets reset on the stack
-            cpu->PC = _get_mem_byte(mem, CPU_VEC_EMU_IRQ, cpu->setacc);
-            cpu->PC |= _get_mem_byte(mem, CPU_VEC_EMU_IRQ + 1, cpu->setacc) << 8;
-            cpu->PBR = 0;
-            cpu->cycles += 7;
+            reason = CPU_STOP_CRASH;
+            break;
         }
-        else
+        else if (err == CPU_ERR_UNKNOWN_OPCODE)
         {
-            _stackCPU_push24(cpu, mem, _cpu_get_effective_pc(cpu), cpu->setacc);
-            _stackCPU_pushByte(cpu, mem, _cpu_get_sr(cpu), cpu->setacc);
-            cpu->PC = _get_mem_byte(mem, CPU_VEC_NATIVE_IRQ, cpu->setacc);
-            cpu->PC |= _get_mem_byte(mem, CPU_VEC_NATIVE_IRQ + 1, cpu->setacc) << 8;
-            cpu->PBR = 0;
-            cpu->cycles += 8;
+            reason = CPU_STOP_UNKNOWN_OPCODE;
+            break;
+        }
+        else if (err == CPU_ERR_STP)
+        {
+            reason = CPU_STOP_STP;
+            break;
         }
 
-        cpu->P.D = 0; // Binary mode (65C02)
-        cpu->P.I = 1;
+        if (!rst)
+        {
+            // Only WAI (and block moves) leave the PC where it was
+            if (!cpu->P.STP && _cpu_get_effective_pc(cpu) == pc && _get_mem_byte(mem, pc, false) == 0xcb)
+            {
+                reason = CPU_STOP_WAI;
+                break;
+            }
+
+            ++count;
+
+            if (rec)
+            {
+                trace_end(cpu->trace, rec, mem);
+            }
+
+            if (cpu->P.STP)
+            {
+                reason = CPU_STOP_STP;
+                break;
+            }
+        }
 
-        return CPU_ERR_OK;
+        if (_test_mem_flags(mem, _cpu_get_effective_pc(cpu)).B == 1)
+        {
+            reason = CPU_STOP_BREAKPOINT;
+            break;
+        }
     }
 
-
-    return CPU_ERR_OK;
+    if (stop)
+    {
+        *stop = reason;
+    }
+    return count;
 }
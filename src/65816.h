@@ -22,6 +22,11 @@
 #define CPU_VEC_RESET 0xfffc
 #define CPU_VEC_EMU_IRQ 0xfffe
 
+// Max number of bytes moved by one step of MVN/MVP. Interrupts (and
+// device events) are only seen between steps, so this bounds their
+// latency to 7 cycles per byte (448 cycles).
+#define CPU_MV_CHUNK 64
+
 // CPU "Class"
 typedef struct CPU_t CPU_t;
 
@@ -38,13 +43,13 @@ struct CPU_t
     struct {
         // Order matters (keep in sync with SR in CPU):
         unsigned char C : 1;   
-        unsigned char Z : 1;
+        unsigned char Z_slot : 1; // Z is kept in CPU_t.nz
         unsigned char I : 1;
         unsigned char D : 1;
         unsigned char XB : 1; // B in emulation
         unsigned char M : 1;
         unsigned char V : 1;
-        unsigned char N : 1;
+        unsigned char N_slot : 1; // N is kept in CPU_t.nz
         // Order no longer matters:
         unsigned char E : 1;
         unsigned char RST : 1; // 1 if the CPU was reset, 0 if reset vector has been jumped to
@@ -56,6 +61,13 @@ struct CPU_t
 
     } P;
 
+    // The N and Z flags, evaluated lazily: handlers store the result
+    // which sets them (CPU_NZ8() or CPU_NZ16()), and the flags are
+    // only worked out when something reads them (CPU_NZ_GET_N() and
+    // CPU_NZ_GET_Z(), _cpu_get_sr()). Z is set if the low 16 bits are
+    // 0, N if bit 15 or bit 31 is set.
+    uint32_t nz;
+
     // Total phi-1 cycles the CPU has run
     // Just prepairing for the end of the Universe ... don't worry about it :)
     uint64_t cycles;
@@ -63,6 +75,18 @@ struct CPU_t
     // Enables this CPU to update access flags on memory addresses
     bool setacc;
 
+    // Register width mode (CPU_Width_Mode_t) matching the E, M and X
+    // flags. Selects the handler table of the width specialized
+    // dispatch engine. Kept up to date by the core, but anything
+    // else which changes those flags must call _cpu_update_width()
+    uint8_t width_mode;
+
+    // Bytes after the opcode of the instruction being run, taken from
+    // the instruction cache instead of memory while predecoded is set
+    // (see _cpu_get_immd_byte())
+    uint32_t operand;
+    bool predecoded;
+
     // ******** Special features ********
     // Set true to use the immediate value of a COP
     // instruction as an offset from the address placed at
@@ -72,8 +96,39 @@ struct CPU_t
     // for the COP instruction.
     // Default value: false (normal CPU behavior)
     bool cop_vect_enable;
+
+    // Set to run this CPU with translated code instead of the
+    // interpreter (see jit_init() in jit.h). Only used by runCPU().
+    // Default value: NULL (interpreter only)
+    struct jit_t *jit;
+
+    // Set to run this CPU from a cache of decoded instructions
+    // (see icache_init() in 65816-icache.h)
+    // Default value: NULL (every instruction is fetched and decoded)
+    struct icache_t *icache;
+
+    // Set to record every instruction run by runCPU() to a file
+    // (see trace_start() in trace.h). The JIT is not used meanwhile.
+    // Default value: NULL (no trace)
+    struct trace_t *trace;
+
+    // Set to profile the code run by runCPU() (see prof_start() in
+    // prof.h). The JIT is not used meanwhile.
+    // Default value: NULL (no profile)
+    struct prof_t *prof;
 };
 
+// Values of CPU_t.nz for an 8 or 16-bit result
+#define CPU_NZ8(val) ((uint32_t)((val) & 0xff) << 8)
+#define CPU_NZ16(val) ((uint32_t)((val) & 0xffff))
+
+// Value of CPU_t.nz for any N and Z flags
+#define CPU_NZ(n, z) (((n) ? 0x80000000u : 0) | ((z) ? 0 : 1))
+
+// The flags held by a value of CPU_t.nz
+#define CPU_NZ_GET_N(nz) (((nz) & 0x80008000u) != 0)
+#define CPU_NZ_GET_Z(nz) (((nz) & 0xffff) == 0)
+
 // Possible error codes from CPU public (non-static) functions
 typedef enum CPU_Error_Code_t
  {
@@ -85,6 +140,29 @@ typedef enum CPU_Error_Code_t
      CPU_ERR_STR_PARSE, // Returned in fromstrCPU() if scanning of the input string fails
  } CPU_Error_Code_t;
 
+// Reasons for runCPU() to return
+typedef enum CPU_Stop_Reason_t
+{
+    CPU_STOP_STP = 0,        // STP was executed
+    CPU_STOP_CRASH,          // An invalid sim state was reached
+    CPU_STOP_UNKNOWN_OPCODE,
+    CPU_STOP_BREAKPOINT,     // The PC reached an address with a breakpoint flag
+    CPU_STOP_WAI,            // WAI is waiting for an interrupt
+    CPU_STOP_CYCLES,         // The cycle budget was used up
+    CPU_STOP_INSTRUCTIONS    // The instruction budget was used up
+} CPU_Stop_Reason_t;
+
+// Register width modes of the CPU (see CPU_t.width_mode)
+typedef enum CPU_Width_Mode_t
+{
+    CPU_WIDTH_E = 0,  // Emulation mode (8-bit A, X and Y)
+    CPU_WIDTH_M8X8,   // Native mode, 8-bit A, 8-bit X and Y
+    CPU_WIDTH_M8X16,  // Native mode, 8-bit A, 16-bit X and Y
+    CPU_WIDTH_M16X8,  // Native mode, 16-bit A, 8-bit X and Y
+    CPU_WIDTH_M16X16, // Native mode, 16-bit A, 16-bit X and Y
+    CPU_WIDTH_COUNT
+} CPU_Width_Mode_t;
+
 // Used to specify if the call to stack operations should allow
 // keeping the stack within page 1 while a CPU is in emulation mode
 typedef enum Emul_Stack_Mod_t
@@ -134,17 +212,105 @@ typedef struct mem_flag_t {
 #define MEM_FLAG_W 0x02
 #define MEM_FLAG_B 0x04
 
+// Size of the 24-bit address space in bytes
+#define CPU_MEM_SIZE 0x1000000
+
+// Memory is split into pages which are only allocated once
+// they are written to (or have flags set on them)
+#define MEM_PAGE_BITS 12
+#define MEM_PAGE_SIZE (1 << MEM_PAGE_BITS)
+#define MEM_PAGE_MASK (MEM_PAGE_SIZE - 1)
+#define MEM_PAGE_COUNT (CPU_MEM_SIZE >> MEM_PAGE_BITS)
+
+// Max number of memory mapped I/O regions in a memory_t
+#define MEM_IO_MAX 16
+
+// Memory mapped I/O device callbacks
+// setacc is true for accesses which should have side effects on the
+// device (CPU accesses), and false for inspection (e.g. a debugger)
+typedef uint8_t (*mem_io_read_t)(void *dev, uint32_t addr, bool setacc);
+typedef void (*mem_io_write_t)(void *dev, uint32_t addr, uint8_t val, bool setacc);
+
+// Max number of watchers of a memory_t (see _add_mem_watcher())
+#define MEM_WATCH_MAX 8
+
+// Called before a byte on a watched page is written, or gets its
+// breakpoint flag set. Returns true to keep watching the page.
+typedef bool (*mem_watch_t)(void *dev, uint32_t addr);
+
+// Something which caches what it has read from memory (e.g. translated
+// code) and has to know when that goes stale
+typedef struct mem_watcher_t {
+    void *dev;      // Passed to fn
+    mem_watch_t fn; // NULL = unused slot
+} mem_watcher_t;
+
+// An address range which is handled by a device
+typedef struct mem_io_t {
+    uint32_t start; // First address of the region
+    uint32_t end;   // Last address of the region (inclusive)
+    void *dev;      // Passed to the callbacks
+    mem_io_read_t read;
+    mem_io_write_t write;
+} mem_io_t;
+
+// System memory
+// The data bytes and their flags are kept in separate page tables so
+// that plain execution only has to touch the data bytes. Data pages
+// which have never been written all share fill_page, which holds the
+// fill (open bus) value, and a flag page which has never been set
+// reads as all clear. Access flags are only recorded when both track
+// and the CPU's setacc are enabled.
+//
+// Accesses go through the rd and wr tables. An entry is NULL if the
+// access must take the slow path: a write to an untouched page, or
+// any access to a page with an I/O region on it, or a write to a page
+// which is watched (see _watch_mem_page()), or the first write to a
+// page since the last checkpoint (which marks it dirty, see
+// _save_mem_checkpoint()).
+// Use _init_mem(), _free_mem(), _set_mem_fill() and _map_mem_io()
+// from 65816-util to manage it.
 typedef struct memory_t {
-    uint8_t val;
-    mem_flag_t acc;
+    uint8_t **rd;       // MEM_PAGE_COUNT read pointers
+    uint8_t **wr;       // MEM_PAGE_COUNT write pointers
+    uint8_t **page;     // MEM_PAGE_COUNT backing pages (NULL = untouched)
+    uint8_t *fill_page; // Read by all untouched pages
+    mem_flag_t **flags; // MEM_PAGE_COUNT flag pages (NULL = all clear)
+    bool track;         // Record R/W access flags
+    uint8_t fill;       // Value read from untouched pages
+    int io_count;
+    mem_io_t io[MEM_IO_MAX];
+    uint8_t *watch;     // MEM_PAGE_COUNT watcher bit sets (bit n = watchers[n])
+    mem_watcher_t watchers[MEM_WATCH_MAX];
+    const struct memory_t *base; // Read by untouched pages it has data for (see _share_mem())
+    uint64_t *dirty;    // MEM_CKPT_CHUNKS words, bit n of word c is set if page
+                        // c * MEM_CKPT_CHUNK_PAGES + n may have changed since the last checkpoint
+    struct mem_ckpt_chunk_t **synced; // MEM_CKPT_CHUNKS chunks of pages as of the last checkpoint
+    uint64_t gen;       // Number of checkpoints taken
 } memory_t;
 
+// Checkpoints keep their pages in chunks of MEM_CKPT_CHUNK_PAGES pages
+// (one word of memory_t.dirty)
+#define MEM_CKPT_CHUNK_PAGES 64
+#define MEM_CKPT_CHUNKS (MEM_PAGE_COUNT / MEM_CKPT_CHUNK_PAGES)
+
+// The data pages of a memory at one point in time (see
+// _save_mem_checkpoint()). Pages, and chunks of pages, which did not
+// change between two checkpoints are shared by them, so a checkpoint
+// only costs a copy of the pages written since the one before it.
+typedef struct mem_checkpoint_t {
+    struct mem_ckpt_chunk_t *chunk[MEM_CKPT_CHUNKS]; // NULL = all pages untouched
+    uint64_t gen;       // Value of memory_t.gen it was taken at
+} mem_checkpoint_t;
+
 
 CPU_Error_Code_t tostrCPU(CPU_t *, char *);
 CPU_Error_Code_t fromstrCPU(CPU_t *, char *);
 CPU_Error_Code_t initCPU(CPU_t *);
 CPU_Error_Code_t resetCPU(CPU_t *);
 CPU_Error_Code_t stepCPU(CPU_t *, memory_t *);
+uint64_t runCPU(CPU_t *, memory_t *, uint64_t, uint64_t, CPU_Stop_Reason_t *);
+uint64_t interpretCPU(CPU_t *, memory_t *, uint64_t, uint64_t, CPU_Stop_Reason_t *);
 
 
 #endif
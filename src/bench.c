@@ -0,0 +1,137 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+// CPU core benchmark (make bench)
+//
+// Runs a fixed number of instructions of a small native mode program
+// which mixes 8 and 16-bit loads, stores, ALU operations, indexed
+// addressing, stack operations, subroutine calls and branches, then
+// prints the number of instructions executed per second. The final
+// CPU state is printed as well so the dispatch engines (and the JIT,
+// built with BENCH_JIT defined, and the instruction cache, built with
+// BENCH_ICACHE defined) can be checked against each other.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "65816.h"
+#include "65816-util.h"
+#include "65816-icache.h"
+#include "jit.h"
+
+#define BENCH_INSTRUCTIONS 100000000ULL
+
+// Code at $8000 (native mode, 16-bit A/X/Y in the main loop)
+static uint8_t bench_main[] = {
+    0x18,             // 8000 clc
+    0xfb,             // 8001 xce
+    0xc2, 0x30,       // 8002 rep #$30
+    0xa2, 0x00, 0x00, // 8004 ldx #$0000
+    0xbd, 0x00, 0x20, // 8007 lda $2000,X
+    0x18,             // 800a clc
+    0x69, 0x01, 0x00, // 800b adc #$0001
+    0x0a,             // 800e asl A
+    0x45, 0x20,       // 800f eor $20
+    0x9d, 0x00, 0x30, // 8011 sta $3000,X
+    0x48,             // 8014 pha
+    0x20, 0x40, 0x80, // 8015 jsr $8040
+    0x68,             // 8018 pla
+    0xe8,             // 8019 inx
+    0xe8,             // 801a inx
+    0xe0, 0x00, 0x01, // 801b cpx #$0100
+    0xd0, 0xe7,       // 801e bne $8007
+    0xe6, 0x22,       // 8020 inc $22
+    0x80, 0xe0        // 8022 bra $8004
+};
+
+// Subroutine at $8040 (8-bit A)
+static uint8_t bench_sub[] = {
+    0xe2, 0x20,       // 8040 sep #$20
+    0xa5, 0x12,       // 8042 lda $12
+    0x38,             // 8044 sec
+    0xe9, 0x03,       // 8045 sbc #$03
+    0x85, 0x12,       // 8047 sta $12
+    0x29, 0x0f,       // 8049 and #$0f
+    0xf0, 0x02,       // 804b beq $804f
+    0xc6, 0x13,       // 804d dec $13
+    0xc2, 0x20,       // 804f rep #$20
+    0x60              // 8051 rts
+};
+
+static uint8_t bench_reset_vect[] = { 0x00, 0x80 };
+
+
+int main(int argc, char *argv[])
+{
+    CPU_t cpu = {0};
+    memory_t bench_mem;
+    memory_t *mem = &bench_mem;
+    char buf[256];
+    struct timespec start, end;
+
+    // No access tracking: the CPU runs with setacc disabled
+    if (!_init_mem(mem, false)) {
+        printf("Unable to allocate system memory!\n");
+        return EXIT_FAILURE;
+    }
+
+    _init_mem_arr(mem, bench_main, 0x8000, sizeof(bench_main));
+    _init_mem_arr(mem, bench_sub, 0x8040, sizeof(bench_sub));
+    _init_mem_arr(mem, bench_reset_vect, CPU_VEC_RESET, sizeof(bench_reset_vect));
+
+    initCPU(&cpu);
+    stepCPU(&cpu, mem); // Load the reset vector
+
+#ifdef BENCH_JIT
+    jit_t jit;
+
+    if (!jit_init(&jit, mem, false)) {
+        printf("Unable to set up the JIT!\n");
+        return EXIT_FAILURE;
+    }
+    cpu.jit = &jit;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    runCPU(&cpu, mem, 0, BENCH_INSTRUCTIONS, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    jit_free(&jit);
+#else
+#ifdef BENCH_ICACHE
+    icache_t icache;
+
+    if (!icache_init(&icache, &cpu, mem)) {
+        printf("Unable to set up the instruction cache!\n");
+        return EXIT_FAILURE;
+    }
+    cpu.icache = &icache;
+#endif
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint64_t i = 0; i < BENCH_INSTRUCTIONS; ++i) {
+        stepCPU(&cpu, mem);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+#ifdef BENCH_ICACHE
+    icache_free(&icache);
+#endif
+#endif
+
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    tostrCPU(&cpu, buf);
+    printf("%s\n", argv[0]);
+    printf("  %" PRIu64 " instructions in %.3f s = %.2f M instructions/s\n",
+           (uint64_t)BENCH_INSTRUCTIONS, secs, BENCH_INSTRUCTIONS / secs / 1e6);
+    printf("  %s\n", buf);
+
+    _free_mem(mem);
+
+    return EXIT_SUCCESS;
+}
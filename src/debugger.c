@@ -7,6 +7,7 @@
 #define _FILE_OFFSET_BITS 64
 
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
@@ -15,13 +16,22 @@
 #include <ncurses.h>
 
 #include <sys/stat.h> // For getting file sizes
+#include <unistd.h> // STDIN_FILENO
 #include <errno.h>
 
 #include "disassembler.h"
 #include "65816.h"
 #include "65816-util.h"
 #include "16C750.h"
+#include "scheduler.h"
 #include "debugger.h"
+#include "headless.h"
+#include "65816-icache.h"
+#include "jit.h"
+#include "snapshot.h"
+#include "timeline.h"
+#include "trace.h"
+#include "prof.h"
 
 
 // Messages to print in the status bar at the top of the screen
@@ -38,7 +48,7 @@ static char *status_msgs[] = {
 // Global error message buffer. Used in conjunction
 // with the cmd_err_msgs return values.
 // To signal use of this buffer, return
-// cmd_err_t = CMD_SPECIAL
+// cmd_err_t = CMD_SPECIAL (or CMD_SPECIAL_INFO with STAT_INFO)
 char global_err_msg_buf[1024];
 
 // Error messages for command parsing/execution
@@ -46,12 +56,13 @@ char global_err_msg_buf[1024];
 cmd_err_msg cmd_err_msgs[] = {
     {"",0,0,""}, // OK
     {"ERROR!", 3, 4, global_err_msg_buf},
+    {"INFO",   3, 4, global_err_msg_buf},
     {"ERROR!", 3, 34, "Expected argument for command."},
     {"ERROR!", 3, 27, "Expected register name."},
     {"ERROR!", 3, 19, "Expected value."},
     {"ERROR!", 3, 21, "Unknown argument."},
     {"ERROR!", 3, 20, "Unknown command."},
-    {"HELP", 18, 43, "Available commands\n"
+    {"HELP", 25, 43, "Available commands\n"
      " > exit ... Close simulator\n"
      " > mw[1|2] [mem|asm] (pc|addr)\n"
      " > mw[1|2] aaaaaa\n"
@@ -59,12 +70,20 @@ cmd_err_msg cmd_err_msgs[] = {
      " > nmi [set|clear]\n"
      " > aaaaaa: xx yy zz\n"
      " > save [mem|cpu] filename\n"
+     " > save snap filename (pack)\n"
      " > load mem (offset) filename\n"
-     " > load cpu filename\n"
+     " > load [cpu|snap] filename\n"
      " > cpu [reg] xxxx\n"
      " > cpu [option] [enable|disable|status]\n"
      " > bp aaaaaa\n"
-     " > uart [type] aaaaaa (pppp)\n"
+     " > uart [type] aaaaaa (pppp|pty|unix path)\n"
+     " > uart [type] aaaaaa file in out (fast)\n"
+     " > timeline [enable|disable|status] (n)\n"
+     " > rstep (n)\n"
+     " > rcont\n"
+     " > goto n\n"
+     " > trace [start|stop|status|mem|pc|cycles]\n"
+     " > prof [start|stop|status|report|folded]\n"
      " ? ... Help Menu\n"
      " ^C to clear command input"},
     {"HELP?", 3, 13, "Not help."},
@@ -85,7 +104,26 @@ cmd_err_msg cmd_err_msgs[] = {
     {"ERROR!", 3, 44, "Unable to allocate memory for operation."},
     {"ERROR!", 3, 23, "Unsupported device."},
     {"ERROR!", 3, 24, "Invalid port number."},
-    {"INFO",   3, 18, "UART disabled."}
+    {"INFO",   3, 18, "UART disabled."},
+    {"ERROR!", 3, 33, "Unable to map UART registers."},
+    {"ERROR!", 3, 25, "All UARTs are in use."},
+    {"ERROR!", 3, 37, "Overlaps the registers of a UART."},
+    {"INFO",   3, 27, "CPU option jit ENABLED."},
+    {"INFO",   3, 28, "CPU option jit DISABLED."},
+    {"ERROR!", 3, 38, "JIT is not supported on this host."},
+    {"INFO",   3, 30, "CPU option icache ENABLED."},
+    {"INFO",   3, 31, "CPU option icache DISABLED."},
+    {"INFO",   3, 21, "Timeline ENABLED."},
+    {"INFO",   3, 22, "Timeline DISABLED."},
+    {"INFO",   3, 42, "No earlier breakpoint in the timeline."},
+    {"ERROR!", 3, 40, "CPU stopped before reaching the point."},
+    {"INFO",   3, 18, "Trace STARTED."},
+    {"INFO",   3, 18, "Trace STOPPED."},
+    {"ERROR!", 3, 35, "Unable to write the trace file."},
+    {"INFO",   3, 20, "Profile STARTED."},
+    {"INFO",   3, 20, "Profile STOPPED."},
+    {"INFO",   3, 20, "Profile written."},
+    {"ERROR!", 3, 24, "No profile to write."}
 };
 
 
@@ -145,8 +183,8 @@ void print_cpu_regs(WINDOW *win, CPU_t *cpu, int y, int x)
     mvwprintw(win, y+7, x, "%d    %d    %d    %d    %d",
               cpu->P.RST, cpu->P.IRQ, cpu->P.NMI, cpu->P.STP, cpu->P.CRASH);
     mvwprintw(win, y+1, x+22, "%d%d%d%d%d%d%d%d|%d",
-              cpu->P.N, cpu->P.V, cpu->P.M, cpu->P.XB, cpu->P.D,
-              cpu->P.I, cpu->P.Z, cpu->P.C, cpu->P.E);
+              CPU_NZ_GET_N(cpu->nz), cpu->P.V, cpu->P.M, cpu->P.XB, cpu->P.D,
+              cpu->P.I, CPU_NZ_GET_Z(cpu->nz), cpu->P.C, cpu->P.E);
     mvwprintw(win, y+4, x+22, "%010ld", cpu->cycles);
     wattroff(win, A_BOLD);
 }
@@ -207,11 +245,11 @@ void update_cpu_hist(hist_t *hist, CPU_t *cpu, memory_t *mem, bool replace)
     memcpy(hist->cpu + i, cpu, sizeof(*cpu));
 
     // Copy in memory in case there is self-modifying asm code
-    hist->mem[i][0].val = _get_mem_byte(mem, _cpu_get_effective_pc(cpu), false);
+    hist->mem[i][0] = _get_mem_byte(mem, _cpu_get_effective_pc(cpu), false);
     val = _cpu_get_immd_long(cpu, mem, false);
-    hist->mem[i][1].val = val & 0xff;
-    hist->mem[i][2].val = (val >> 8) & 0xff;
-    hist->mem[i][3].val = (val >> 16) & 0xff;
+    hist->mem[i][1] = val & 0xff;
+    hist->mem[i][2] = (val >> 8) & 0xff;
+    hist->mem[i][3] = (val >> 16) & 0xff;
 }
 
 
@@ -223,7 +261,7 @@ void update_cpu_hist(hist_t *hist, CPU_t *cpu, memory_t *mem, bool replace)
  */
 void print_cpu_hist(hist_t *hist)
 {
-    size_t i, j, j_1, str_index, row, row_mod, row_prev;
+    size_t i, j, j_1 = 0, str_index, row, row_mod, row_prev;
     char buf[100];
     CPU_t *pcpu, *ccpu;
     bool prev_has_diff, curr_has_diff;
@@ -307,7 +345,7 @@ void print_cpu_hist(hist_t *hist)
                 wclrtoeol(hist->win);
 
                 // Print the current opcode
-                get_opcode_by_addr((memory_t*)&(hist->mem[j]), &(hist->cpu[j]), buf, 0);
+                get_opcode_by_bytes(hist->mem[j], &(hist->cpu[j]), buf);
                 mvwprintw(hist->win, row, 10, "%s", buf);
             }
             else {
@@ -355,32 +393,6 @@ bool is_dec_do_parse(char *str, uint32_t *val)
 }
 
 
-/**
- * Check if a string is a hex string and parse it if so
- * 
- * @param *str The string to parse
- * @param *val A pointer to the variable to store the parsed value in
- * @return false if the string is not hex (val will not be modified if so)
- *         true if the string is hex and was successfully parsed
- */
-bool is_hex_do_parse(char *str, uint32_t *val)
-{
-    // Determine if this is actually a hex address
-    char *tmp = str;
-    while (isxdigit(*tmp)) {
-        /* scan */
-        ++tmp;
-    }
-
-    // If the entire argument is hex, use it as an address
-    if (*tmp == '\0' || *tmp == '\n') {
-        *val = strtoul(str, NULL, 16);
-        return true;
-    }
-    return false;
-}
-
-
 /**
  * Load a file into memory
  * 
@@ -418,12 +430,12 @@ cmd_err_t load_file_mem(char *filename, memory_t *mem, uint32_t base_addr)
     size_t size = finfo.st_size;
             
     // Check file size
-    if (size / sizeof(*mem) > 0x1000000) {
+    if (size > MEMORY_SIZE) {
         return CMD_FILE_TOO_LARGE;
     }
 
     // Make sure the file won't wrap
-    if ((size / sizeof(*mem)) + base_addr > 0x1000000) {
+    if (size + base_addr > MEMORY_SIZE) {
         return CMD_FILE_WILL_WRAP;
     }
             
@@ -517,6 +529,35 @@ cmd_err_t load_file_cpu(char *filename, CPU_t *cpu)
 }
 
 
+/**
+ * Save a profile to a file
+ *
+ * @param *prof The profile (see prof_sync() if it is running)
+ * @param *filename The path of the file to save
+ * @param folded Save the folded stacks of the call tree instead of a report
+ * @return The error status of the save operation
+ */
+cmd_err_t save_file_prof(prof_t *prof, char *filename, bool folded)
+{
+    if (!prof->node_count) {
+        return CMD_PROF_EMPTY;
+    }
+
+    FILE *fp = fopen(filename, "w");
+
+    if (!fp) {
+        return CMD_FILE_IO_ERROR;
+    }
+
+    bool ok = folded ? prof_folded(prof, fp) : prof_report(prof, fp);
+
+    if (fclose(fp) != 0 || !ok) {
+        return CMD_FILE_IO_ERROR;
+    }
+    return CMD_OK;
+}
+
+
 /**
  * Clear the command input buffer and onscreen text
  * 
@@ -622,7 +663,7 @@ cmd_err_t command_execute_watch(watch_t *watch, char* tok)
     }
     else {
         // Check if user is setting watch start address
-        if (is_hex_do_parse(tok, &(watch->addr_s))) {
+        if (headless_parse_hex(tok, &(watch->addr_s))) {
 
             if (watch->addr_s > 0xffffff) {
                 return CMD_VAL_OVERFLOW;
@@ -665,9 +706,13 @@ cmd_err_t command_execute_watch(watch_t *watch, char* tok)
  * @param *watch2 Watch window 2 structure
  * @param *cpu The CPU to modify if a command needs to
  * @param *mem The memory to modify if a command needs to
+ * @param *uarts The UARTs to configure
+ * @param *tl The timeline, reset when a command changes the machine
+ * @param *tr The execution trace of the CPU
+ * @param *prof The profiler of the CPU
  * @return True if an error occured, false otherwise
  */
-cmd_status_t command_execute(cmd_err_t *status, char *_cmdbuf, int cmdbuf_index, watch_t *watch1, watch_t *watch2, CPU_t *cpu, memory_t *mem, tl16c750_t *uart)
+cmd_status_t command_execute(cmd_err_t *status, char *_cmdbuf, int cmdbuf_index, watch_t *watch1, watch_t *watch2, CPU_t *cpu, memory_t *mem, tl16c750_t *uarts, timeline_t *tl, trace_t *tr, prof_t *prof)
 {
     if (cmdbuf_index == 0) {
         *status = CMD_OK; // No command
@@ -718,6 +763,7 @@ cmd_status_t command_execute(cmd_err_t *status, char *_cmdbuf, int cmdbuf_index,
             *status = CMD_UNKNOWN_ARG;
             return STAT_ERR;
         }
+        timeline_reset(tl);
         *status = CMD_OK;
         return STAT_OK;
     }
@@ -741,6 +787,7 @@ cmd_status_t command_execute(cmd_err_t *status, char *_cmdbuf, int cmdbuf_index,
             *status = CMD_UNKNOWN_ARG;
             return STAT_ERR;
         }
+        timeline_reset(tl);
         *status = CMD_OK;
         return STAT_OK;
     }
@@ -811,6 +858,26 @@ cmd_status_t command_execute(cmd_err_t *status, char *_cmdbuf, int cmdbuf_index,
             fprintf(fp, "%s", buf);
             fclose(fp);
         }
+        else if (strcmp(tok, "snap") == 0) { // Whole machine snapshot
+
+            bool pack = false;
+            tok = strtok(NULL, " \t\n\r");
+
+            if (tok) {
+                if (strcmp(tok, "pack") != 0) {
+                    *status = CMD_UNKNOWN_ARG;
+                    return STAT_ERR;
+                }
+                pack = true;
+            }
+
+            snap_err_t err = snapshot_save(filename, cpu, mem, uarts, UART_MAX_COUNT, pack);
+            if (err != SNAP_OK) {
+                sprintf(global_err_msg_buf, "%s", snapshot_strerror(err));
+                *status = CMD_SPECIAL;
+                return STAT_ERR;
+            }
+        }
         else {
             *status = CMD_EXPECTED_ARG;
             return STAT_ERR;
@@ -841,7 +908,7 @@ cmd_status_t command_execute(cmd_err_t *status, char *_cmdbuf, int cmdbuf_index,
             uint32_t base_addr = 0;
 
             // If a load offset is given, parse it
-            if (is_hex_do_parse(tok, &base_addr)) {
+            if (headless_parse_hex(tok, &base_addr)) {
 
                 if (base_addr > 0xffffff) {
                     *status = CMD_VAL_OVERFLOW;
@@ -861,6 +928,7 @@ cmd_status_t command_execute(cmd_err_t *status, char *_cmdbuf, int cmdbuf_index,
             if (*status != CMD_OK) {
                 return STAT_ERR;
             } else {
+                timeline_reset(tl);
                 return STAT_OK;
             }
         }
@@ -874,7 +942,29 @@ cmd_status_t command_execute(cmd_err_t *status, char *_cmdbuf, int cmdbuf_index,
                 return STAT_ERR;
             }
 
-            return load_file_cpu(tok, cpu);
+            cmd_status_t stat = load_file_cpu(tok, cpu);
+            timeline_reset(tl);
+            return stat;
+        }
+        else if (strcmp(tok, "snap") == 0) {
+
+            // Get filename
+            tok = strtok(NULL, " \t\n\r");
+
+            if (!tok) {
+                *status = CMD_EXPECTED_FILENAME;
+                return STAT_ERR;
+            }
+
+            snap_err_t err = snapshot_load(tok, cpu, mem, uarts, UART_MAX_COUNT);
+            timeline_reset(tl);
+            if (err != SNAP_OK) {
+                sprintf(global_err_msg_buf, "%s", snapshot_strerror(err));
+                *status = CMD_SPECIAL;
+                return STAT_ERR;
+            }
+            *status = CMD_OK;
+            return STAT_OK;
         }
         else {
             *status = CMD_UNKNOWN_ARG;
@@ -907,11 +997,13 @@ cmd_status_t command_execute(cmd_err_t *status, char *_cmdbuf, int cmdbuf_index,
 
             if (strcmp(tok, "enable") == 0) {
                 cpu->cop_vect_enable = true;
+                timeline_reset(tl);
                 *status = CMD_CPU_OPTION_COP_VEC_ENABLED;
                 return STAT_INFO;
             }
             else if (strcmp(tok, "disable") == 0) {
                 cpu->cop_vect_enable = true;
+                timeline_reset(tl);
                 *status = CMD_CPU_OPTION_COP_VEC_DISABLED;
                 return STAT_INFO;
             }
@@ -928,6 +1020,94 @@ cmd_status_t command_execute(cmd_err_t *status, char *_cmdbuf, int cmdbuf_index,
             return STAT_ERR;
         }
 
+        // Check for JIT option
+        if (strcmp(tok, "jit") == 0) {
+
+            tok = strtok(NULL, " \t\n\r");
+
+            if (!tok) {
+                *status = CMD_EXPECTED_ARG;
+                return STAT_ERR;
+            }
+
+            // perf also writes a symbol map of the translated blocks
+            if (strcmp(tok, "enable") == 0 || strcmp(tok, "perf") == 0) {
+                if (!cpu->jit) {
+                    if (!jit_supported()) {
+                        *status = CMD_JIT_UNAVAILABLE;
+                        return STAT_ERR;
+                    }
+
+                    jit_t *jit = malloc(sizeof(jit_t));
+
+                    if (!jit || !jit_init(jit, mem, strcmp(tok, "perf") == 0)) {
+                        free(jit);
+                        *status = CMD_OUT_OF_MEM;
+                        return STAT_ERR;
+                    }
+                    cpu->jit = jit;
+                }
+                *status = CMD_CPU_OPTION_JIT_ENABLED;
+                return STAT_INFO;
+            }
+            else if (strcmp(tok, "disable") == 0) {
+                if (cpu->jit) {
+                    jit_free(cpu->jit);
+                    free(cpu->jit);
+                    cpu->jit = NULL;
+                }
+                *status = CMD_CPU_OPTION_JIT_DISABLED;
+                return STAT_INFO;
+            }
+            else if (strcmp(tok, "status") == 0) {
+                *status = cpu->jit ? CMD_CPU_OPTION_JIT_ENABLED : CMD_CPU_OPTION_JIT_DISABLED;
+                return STAT_INFO;
+            }
+            *status = CMD_UNKNOWN_ARG;
+            return STAT_ERR;
+        }
+
+        // Check for instruction cache option
+        if (strcmp(tok, "icache") == 0) {
+
+            tok = strtok(NULL, " \t\n\r");
+
+            if (!tok) {
+                *status = CMD_EXPECTED_ARG;
+                return STAT_ERR;
+            }
+
+            if (strcmp(tok, "enable") == 0) {
+                if (!cpu->icache) {
+                    icache_t *icache = malloc(sizeof(icache_t));
+
+                    if (!icache || !icache_init(icache, cpu, mem)) {
+                        free(icache);
+                        *status = CMD_OUT_OF_MEM;
+                        return STAT_ERR;
+                    }
+                    cpu->icache = icache;
+                }
+                *status = CMD_CPU_OPTION_ICACHE_ENABLED;
+                return STAT_INFO;
+            }
+            else if (strcmp(tok, "disable") == 0) {
+                if (cpu->icache) {
+                    icache_free(cpu->icache);
+                    free(cpu->icache);
+                    cpu->icache = NULL;
+                }
+                *status = CMD_CPU_OPTION_ICACHE_DISABLED;
+                return STAT_INFO;
+            }
+            else if (strcmp(tok, "status") == 0) {
+                *status = cpu->icache ? CMD_CPU_OPTION_ICACHE_ENABLED : CMD_CPU_OPTION_ICACHE_DISABLED;
+                return STAT_INFO;
+            }
+            *status = CMD_UNKNOWN_ARG;
+            return STAT_ERR;
+        }
+
         // Else, it's a register assignment
         
         char *hexval = strtok(NULL, " \t\n\r");
@@ -940,7 +1120,7 @@ cmd_status_t command_execute(cmd_err_t *status, char *_cmdbuf, int cmdbuf_index,
         uint32_t val = 0;
         
         // Make sure it's hex
-        if (!is_hex_do_parse(hexval, &val)) {
+        if (!headless_parse_hex(hexval, &val)) {
             *status = CMD_EXPECTED_VALUE;
             return STAT_ERR;
         }
@@ -1018,7 +1198,7 @@ cmd_status_t command_execute(cmd_err_t *status, char *_cmdbuf, int cmdbuf_index,
                 *status = CMD_VAL_OVERFLOW;
                 return STAT_ERR;
             }
-            cpu->P.N = val;
+            cpu->nz = CPU_NZ(val, CPU_NZ_GET_Z(cpu->nz));
         }
         else if (strcmp(tok, "P.V") == 0) {
             if (val > 0x1) {
@@ -1060,7 +1240,7 @@ cmd_status_t command_execute(cmd_err_t *status, char *_cmdbuf, int cmdbuf_index,
                 *status = CMD_VAL_OVERFLOW;
                 return STAT_ERR;
             }
-            cpu->P.Z = val;
+            cpu->nz = CPU_NZ(CPU_NZ_GET_N(cpu->nz), val);
         }
         else if (strcmp(tok, "P.C") == 0) {
             if (val > 0x1) {
@@ -1115,6 +1295,8 @@ cmd_status_t command_execute(cmd_err_t *status, char *_cmdbuf, int cmdbuf_index,
             *status = CMD_UNKNOWN_ARG;
             return STAT_ERR;
         }
+        _cpu_update_width(cpu); // In case P.E, P.M or P.X changed
+        timeline_reset(tl);
         *status = CMD_OK;
         return STAT_OK;
     }
@@ -1129,7 +1311,7 @@ cmd_status_t command_execute(cmd_err_t *status, char *_cmdbuf, int cmdbuf_index,
 
         uint32_t addr;
 
-        if (!is_hex_do_parse(tok, &addr)) {
+        if (!headless_parse_hex(tok, &addr)) {
             *status = CMD_EXPECTED_VALUE;
             return STAT_ERR;
         }
@@ -1164,19 +1346,53 @@ cmd_status_t command_execute(cmd_err_t *status, char *_cmdbuf, int cmdbuf_index,
         // Get base address for UART device
         uint32_t addr;
 
-        if (!is_hex_do_parse(tmp, &addr)) {
+        if (!headless_parse_hex(tmp, &addr)) {
             *status = CMD_EXPECTED_VALUE;
             return STAT_ERR;
         }
 
-        // Get port for UART to listen on (for network connections)
+        // Get port for UART to listen on (for network connections),
+        // or "pty", "unix path" or "file in out (fast)" for the
+        // other backends
         // Optional parameter
         tmp = strtok(NULL, " \t\n\r");
         
-        uint32_t port;
+        uint32_t port = UART_SOCK_PORT;
+        uart_backend_t backend = UART_BACKEND_TCP;
+        char *path = NULL;
+        char *out_path = NULL;
+        bool unpaced = false;
 
         if (!tmp) {
-            port = UART_SOCK_PORT;
+            // Default TCP port
+        } else if (strcmp(tmp, "pty") == 0) {
+            backend = UART_BACKEND_PTY;
+        } else if (strcmp(tmp, "unix") == 0) {
+            backend = UART_BACKEND_UNIX;
+            path = strtok(NULL, " \t\n\r");
+
+            if (!path) {
+                *status = CMD_EXPECTED_FILENAME;
+                return STAT_ERR;
+            }
+        } else if (strcmp(tmp, "file") == 0) {
+            backend = UART_BACKEND_FILE;
+            path = strtok(NULL, " \t\n\r");
+            out_path = strtok(NULL, " \t\n\r");
+
+            if (!path || !out_path) {
+                *status = CMD_EXPECTED_FILENAME;
+                return STAT_ERR;
+            }
+
+            tmp = strtok(NULL, " \t\n\r");
+            if (tmp && strcmp(tmp, "fast") == 0) {
+                unpaced = true;
+            }
+            else if (tmp) {
+                *status = CMD_UNKNOWN_ARG;
+                return STAT_ERR;
+            }
         } else if (!is_dec_do_parse(tmp, &port)) {
             *status = CMD_EXPECTED_VALUE;
             return STAT_ERR;
@@ -1189,12 +1405,69 @@ cmd_status_t command_execute(cmd_err_t *status, char *_cmdbuf, int cmdbuf_index,
 
         if (strcmp(tok, "c750") == 0) {
 
+            // Reconfigure the UART at this address, otherwise
+            // take one which is not in use
+            tl16c750_t *uart = NULL;
+
+            for (int i = 0; i < UART_MAX_COUNT && !uart; ++i) {
+                if (uarts[i].enabled && uarts[i].addr == addr) {
+                    uart = &uarts[i];
+                }
+            }
+            for (int i = 0; i < UART_MAX_COUNT && !uart; ++i) {
+                if (!uarts[i].enabled) {
+                    uart = &uarts[i];
+                }
+            }
+
+            if (!uart) {
+                *status = CMD_UART_LIMIT;
+                return STAT_ERR;
+            }
+
+            // Each register may only belong to one UART
+            for (int i = 0; i < UART_MAX_COUNT && port; ++i) {
+                if (&uarts[i] != uart && uarts[i].enabled &&
+                    addr <= uarts[i].addr + TLA_SCR && uarts[i].addr <= addr + TLA_SCR) {
+                    *status = CMD_UART_OVERLAP;
+                    return STAT_ERR;
+                }
+            }
+
+            // Unmap the UART from its previous address (if any)
+            detach_16c750(uart, mem);
             uart->addr = addr;
 
             int err;
-            if ((err = init_port_16c750(uart, port))) {
-                sprintf(global_err_msg_buf, "%s (port: %d)", strerror(err), port);
+            if (backend == UART_BACKEND_PTY) {
+                err = init_pty_16c750(uart);
+            }
+            else if (backend == UART_BACKEND_UNIX) {
+                err = init_unix_16c750(uart, path);
+            }
+            else if (backend == UART_BACKEND_FILE) {
+                err = init_file_16c750(uart, path, out_path, unpaced);
+            }
+            else {
+                err = init_port_16c750(uart, port);
+            }
+
+            if (err) {
+                if (backend == UART_BACKEND_PTY) {
+                    sprintf(global_err_msg_buf, "%s (pty)", strerror(err));
+                }
+                else if (backend == UART_BACKEND_UNIX) {
+                    snprintf(global_err_msg_buf, sizeof(global_err_msg_buf), "%s (path: %s)", strerror(err), path);
+                }
+                else if (backend == UART_BACKEND_FILE) {
+                    snprintf(global_err_msg_buf, sizeof(global_err_msg_buf), "%s (files: %s %s)", strerror(err), path, out_path);
+                }
+                else {
+                    sprintf(global_err_msg_buf, "%s (port: %d)", strerror(err), port);
+                }
+                stop_16c750(uart);
                 uart->enabled = false;
+                timeline_reset(tl);
                 
                 *status = CMD_SPECIAL;
                 return STAT_ERR;
@@ -1203,12 +1476,31 @@ cmd_status_t command_execute(cmd_err_t *status, char *_cmdbuf, int cmdbuf_index,
             // If port is 0, disable UART
             if (port == 0) {
                 uart->enabled = false;
+                timeline_reset(tl);
                 
                 *status = CMD_UART_DISABLED;
                 return STAT_INFO;
             }
             
+            if (!attach_16c750(uart, mem)) {
+                stop_16c750(uart);
+                uart->enabled = false;
+                timeline_reset(tl);
+
+                *status = CMD_UART_NOT_MAPPED;
+                return STAT_ERR;
+            }
+
             uart->enabled = true;
+            timeline_reset(tl);
+
+            // The pty's name is only known now, the user needs it to connect
+            if (backend == UART_BACKEND_PTY) {
+                sprintf(global_err_msg_buf, "UART on %s", uart->pty_name);
+
+                *status = CMD_SPECIAL_INFO;
+                return STAT_INFO;
+            }
             
             *status = CMD_OK;
             return STAT_OK;
@@ -1218,6 +1510,303 @@ cmd_status_t command_execute(cmd_err_t *status, char *_cmdbuf, int cmdbuf_index,
             return STAT_ERR;
         }
     }
+    else if (strcmp(tok, "timeline") == 0) {
+
+        tok = strtok(NULL, " \t\n\r");
+
+        if (!tok) {
+            *status = CMD_EXPECTED_ARG;
+            return STAT_ERR;
+        }
+
+        if (strcmp(tok, "enable") == 0) {
+
+            // Optional number of cycles between checkpoints
+            uint64_t interval = 0;
+            tok = strtok(NULL, " \t\n\r");
+
+            if (tok && !headless_parse_dec64(tok, &interval)) {
+                *status = CMD_EXPECTED_VALUE;
+                return STAT_ERR;
+            }
+
+            if (!timeline_enable(tl, interval)) {
+                *status = CMD_OUT_OF_MEM;
+                return STAT_ERR;
+            }
+            *status = CMD_TIMELINE_ENABLED;
+            return STAT_INFO;
+        }
+        else if (strcmp(tok, "disable") == 0) {
+            timeline_disable(tl);
+            *status = CMD_TIMELINE_DISABLED;
+            return STAT_INFO;
+        }
+        else if (strcmp(tok, "status") == 0) {
+            if (!tl->enabled) {
+                *status = CMD_TIMELINE_DISABLED;
+                return STAT_INFO;
+            }
+            sprintf(global_err_msg_buf, "At instruction %" PRIu64 " of %" PRIu64 ", %d checkpoints %" PRIu64 " cycles apart",
+                    tl->inst, tl->end_inst, tl->count, tl->interval);
+            *status = CMD_SPECIAL_INFO;
+            return STAT_INFO;
+        }
+        *status = CMD_UNKNOWN_ARG;
+        return STAT_ERR;
+    }
+    else if (strcmp(tok, "rstep") == 0) { // Reverse step
+
+        uint64_t n = 1;
+        tok = strtok(NULL, " \t\n\r");
+
+        if (tok && !headless_parse_dec64(tok, &n)) {
+            *status = CMD_EXPECTED_VALUE;
+            return STAT_ERR;
+        }
+        if (!tl->enabled) {
+            *status = CMD_TIMELINE_DISABLED;
+            return STAT_INFO;
+        }
+
+        if (!timeline_seek(tl, (n < tl->inst) ? tl->inst - n : 0)) {
+            *status = CMD_TIMELINE_NOT_REACHED;
+            return STAT_ERR;
+        }
+        *status = CMD_OK;
+        return STAT_OK;
+    }
+    else if (strcmp(tok, "rcont") == 0) { // Reverse continue
+        if (!tl->enabled) {
+            *status = CMD_TIMELINE_DISABLED;
+            return STAT_INFO;
+        }
+
+        if (!timeline_reverse_continue(tl)) {
+            *status = CMD_TIMELINE_NO_BREAKPOINT;
+            return STAT_INFO;
+        }
+        *status = CMD_OK;
+        return STAT_OK;
+    }
+    else if (strcmp(tok, "goto") == 0) { // Go to a cycle count
+
+        uint64_t cycles;
+        tok = strtok(NULL, " \t\n\r");
+
+        if (!tok || !headless_parse_dec64(tok, &cycles)) {
+            *status = CMD_EXPECTED_VALUE;
+            return STAT_ERR;
+        }
+        if (!tl->enabled) {
+            *status = CMD_TIMELINE_DISABLED;
+            return STAT_INFO;
+        }
+
+        if (!timeline_goto_cycle(tl, cycles)) {
+            *status = CMD_TIMELINE_NOT_REACHED;
+            return STAT_ERR;
+        }
+        *status = CMD_OK;
+        return STAT_OK;
+    }
+    else if (strcmp(tok, "trace") == 0) { // Execution trace
+
+        tok = strtok(NULL, " \t\n\r");
+
+        if (!tok) {
+            *status = CMD_EXPECTED_ARG;
+            return STAT_ERR;
+        }
+
+        if (strcmp(tok, "start") == 0) {
+
+            // Get filename
+            tok = strtok(NULL, " \t\n\r");
+
+            if (!tok) {
+                *status = CMD_EXPECTED_FILENAME;
+                return STAT_ERR;
+            }
+
+            if (tr->running) {
+                cpu->trace = NULL;
+                trace_stop(tr);
+            }
+            if (!trace_start(tr, tok)) {
+                sprintf(global_err_msg_buf, "Unable to start the trace: %s", strerror(errno));
+                *status = CMD_SPECIAL;
+                return STAT_ERR;
+            }
+            cpu->trace = tr;
+            *status = CMD_TRACE_STARTED;
+            return STAT_INFO;
+        }
+        else if (strcmp(tok, "stop") == 0) {
+            cpu->trace = NULL;
+
+            if (!trace_stop(tr)) {
+                *status = CMD_TRACE_WRITE_ERROR;
+                return STAT_ERR;
+            }
+            *status = CMD_TRACE_STOPPED;
+            return STAT_INFO;
+        }
+        else if (strcmp(tok, "status") == 0) {
+            sprintf(global_err_msg_buf, "%s, %" PRIu64 " records in %" PRIu64 " bytes",
+                    tr->running ? "Tracing" : "Not tracing", atomic_load(&tr->records), atomic_load(&tr->bytes));
+            *status = CMD_SPECIAL_INFO;
+            return STAT_INFO;
+        }
+        else if (strcmp(tok, "mem") == 0) { // Record effective addresses
+
+            tok = strtok(NULL, " \t\n\r");
+
+            if (!tok) {
+                *status = CMD_EXPECTED_ARG;
+                return STAT_ERR;
+            }
+
+            if (strcmp(tok, "enable") == 0) {
+                tr->mem = true;
+            }
+            else if (strcmp(tok, "disable") == 0) {
+                tr->mem = false;
+            }
+            else {
+                *status = CMD_UNKNOWN_ARG;
+                return STAT_ERR;
+            }
+            *status = CMD_OK;
+            return STAT_OK;
+        }
+        else if (strcmp(tok, "pc") == 0) { // Range of addresses
+
+            uint32_t lo, hi;
+            char *tok_hi;
+
+            tok = strtok(NULL, " \t\n\r");
+            tok_hi = strtok(NULL, " \t\n\r");
+
+            if (!tok || !tok_hi || !headless_parse_hex(tok, &lo) || !headless_parse_hex(tok_hi, &hi)) {
+                *status = CMD_EXPECTED_VALUE;
+                return STAT_ERR;
+            }
+            if (lo > 0xffffff || hi > 0xffffff) {
+                *status = CMD_VAL_OVERFLOW;
+                return STAT_ERR;
+            }
+            tr->pc_lo = lo;
+            tr->pc_hi = hi;
+            *status = CMD_OK;
+            return STAT_OK;
+        }
+        else if (strcmp(tok, "cycles") == 0) { // Window of cycle counts
+
+            uint64_t lo, hi = 0;
+
+            tok = strtok(NULL, " \t\n\r");
+
+            if (!tok || !headless_parse_dec64(tok, &lo)) {
+                *status = CMD_EXPECTED_VALUE;
+                return STAT_ERR;
+            }
+
+            // Optional end of the window
+            tok = strtok(NULL, " \t\n\r");
+
+            if (tok && !headless_parse_dec64(tok, &hi)) {
+                *status = CMD_EXPECTED_VALUE;
+                return STAT_ERR;
+            }
+            tr->cycles_lo = lo;
+            tr->cycles_hi = hi;
+            *status = CMD_OK;
+            return STAT_OK;
+        }
+        *status = CMD_UNKNOWN_ARG;
+        return STAT_ERR;
+    }
+    else if (strcmp(tok, "prof") == 0) { // Profiler
+
+        tok = strtok(NULL, " \t\n\r");
+
+        if (!tok) {
+            *status = CMD_EXPECTED_ARG;
+            return STAT_ERR;
+        }
+
+        if (strcmp(tok, "start") == 0) {
+
+            // Optional sampling interval (0 = count every instruction)
+            uint64_t interval = 0;
+
+            tok = strtok(NULL, " \t\n\r");
+
+            if (tok && !headless_parse_dec64(tok, &interval)) {
+                *status = CMD_EXPECTED_VALUE;
+                return STAT_ERR;
+            }
+
+            cpu->prof = NULL;
+            prof_stop(prof, cpu);
+
+            if (!prof_start(prof, cpu, interval)) {
+                *status = CMD_OUT_OF_MEM;
+                return STAT_ERR;
+            }
+            cpu->prof = prof;
+            *status = CMD_PROF_STARTED;
+            return STAT_INFO;
+        }
+        else if (strcmp(tok, "stop") == 0) {
+            cpu->prof = NULL;
+            prof_stop(prof, cpu);
+            *status = CMD_PROF_STOPPED;
+            return STAT_INFO;
+        }
+        else if (strcmp(tok, "status") == 0) {
+            prof_sync(prof, cpu);
+
+            if (!prof->running) {
+                sprintf(global_err_msg_buf, "Not profiling, %" PRIu64 " cycles in the profile",
+                        prof_total(prof));
+            }
+            else if (prof->interval) {
+                sprintf(global_err_msg_buf, "Profiling every %" PRIu64 " cycles, %" PRIu64 " samples",
+                        prof->interval, prof->steps);
+            }
+            else {
+                sprintf(global_err_msg_buf, "Profiling, %" PRIu64 " cycles, %" PRIu64 " instructions",
+                        prof_total(prof), prof->steps);
+            }
+            *status = CMD_SPECIAL_INFO;
+            return STAT_INFO;
+        }
+        else if (strcmp(tok, "report") == 0 || strcmp(tok, "folded") == 0) {
+
+            bool folded = tok[0] == 'f';
+
+            // Get filename
+            tok = strtok(NULL, " \t\n\r");
+
+            if (!tok) {
+                *status = CMD_EXPECTED_FILENAME;
+                return STAT_ERR;
+            }
+
+            prof_sync(prof, cpu);
+            *status = save_file_prof(prof, tok, folded);
+
+            if (*status != CMD_OK) {
+                return STAT_ERR;
+            }
+            *status = CMD_PROF_WRITTEN;
+            return STAT_INFO;
+        }
+        *status = CMD_UNKNOWN_ARG;
+        return STAT_ERR;
+    }
 
     // Not a named command, maybe it's a memory access?
     static uint32_t addr = 0; // Retain the previous value
@@ -1251,6 +1840,10 @@ cmd_status_t command_execute(cmd_err_t *status, char *_cmdbuf, int cmdbuf_index,
         valid_character = isxdigit(*next) || isspace(*next) || (*next == ':') || (*next == '\0');
     }
 
+    if (found_store_delim) {
+        timeline_reset(tl);
+    }
+
     if (!valid_character && found_store_delim) {
         *status = CMD_INVALID_CHAR;
         return STAT_ERR;
@@ -1405,7 +1998,7 @@ void msg_box(WINDOW **win, char *msg, char *title, int height, int width, int sc
     // User message
     // Need to malloc and copy since string literals
     // are stored in RO region of memory
-    char *msg_dup = malloc(sizeof(*msg) * strlen(msg));
+    char *msg_dup = malloc(sizeof(*msg) * (strlen(msg) + 1));
     strcpy(msg_dup, msg);
     
     char *tok = strtok(msg_dup, "\n"); // Print each line separately
@@ -1460,6 +2053,38 @@ void hist_init(hist_t *h)
 }
 
 
+/**
+ * Fill a history with the instructions which led up to the point a
+ * timeline is at, by going back and running them again
+ * 
+ * @param *h The history to fill
+ * @param *tl The timeline (its CPU ends up where it was)
+ */
+void hist_from_timeline(hist_t *h, timeline_t *tl)
+{
+    uint64_t inst = tl->inst;
+    uint64_t cycles = tl->cpu->cycles;
+
+    h->entry_count = 0;
+    h->entry_start = 0;
+    wclear(h->win);
+
+    timeline_seek(tl, (inst > CMD_HIST_ENTRIES - 1) ? inst - (CMD_HIST_ENTRIES - 1) : 0);
+    update_cpu_hist(h, tl->cpu, tl->mem, PUSH_INST);
+
+    while (tl->inst < inst && timeline_run(tl, 0, 1, NULL) > 0) {
+        update_cpu_hist(h, tl->cpu, tl->mem, PUSH_INST);
+    }
+
+    // A goto may end on a WAI, past the end of its instruction
+    if (tl->cpu->cycles < cycles) {
+        timeline_goto_cycle(tl, cycles);
+        update_cpu_hist(h, tl->cpu, tl->mem, REPLACE_INST);
+    }
+    tl->moved = false;
+}
+
+
 void print_help_and_exit()
 {
     printf(
@@ -1472,6 +2097,19 @@ void print_help_and_exit()
         " --mem (offset) filename ... Load memory at offset (in hex) with a file\n"
         " --cmd \"[command here]\" .... Run a command during initialization\n"
         " --cmd_file filename ....... Run commands from a file during initialization\n"
+        " --snap filename ........... Load a snapshot (saved by 'save snap')\n"
+        "\n"
+        "Headless mode:\n"
+        " --headless ................ Run without the UI until STP, CRASH, a breakpoint,\n"
+        "                             or a budget is reached, then print the CPU state\n"
+        " --max_cycles n ............ Stop a headless run after n (decimal) cycles\n"
+        " --max_inst n .............. Stop a headless run after n (decimal) instructions\n"
+        " --dump aaaaaa bbbbbb ...... Print memory from aaaaaa to bbbbbb (inclusive, hex)\n"
+        "                             after a headless run (may be repeated)\n"
+        " --out filename ............ Write headless results to a file instead of stdout\n"
+        " --save_snap filename ...... Save a snapshot after a headless run\n"
+        " --prof filename ........... Profile a headless run, and save the report to a\n"
+        "                             file and the folded stacks to filename.folded\n"
         "\n"
         );
     exit(EXIT_SUCCESS);
@@ -1486,7 +2124,6 @@ int main(int argc, char *argv[])
     bool alert = true;
     bool cmd_exit = false;
     bool in_run_mode = false;
-    int run_mode_step_count = 0;
     WINDOW *win_cpu, *win_cmd, *win_msg = NULL;
     char cmdbuf[MAX_CMD_LEN];
     char cmdbuf_dup[MAX_CMD_LEN];
@@ -1502,22 +2139,60 @@ int main(int argc, char *argv[])
     hist_t inst_hist;
     hist_init(&inst_hist);
     
-    CPU_t cpu;
+    CPU_t cpu = {0}; // Registers not set by a reset start out zeroed
     initCPU(&cpu);
     resetCPU(&cpu);
     cpu.setacc = true; // Enable CPU to update access flags
 
-    tl16c750_t uart;
-    init_16c750(&uart);
-    uart.enabled = false;
+    // Device events are run against the CPU cycle count
+    scheduler_t sched;
+    sched_init(&sched, &cpu);
 
-    memory_t *memory = calloc(MEMORY_SIZE, sizeof(*memory));
+    // Socket I/O of all UARTs runs on one thread
+    io_thread_t uart_io;
+    if (!io_init(&uart_io)) {
+        printf("Unable to set up the UART I/O thread!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Their interrupts are ORed onto the CPU's IRQ line
+    tl16c750_t uarts[UART_MAX_COUNT];
+    for (int i = 0; i < UART_MAX_COUNT; ++i) {
+        init_16c750(&uarts[i]);
+        uarts[i].enabled = false;
+        uarts[i].io = &uart_io;
+        uarts[i].sched = &sched;
+        uarts[i].irq_line = i;
+    }
 
-    if (!memory) {
+    headless_t headless;
+    headless_init(&headless);
+
+    memory_t system_mem;
+    memory_t *memory = &system_mem;
+
+    // Track accesses for the read/write highlights in the memory watches
+    if (!_init_mem(memory, true)) {
         printf("Unable to allocate system memory!\n");
         exit(EXIT_FAILURE);
     }
 
+    // Checkpoints and host input of the run, so the CPU can be stepped
+    // backwards. Enabled up front so a --cmd can configure it.
+    timeline_t timeline;
+    timeline_init(&timeline, &cpu, memory, &sched, uarts, UART_MAX_COUNT);
+    if (!timeline_enable(&timeline, 0)) {
+        printf("Unable to allocate the timeline, running without it!\n");
+    }
+
+    // Started by 'trace start'
+    trace_t trace;
+    trace_init(&trace);
+
+    // Started by 'prof start', or --prof
+    prof_t prof;
+    prof_init(&prof);
+
     // Command line parsing
     printf("Loading simulator...\n");
 
@@ -1536,9 +2211,37 @@ int main(int argc, char *argv[])
                 else if (strcmp(argv[i], "--cmd") == 0) {
                     cli_pstate = 3;
                 }
+                else if (strcmp(argv[i], "--snap") == 0) {
+                    cli_pstate = 10;
+                }
                 else if (strcmp(argv[i], "--cmd_file") == 0) {
                     cli_pstate = 4;
                 }
+                else if (strcmp(argv[i], "--headless") == 0) {
+                    headless.enabled = true;
+                }
+                else if (strcmp(argv[i], "--max_cycles") == 0) {
+                    cli_pstate = 5;
+                }
+                else if (strcmp(argv[i], "--max_inst") == 0) {
+                    cli_pstate = 6;
+                }
+                else if (strcmp(argv[i], "--dump") == 0) {
+                    if (headless.dump_count == HEADLESS_MAX_DUMPS) {
+                        printf("Too many --dump ranges (max %d)\n", HEADLESS_MAX_DUMPS);
+                        exit(EXIT_FAILURE);
+                    }
+                    cli_pstate = 7;
+                }
+                else if (strcmp(argv[i], "--out") == 0) {
+                    cli_pstate = 9;
+                }
+                else if (strcmp(argv[i], "--save_snap") == 0) {
+                    cli_pstate = 11;
+                }
+                else if (strcmp(argv[i], "--prof") == 0) {
+                    cli_pstate = 12;
+                }
                 else if (strcmp(argv[i], "--help") == 0) {
                     print_help_and_exit();
                 }
@@ -1557,7 +2260,7 @@ int main(int argc, char *argv[])
             case 2: // MEM load
                 // If the argument is hex, use it as an address
                 // Otherwise just load the file
-                if (!is_hex_do_parse(argv[i], &base_addr)) {
+                if (!headless_parse_hex(argv[i], &base_addr)) {
                     if ((cmd_err = load_file_mem(argv[i], memory, base_addr)) > 0) {
                         printf("Error! (%s) %s\n", argv[i], cmd_err_msgs[cmd_err].msg);
                         exit(EXIT_FAILURE);
@@ -1573,7 +2276,10 @@ int main(int argc, char *argv[])
                     &watch1, &watch2,
                     &cpu,
                     memory,
-                    &uart
+                    uarts,
+                    &timeline,
+                    &trace,
+                    &prof
                     );
                     
                 if (cmd_stat != STAT_OK) {
@@ -1585,6 +2291,7 @@ int main(int argc, char *argv[])
                     else if (cmd_stat == STAT_INFO) {
                         // Print info messages
                         printf("Info (%s) %s\n", argv[i], cmd_err_msgs[cmd_err].msg);
+                        fflush(stdout); // e.g. a pty name, needed while running
                     }
                     else {
                         // If there is errors, print an appropiate message
@@ -1618,7 +2325,10 @@ int main(int argc, char *argv[])
                         &watch1, &watch2,
                         &cpu,
                         memory,
-                        &uart
+                        uarts,
+                        &timeline,
+                        &trace,
+                        &prof
                         );
                     
                     if (cmd_stat != STAT_OK) {
@@ -1630,6 +2340,7 @@ int main(int argc, char *argv[])
                         else if (cmd_stat == STAT_INFO) {
                             // Print info messages
                             printf("Info (%s, %s) %s\n", argv[i], buf, cmd_err_msgs[cmd_err].msg);
+                            fflush(stdout);
                         }
                         else {
                             // If there is errors, print an appropiate message
@@ -1641,6 +2352,65 @@ int main(int argc, char *argv[])
 
                 fclose(fp);
                 
+                cli_pstate = 0;
+            }
+                break;
+            case 5: // Cycle budget
+                if (!headless_parse_dec64(argv[i], &headless.max_cycles)) {
+                    printf("Error! (%s) Expected a decimal cycle count\n", argv[i]);
+                    exit(EXIT_FAILURE);
+                }
+                cli_pstate = 0;
+                break;
+            case 6: // Instruction budget
+                if (!headless_parse_dec64(argv[i], &headless.max_inst)) {
+                    printf("Error! (%s) Expected a decimal instruction count\n", argv[i]);
+                    exit(EXIT_FAILURE);
+                }
+                cli_pstate = 0;
+                break;
+            case 7: // Dump range start
+            case 8: { // Dump range end
+                uint32_t addr;
+                if (!headless_parse_hex(argv[i], &addr) || addr > 0xffffff) {
+                    printf("Error! (%s) Expected a 24-bit hex address\n", argv[i]);
+                    exit(EXIT_FAILURE);
+                }
+
+                dump_range_t *range = &headless.dumps[headless.dump_count];
+                if (cli_pstate == 7) {
+                    range->start = addr;
+                    cli_pstate = 8;
+                }
+                else if (addr < range->start) {
+                    printf("Error! (%s) Dump range end is before its start\n", argv[i]);
+                    exit(EXIT_FAILURE);
+                }
+                else {
+                    range->end = addr;
+                    ++headless.dump_count;
+                    cli_pstate = 0;
+                }
+            }
+                break;
+            case 9: // Headless output file
+                headless.out_filename = argv[i];
+                cli_pstate = 0;
+                break;
+            case 11: // Headless snapshot file
+                headless.snap_filename = argv[i];
+                cli_pstate = 0;
+                break;
+            case 12: // Headless profile file
+                headless.prof_filename = argv[i];
+                cli_pstate = 0;
+                break;
+            case 10: { // Snapshot load
+                snap_err_t err = snapshot_load(argv[i], &cpu, memory, uarts, UART_MAX_COUNT);
+                if (err != SNAP_OK) {
+                    printf("Error! (%s) %s\n", argv[i], snapshot_strerror(err));
+                    exit(EXIT_FAILURE);
+                }
                 cli_pstate = 0;
             }
                 break;
@@ -1670,6 +2440,28 @@ int main(int argc, char *argv[])
             case 4: // CMD file execute
                 printf("cmd_file\n");
                 break;
+            case 5: // Cycle budget
+                printf("max_cycles\n");
+                break;
+            case 6: // Instruction budget
+                printf("max_inst\n");
+                break;
+            case 7: // Dump range
+            case 8:
+                printf("dump\n");
+                break;
+            case 9: // Headless output file
+                printf("out\n");
+                break;
+            case 10: // Snapshot load
+                printf("snap\n");
+                break;
+            case 11: // Headless snapshot file
+                printf("save_snap\n");
+                break;
+            case 12: // Headless profile file
+                printf("prof\n");
+                break;
             default:
                 printf("Unhandled cli_pstate in missing arg handler\n");
                 break;
@@ -1678,6 +2470,88 @@ int main(int argc, char *argv[])
         }
     }
 
+    // Headless mode never starts curses
+    if (headless.enabled) {
+        // Nothing looks at the access flags in headless mode, and
+        // nothing goes back in time
+        memory->track = false;
+        timeline_disable(&timeline);
+
+        // Counts every instruction, unless a --cmd started sampling
+        if (headless.prof_filename && !prof.running) {
+            if (!prof_start(&prof, &cpu, 0)) {
+                printf("Error! %s\n", cmd_err_msgs[CMD_OUT_OF_MEM].msg);
+                exit(EXIT_FAILURE);
+            }
+            cpu.prof = &prof;
+        }
+
+        headless_run(&headless, &cpu, memory, &sched);
+
+        // Everything run is in the file before the report is
+        cpu.trace = NULL;
+        if (!trace_stop(&trace)) {
+            fprintf(stderr, "Error! %s\n", cmd_err_msgs[CMD_TRACE_WRITE_ERROR].msg);
+        }
+
+        cpu.prof = NULL;
+        prof_stop(&prof, &cpu);
+        cmd_err_t prof_err = CMD_OK;
+        if (headless.prof_filename) {
+            char folded[strlen(headless.prof_filename) + sizeof(".folded")];
+
+            sprintf(folded, "%s.folded", headless.prof_filename);
+            prof_err = save_file_prof(&prof, headless.prof_filename, false);
+            if (prof_err == CMD_OK) {
+                prof_err = save_file_prof(&prof, folded, true);
+            }
+            if (prof_err != CMD_OK) {
+                fprintf(stderr, "Error! (%s) %s\n", headless.prof_filename, cmd_err_msgs[prof_err].msg);
+            }
+        }
+
+        // Before the UARTs are stopped, which empties their TX FIFOs
+        snap_err_t snap_err = SNAP_OK;
+        if (headless.snap_filename) {
+            snap_err = snapshot_save(headless.snap_filename, &cpu, memory, uarts, UART_MAX_COUNT, true);
+            if (snap_err != SNAP_OK) {
+                fprintf(stderr, "Error! (%s) %s\n", headless.snap_filename, snapshot_strerror(snap_err));
+            }
+        }
+
+        // Output still buffered by the UARTs goes before the report
+        for (int i = 0; i < UART_MAX_COUNT; ++i) {
+            if (uarts[i].enabled) {
+                stop_16c750(&uarts[i]);
+            }
+        }
+        io_free(&uart_io);
+
+        int ret = headless_report(&headless, &cpu, memory);
+        if (snap_err != SNAP_OK || prof_err != CMD_OK) {
+            ret = EXIT_FAILURE;
+        }
+        prof_free(&prof);
+
+        if (cpu.jit) {
+            jit_free(cpu.jit);
+            free(cpu.jit);
+        }
+        if (cpu.icache) {
+            icache_free(cpu.icache);
+            free(cpu.icache);
+        }
+        _free_mem(memory);
+
+        return ret;
+    }
+
+    // A key press ends waiting on WAI in run mode
+    sched.host_fd = STDIN_FILENO;
+
+    // The timeline starts with what the arguments loaded
+    timeline_reset(&timeline);
+
     initscr();              // Start curses mode
     getmaxyx(stdscr, scrh, scrw); // Get screen dimensions
     raw();                  // Disable line buffering
@@ -1717,9 +2591,11 @@ int main(int argc, char *argv[])
             break;
         case KEY_F(2): // IRQ
             cpu.P.IRQ = !cpu.P.IRQ;
+            timeline_reset(&timeline);
             break;
         case KEY_F(3): // NMI
             cpu.P.NMI = !cpu.P.NMI;
+            timeline_reset(&timeline);
             break;
         case KEY_F(4): // Halt
             in_run_mode = false;
@@ -1727,24 +2603,39 @@ int main(int argc, char *argv[])
             break;
         case KEY_F(5): // Run (until BRK)
             in_run_mode = true;
-            run_mode_step_count = 0;
             timeout(0); // Disable waiting for keypresses
             status_id = STATUS_RUN;
             break;
         case KEY_F(6): // Step over
             if (!in_run_mode) {
                 cpu.PC += get_opcode(memory, &cpu, NULL);
+                timeline_reset(&timeline);
                 update_cpu_hist(&inst_hist, &cpu, memory, REPLACE_INST);
             }
             break;
         case KEY_F(7): // Step
             if (!in_run_mode) {
-                stepCPU(&cpu, memory);
+                // The reset sequence is not an instruction, the timeline
+                // starts again after it
+                if (cpu.P.RST) {
+                    stepCPU(&cpu, memory);
+                    sched_run_due(&sched, cpu.cycles);
+                    timeline_reset(&timeline);
+                }
+                else {
+                    timeline_run(&timeline, 0, 1, NULL);
+                }
                 update_cpu_hist(&inst_hist, &cpu, memory, PUSH_INST);
             }
             break;
+        case KEY_F(8): // Reverse step
+            if (!in_run_mode && timeline.inst > 0) {
+                timeline_seek(&timeline, timeline.inst - 1);
+            }
+            break;
         case KEY_F(9):
             resetCPU(&cpu);
+            timeline_reset(&timeline);
             update_cpu_hist(&inst_hist, &cpu, memory, PUSH_INST);
             in_run_mode = false;
             timeout(-1); // Enable keypress waiting
@@ -1787,7 +2678,10 @@ int main(int argc, char *argv[])
                     &watch2,
                     &cpu,
                     memory,
-                    &uart
+                    uarts,
+                    &timeline,
+                    &trace,
+                    &prof
                     );
                 
                 if (cmd_err == CMD_EXIT) {
@@ -1812,7 +2706,7 @@ int main(int argc, char *argv[])
 
                     // For custom "special" error messages, we have to
                     // figure out the length
-                    if (cmd_err == CMD_SPECIAL) {
+                    if (cmd_err == CMD_SPECIAL || cmd_err == CMD_SPECIAL_INFO) {
                         win_w = strlen(msg->msg) + 4; // 2 chars of passing on each side
                     }
 
@@ -1823,15 +2717,29 @@ int main(int argc, char *argv[])
 
             break;
         }
+
+        // The history is run again after going back in time
+        if (timeline.moved) {
+            hist_from_timeline(&inst_hist, &timeline);
+        }
         
         // RUN mode
+        // Runs the CPU for one display update per pass through the
+        // event loop. Only the last CMD_HIST_ENTRIES instructions are
+        // stepped one at a time, since those are all the history shows
         if (in_run_mode) {
-            stepCPU(&cpu, memory);
-            update_cpu_hist(&inst_hist, &cpu, memory, PUSH_INST);
+            CPU_Stop_Reason_t stop;
+
+            timeline_run(&timeline, 0, RUN_MODE_STEPS_UNTIL_DISP_UPDATE - CMD_HIST_ENTRIES, &stop);
+
+            for (int i = 0; i < CMD_HIST_ENTRIES && stop == CPU_STOP_INSTRUCTIONS; ++i) {
+                timeline_run(&timeline, 0, 1, &stop);
+                update_cpu_hist(&inst_hist, &cpu, memory, PUSH_INST);
+            }
 
-            ++run_mode_step_count;
-            if (run_mode_step_count == RUN_MODE_STEPS_UNTIL_DISP_UPDATE) {
-                run_mode_step_count = 0;
+            if (stop == CPU_STOP_STP) {
+                in_run_mode = false;
+                timeout(-1); // Back to waiting for key handling
             }
         }
 
@@ -1841,15 +2749,6 @@ int main(int argc, char *argv[])
             timeout(-1); // Back to waiting for key handling
         }
 
-        // Handle UART updating & control
-        if (uart.enabled) {
-            if (step_16c750(&uart, memory)) {
-                cpu.P.IRQ = 1;
-            } else {
-                cpu.P.IRQ = 0;
-            }
-        }
-        
         // Handle exiting
         if (c == KEY_F(12)) {
             status_id = STATUS_F12;
@@ -1868,52 +2767,49 @@ int main(int argc, char *argv[])
 
         // Update screen
         // getmaxyx(stdscr, scrh, scrw); // Get screen dimensions
-        if (!in_run_mode || (run_mode_step_count == 0)) {
-
-            print_header(scrw, status_id, alert);
-            print_cpu_regs(win_cpu, &cpu, 1, 2);
-            mem_watch_print(&watch1, memory, &cpu);
-            mem_watch_print(&watch2, memory, &cpu);
-            print_cpu_hist(&inst_hist);
-
-            mvwprintw(win_cmd, 1, 2, ">"); // Command prompt
-
-            // Window borders (DIM)
-            wattron(watch1.win, A_DIM);
-            wattron(watch2.win, A_DIM);
-            wattron(win_cpu, A_DIM);
-            wattron(win_cmd, A_DIM);
-            wattron(inst_hist.win, A_DIM);
-            box(watch1.win, 0, 0);
-            box(watch2.win, 0, 0);
-            box(win_cpu, 0, 0);
-            box(win_cmd, 0, 0);
-            box(inst_hist.win, 0, 0);
-
-            // Window Titles (Normal)
-            wattroff(watch1.win, A_DIM);
-            wattroff(watch2.win, A_DIM);
-            wattroff(win_cpu, A_DIM);
-            wattroff(win_cmd, A_DIM);
-            wattroff(inst_hist.win, A_DIM);
-            mvwprintw(watch1.win, 0, 3, " MEM WATCH 1 ");
-            mvwprintw(watch2.win, 0, 3, " MEM WATCH 2 ");
-            mvwprintw(win_cpu, 0, 3, " CPU STATUS ");
-            mvwprintw(win_cmd, 0, 3, " COMMAND ");
-            mvwprintw(inst_hist.win, 0, 3, " INSTRUCTION HISTORY ");
-
-            // If message box, prevent the other windows from updating
-            if (win_msg) {
-                wrefresh(win_msg);
-            }
-            else {
-                // Order of refresh matters - layering of title bars
-                wrefresh(win_cpu);
-                wrefresh(inst_hist.win);
-                wrefresh(win_cmd);
-                wrefresh(watch1.win);
-                wrefresh(watch2.win);
-            }
+        print_header(scrw, status_id, alert);
+        print_cpu_regs(win_cpu, &cpu, 1, 2);
+        mem_watch_print(&watch1, memory, &cpu);
+        mem_watch_print(&watch2, memory, &cpu);
+        print_cpu_hist(&inst_hist);
+
+        mvwprintw(win_cmd, 1, 2, ">"); // Command prompt
+
+        // Window borders (DIM)
+        wattron(watch1.win, A_DIM);
+        wattron(watch2.win, A_DIM);
+        wattron(win_cpu, A_DIM);
+        wattron(win_cmd, A_DIM);
+        wattron(inst_hist.win, A_DIM);
+        box(watch1.win, 0, 0);
+        box(watch2.win, 0, 0);
+        box(win_cpu, 0, 0);
+        box(win_cmd, 0, 0);
+        box(inst_hist.win, 0, 0);
+
+        // Window Titles (Normal)
+        wattroff(watch1.win, A_DIM);
+        wattroff(watch2.win, A_DIM);
+        wattroff(win_cpu, A_DIM);
+        wattroff(win_cmd, A_DIM);
+        wattroff(inst_hist.win, A_DIM);
+        mvwprintw(watch1.win, 0, 3, " MEM WATCH 1 ");
+        mvwprintw(watch2.win, 0, 3, " MEM WATCH 2 ");
+        mvwprintw(win_cpu, 0, 3, " CPU STATUS ");
+        mvwprintw(win_cmd, 0, 3, " COMMAND ");
+        mvwprintw(inst_hist.win, 0, 3, " INSTRUCTION HISTORY ");
+
+        // If message box, prevent the other windows from updating
+        if (win_msg) {
+            wrefresh(win_msg);
+        }
+        else {
+            // Order of refresh matters - layering of title bars
+            wrefresh(win_cpu);
+            wrefresh(inst_hist.win);
+            wrefresh(win_cmd);
+            wrefresh(watch1.win);
+            wrefresh(watch2.win);
         }
         
         refresh();
@@ -1938,11 +2834,30 @@ int main(int argc, char *argv[])
     delwin(inst_hist.win);
     endwin();			// Clean up curses mode
 
-    free(memory);
+    if (cpu.jit) {
+        jit_free(cpu.jit);
+        free(cpu.jit);
+    }
+    if (cpu.icache) {
+        icache_free(cpu.icache);
+        free(cpu.icache);
+    }
+    timeline_disable(&timeline);
+    cpu.trace = NULL;
+    if (!trace_stop(&trace)) {
+        printf("Error! %s\n", cmd_err_msgs[CMD_TRACE_WRITE_ERROR].msg);
+    }
+    cpu.prof = NULL;
+    prof_stop(&prof, &cpu);
+    prof_free(&prof);
+    _free_mem(memory);
 
-    if (uart.enabled) {
-        stop_16c750(&uart);
+    for (int i = 0; i < UART_MAX_COUNT; ++i) {
+        if (uarts[i].enabled) {
+            stop_16c750(&uarts[i]);
+        }
     }
+    io_free(&uart_io);
 
     printf("Stopped simulator\n");
     
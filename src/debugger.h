@@ -12,6 +12,9 @@
 
 #define UART_SOCK_PORT 6501
 
+// Number of UARTs which can be mapped at once (each has its own port)
+#define UART_MAX_COUNT 8
+
 #define KEY_CTRL_C 3
 #define KEY_CTRL_H 8
 #define KEY_CR 10
@@ -56,7 +59,7 @@ typedef struct hist_t {
     int entry_count;
     int entry_start;
     CPU_t cpu[CMD_HIST_ENTRIES];
-    memory_t mem[CMD_HIST_ENTRIES][4];
+    uint8_t mem[CMD_HIST_ENTRIES][4]; // Instruction bytes
 } hist_t;
     
 
@@ -66,6 +69,7 @@ typedef enum cmd_err_t {
     CMD_EXIT = -1,
     CMD_OK = 0, // Start of cmd_err_msgs index
     CMD_SPECIAL,
+    CMD_SPECIAL_INFO,
     CMD_EXPECTED_ARG,
     CMD_EXPECTED_REG,
     CMD_EXPECTED_VALUE,
@@ -90,7 +94,26 @@ typedef enum cmd_err_t {
     CMD_OUT_OF_MEM,
     CMD_UNSUPPORTED_DEVICE,
     CMD_PORT_NUM_INVALID,
-    CMD_UART_DISABLED
+    CMD_UART_DISABLED,
+    CMD_UART_NOT_MAPPED,
+    CMD_UART_LIMIT,
+    CMD_UART_OVERLAP,
+    CMD_CPU_OPTION_JIT_ENABLED,
+    CMD_CPU_OPTION_JIT_DISABLED,
+    CMD_JIT_UNAVAILABLE,
+    CMD_CPU_OPTION_ICACHE_ENABLED,
+    CMD_CPU_OPTION_ICACHE_DISABLED,
+    CMD_TIMELINE_ENABLED,
+    CMD_TIMELINE_DISABLED,
+    CMD_TIMELINE_NO_BREAKPOINT,
+    CMD_TIMELINE_NOT_REACHED,
+    CMD_TRACE_STARTED,
+    CMD_TRACE_STOPPED,
+    CMD_TRACE_WRITE_ERROR,
+    CMD_PROF_STARTED,
+    CMD_PROF_STOPPED,
+    CMD_PROF_WRITTEN,
+    CMD_PROF_EMPTY
 } cmd_err_t;
 
 // Error message box type
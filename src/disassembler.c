@@ -425,22 +425,21 @@ opcode_t opcode_table[256] = {
 // Now, we can get to the functions!
 
 /**
- * Generate the opcode string for a CPU's PC address
+ * Generate the opcode string for an instruction's bytes
  * 
- * @param *mem The CPU's memory to use for the opcode
- * @param *cpu The CPU to get information from (e.g., X width, PC value, etc.)
+ * @param *bytes The opcode followed by (up to) 3 operand bytes
+ * @param *cpu The CPU to get information from (e.g., X width, etc.)
  * @param *buf[] The buffer to return the string in
  *               Can be NULL, in which case, no disassembly is generated
- * @param addr_offs An offset to be used to correct relative addressing 
- *                  calculations. Typically the address of the instruction
- *                  with relative addressing
+ * @param addr The address of the instruction. Used to turn relative
+ *             branch offsets into addresses
  * @return The number of bytes that the instruction occupies
  */
-static int _get_opcode(memory_t *mem, CPU_t *cpu, char *buf, uint32_t addr_offs)
+static int _get_opcode(uint8_t *bytes, CPU_t *cpu, char *buf, uint32_t addr)
 {
-    uint32_t addr = _cpu_get_effective_pc(cpu);
-    opcode_t *op = &opcode_table[_get_mem_byte(mem, addr, false)];
+    opcode_t *op = &opcode_table[bytes[0]];
     int size = addr_fmt_sizes[op->addr_mode];
+    uint32_t word = bytes[1] | (bytes[2] << 8);
 
     if (buf) {
         sprintf(buf, "%s", instruction_mne[op->inst]);
@@ -451,23 +450,22 @@ static int _get_opcode(memory_t *mem, CPU_t *cpu, char *buf, uint32_t addr_offs)
     case 1:
         break;
     case 2: {
-        uint32_t val = _get_mem_byte(mem, _addr_add_val_bank_wrap(addr, 1), false);
+        uint32_t val = bytes[1];
         char *fmt = addr_fmts[op->addr_mode];
 
         // Correct operand value to be an address for branches
         if (op->addr_mode == CPU_ADDR_PCR) {
-            val = _addrCPU_getRelative8(cpu, mem, false);
-            val = _addr_add_val_bank_wrap(val, addr_offs);
+            val = _addr_add_val_bank_wrap(addr, 2 + (int8_t)bytes[1]);
         }
         // Correct value for immediate
         else if (op->addr_mode == CPU_ADDR_IMMD) {
             if (op->reg == REG_A && !(cpu->P.E || (!cpu->P.E && cpu->P.M))) { // 16-bit
-                val = _get_mem_word_bank_wrap(mem, _addr_add_val_bank_wrap(addr, 1), false);
+                val = word;
                 size = 3;
                 fmt = " $%04x";
             }
             else if (op->reg == REG_X && !(cpu->P.E || (!cpu->P.E && cpu->P.XB))) { // 16-bit
-                val = _get_mem_word_bank_wrap(mem, _addr_add_val_bank_wrap(addr, 1), false);
+                val = word;
                 size = 3;
                 fmt = " $%04x";
             }
@@ -479,13 +477,12 @@ static int _get_opcode(memory_t *mem, CPU_t *cpu, char *buf, uint32_t addr_offs)
     }
         break;
     case 3: {
-        uint32_t val = _get_mem_word_bank_wrap(mem, _addr_add_val_bank_wrap(addr, 1), false);
+        uint32_t val = word;
         uint32_t val2 = 0;
         
         if (op->addr_mode == CPU_ADDR_PCRL ||
             op->inst == I_PER) {
-            val = _addrCPU_getRelative16(cpu, mem, false);
-            val = _addr_add_val_bank_wrap(val, addr_offs);
+            val = _addr_add_val_bank_wrap(addr, 3 + (int16_t)word);
         }
         else if (op->addr_mode == CPU_ADDR_BMV) {
             val2 = (val >> 8) & 0xff;
@@ -499,8 +496,7 @@ static int _get_opcode(memory_t *mem, CPU_t *cpu, char *buf, uint32_t addr_offs)
         break;
     case 4:
         if (buf) {
-            sprintf(buf+3, addr_fmts[op->addr_mode],
-                    _get_mem_long_bank_wrap(mem, _addr_add_val_bank_wrap(addr, 1), false));
+            sprintf(buf+3, addr_fmts[op->addr_mode], word | (bytes[3] << 16));
         }
         break;
     default:
@@ -526,7 +522,7 @@ static int _get_opcode(memory_t *mem, CPU_t *cpu, char *buf, uint32_t addr_offs)
  */
 int get_opcode(memory_t *mem, CPU_t *cpu, char *buf)
 {
-    return _get_opcode(mem, cpu, buf, 0);
+    return get_opcode_by_addr(mem, cpu, buf, _cpu_get_effective_pc(cpu));
 }
 
 
@@ -541,15 +537,27 @@ int get_opcode(memory_t *mem, CPU_t *cpu, char *buf)
  */
 int get_opcode_by_addr(memory_t *mem, CPU_t *cpu, char *buf, uint32_t addr)
 {
-    CPU_t cpu_dup;
+    uint8_t bytes[4];
 
-    memcpy(&cpu_dup, cpu, sizeof(cpu_dup));
-
-    // Set effective CPU address
-    cpu_dup.PC = addr & 0xffff;
-    cpu_dup.PBR = (addr >> 16) & 0xff;
+    // Operands bank wrap like the program counter does
+    for (int i = 0; i < 4; ++i) {
+        bytes[i] = _get_mem_byte(mem, _addr_add_val_bank_wrap(addr, i), false);
+    }
 
-    return _get_opcode(mem, &cpu_dup, buf, _cpu_get_effective_pc(cpu));
+    return _get_opcode(bytes, cpu, buf, addr);
 }
 
 
+/**
+ * Generate the opcode string for a copy of the instruction
+ * bytes at a CPU's PC address (e.g., from a history buffer)
+ * 
+ * @param *bytes The opcode followed by 3 operand bytes
+ * @param *cpu The CPU to get information from (e.g., X width, PC value, etc.)
+ * @param *buf[] The buffer to return the string in
+ * @return The number of bytes that the instruction occupies
+ */
+int get_opcode_by_bytes(uint8_t *bytes, CPU_t *cpu, char *buf)
+{
+    return _get_opcode(bytes, cpu, buf, _cpu_get_effective_pc(cpu));
+}
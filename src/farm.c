@@ -0,0 +1,618 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+// Parallel headless test runner (build/farm)
+//
+// Runs the jobs of a manifest file on a pool of threads, one CPU and
+// memory per job, and prints the outcome of each job as it finishes.
+// Each line of the manifest is a job: a name followed by the headless
+// arguments of the simulator for it (see farm_usage()). ROM images
+// given with --rom are loaded once and shared by the memory of every
+// job (see _share_mem()), so a job only allocates the pages it writes.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "65816.h"
+#include "65816-util.h"
+#include "65816-icache.h"
+#include "jit.h"
+#include "headless.h"
+#include "scheduler.h"
+#include "snapshot.h"
+
+// Max number of --rom images, and of --mem images per job
+#define FARM_MAX_IMAGES 16
+
+// Max length of a manifest or command file line
+#define FARM_LINE_LEN 2048
+
+// Max size of a CPU state file
+#define FARM_CPU_FILE_LEN 1024
+
+// The outcome of a job
+typedef enum farm_result_t {
+    FARM_PASS,
+    FARM_FAIL,  // Ran, but not as expected
+    FARM_ERROR  // Could not be run
+} farm_result_t;
+
+// A line of the manifest
+typedef struct farm_job_t {
+    char *name;
+    int image_count;
+    headless_image_t images[FARM_MAX_IMAGES];
+    char *snap_filename;       // Snapshot to start from (NULL = none)
+    char *cpu_filename;        // NULL = reset state
+    char *cmd_filename;        // NULL = none
+    headless_t hl;             // Budgets, dumps and --out of the run
+    bool expect_stop;          // Fail unless the CPU stops with expected_stop
+    CPU_Stop_Reason_t expected_stop;
+    char *expect_cpu_filename; // Fail unless the final state matches (NULL = any)
+} farm_job_t;
+
+// The jobs and how they are run
+typedef struct farm_t {
+    int job_count;
+    farm_job_t *jobs;
+    atomic_int next_job;       // Index of the next job to hand to a thread
+    const memory_t *rom;       // Shared by the memory of every job
+    bool icache;
+    bool jit;
+
+    pthread_mutex_t out_lock;  // Held while printing a result
+    int results[3];            // Job count of each farm_result_t
+} farm_t;
+
+
+/**
+ * Print the usage and exit
+ */
+static void farm_usage(void)
+{
+    printf(
+        "65816 Simulator (C) Zach Baldwin 2022-2023\n"
+        "USAGE:\n"
+        " $ farm (-j n) (--rom (offset) filename)... (--icache) (--jit) manifest\n"
+        "\n"
+        "Args:\n"
+        " -j n ...................... Run n jobs at a time (default: one per host core)\n"
+        " --rom (offset) filename ... Load a read-only image shared by every job\n"
+        " --icache .................. Run each job with the instruction cache\n"
+        " --jit ..................... Run each job with the JIT (x86-64 only)\n"
+        "\n"
+        "Each manifest line is a job name followed by its arguments:\n"
+        " --snap filename ........... Start from a snapshot (saved by 'save snap')\n"
+        " --mem (offset) filename ... Load memory at offset (in hex) with a file\n"
+        " --cpu filename ............ Start from a saved CPU state\n"
+        " --cmd_file filename ....... Apply 'bp aaaaaa' and 'aaaaaa: xx yy zz' lines\n"
+        " --max_cycles n ............ Stop after n (decimal) cycles\n"
+        " --max_inst n .............. Stop after n (decimal) instructions\n"
+        " --dump aaaaaa bbbbbb ...... Add memory to the --out report\n"
+        " --out filename ............ Write the headless report of the job to a file\n"
+        " --expect stop ............. Pass only on this stop reason (e.g. stp)\n"
+        " --expect_cpu filename ..... Pass only if the final CPU state matches a file\n"
+        );
+    exit(EXIT_FAILURE);
+}
+
+
+/**
+ * Load a saved CPU state
+ *
+ * @param *cpu The CPU
+ * @param *filename The file (as written by 'save cpu')
+ * @param *err Set to a description of the error on failure
+ * @return False if the file could not be loaded
+ */
+static bool farm_load_cpu(CPU_t *cpu, const char *filename, const char **err)
+{
+    size_t size;
+    char *buf = (char *)headless_read_file(filename, FARM_CPU_FILE_LEN, &size, err);
+    if (!buf) {
+        return false;
+    }
+    bool ok = fromstrCPU(cpu, buf) == CPU_ERR_OK;
+    free(buf);
+    if (!ok) {
+        *err = "Corrupt CPU file";
+    }
+    return ok;
+}
+
+
+/**
+ * Apply a command file to a job: breakpoints and memory stores, the
+ * commands of the simulator a headless job has a use for
+ *
+ * @param *mem The memory of the job
+ * @param *filename The file
+ * @param *err Set to a description of the error on failure
+ * @return False if the file could not be read or has another command
+ */
+static bool farm_run_cmd_file(memory_t *mem, const char *filename, const char **err)
+{
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        *err = strerror(errno);
+        return false;
+    }
+
+    char buf[FARM_LINE_LEN];
+    bool ok = true;
+
+    while (ok && fgets(buf, sizeof(buf), fp)) {
+        char *save;
+        char *tok = strtok_r(buf, " \t\n\r", &save);
+        uint32_t addr, val;
+
+        if (!tok) {
+            continue;
+        }
+        if (strcmp(tok, "bp") == 0) {
+            tok = strtok_r(NULL, " \t\n\r", &save);
+            if (!tok || !headless_parse_hex(tok, &addr)) {
+                ok = false;
+                break;
+            }
+            _set_mem_flags(mem, addr, MEM_FLAG_B);
+            continue;
+        }
+
+        // aaaaaa: xx yy zz
+        size_t len = strlen(tok);
+        if (len < 2 || tok[len - 1] != ':') {
+            ok = false;
+            break;
+        }
+        tok[len - 1] = '\0';
+        if (!headless_parse_hex(tok, &addr)) {
+            ok = false;
+            break;
+        }
+        while ((tok = strtok_r(NULL, " \t\n\r", &save))) {
+            if (!headless_parse_hex(tok, &val)) {
+                ok = false;
+                break;
+            }
+            _set_mem_byte(mem, addr++, (uint8_t)val, true);
+        }
+    }
+    fclose(fp);
+
+    if (!ok) {
+        *err = "Unsupported command in command file";
+    }
+    return ok;
+}
+
+
+/**
+ * Print the outcome of a job
+ *
+ * @param *farm The farm
+ * @param *job The job
+ * @param result The outcome
+ * @param *msg The details
+ */
+static void farm_report(farm_t *farm, farm_job_t *job, farm_result_t result, const char *msg)
+{
+    static const char *result_names[] = { "pass", "FAIL", "ERROR" };
+
+    pthread_mutex_lock(&farm->out_lock);
+    printf("%s %s %s\n", result_names[result], job->name, msg);
+    fflush(stdout);
+    ++farm->results[result];
+    pthread_mutex_unlock(&farm->out_lock);
+}
+
+
+/**
+ * Set up, run and check a job
+ *
+ * @param *farm The farm
+ * @param *job The job
+ */
+static void farm_run_job(farm_t *farm, farm_job_t *job)
+{
+    char msg[FARM_LINE_LEN];
+    const char *err = NULL;
+    memory_t job_mem;
+    memory_t *mem = &job_mem;
+    CPU_t cpu = {0};
+    scheduler_t sched;
+
+    if (!_init_mem(mem, false)) {
+        farm_report(farm, job, FARM_ERROR, "Unable to allocate system memory");
+        return;
+    }
+    _share_mem(mem, farm->rom);
+
+    initCPU(&cpu);
+    resetCPU(&cpu);
+    cpu.setacc = true; // As in the simulator (memory->track is off)
+    sched_init(&sched, &cpu);
+
+    if (job->snap_filename) {
+        snap_err_t snap_err = snapshot_load(job->snap_filename, &cpu, mem, NULL, 0);
+        if (snap_err != SNAP_OK) {
+            err = snapshot_strerror(snap_err);
+            snprintf(msg, sizeof(msg), "(%s) %s", job->snap_filename, err);
+        }
+    }
+    for (int i = 0; i < job->image_count && !err; ++i) {
+        if (!headless_load_image(mem, &job->images[i], &err)) {
+            snprintf(msg, sizeof(msg), "(%s) %s", job->images[i].filename, err);
+        }
+    }
+    if (!err && job->cpu_filename && !farm_load_cpu(&cpu, job->cpu_filename, &err)) {
+        snprintf(msg, sizeof(msg), "(%s) %s", job->cpu_filename, err);
+    }
+    if (!err && job->cmd_filename && !farm_run_cmd_file(mem, job->cmd_filename, &err)) {
+        snprintf(msg, sizeof(msg), "(%s) %s", job->cmd_filename, err);
+    }
+    if (!err && farm->icache) {
+        cpu.icache = malloc(sizeof(icache_t));
+        if (!cpu.icache || !icache_init(cpu.icache, &cpu, mem)) {
+            free(cpu.icache);
+            cpu.icache = NULL;
+            err = "Unable to allocate the instruction cache";
+            snprintf(msg, sizeof(msg), "%s", err);
+        }
+    }
+    if (!err && farm->jit) {
+        cpu.jit = malloc(sizeof(jit_t));
+        if (!cpu.jit || !jit_init(cpu.jit, mem, false)) {
+            free(cpu.jit);
+            cpu.jit = NULL;
+            err = "Unable to allocate the JIT";
+            snprintf(msg, sizeof(msg), "%s", err);
+        }
+    }
+
+    if (err) {
+        farm_report(farm, job, FARM_ERROR, msg);
+    }
+    else {
+        headless_t hl = job->hl;
+        farm_result_t result = FARM_PASS;
+        char expected[256] = "";
+
+        headless_run(&hl, &cpu, mem, &sched);
+
+        if (hl.out_filename && headless_report(&hl, &cpu, mem) != EXIT_SUCCESS
+            && hl.stop != CPU_STOP_CRASH && hl.stop != CPU_STOP_UNKNOWN_OPCODE) {
+            result = FARM_ERROR;
+            snprintf(expected, sizeof(expected), " (unable to write %s)", hl.out_filename);
+        }
+        else if (job->expect_stop) {
+            if (hl.stop != job->expected_stop) {
+                result = FARM_FAIL;
+                snprintf(expected, sizeof(expected), " (expected %s)", headless_stop_name(job->expected_stop));
+            }
+        }
+        else if (hl.stop == CPU_STOP_CRASH || hl.stop == CPU_STOP_UNKNOWN_OPCODE) {
+            result = FARM_FAIL; // As the exit status of a headless run
+        }
+
+        if (result == FARM_PASS && job->expect_cpu_filename) {
+            CPU_t want = {0};
+            char want_buf[256], got_buf[256];
+
+            initCPU(&want);
+            if (!farm_load_cpu(&want, job->expect_cpu_filename, &err)) {
+                result = FARM_ERROR;
+                snprintf(expected, sizeof(expected), " (%s) %s", job->expect_cpu_filename, err);
+            }
+            else {
+                tostrCPU(&want, want_buf);
+                tostrCPU(&cpu, got_buf);
+                if (strcmp(want_buf, got_buf) != 0) {
+                    result = FARM_FAIL;
+                    snprintf(expected, sizeof(expected), " (cpu differs from %s)", job->expect_cpu_filename);
+                }
+            }
+        }
+
+        snprintf(msg, sizeof(msg), "stop: %s instructions: %" PRIu64 " cycles: %" PRIu64 "%s",
+                 headless_stop_name(hl.stop), hl.inst_count, cpu.cycles, expected);
+        farm_report(farm, job, result, msg);
+    }
+
+    if (cpu.jit) {
+        jit_free(cpu.jit);
+        free(cpu.jit);
+    }
+    if (cpu.icache) {
+        icache_free(cpu.icache);
+        free(cpu.icache);
+    }
+    _free_mem(mem);
+}
+
+
+/**
+ * Run jobs until there are none left. Every thread takes the next job
+ * from the shared index, so a thread which finishes its job early
+ * just takes another one.
+ *
+ * @param *arg The farm
+ * @return NULL
+ */
+static void *farm_worker(void *arg)
+{
+    farm_t *farm = arg;
+    int i;
+
+    while ((i = atomic_fetch_add(&farm->next_job, 1)) < farm->job_count) {
+        farm_run_job(farm, &farm->jobs[i]);
+    }
+    return NULL;
+}
+
+
+/**
+ * Parse the arguments of a manifest line into a job
+ *
+ * @param *job The job to fill in
+ * @param argc Number of arguments (after the name)
+ * @param *argv The arguments
+ * @return NULL, or a description of the error
+ */
+static const char *farm_parse_job(farm_job_t *job, int argc, char **argv)
+{
+    for (int i = 0; i < argc; ++i) {
+        char *opt = argv[i];
+        char *arg = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (!arg) {
+            return "Missing argument";
+        }
+        ++i;
+
+        if (strcmp(opt, "--mem") == 0) {
+            if (job->image_count == FARM_MAX_IMAGES) {
+                return "Too many --mem images";
+            }
+            headless_image_t *img = &job->images[job->image_count++];
+            img->addr = 0;
+            if (headless_parse_hex(arg, &img->addr)) {
+                if (++i == argc) {
+                    return "Missing argument";
+                }
+                arg = argv[i];
+            }
+            img->filename = arg;
+        }
+        else if (strcmp(opt, "--snap") == 0) {
+            job->snap_filename = arg;
+        }
+        else if (strcmp(opt, "--cpu") == 0) {
+            job->cpu_filename = arg;
+        }
+        else if (strcmp(opt, "--cmd_file") == 0) {
+            job->cmd_filename = arg;
+        }
+        else if (strcmp(opt, "--max_cycles") == 0) {
+            if (!headless_parse_dec64(arg, &job->hl.max_cycles)) {
+                return "Expected a decimal cycle count";
+            }
+        }
+        else if (strcmp(opt, "--max_inst") == 0) {
+            if (!headless_parse_dec64(arg, &job->hl.max_inst)) {
+                return "Expected a decimal instruction count";
+            }
+        }
+        else if (strcmp(opt, "--dump") == 0) {
+            if (job->hl.dump_count == HEADLESS_MAX_DUMPS) {
+                return "Too many --dump ranges";
+            }
+            dump_range_t *range = &job->hl.dumps[job->hl.dump_count++];
+            if (++i == argc) {
+                return "Missing argument";
+            }
+            if (!headless_parse_hex(arg, &range->start) || !headless_parse_hex(argv[i], &range->end)
+                || range->end > 0xffffff || range->end < range->start) {
+                return "Expected a range of 24-bit hex addresses";
+            }
+        }
+        else if (strcmp(opt, "--out") == 0) {
+            job->hl.out_filename = arg;
+        }
+        else if (strcmp(opt, "--expect") == 0) {
+            if (!headless_parse_stop(arg, &job->expected_stop)) {
+                return "Unknown stop reason";
+            }
+            job->expect_stop = true;
+        }
+        else if (strcmp(opt, "--expect_cpu") == 0) {
+            job->expect_cpu_filename = arg;
+        }
+        else {
+            return "Unknown argument";
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * Read the jobs of a manifest. Blank lines and lines starting with #
+ * are skipped.
+ *
+ * @param *farm The farm to add the jobs to
+ * @param *filename The manifest
+ * @return False if the manifest could not be read or has an error
+ */
+static bool farm_load_manifest(farm_t *farm, const char *filename)
+{
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        printf("Error! Unable to open file '%s':\n%s\n", filename, strerror(errno));
+        return false;
+    }
+
+    char buf[FARM_LINE_LEN];
+    int line = 0;
+    int cap = 0;
+
+    while (fgets(buf, sizeof(buf), fp)) {
+        char *argv[FARM_LINE_LEN / 2];
+        int argc = 0;
+        char *save;
+
+        ++line;
+        for (char *tok = strtok_r(buf, " \t\n\r", &save); tok; tok = strtok_r(NULL, " \t\n\r", &save)) {
+            argv[argc++] = tok;
+        }
+        if (!argc || argv[0][0] == '#') {
+            continue;
+        }
+
+        if (farm->job_count == cap) {
+            cap = cap ? cap * 2 : 64;
+            farm_job_t *jobs = realloc(farm->jobs, cap * sizeof(*jobs));
+            if (!jobs) {
+                printf("Out of memory!\n");
+                fclose(fp);
+                return false;
+            }
+            farm->jobs = jobs;
+        }
+
+        // The job keeps pointers into its copy of the line
+        farm_job_t *job = &farm->jobs[farm->job_count];
+        char *copy = malloc(sizeof(buf));
+        if (!copy) {
+            printf("Out of memory!\n");
+            fclose(fp);
+            return false;
+        }
+        memcpy(copy, buf, sizeof(buf));
+        for (int i = 0; i < argc; ++i) {
+            argv[i] = copy + (argv[i] - buf);
+        }
+
+        memset(job, 0, sizeof(*job));
+        headless_init(&job->hl);
+        job->name = argv[0];
+
+        const char *err = farm_parse_job(job, argc - 1, argv + 1);
+        if (err) {
+            printf("Error! (%s:%d) %s\n", filename, line, err);
+            fclose(fp);
+            return false;
+        }
+        ++farm->job_count;
+    }
+    fclose(fp);
+    return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+    farm_t farm = {0};
+    memory_t rom;
+    char *manifest = NULL;
+    long thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (!_init_mem(&rom, false)) {
+        printf("Unable to allocate system memory!\n");
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            uint64_t n;
+            if (!headless_parse_dec64(argv[++i], &n) || n == 0 || n > 4096) {
+                printf("Error! (%s) Expected a thread count\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            thread_count = (long)n;
+        }
+        else if (strcmp(argv[i], "--rom") == 0 && i + 1 < argc) {
+            headless_image_t img = { 0, argv[++i] };
+            const char *err;
+
+            if (headless_parse_hex(img.filename, &img.addr)) {
+                if (++i == argc) {
+                    farm_usage();
+                }
+                img.filename = argv[i];
+            }
+            if (!headless_load_image(&rom, &img, &err)) {
+                printf("Error! (%s) %s\n", img.filename, err);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--icache") == 0) {
+            farm.icache = true;
+        }
+        else if (strcmp(argv[i], "--jit") == 0) {
+            if (!jit_supported()) {
+                printf("Error! The JIT is not supported on this host\n");
+                return EXIT_FAILURE;
+            }
+            farm.jit = true;
+        }
+        else if (argv[i][0] != '-' && !manifest) {
+            manifest = argv[i];
+        }
+        else {
+            farm_usage();
+        }
+    }
+    if (!manifest) {
+        farm_usage();
+    }
+    if (!farm_load_manifest(&farm, manifest)) {
+        return EXIT_FAILURE;
+    }
+
+    farm.rom = &rom;
+    atomic_init(&farm.next_job, 0);
+    pthread_mutex_init(&farm.out_lock, NULL);
+
+    if (thread_count < 1) {
+        thread_count = 1;
+    }
+    if (thread_count > farm.job_count) {
+        thread_count = farm.job_count ? farm.job_count : 1;
+    }
+
+    pthread_t *threads = malloc(thread_count * sizeof(*threads));
+    if (!threads) {
+        printf("Out of memory!\n");
+        return EXIT_FAILURE;
+    }
+
+    // The main thread is one of the workers
+    long started = 1;
+    while (started < thread_count && pthread_create(&threads[started], NULL, farm_worker, &farm) == 0) {
+        ++started;
+    }
+    farm_worker(&farm);
+    for (long i = 1; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    printf("jobs: %d passed: %d failed: %d errors: %d\n", farm.job_count,
+           farm.results[FARM_PASS], farm.results[FARM_FAIL], farm.results[FARM_ERROR]);
+
+    free(threads);
+    pthread_mutex_destroy(&farm.out_lock);
+    _free_mem(&rom);
+
+    return farm.results[FARM_FAIL] || farm.results[FARM_ERROR] ? EXIT_FAILURE : EXIT_SUCCESS;
+}
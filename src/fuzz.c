@@ -0,0 +1,976 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+// Coverage-guided fuzzer for firmware which reads a UART (build/fuzz)
+//
+// The firmware is booted once, up to a marker address (e.g. where its
+// command parser waits for the first char), and the CPU, scheduler and
+// UART are kept as they are there. Every input is then fed to the RX
+// FIFO of the UART from that point, and the control flow edges of the
+// run (taken branches, jumps, calls, returns and interrupts) are counted
+// in a map like AFL's. Inputs which reach a new edge, or a new hit count
+// of one, join the corpus, which is mutated to make the next inputs.
+// Runs which crash are written out as reproducers.
+//
+// The memory of the runs reads the pages of the boot memory (see
+// _share_mem()), so going back to the marker only frees the pages the
+// last run wrote (_clear_mem()) instead of copying the whole 16MiB.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/stat.h>
+
+#include "65816.h"
+#include "65816-util.h"
+#include "16C750.h"
+#include "headless.h"
+#include "scheduler.h"
+#include "snapshot.h"
+
+// Max number of --mem images, and of --crash and --done addresses
+#define FUZZ_MAX_IMAGES 16
+#define FUZZ_MAX_ADDRS 16
+
+// Entries in the coverage map (a power of 2)
+#define FUZZ_MAP_SIZE 0x10000
+
+// Max number of distinct crashes written out
+#define FUZZ_MAX_CRASHES 4096
+
+// Without --stack, how deep calls may go below the SP at the marker,
+// and how far returns may go above it. In emulation mode the stack may
+// not wrap around page 1 either.
+#define FUZZ_STACK_DEPTH 0x800
+#define FUZZ_STACK_SLACK 0x20
+
+// Defaults of --max_inst, --tail, --max_len and --boot_max_inst
+#define FUZZ_DEFAULT_MAX_INST 100000
+#define FUZZ_DEFAULT_TAIL 2000
+#define FUZZ_DEFAULT_MAX_LEN 256
+#define FUZZ_DEFAULT_BOOT_MAX_INST 100000000
+
+// How a run ended. Everything but FUZZ_OK is a crash.
+typedef enum fuzz_verdict_t {
+    FUZZ_OK,             // The input was used up, or a budget or --done address reached
+    FUZZ_CRASH,          // An invalid sim state was reached (P.CRASH)
+    FUZZ_UNKNOWN_OPCODE,
+    FUZZ_STACK,          // The stack pointer left its range
+    FUZZ_CRASH_ADDR      // A --crash address was reached
+} fuzz_verdict_t;
+
+static const char *fuzz_verdict_names[] = {
+    "ok", "crash", "unknown_opcode", "stack", "crash_addr"
+};
+
+// An input
+typedef struct fuzz_input_t {
+    uint8_t *data;
+    size_t len;
+} fuzz_input_t;
+
+// The machine at the marker, the run from it and the corpus
+typedef struct fuzz_t {
+    memory_t boot;        // Memory at the marker, read by mem
+    memory_t mem;         // Memory of the runs
+    CPU_t cpu;
+    scheduler_t sched;
+    tl16c750_t uart;
+
+    CPU_t cpu0;           // State at the marker
+    scheduler_t sched0;
+    uint8_t uart0[UART_STATE_LEN];
+
+    uint64_t max_inst;    // Budget of a run
+    uint64_t tail;        // Instructions run once the input is used up
+    bool stack_range;     // Check SP against stack_lo..stack_hi, not its depth
+    uint16_t stack_lo;
+    uint16_t stack_hi;
+    int crash_addr_count;
+    uint32_t crash_addrs[FUZZ_MAX_ADDRS];
+    int done_addr_count;
+    uint32_t done_addrs[FUZZ_MAX_ADDRS];
+
+    uint8_t trace[FUZZ_MAP_SIZE]; // Edge hit counts of the last run
+    uint8_t seen[FUZZ_MAP_SIZE];  // Hit count buckets seen by any run
+    uint32_t edges;               // Entries of seen in use
+
+    int corpus_count;
+    int corpus_cap;
+    fuzz_input_t *corpus;
+    const char *corpus_dir; // NULL = keep the corpus in memory only
+    const char *crash_dir;
+    size_t max_len;
+
+    int crash_count;
+    uint64_t crash_sigs[FUZZ_MAX_CRASHES]; // Verdict and address of each crash found
+    uint64_t execs;
+    uint64_t rng;
+} fuzz_t;
+
+// Set by SIGINT, ends the fuzzing loop
+static volatile sig_atomic_t fuzz_quit = 0;
+
+
+/**
+ * Print the usage and exit
+ */
+static void fuzz_usage(void)
+{
+    printf(
+        "65816 Simulator (C) Zach Baldwin 2022-2023\n"
+        "USAGE:\n"
+        " $ fuzz --uart aaaaaa (--mem (offset) filename)... (--snap filename) (--marker aaaaaa) ...\n"
+        "\n"
+        "Machine:\n"
+        " --mem (offset) filename ... Load memory at offset (in hex) with a file\n"
+        " --snap filename ........... Start from a snapshot (saved by 'save snap')\n"
+        " --uart aaaaaa ............. Address of the TL16C750 the inputs are received on\n"
+        " --marker aaaaaa ........... Boot until the PC reaches this address, and start\n"
+        "                             every run from there (default: start right away)\n"
+        " --boot_max_inst n ......... Give up booting after n instructions (default: 100000000)\n"
+        "\n"
+        "Runs:\n"
+        " --max_inst n .............. Stop a run after n instructions (default: 100000)\n"
+        " --tail n .................. Stop a run n instructions after its input was\n"
+        "                             read (default: 2000)\n"
+        " --done aaaaaa ............. Stop a run when the PC reaches this address\n"
+        " --crash aaaaaa ............ Count reaching this address (e.g. a panic handler)\n"
+        "                             as a crash\n"
+        " --stack lo hi ............. Count SP leaving lo..hi (hex) as a crash (default:\n"
+        "                             0x800 bytes deeper or 0x20 above the SP at the\n"
+        "                             marker, or wrapping in emulation mode)\n"
+        "\n"
+        "Fuzzing:\n"
+        " --corpus dir .............. Read the seed inputs from, and save new inputs to, dir\n"
+        " --crashes dir ............. Save crashing inputs to dir (default: crashes)\n"
+        " --max_len n ............... Longest input made (default: 256)\n"
+        " --iterations n ............ Stop after n runs (default: until ^C)\n"
+        " --seed n .................. Seed of the mutations (default: from the time)\n"
+        " --run filename ............ Run one input, print how it ended and exit\n"
+        );
+    exit(EXIT_FAILURE);
+}
+
+
+/**
+ * Write a whole file
+ *
+ * @param *filename The file
+ * @param *data The contents
+ * @param len Number of bytes
+ * @return False if the file could not be written
+ */
+static bool fuzz_write_file(const char *filename, const uint8_t *data, size_t len)
+{
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        return false;
+    }
+    bool ok = fwrite(data, 1, len, fp) == len;
+    return fclose(fp) == 0 && ok;
+}
+
+
+/**
+ * Next pseudo-random number (xorshift64*)
+ *
+ * @param *fz The fuzzer
+ * @param n Size of the range
+ * @return A number from 0 to n - 1
+ */
+static uint32_t fuzz_rand(fuzz_t *fz, uint32_t n)
+{
+    fz->rng ^= fz->rng >> 12;
+    fz->rng ^= fz->rng << 25;
+    fz->rng ^= fz->rng >> 27;
+    return (uint32_t)((fz->rng * 0x2545f4914f6cdd1dULL) >> 32) % n;
+}
+
+
+/**
+ * Hash an address into an index of the coverage map
+ *
+ * @param addr The address
+ * @return The index
+ */
+static inline uint32_t fuzz_hash(uint32_t addr)
+{
+    return (addr * 0x9e3779b1u) >> 16;
+}
+
+
+/**
+ * Check if the PC is one of a list of addresses
+ *
+ * @param pc The PC
+ * @param *addrs The addresses
+ * @param count Number of addresses
+ * @return True if it is
+ */
+static inline bool fuzz_at(uint32_t pc, const uint32_t *addrs, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        if (addrs[i] == pc) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Check the stack pointer after an instruction
+ *
+ * @param *fz The fuzzer
+ * @param *cpu The CPU
+ * @param prev_sp SP before the instruction
+ * @param *depth Bytes on the stack since the marker, updated
+ * @return False if the stack over- or underflowed
+ */
+static inline bool fuzz_stack_ok(fuzz_t *fz, CPU_t *cpu, uint16_t prev_sp, int32_t *depth)
+{
+    if (fz->stack_range) {
+        return cpu->SP >= fz->stack_lo && cpu->SP <= fz->stack_hi;
+    }
+
+    // An instruction moves SP by a few bytes, so the low byte is enough
+    // to follow it around page 1 in emulation mode
+    if (cpu->P.E) {
+        *depth += (int8_t)(uint8_t)(prev_sp - cpu->SP);
+        return *depth >= -FUZZ_STACK_SLACK && *depth <= (fz->cpu0.SP & 0xff);
+    }
+    *depth += (int16_t)(uint16_t)(prev_sp - cpu->SP);
+    return *depth >= -FUZZ_STACK_SLACK && *depth <= FUZZ_STACK_DEPTH;
+}
+
+
+/**
+ * Run an input from the marker. The edges it took are left in fz->trace.
+ *
+ * @param *fz The fuzzer
+ * @param *data The input
+ * @param len Length of the input
+ * @param *where Set to the address of the instruction which crashed
+ * @param *inst_count Set to the number of instructions run
+ * @param *stop Set to the reason the CPU stopped (if it did)
+ * @return How the run ended
+ */
+static fuzz_verdict_t fuzz_exec(fuzz_t *fz, const uint8_t *data, size_t len,
+                                uint32_t *where, uint64_t *inst_count, CPU_Stop_Reason_t *stop)
+{
+    CPU_t *cpu = &fz->cpu;
+    fuzz_verdict_t verdict = FUZZ_OK;
+
+    // Back to the marker. The UART reschedules itself on the restored
+    // scheduler, so it goes last.
+    fz->sched = fz->sched0;
+    *cpu = fz->cpu0;
+    load_16c750(&fz->uart, fz->uart0);
+    _clear_mem(&fz->mem);
+    feed_16c750(&fz->uart, data, len);
+    memset(fz->trace, 0, sizeof(fz->trace));
+    ++fz->execs;
+
+    uint32_t pc = _cpu_get_effective_pc(cpu);
+    uint64_t count = 0;
+    uint64_t tail = fz->tail;
+    int32_t depth = 0;
+    *stop = CPU_STOP_INSTRUCTIONS;
+
+    while (count < fz->max_inst) {
+        uint16_t sp = cpu->SP;
+        count += sched_run_cpu(&fz->sched, cpu, &fz->mem, 0, 1, stop);
+
+        // Anything but the next instruction is an edge (a branch of up
+        // to 2 bytes looks like falling through, which is fine)
+        uint32_t next = _cpu_get_effective_pc(cpu);
+        if (next - pc > 4) {
+            ++fz->trace[((fuzz_hash(pc) >> 1) ^ fuzz_hash(next)) & (FUZZ_MAP_SIZE - 1)];
+        }
+
+        if (*stop == CPU_STOP_CRASH || *stop == CPU_STOP_UNKNOWN_OPCODE) {
+            verdict = *stop == CPU_STOP_CRASH ? FUZZ_CRASH : FUZZ_UNKNOWN_OPCODE;
+            *where = pc;
+            break;
+        }
+        if (!fuzz_stack_ok(fz, cpu, sp, &depth)) {
+            verdict = FUZZ_STACK;
+            *where = pc;
+            break;
+        }
+        pc = next;
+        if (*stop != CPU_STOP_INSTRUCTIONS) {
+            break; // STP, or WAI with nothing left to receive
+        }
+        if (fuzz_at(pc, fz->crash_addrs, fz->crash_addr_count)) {
+            verdict = FUZZ_CRASH_ADDR;
+            *where = pc;
+            break;
+        }
+        if (fuzz_at(pc, fz->done_addrs, fz->done_addr_count)) {
+            break;
+        }
+
+        // Give the firmware a little time to act on the last char
+        if (fz->uart.buf_in_len == 0 && !(fz->uart.regs[TL_LSR] & (1u << LSR_DR)) && tail-- == 0) {
+            break;
+        }
+    }
+
+    *inst_count = count;
+    return verdict;
+}
+
+
+/**
+ * Merge the edges of the last run into the edges seen, with their hit
+ * counts put in buckets (1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+)
+ *
+ * @param *fz The fuzzer
+ * @return True if the run reached a new edge or bucket
+ */
+static bool fuzz_merge(fuzz_t *fz)
+{
+    static uint8_t buckets[256];
+    bool found = false;
+
+    if (!buckets[1]) {
+        for (int i = 1; i < 256; ++i) {
+            buckets[i] = i == 1 ? 1 : i == 2 ? 2 : i == 3 ? 4 : i < 8 ? 8 :
+                i < 16 ? 16 : i < 32 ? 32 : i < 128 ? 64 : 128;
+        }
+    }
+
+    for (uint32_t i = 0; i < FUZZ_MAP_SIZE; i += 8) {
+        uint64_t word;
+        memcpy(&word, &fz->trace[i], sizeof(word));
+        if (!word) {
+            continue; // Most of the map is untouched
+        }
+        for (uint32_t j = i; j < i + 8; ++j) {
+            uint8_t b = buckets[fz->trace[j]];
+            if (b & ~fz->seen[j]) {
+                fz->edges += !fz->seen[j];
+                fz->seen[j] |= b;
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+
+/**
+ * Add an input to the corpus, and save it to the corpus directory
+ *
+ * @param *fz The fuzzer
+ * @param *data The input
+ * @param len Length of the input
+ * @param save True to write it to the corpus directory
+ * @return False if out of memory
+ */
+static bool fuzz_add(fuzz_t *fz, const uint8_t *data, size_t len, bool save)
+{
+    if (fz->corpus_count == fz->corpus_cap) {
+        int cap = fz->corpus_cap ? fz->corpus_cap * 2 : 64;
+        fuzz_input_t *corpus = realloc(fz->corpus, cap * sizeof(*corpus));
+        if (!corpus) {
+            return false;
+        }
+        fz->corpus = corpus;
+        fz->corpus_cap = cap;
+    }
+
+    fuzz_input_t *in = &fz->corpus[fz->corpus_count];
+    in->data = malloc(len ? len : 1);
+    if (!in->data) {
+        return false;
+    }
+    memcpy(in->data, data, len);
+    in->len = len;
+    ++fz->corpus_count;
+
+    if (save && fz->corpus_dir) {
+        char name[4096];
+        snprintf(name, sizeof(name), "%s/id-%06d", fz->corpus_dir, fz->corpus_count);
+        if (!fuzz_write_file(name, data, len)) {
+            printf("Warning! Unable to write '%s': %s\n", name, strerror(errno));
+        }
+    }
+    return true;
+}
+
+
+/**
+ * Save a crashing input, unless a crash of the same kind at the same
+ * address was saved before
+ *
+ * @param *fz The fuzzer
+ * @param verdict How the run ended
+ * @param where Address of the instruction which crashed
+ * @param *data The input
+ * @param len Length of the input
+ */
+static void fuzz_save_crash(fuzz_t *fz, fuzz_verdict_t verdict, uint32_t where, const uint8_t *data, size_t len)
+{
+    uint64_t sig = ((uint64_t)verdict << 32) | where;
+
+    for (int i = 0; i < fz->crash_count; ++i) {
+        if (fz->crash_sigs[i] == sig) {
+            return;
+        }
+    }
+    if (fz->crash_count == FUZZ_MAX_CRASHES) {
+        return;
+    }
+    fz->crash_sigs[fz->crash_count++] = sig;
+
+    char name[4096];
+    snprintf(name, sizeof(name), "%s/%s-%06" PRIx32, fz->crash_dir, fuzz_verdict_names[verdict], where);
+    if (fuzz_write_file(name, data, len)) {
+        printf("New crash: %s\n", name);
+    }
+    else {
+        printf("Warning! Unable to write '%s': %s\n", name, strerror(errno));
+    }
+    fflush(stdout);
+}
+
+
+/**
+ * Make a new input from an input of the corpus with a stack of random
+ * changes
+ *
+ * @param *fz The fuzzer
+ * @param *buf Receives the input (fz->max_len bytes)
+ * @param *src The input to start from
+ * @return Length of the new input
+ */
+static size_t fuzz_mutate(fuzz_t *fz, uint8_t *buf, const fuzz_input_t *src)
+{
+    static const uint8_t interesting[] = {
+        0x00, 0x01, 0x7f, 0x80, 0xff, '\r', '\n', ' ', '\t', ',', ':', '=',
+        '-', '+', '"', '0', '1', '9', 'A', 'F', 'Z', 'a', 'f', 'z'
+    };
+    size_t max_len = fz->max_len;
+    size_t len = src->len < max_len ? src->len : max_len;
+    memcpy(buf, src->data, len);
+
+    for (int rounds = 1 << fuzz_rand(fz, 4); rounds > 0; --rounds) {
+        size_t pos = len ? fuzz_rand(fz, (uint32_t)len) : 0;
+        size_t n;
+
+        switch (fuzz_rand(fz, 8)) {
+        case 0: // Flip a bit
+            if (len) {
+                buf[pos] ^= 1u << fuzz_rand(fz, 8);
+            }
+            break;
+        case 1: // Random byte
+            if (len) {
+                buf[pos] = (uint8_t)fuzz_rand(fz, 256);
+            }
+            break;
+        case 2: // Interesting byte
+            if (len) {
+                buf[pos] = interesting[fuzz_rand(fz, sizeof(interesting))];
+            }
+            break;
+        case 3: // Insert random or interesting bytes
+        case 4:
+            n = 1 + fuzz_rand(fz, 4);
+            if (len + n > max_len) {
+                break;
+            }
+            memmove(buf + pos + n, buf + pos, len - pos);
+            for (size_t i = 0; i < n; ++i) {
+                buf[pos + i] = fuzz_rand(fz, 2) ? interesting[fuzz_rand(fz, sizeof(interesting))]
+                                                : (uint8_t)fuzz_rand(fz, 256);
+            }
+            len += n;
+            break;
+        case 5: // Delete bytes
+            if (len > 1) {
+                n = 1 + fuzz_rand(fz, (uint32_t)(len - pos < 16 ? len - pos : 16));
+                memmove(buf + pos, buf + pos + n, len - pos - n);
+                len -= n;
+            }
+            break;
+        case 6: // Insert a copy of a part of the input
+            if (len) {
+                size_t from = fuzz_rand(fz, (uint32_t)len);
+                n = 1 + fuzz_rand(fz, (uint32_t)(len - from));
+                if (len + n > max_len) {
+                    break;
+                }
+                memmove(buf + pos + n, buf + pos, len - pos);
+                memmove(buf + pos, buf + (from < pos ? from : from + n), n);
+                len += n;
+            }
+            break;
+        default: { // Splice: the start of this input, the end of another
+            const fuzz_input_t *other = &fz->corpus[fuzz_rand(fz, fz->corpus_count)];
+            if (!other->len) {
+                break;
+            }
+            size_t from = fuzz_rand(fz, (uint32_t)other->len);
+            n = other->len - from;
+            if (pos + n > max_len) {
+                n = max_len - pos;
+            }
+            memcpy(buf + pos, other->data + from, n);
+            len = pos + n;
+            break;
+        }
+        }
+    }
+    return len;
+}
+
+
+/**
+ * Run an input and add it to the corpus if it found new edges, or save
+ * it if it crashed
+ *
+ * @param *fz The fuzzer
+ * @param *data The input
+ * @param len Length of the input
+ * @return False if out of memory
+ */
+static bool fuzz_one(fuzz_t *fz, const uint8_t *data, size_t len)
+{
+    uint32_t where = 0;
+    uint64_t count;
+    CPU_Stop_Reason_t stop;
+    fuzz_verdict_t verdict = fuzz_exec(fz, data, len, &where, &count, &stop);
+
+    if (verdict != FUZZ_OK) {
+        fuzz_save_crash(fz, verdict, where, data, len);
+        fuzz_merge(fz); // Its edges are known, but crashes are not mutated further
+        return true;
+    }
+    if (fuzz_merge(fz)) {
+        return fuzz_add(fz, data, len, true);
+    }
+    return true;
+}
+
+
+/**
+ * Run the seeds of the corpus directory (or an empty input if there are
+ * none), keeping the ones which find new edges
+ *
+ * @param *fz The fuzzer
+ * @return False if the seeds could not be read
+ */
+static bool fuzz_load_seeds(fuzz_t *fz)
+{
+    DIR *dir = fz->corpus_dir ? opendir(fz->corpus_dir) : NULL;
+    struct dirent *ent;
+    int seeds = 0;
+
+    // The saved inputs are kept under their names
+    const char *corpus_dir = fz->corpus_dir;
+    fz->corpus_dir = NULL;
+
+    while (dir && (ent = readdir(dir))) {
+        char name[4096];
+        const char *err;
+        size_t len;
+
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(name, sizeof(name), "%s/%s", corpus_dir, ent->d_name);
+
+        struct stat st;
+        if (stat(name, &st) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        uint8_t *data = headless_read_file(name, fz->max_len, &len, &err);
+        if (!data) {
+            printf("Warning! Skipping seed '%s': %s\n", name, err);
+            continue;
+        }
+        bool ok = fuzz_one(fz, data, len);
+        free(data);
+        if (!ok) {
+            closedir(dir);
+            return false;
+        }
+        ++seeds;
+    }
+    if (dir) {
+        closedir(dir);
+    }
+    fz->corpus_dir = corpus_dir;
+
+    if (!fz->corpus_count && !fuzz_add(fz, (const uint8_t *)"", 0, false)) {
+        return false;
+    }
+    printf("seeds: %d corpus: %d edges: %" PRIu32 "\n", seeds, fz->corpus_count, fz->edges);
+    return true;
+}
+
+
+/**
+ * Time since an arbitrary point
+ *
+ * @return Seconds
+ */
+static double fuzz_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+ * Print the progress of the fuzzer
+ *
+ * @param *fz The fuzzer
+ * @param elapsed Seconds since fuzzing started
+ */
+static void fuzz_status(fuzz_t *fz, double elapsed)
+{
+    printf("execs: %" PRIu64 " exec/s: %.0f corpus: %d edges: %" PRIu32 " crashes: %d\n",
+           fz->execs, elapsed > 0 ? fz->execs / elapsed : 0.0, fz->corpus_count, fz->edges, fz->crash_count);
+    fflush(stdout);
+}
+
+
+/**
+ * Stop fuzzing at the end of the current run
+ *
+ * @param sig Ignored
+ */
+static void fuzz_on_sigint(int sig)
+{
+    (void)sig;
+    fuzz_quit = 1;
+}
+
+
+/**
+ * Make a directory if it does not exist yet
+ *
+ * @param *path The directory
+ * @return False if it does not exist and could not be made
+ */
+static bool fuzz_make_dir(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        return S_ISDIR(st.st_mode);
+    }
+    return mkdir(path, 0777) == 0;
+}
+
+
+/**
+ * Boot the firmware up to the marker and keep the state there
+ *
+ * @param *fz The fuzzer (boot memory loaded, UART set up)
+ * @param marker Address to boot to
+ * @param use_marker False to keep the state as it is
+ * @param max_inst Budget of the boot
+ * @return False if the marker was not reached
+ */
+static bool fuzz_boot(fuzz_t *fz, uint32_t marker, bool use_marker, uint64_t max_inst)
+{
+    if (use_marker) {
+        CPU_Stop_Reason_t stop = CPU_STOP_INSTRUCTIONS;
+
+        // runCPU() only stops on a breakpoint after running at least
+        // one instruction, so check the reset PC first
+        if (_cpu_get_effective_pc(&fz->cpu) != marker) {
+            _set_mem_flags(&fz->boot, marker, MEM_FLAG_B);
+            uint64_t count = sched_run_cpu(&fz->sched, &fz->cpu, &fz->boot, 0, max_inst, &stop);
+            _reset_mem_flags(&fz->boot, marker, MEM_FLAG_B);
+
+            if (stop != CPU_STOP_BREAKPOINT || _cpu_get_effective_pc(&fz->cpu) != marker) {
+                printf("Error! The marker was not reached (stop: %s after %" PRIu64 " instructions)\n",
+                       headless_stop_name(stop), count);
+                return false;
+            }
+        }
+    }
+
+    // Runs use the UART in their own memory from now on, which restarts
+    // its line: take the checkpoint after that
+    detach_16c750(&fz->uart, &fz->boot);
+    if (!_init_mem(&fz->mem, false)) {
+        printf("Unable to allocate system memory!\n");
+        return false;
+    }
+    _share_mem(&fz->mem, &fz->boot);
+    if (!attach_16c750(&fz->uart, &fz->mem)) {
+        printf("Error! Unable to map the UART\n");
+        return false;
+    }
+
+    fz->cpu0 = fz->cpu;
+    fz->sched0 = fz->sched;
+    save_16c750(&fz->uart, fz->uart0);
+    return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+    fuzz_t *fz = calloc(1, sizeof(*fz));
+    int image_count = 0;
+    headless_image_t images[FUZZ_MAX_IMAGES];
+    const char *snap_filename = NULL;
+    const char *run_filename = NULL;
+    uint32_t uart_addr = 0, marker = 0;
+    bool have_uart = false, have_marker = false;
+    uint32_t stack_lo = 0, stack_hi = 0;
+    uint64_t boot_max_inst = FUZZ_DEFAULT_BOOT_MAX_INST;
+    uint64_t iterations = 0;
+    uint64_t seed = (uint64_t)time(NULL);
+    uint64_t n;
+
+    if (!fz) {
+        printf("Out of memory!\n");
+        return EXIT_FAILURE;
+    }
+    fz->max_inst = FUZZ_DEFAULT_MAX_INST;
+    fz->tail = FUZZ_DEFAULT_TAIL;
+    fz->max_len = FUZZ_DEFAULT_MAX_LEN;
+    fz->crash_dir = "crashes";
+
+    for (int i = 1; i < argc; ++i) {
+        char *opt = argv[i];
+        char *arg = i + 1 < argc ? argv[++i] : NULL;
+
+        if (!arg) {
+            fuzz_usage();
+        }
+        if (strcmp(opt, "--mem") == 0) {
+            if (image_count == FUZZ_MAX_IMAGES) {
+                printf("Error! Too many --mem images\n");
+                return EXIT_FAILURE;
+            }
+            headless_image_t *img = &images[image_count++];
+            img->addr = 0;
+            if (headless_parse_hex(arg, &img->addr)) {
+                if (++i == argc) {
+                    fuzz_usage();
+                }
+                arg = argv[i];
+            }
+            img->filename = arg;
+        }
+        else if (strcmp(opt, "--snap") == 0) {
+            snap_filename = arg;
+        }
+        else if (strcmp(opt, "--uart") == 0 || strcmp(opt, "--marker") == 0 ||
+                 strcmp(opt, "--done") == 0 || strcmp(opt, "--crash") == 0) {
+            uint32_t addr;
+            if (!headless_parse_hex(arg, &addr) || addr > 0xffffff) {
+                printf("Error! (%s) Expected a 24-bit hex address\n", arg);
+                return EXIT_FAILURE;
+            }
+            if (opt[2] == 'u') {
+                uart_addr = addr;
+                have_uart = true;
+            }
+            else if (opt[2] == 'm') {
+                marker = addr;
+                have_marker = true;
+            }
+            else {
+                bool done = opt[2] == 'd';
+                int *count = done ? &fz->done_addr_count : &fz->crash_addr_count;
+                if (*count == FUZZ_MAX_ADDRS) {
+                    printf("Error! Too many %s addresses\n", opt);
+                    return EXIT_FAILURE;
+                }
+                (done ? fz->done_addrs : fz->crash_addrs)[(*count)++] = addr;
+            }
+        }
+        else if (strcmp(opt, "--stack") == 0) {
+            if (++i == argc || !headless_parse_hex(arg, &stack_lo) || !headless_parse_hex(argv[i], &stack_hi) ||
+                stack_hi > 0xffff || stack_lo > stack_hi) {
+                printf("Error! Expected a range of 16-bit hex addresses\n");
+                return EXIT_FAILURE;
+            }
+            fz->stack_range = true;
+            fz->stack_lo = (uint16_t)stack_lo;
+            fz->stack_hi = (uint16_t)stack_hi;
+        }
+        else if (strcmp(opt, "--boot_max_inst") == 0 || strcmp(opt, "--max_inst") == 0 ||
+                 strcmp(opt, "--tail") == 0 || strcmp(opt, "--max_len") == 0 ||
+                 strcmp(opt, "--iterations") == 0 || strcmp(opt, "--seed") == 0) {
+            if (!headless_parse_dec64(arg, &n)) {
+                printf("Error! (%s) Expected a decimal number\n", arg);
+                return EXIT_FAILURE;
+            }
+            if (strcmp(opt, "--boot_max_inst") == 0) {
+                boot_max_inst = n;
+            }
+            else if (strcmp(opt, "--max_inst") == 0) {
+                fz->max_inst = n;
+            }
+            else if (strcmp(opt, "--tail") == 0) {
+                fz->tail = n;
+            }
+            else if (strcmp(opt, "--max_len") == 0) {
+                if (n == 0 || n > HEADLESS_MEM_SIZE) {
+                    printf("Error! (%s) Expected a length from 1 to %d\n", arg, HEADLESS_MEM_SIZE);
+                    return EXIT_FAILURE;
+                }
+                fz->max_len = n;
+            }
+            else if (strcmp(opt, "--iterations") == 0) {
+                iterations = n;
+            }
+            else {
+                seed = n;
+            }
+        }
+        else if (strcmp(opt, "--corpus") == 0) {
+            fz->corpus_dir = arg;
+        }
+        else if (strcmp(opt, "--crashes") == 0) {
+            fz->crash_dir = arg;
+        }
+        else if (strcmp(opt, "--run") == 0) {
+            run_filename = arg;
+        }
+        else {
+            fuzz_usage();
+        }
+    }
+    if (!have_uart) {
+        fuzz_usage();
+    }
+
+    // The machine
+    if (!_init_mem(&fz->boot, false)) {
+        printf("Unable to allocate system memory!\n");
+        return EXIT_FAILURE;
+    }
+    initCPU(&fz->cpu);
+    resetCPU(&fz->cpu);
+    fz->cpu.setacc = true; // So the UART sees the CPU's accesses
+    sched_init(&fz->sched, &fz->cpu);
+
+    init_16c750(&fz->uart);
+    init_buffer_16c750(&fz->uart, true);
+    fz->uart.addr = uart_addr;
+    fz->uart.sched = &fz->sched;
+    if (!attach_16c750(&fz->uart, &fz->boot)) {
+        printf("Error! Unable to map the UART at %06" PRIx32 "\n", uart_addr);
+        return EXIT_FAILURE;
+    }
+    fz->uart.enabled = true;
+
+    if (snap_filename) {
+        snap_err_t snap_err = snapshot_load(snap_filename, &fz->cpu, &fz->boot, &fz->uart, 1);
+        if (snap_err != SNAP_OK) {
+            printf("Error! (%s) %s\n", snap_filename, snapshot_strerror(snap_err));
+            return EXIT_FAILURE;
+        }
+    }
+    for (int i = 0; i < image_count; ++i) {
+        const char *err;
+        if (!headless_load_image(&fz->boot, &images[i], &err)) {
+            printf("Error! (%s) %s\n", images[i].filename, err);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!fuzz_boot(fz, marker, have_marker, boot_max_inst)) {
+        return EXIT_FAILURE;
+    }
+
+    // One input
+    if (run_filename) {
+        const char *err;
+        size_t len;
+        uint8_t *data = headless_read_file(run_filename, HEADLESS_MEM_SIZE, &len, &err);
+        if (!data) {
+            printf("Error! (%s) %s\n", run_filename, err);
+            return EXIT_FAILURE;
+        }
+
+        uint32_t where = 0;
+        uint64_t count;
+        CPU_Stop_Reason_t stop;
+        char buf[256];
+        fuzz_verdict_t verdict = fuzz_exec(fz, data, len, &where, &count, &stop);
+
+        tostrCPU(&fz->cpu, buf);
+        printf("verdict: %s", fuzz_verdict_names[verdict]);
+        if (verdict != FUZZ_OK) {
+            printf(" at: %06" PRIx32, where);
+        }
+        if (stop != CPU_STOP_INSTRUCTIONS) {
+            printf(" stop: %s", headless_stop_name(stop));
+        }
+        printf(" instructions: %" PRIu64 "\n%s\n", count, buf);
+        free(data);
+        return verdict == FUZZ_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (!fuzz_make_dir(fz->crash_dir) || (fz->corpus_dir && !fuzz_make_dir(fz->corpus_dir))) {
+        printf("Error! Unable to make the output directories: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    uint8_t *buf = malloc(fz->max_len);
+    fz->rng = seed * 0x9e3779b97f4a7c15ULL | 1;
+    if (!buf || !fuzz_load_seeds(fz)) {
+        printf("Out of memory!\n");
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGINT, fuzz_on_sigint);
+    double start = fuzz_now();
+    double last = start;
+    fz->execs = 0;
+
+    while (!fuzz_quit && (!iterations || fz->execs < iterations)) {
+        const fuzz_input_t *src = &fz->corpus[fuzz_rand(fz, fz->corpus_count)];
+        size_t len = fuzz_mutate(fz, buf, src);
+
+        if (!fuzz_one(fz, buf, len)) {
+            printf("Out of memory!\n");
+            break;
+        }
+        if ((fz->execs & 0xff) == 0) {
+            double now = fuzz_now();
+            if (now - last >= 1.0) {
+                fuzz_status(fz, now - start);
+                last = now;
+            }
+        }
+    }
+    fuzz_status(fz, fuzz_now() - start);
+
+    free(buf);
+    for (int i = 0; i < fz->corpus_count; ++i) {
+        free(fz->corpus[i].data);
+    }
+    free(fz->corpus);
+    detach_16c750(&fz->uart, &fz->mem);
+    stop_16c750(&fz->uart);
+    _free_mem(&fz->mem);
+    _free_mem(&fz->boot);
+
+    int status = fz->crash_count ? EXIT_FAILURE : EXIT_SUCCESS;
+    free(fz);
+    return status;
+}
@@ -0,0 +1,270 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+
+#include "65816.h"
+#include "65816-util.h"
+#include "scheduler.h"
+#include "headless.h"
+
+
+// Printable names of the stop reasons
+// Keep in sync with CPU_Stop_Reason_t in 65816.h
+static char *headless_stop_names[] = {
+    "stp",
+    "crash",
+    "unknown_opcode",
+    "breakpoint",
+    "wai",
+    "max_cycles",
+    "max_inst"
+};
+
+
+/**
+ * Initialize a headless configuration to a disabled state
+ * with no budget limits and no memory dumps
+ *
+ * @param *hl The configuration to initialize
+ */
+void headless_init(headless_t *hl)
+{
+    hl->enabled = false;
+    hl->max_cycles = 0;
+    hl->max_inst = 0;
+    hl->out_filename = NULL;
+    hl->snap_filename = NULL;
+    hl->prof_filename = NULL;
+    hl->dump_count = 0;
+    hl->stop = CPU_STOP_INSTRUCTIONS;
+    hl->inst_count = 0;
+}
+
+
+/**
+ * Get the printable name of a stop reason (as in the report)
+ *
+ * @param stop The reason
+ * @return The name
+ */
+const char *headless_stop_name(CPU_Stop_Reason_t stop)
+{
+    return headless_stop_names[stop];
+}
+
+
+/**
+ * Find the stop reason with a printable name
+ *
+ * @param *name The name, as in the report (e.g. "stp")
+ * @param *stop Set to the reason if found
+ * @return True if found, false if no reason has that name
+ */
+bool headless_parse_stop(const char *name, CPU_Stop_Reason_t *stop)
+{
+    for (size_t i = 0; i < sizeof(headless_stop_names) / sizeof(*headless_stop_names); ++i) {
+        if (strcmp(name, headless_stop_names[i]) == 0) {
+            *stop = (CPU_Stop_Reason_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Parse a hex number
+ *
+ * @param *str The text
+ * @param *val Set to the number
+ * @return True if the whole text is a hex number
+ */
+bool headless_parse_hex(const char *str, uint32_t *val)
+{
+    char *end;
+    errno = 0;
+    unsigned long v = strtoul(str, &end, 16);
+    if (!*str || *end || errno || v > UINT32_MAX) {
+        return false;
+    }
+    *val = (uint32_t)v;
+    return true;
+}
+
+
+/**
+ * Parse a decimal number
+ *
+ * @param *str The text
+ * @param *val Set to the number
+ * @return True if the whole text is a decimal number
+ */
+bool headless_parse_dec64(const char *str, uint64_t *val)
+{
+    char *end;
+    errno = 0;
+    unsigned long long v = strtoull(str, &end, 10);
+    if (!*str || *end || errno || *str == '-') {
+        return false;
+    }
+    *val = (uint64_t)v;
+    return true;
+}
+
+
+/**
+ * Read a whole file
+ *
+ * @param *filename The file
+ * @param max_size Largest size accepted
+ * @param *size Set to the size of the file
+ * @param *err Set to a description of the error on failure
+ * @return The contents (NUL terminated, free() them) or NULL on failure
+ */
+uint8_t *headless_read_file(const char *filename, size_t max_size, size_t *size, const char **err)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        *err = strerror(errno);
+        return NULL;
+    }
+
+    uint8_t *buf = malloc(max_size + 1);
+    if (!buf) {
+        fclose(fp);
+        *err = "Out of memory";
+        return NULL;
+    }
+
+    *size = fread(buf, 1, max_size + 1, fp);
+    bool io_err = ferror(fp);
+    fclose(fp);
+
+    if (io_err || *size > max_size) {
+        free(buf);
+        *err = io_err ? "Unable to read file" : "File is too large";
+        return NULL;
+    }
+    buf[*size] = '\0';
+    return buf;
+}
+
+
+/**
+ * Load an image into memory
+ *
+ * @param *mem The memory
+ * @param *img The file and its address
+ * @param *err Set to a description of the error on failure
+ * @return False if the file could not be loaded
+ */
+bool headless_load_image(memory_t *mem, headless_image_t *img, const char **err)
+{
+    size_t size;
+    uint8_t *buf = headless_read_file(img->filename, HEADLESS_MEM_SIZE, &size, err);
+    if (!buf) {
+        return false;
+    }
+    if (img->addr + size > HEADLESS_MEM_SIZE) {
+        free(buf);
+        *err = "File would wrap around memory";
+        return false;
+    }
+    _init_mem_arr(mem, buf, img->addr, (uint32_t)size);
+    free(buf);
+    return true;
+}
+
+
+/**
+ * Print an inclusive range of memory as a hex dump
+ *
+ * @param *fp The file to print to
+ * @param *mem The memory to read from
+ * @param *range The range of addresses to print
+ */
+static void headless_dump_mem(FILE *fp, memory_t *mem, dump_range_t *range)
+{
+    fprintf(fp, "mem: %06x-%06x\n", range->start, range->end);
+
+    for (uint32_t addr = range->start; addr <= range->end; ++addr) {
+        if ((addr - range->start) % HEADLESS_DUMP_LINE_LEN == 0) {
+            if (addr != range->start) {
+                fputc('\n', fp);
+            }
+            fprintf(fp, "%06x:", addr);
+        }
+        fprintf(fp, " %02x", _get_mem_byte(mem, addr, false));
+    }
+    fputc('\n', fp);
+}
+
+
+/**
+ * Run a CPU without any user interface until it executes STP,
+ * crashes, hits a breakpoint, waits for an interrupt which can
+ * never come (WAI with no device events pending), or runs out of its cycle or
+ * instruction budget. The outcome is kept in hl for headless_report().
+ *
+ * @param *hl The run configuration
+ * @param *cpu The CPU to run
+ * @param *mem The memory connected to the CPU
+ * @param *sched The device events to run alongside the CPU
+ */
+void headless_run(headless_t *hl, CPU_t *cpu, memory_t *mem, scheduler_t *sched)
+{
+    hl->inst_count = sched_run_cpu(sched, cpu, mem, hl->max_cycles, hl->max_inst, &hl->stop);
+}
+
+
+/**
+ * Write the outcome of headless_run(), the final CPU state and any
+ * requested memory ranges to the output file (or stdout). Devices
+ * should be stopped first, so output they still had buffered comes
+ * before the report.
+ *
+ * @param *hl The run configuration
+ * @param *cpu The CPU which was run
+ * @param *mem The memory connected to the CPU
+ * @return The process exit status. EXIT_FAILURE if the CPU crashed,
+ *         reached an unknown opcode, or the output file could not
+ *         be written. EXIT_SUCCESS otherwise.
+ */
+int headless_report(headless_t *hl, CPU_t *cpu, memory_t *mem)
+{
+    FILE *fp = stdout;
+    if (hl->out_filename) {
+        fp = fopen(hl->out_filename, "w");
+        if (!fp) {
+            fprintf(stderr, "Error! Unable to open file '%s':\n%s\n", hl->out_filename, strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    char buf[256];
+    tostrCPU(cpu, buf);
+
+    fprintf(fp, "stop: %s\n", headless_stop_name(hl->stop));
+    fprintf(fp, "instructions: %" PRIu64 "\n", hl->inst_count);
+    fprintf(fp, "cpu: %s\n", buf);
+
+    for (int i = 0; i < hl->dump_count; ++i) {
+        headless_dump_mem(fp, mem, &hl->dumps[i]);
+    }
+
+    if (fp != stdout) {
+        fclose(fp);
+    }
+
+    if (hl->stop == CPU_STOP_CRASH || hl->stop == CPU_STOP_UNKNOWN_OPCODE) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
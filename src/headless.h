@@ -0,0 +1,62 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+#ifndef _HEADLESS_H
+#define _HEADLESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "65816.h"
+#include "scheduler.h"
+
+// Max number of --dump ranges accepted on the command line
+#define HEADLESS_MAX_DUMPS 16
+
+// Number of bytes printed per line of a memory dump
+#define HEADLESS_DUMP_LINE_LEN 16
+
+// Size of the memory images can be loaded into
+#define HEADLESS_MEM_SIZE 0x1000000
+
+// An inclusive range of memory to print after a headless run
+typedef struct dump_range_t {
+    uint32_t start;
+    uint32_t end;
+} dump_range_t;
+
+// A file to load into memory
+typedef struct headless_image_t {
+    uint32_t addr;
+    char *filename;
+} headless_image_t;
+
+// Configuration of a headless (no ncurses) run
+typedef struct headless_t {
+    bool enabled;
+    uint64_t max_cycles; // 0 = no limit
+    uint64_t max_inst;   // 0 = no limit
+    char *out_filename;  // NULL = stdout
+    char *snap_filename; // Snapshot saved after the run (NULL = none)
+    char *prof_filename; // Profile report saved after the run (NULL = none)
+    int dump_count;
+    dump_range_t dumps[HEADLESS_MAX_DUMPS];
+    CPU_Stop_Reason_t stop; // Set by headless_run()
+    uint64_t inst_count;    // Set by headless_run()
+} headless_t;
+
+
+void headless_init(headless_t *hl);
+void headless_run(headless_t *hl, CPU_t *cpu, memory_t *mem, scheduler_t *sched);
+int headless_report(headless_t *hl, CPU_t *cpu, memory_t *mem);
+const char *headless_stop_name(CPU_Stop_Reason_t stop);
+bool headless_parse_stop(const char *name, CPU_Stop_Reason_t *stop);
+bool headless_parse_hex(const char *str, uint32_t *val);
+bool headless_parse_dec64(const char *str, uint64_t *val);
+uint8_t *headless_read_file(const char *filename, size_t max_size, size_t *size, const char **err);
+bool headless_load_image(memory_t *mem, headless_image_t *img, const char **err);
+
+#endif
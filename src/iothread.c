@@ -0,0 +1,861 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ *
+ * Socket (and pty) I/O for the emulated serial devices, run on a thread of its
+ * own so the CPU thread never makes a syscall for it in the common
+ * case. Bytes are passed between the threads through lock-free single
+ * producer, single consumer rings. The CPU thread only writes to an
+ * eventfd when the I/O thread has to be told about a batch of TX
+ * data, or that RX was paused on a full ring and can resume.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "iothread.h"
+
+// epoll_event.data.u32 of the thread's own eventfd
+// Ports use (index << 1) | IO_EV_DATA
+#define IO_EV_WAKE UINT32_MAX
+#define IO_EV_LISTEN 0
+#define IO_EV_DATA 1
+
+#define IO_MAX_EVENTS 16
+
+
+/**
+ * Get the number of bytes waiting in a ring
+ *
+ * @param *ring The ring to check
+ * @return The number of bytes which can be read
+ */
+uint32_t io_ring_used(io_ring_t *ring)
+{
+    return atomic_load_explicit(&ring->head, memory_order_acquire) -
+        atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+
+/**
+ * Get the free space of a ring
+ *
+ * @param *ring The ring to check
+ * @return The number of bytes which can be written
+ */
+uint32_t io_ring_free(io_ring_t *ring)
+{
+    return IO_RING_LEN - io_ring_used(ring);
+}
+
+
+/**
+ * Get the longest run of free bytes at the head of a ring (producer)
+ *
+ * @param *ring The ring to write
+ * @param **dst Set to the start of the run
+ * @return The length of the run
+ */
+static uint32_t _io_ring_write_span(io_ring_t *ring, uint8_t **dst)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint32_t offs = head & (IO_RING_LEN - 1);
+    uint32_t len = IO_RING_LEN - (head - tail);
+
+    if (len > IO_RING_LEN - offs) {
+        len = IO_RING_LEN - offs;
+    }
+    *dst = ring->buf + offs;
+    return len;
+}
+
+
+/**
+ * Get the longest run of used bytes at the tail of a ring (consumer)
+ *
+ * @param *ring The ring to read
+ * @param **src Set to the start of the run
+ * @return The length of the run
+ */
+static uint32_t _io_ring_read_span(io_ring_t *ring, uint8_t **src)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t offs = tail & (IO_RING_LEN - 1);
+    uint32_t len = head - tail;
+
+    if (len > IO_RING_LEN - offs) {
+        len = IO_RING_LEN - offs;
+    }
+    *src = ring->buf + offs;
+    return len;
+}
+
+
+/**
+ * Publish bytes written into a span from _io_ring_write_span()
+ *
+ * @param *ring The ring written
+ * @param len The number of bytes written
+ */
+static void _io_ring_produce(io_ring_t *ring, uint32_t len)
+{
+    atomic_fetch_add_explicit(&ring->head, len, memory_order_release);
+}
+
+
+/**
+ * Release bytes read from a span from _io_ring_read_span()
+ *
+ * @param *ring The ring read
+ * @param len The number of bytes read
+ */
+static void _io_ring_consume(io_ring_t *ring, uint32_t len)
+{
+    atomic_fetch_add_explicit(&ring->tail, len, memory_order_release);
+}
+
+
+/**
+ * Signal an eventfd
+ *
+ * @param fd The eventfd
+ */
+static void _io_signal(int fd)
+{
+    uint64_t one = 1;
+
+    if (write(fd, &one, sizeof(one)) < 0) {
+        // Only fails if the counter would overflow, it is set anyway
+    }
+}
+
+
+/**
+ * Reset an eventfd so it can be waited on again
+ *
+ * @param fd The (nonblocking) eventfd
+ */
+static void _io_drain(int fd)
+{
+    uint64_t count;
+
+    if (read(fd, &count, sizeof(count)) < 0) {
+        // EAGAIN, nothing was signaled
+    }
+}
+
+
+/**
+ * Wake the device side of a port if it is waiting for the I/O thread
+ *
+ * @param *port The port which made progress
+ */
+static void _io_wake_dev(io_port_t *port)
+{
+    if (atomic_exchange(&port->dev_waiting, false)) {
+        _io_signal(port->wake_fd);
+    }
+}
+
+
+/**
+ * Update the events the I/O thread waits for on a client socket
+ *
+ * @param *io The I/O thread
+ * @param index The index of the port
+ */
+static void _io_update_events(io_thread_t *io, int index)
+{
+    io_port_t *port = io->ports[index];
+    struct epoll_event ev = {0};
+
+    if (!port->rx_paused) {
+        ev.events |= EPOLLIN | EPOLLRDHUP;
+    }
+    if (port->tx_armed) {
+        ev.events |= EPOLLOUT;
+    }
+    ev.data.u32 = (index << 1) | IO_EV_DATA;
+
+    epoll_ctl(io->epoll_fd, EPOLL_CTL_MOD, port->data_fd, &ev);
+}
+
+
+/**
+ * Disconnect the client of a port so a new one can connect.
+ * Unsent TX data is dropped, received data is still delivered.
+ * A stream is only dropped from the epoll set, its owner closes it.
+ *
+ * @param *io The I/O thread
+ * @param *port The port to disconnect
+ */
+static void _io_close_client(io_thread_t *io, io_port_t *port)
+{
+    uint8_t *src;
+    uint32_t len;
+
+    if (port->stream) {
+        epoll_ctl(io->epoll_fd, EPOLL_CTL_DEL, port->data_fd, NULL);
+    }
+    else {
+        close(port->data_fd); // Also removes it from the epoll set
+    }
+    port->data_fd = -1;
+    port->rx_paused = false;
+    port->tx_armed = false;
+
+    while ((len = _io_ring_read_span(&port->tx, &src)) > 0) {
+        _io_ring_consume(&port->tx, len);
+    }
+
+    atomic_store(&port->connected, false);
+    _io_wake_dev(port);
+}
+
+
+/**
+ * Accept a client on a port's listener. Only one client is served at
+ * a time, others are left waiting in the listen backlog.
+ *
+ * @param *io The I/O thread
+ * @param index The index of the port
+ */
+static void _io_accept(io_thread_t *io, int index)
+{
+    io_port_t *port = io->ports[index];
+    struct epoll_event ev = {0};
+
+    if (port->data_fd >= 0) {
+        return;
+    }
+
+    port->data_fd = accept(port->listen_fd, NULL, NULL);
+    if (port->data_fd < 0) {
+        return;
+    }
+
+    int flags = fcntl(port->data_fd, F_GETFL, 0);
+    if (flags != -1) {
+        fcntl(port->data_fd, F_SETFL, flags | O_NONBLOCK);
+    }
+
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.u32 = (index << 1) | IO_EV_DATA;
+    if (epoll_ctl(io->epoll_fd, EPOLL_CTL_ADD, port->data_fd, &ev) < 0) {
+        close(port->data_fd);
+        port->data_fd = -1;
+        return;
+    }
+
+    atomic_store(&port->connected, true);
+    _io_wake_dev(port);
+}
+
+
+/**
+ * Read everything a client has sent (up to the space in the RX ring)
+ *
+ * @param *io The I/O thread
+ * @param index The index of the port
+ */
+static void _io_recv(io_thread_t *io, int index)
+{
+    io_port_t *port = io->ports[index];
+    bool received = false;
+
+    while (port->data_fd >= 0) {
+        uint8_t *dst;
+        uint32_t room = _io_ring_write_span(&port->rx, &dst);
+
+        if (room == 0) {
+            // Pause reading until the device takes some bytes. Check
+            // again in case it did so before seeing the flag.
+            atomic_store(&port->rx_blocked, true);
+            if (io_ring_free(&port->rx) > 0) {
+                atomic_store(&port->rx_blocked, false);
+                continue;
+            }
+            port->rx_paused = true;
+            _io_update_events(io, index);
+            break;
+        }
+
+        ssize_t len = read(port->data_fd, dst, room);
+
+        if (len > 0) {
+            _io_ring_produce(&port->rx, len);
+            received = true;
+        }
+        else if (len == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            _io_close_client(io, port); // 0 = the client disconnected
+        }
+        else {
+            break;
+        }
+    }
+
+    if (received) {
+        _io_wake_dev(port);
+    }
+}
+
+
+/**
+ * Send the TX ring of a port to its client (or drop it if there is
+ * no client). Waits for EPOLLOUT if the socket is full.
+ *
+ * @param *io The I/O thread
+ * @param index The index of the port
+ */
+static void _io_send(io_thread_t *io, int index)
+{
+    io_port_t *port = io->ports[index];
+    bool sent_any = false;
+
+    for (;;) {
+        uint8_t *src;
+        uint32_t len = _io_ring_read_span(&port->tx, &src);
+
+        if (len == 0) {
+            // Drained, let the device side kick again. Check once more
+            // for bytes pushed while the flag was still set.
+            atomic_store(&port->tx_kicked, false);
+            if (io_ring_used(&port->tx) == 0 || atomic_exchange(&port->tx_kicked, true)) {
+                break;
+            }
+            continue;
+        }
+
+        if (port->data_fd < 0) {
+            _io_ring_consume(&port->tx, len); // Nobody to send to
+            sent_any = true;
+            continue;
+        }
+
+        ssize_t sent = port->stream ?
+            write(port->data_fd, src, len) :
+            send(port->data_fd, src, len, MSG_NOSIGNAL);
+
+        if (sent > 0) {
+            _io_ring_consume(&port->tx, sent);
+            sent_any = true;
+        }
+        else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Wait for the client to take more, tx_kicked stays set
+            if (!port->tx_armed) {
+                port->tx_armed = true;
+                _io_update_events(io, index);
+            }
+            break;
+        }
+        else if (sent < 0 && errno != EINTR) {
+            _io_close_client(io, port); // If the pipe was closed, errno should be EPIPE
+        }
+    }
+
+    if (port->tx_armed && port->data_fd >= 0 && io_ring_used(&port->tx) == 0) {
+        port->tx_armed = false;
+        _io_update_events(io, index);
+    }
+    if (sent_any) {
+        _io_wake_dev(port); // The device may be stalled on a full TX ring
+    }
+}
+
+
+/**
+ * Give every port's client a chance (up to the flush timeout) to take
+ * the TX data which is left, before the thread exits
+ *
+ * @param *io The I/O thread
+ */
+static void _io_flush_all(io_thread_t *io)
+{
+    for (int i = 0; i < io->port_count; ++i) {
+        io_port_t *port = io->ports[i];
+
+        while (port->data_fd >= 0 && io_ring_used(&port->tx) > 0) {
+            struct pollfd pfd = { .fd = port->data_fd, .events = POLLOUT };
+
+            if (poll(&pfd, 1, io->flush_timeout) <= 0) {
+                break;
+            }
+            _io_send(io, i);
+        }
+    }
+}
+
+
+/**
+ * I/O thread main loop
+ *
+ * @param *arg The io_thread_t to run
+ * @return NULL
+ */
+static void *_io_run(void *arg)
+{
+    io_thread_t *io = arg;
+    struct epoll_event events[IO_MAX_EVENTS];
+
+    while (!atomic_load(&io->stop)) {
+        int n = epoll_wait(io->epoll_fd, events, IO_MAX_EVENTS, -1);
+
+        for (int i = 0; i < n; ++i) {
+            uint32_t id = events[i].data.u32;
+
+            if (id == IO_EV_WAKE) {
+                _io_drain(io->event_fd);
+            }
+            else if ((id & 1) == IO_EV_LISTEN) {
+                _io_accept(io, id >> 1);
+            }
+            else if (io->ports[id >> 1]->rx_paused) {
+                // Only hangups and errors are reported while paused
+                if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                    _io_close_client(io, io->ports[id >> 1]);
+                }
+            }
+            else if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                _io_recv(io, id >> 1);
+            }
+        }
+
+        // Kicks are not tied to a port, so look at all of them
+        for (int i = 0; i < io->port_count; ++i) {
+            io_port_t *port = io->ports[i];
+
+            if (port->rx_paused && port->data_fd >= 0 && !atomic_load(&port->rx_blocked)) {
+                port->rx_paused = false;
+                _io_update_events(io, i);
+                _io_recv(io, i);
+            }
+            _io_send(io, i);
+        }
+    }
+
+    _io_flush_all(io);
+    return NULL;
+}
+
+
+/**
+ * Initialize an I/O thread without starting it
+ *
+ * @param *io The I/O thread to set up
+ * @return True on success, false if the epoll set could not be created
+ */
+bool io_init(io_thread_t *io)
+{
+    struct epoll_event ev = {0};
+
+    io->running = false;
+    io->port_count = 0;
+    io->flush_timeout = 1000;
+    atomic_init(&io->stop, false);
+
+    io->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    io->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (io->epoll_fd < 0 || io->event_fd < 0) {
+        io_free(io);
+        return false;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.u32 = IO_EV_WAKE;
+    if (epoll_ctl(io->epoll_fd, EPOLL_CTL_ADD, io->event_fd, &ev) < 0) {
+        io_free(io);
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Stop an I/O thread and release its resources
+ *
+ * @param *io The I/O thread
+ */
+void io_free(io_thread_t *io)
+{
+    io_stop(io);
+
+    if (io->epoll_fd >= 0) {
+        close(io->epoll_fd);
+        io->epoll_fd = -1;
+    }
+    if (io->event_fd >= 0) {
+        close(io->event_fd);
+        io->event_fd = -1;
+    }
+}
+
+
+/**
+ * Start running the I/O of the ports added to an I/O thread
+ *
+ * @param *io The I/O thread
+ * @return True if running
+ */
+bool io_start(io_thread_t *io)
+{
+    if (io->running) {
+        return true;
+    }
+
+    atomic_store(&io->stop, false);
+    io->running = pthread_create(&io->thread, NULL, _io_run, io) == 0;
+    return io->running;
+}
+
+
+/**
+ * Stop an I/O thread (after flushing TX data) and wait for it to exit.
+ * Ports can only be added and removed while the thread is stopped.
+ *
+ * @param *io The I/O thread
+ */
+void io_stop(io_thread_t *io)
+{
+    if (!io->running) {
+        return;
+    }
+
+    atomic_store(&io->stop, true);
+    _io_signal(io->event_fd);
+    pthread_join(io->thread, NULL);
+    io->running = false;
+}
+
+
+/**
+ * Initialize a port with empty rings and no sockets
+ *
+ * @param *port The port to set up
+ * @return True on success, false if its eventfd could not be created
+ */
+bool io_init_port(io_port_t *port)
+{
+    port->listen_fd = -1;
+    port->data_fd = -1;
+    port->stream = false;
+    atomic_init(&port->rx.head, 0);
+    atomic_init(&port->rx.tail, 0);
+    atomic_init(&port->tx.head, 0);
+    atomic_init(&port->tx.tail, 0);
+    atomic_init(&port->connected, false);
+    atomic_init(&port->tx_kicked, false);
+    atomic_init(&port->rx_blocked, false);
+    atomic_init(&port->dev_waiting, false);
+    port->rx_paused = false;
+    port->tx_armed = false;
+
+    port->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return port->wake_fd >= 0;
+}
+
+
+/**
+ * Release the resources of a port (which must not be added to a thread)
+ *
+ * @param *port The port
+ */
+void io_free_port(io_port_t *port)
+{
+    if (port->wake_fd >= 0) {
+        close(port->wake_fd);
+        port->wake_fd = -1;
+    }
+}
+
+
+/**
+ * Add a port to a stopped I/O thread. The thread takes over the
+ * listening socket until the port is removed.
+ *
+ * @param *io The I/O thread
+ * @param *port The port to serve
+ * @param listen_fd A nonblocking listening socket
+ * @return True if added, false if there are already IO_MAX_PORTS
+ *         or the socket could not be watched
+ */
+bool io_add_port(io_thread_t *io, io_port_t *port, int listen_fd)
+{
+    struct epoll_event ev = {0};
+
+    if (io->running || io->port_count >= IO_MAX_PORTS) {
+        return false;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.u32 = (io->port_count << 1) | IO_EV_LISTEN;
+    if (epoll_ctl(io->epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) < 0) {
+        return false;
+    }
+
+    port->listen_fd = listen_fd;
+    port->stream = false;
+    io->ports[io->port_count++] = port;
+    return true;
+}
+
+
+/**
+ * Add a port to a stopped I/O thread which reads and writes a stream
+ * directly, such as a pty master. The port counts as connected until
+ * it is removed. The caller keeps owning the file descriptor.
+ *
+ * @param *io The I/O thread
+ * @param *port The port to serve
+ * @param fd A nonblocking file descriptor open for reading and writing
+ * @return True if added, false if there are already IO_MAX_PORTS
+ *         or the file descriptor could not be watched
+ */
+bool io_add_stream_port(io_thread_t *io, io_port_t *port, int fd)
+{
+    struct epoll_event ev = {0};
+
+    if (io->running || io->port_count >= IO_MAX_PORTS) {
+        return false;
+    }
+
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.u32 = (io->port_count << 1) | IO_EV_DATA;
+    if (epoll_ctl(io->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        return false;
+    }
+
+    port->listen_fd = -1;
+    port->data_fd = fd;
+    port->stream = true;
+    port->rx_paused = false;
+    port->tx_armed = false;
+    atomic_store(&port->connected, true);
+    io->ports[io->port_count++] = port;
+    return true;
+}
+
+
+/**
+ * Remove a port from a stopped I/O thread, disconnecting its client.
+ * The listening socket is left open for the caller to close.
+ *
+ * @param *io The I/O thread
+ * @param *port The port to remove
+ */
+void io_remove_port(io_thread_t *io, io_port_t *port)
+{
+    int index = 0;
+
+    if (io->running) {
+        return;
+    }
+
+    while (index < io->port_count && io->ports[index] != port) {
+        ++index;
+    }
+    if (index == io->port_count) {
+        return;
+    }
+
+    if (port->data_fd >= 0) {
+        _io_close_client(io, port);
+    }
+    if (port->listen_fd >= 0) {
+        epoll_ctl(io->epoll_fd, EPOLL_CTL_DEL, port->listen_fd, NULL);
+        port->listen_fd = -1;
+    }
+    port->stream = false;
+
+    // Keep the ports packed, the moved port's epoll data has to follow it
+    io->ports[index] = io->ports[--io->port_count];
+    if (index < io->port_count) {
+        io_port_t *moved = io->ports[index];
+        struct epoll_event ev = {0};
+
+        ev.events = EPOLLIN;
+        ev.data.u32 = (index << 1) | IO_EV_LISTEN;
+        if (moved->listen_fd >= 0) {
+            epoll_ctl(io->epoll_fd, EPOLL_CTL_MOD, moved->listen_fd, &ev);
+        }
+        if (moved->data_fd >= 0) {
+            _io_update_events(io, index);
+        }
+    }
+}
+
+
+/**
+ * Read from a file straight into a port's RX ring, for a port which is
+ * not served by an I/O thread (device side)
+ *
+ * @param *port The port
+ * @param fd The file to read
+ * @return The number of bytes read (0 at end of file or if the ring
+ *         is full), or -1 on error
+ */
+ssize_t io_port_read(io_port_t *port, int fd)
+{
+    uint8_t *dst;
+    uint32_t room = _io_ring_write_span(&port->rx, &dst);
+
+    if (room == 0) {
+        return 0;
+    }
+
+    ssize_t len = read(fd, dst, room);
+    if (len > 0) {
+        _io_ring_produce(&port->rx, len);
+    }
+    return len;
+}
+
+
+/**
+ * Write everything in a port's TX ring straight to a file, for a port
+ * which is not served by an I/O thread (device side). If the file
+ * fails, the data is dropped as if nobody was connected.
+ *
+ * @param *port The port
+ * @param fd The file to write
+ * @return The number of bytes written, or -1 on error
+ */
+ssize_t io_port_write(io_port_t *port, int fd)
+{
+    ssize_t total = 0;
+    uint8_t *src;
+    uint32_t len;
+
+    while ((len = _io_ring_read_span(&port->tx, &src)) > 0) {
+        ssize_t written = write(fd, src, len);
+
+        if (written > 0) {
+            _io_ring_consume(&port->tx, written);
+            total += written;
+        }
+        else if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        else if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break; // Try again later
+        }
+        else {
+            _io_ring_consume(&port->tx, io_ring_used(&port->tx));
+            return -1;
+        }
+    }
+    return total;
+}
+
+
+/**
+ * Drop everything waiting in both rings of a port which is not
+ * served by an I/O thread
+ *
+ * @param *port The port
+ */
+void io_port_clear(io_port_t *port)
+{
+    atomic_store(&port->rx.tail, atomic_load(&port->rx.head));
+    atomic_store(&port->tx.tail, atomic_load(&port->tx.head));
+}
+
+
+/**
+ * Queue a byte to be sent to a port's client (device side)
+ *
+ * @param *port The port
+ * @param c The byte to send
+ * @return True if queued, false if the TX ring is full
+ */
+bool io_port_putc(io_port_t *port, uint8_t c)
+{
+    uint8_t *dst;
+
+    if (_io_ring_write_span(&port->tx, &dst) == 0) {
+        return false;
+    }
+    *dst = c;
+    _io_ring_produce(&port->tx, 1);
+    return true;
+}
+
+
+/**
+ * Take a byte received from a port's client (device side)
+ *
+ * @param *io The I/O thread serving the port
+ * @param *port The port
+ * @param *c Set to the byte received
+ * @return True if a byte was taken, false if the RX ring is empty
+ */
+bool io_port_getc(io_thread_t *io, io_port_t *port, uint8_t *c)
+{
+    uint8_t *src;
+
+    if (_io_ring_read_span(&port->rx, &src) == 0) {
+        return false;
+    }
+    *c = *src;
+    _io_ring_consume(&port->rx, 1);
+
+    // Reading was paused on a full ring, there is room again
+    if (atomic_load_explicit(&port->rx_blocked, memory_order_relaxed) &&
+        atomic_exchange(&port->rx_blocked, false)) {
+        _io_signal(io->event_fd);
+    }
+    return true;
+}
+
+
+/**
+ * Tell the I/O thread there is TX data to send (device side).
+ * Only makes a syscall if the thread has not been told already.
+ *
+ * @param *io The I/O thread serving the port
+ * @param *port The port
+ */
+void io_port_kick_tx(io_thread_t *io, io_port_t *port)
+{
+    if (!atomic_load_explicit(&port->tx_kicked, memory_order_relaxed) &&
+        !atomic_exchange(&port->tx_kicked, true)) {
+        _io_signal(io->event_fd);
+    }
+}
+
+
+/**
+ * Announce the device side is about to block on port->wake_fd.
+ * The caller has to check its rings again afterwards, anything
+ * the I/O thread does from here on signals wake_fd.
+ *
+ * @param *port The port
+ */
+void io_port_wait_begin(io_port_t *port)
+{
+    _io_drain(port->wake_fd);
+    atomic_store(&port->dev_waiting, true);
+}
+
+
+/**
+ * End (or cancel) a wait started with io_port_wait_begin()
+ *
+ * @param *port The port
+ */
+void io_port_wait_end(io_port_t *port)
+{
+    if (atomic_load_explicit(&port->dev_waiting, memory_order_relaxed)) {
+        atomic_store(&port->dev_waiting, false);
+    }
+}
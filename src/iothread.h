@@ -0,0 +1,84 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+#ifndef _IOTHREAD_H
+#define _IOTHREAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+// Size of the rings between a device and the I/O thread (power of 2)
+#define IO_RING_LEN 4096
+
+// Max number of ports one I/O thread serves
+#define IO_MAX_PORTS 8
+
+// Lock-free single producer, single consumer byte ring
+// head is only written by the producer, tail only by the consumer
+typedef struct io_ring_t {
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    uint8_t buf[IO_RING_LEN];
+} io_ring_t;
+
+// A socket listener and its (single) client, or a stream which is
+// always connected (e.g. a pty master), served by the I/O thread.
+// The device side only touches the rings and the atomic flags.
+typedef struct io_port_t {
+    int listen_fd;
+    int data_fd;              // Owned by the I/O thread unless stream (-1 = no client)
+    bool stream;              // data_fd was given by the owner, there is no listener
+    int wake_fd;              // eventfd, wakes the device side from an idle wait
+    io_ring_t rx;             // Socket -> device
+    io_ring_t tx;             // Device -> socket
+    _Atomic bool connected;
+    _Atomic bool tx_kicked;   // The I/O thread was told about TX data
+    _Atomic bool rx_blocked;  // The RX ring filled up, reading is paused
+    _Atomic bool dev_waiting; // The device side is blocked on wake_fd
+    bool rx_paused;           // I/O thread: EPOLLIN is disabled
+    bool tx_armed;            // I/O thread: EPOLLOUT is enabled
+} io_port_t;
+
+// Thread which runs all socket I/O of the ports added to it
+typedef struct io_thread_t {
+    pthread_t thread;
+    bool running;
+    int epoll_fd;
+    int event_fd;             // eventfd, wakes the I/O thread
+    _Atomic bool stop;
+    unsigned int flush_timeout; // ms to wait for clients to take the last TX data
+    int port_count;
+    io_port_t *ports[IO_MAX_PORTS];
+} io_thread_t;
+
+
+uint32_t io_ring_used(io_ring_t *ring);
+uint32_t io_ring_free(io_ring_t *ring);
+
+bool io_init(io_thread_t *io);
+void io_free(io_thread_t *io);
+bool io_start(io_thread_t *io);
+void io_stop(io_thread_t *io);
+
+bool io_init_port(io_port_t *port);
+void io_free_port(io_port_t *port);
+bool io_add_port(io_thread_t *io, io_port_t *port, int listen_fd);
+bool io_add_stream_port(io_thread_t *io, io_port_t *port, int fd);
+void io_remove_port(io_thread_t *io, io_port_t *port);
+
+ssize_t io_port_read(io_port_t *port, int fd);
+ssize_t io_port_write(io_port_t *port, int fd);
+void io_port_clear(io_port_t *port);
+
+bool io_port_putc(io_port_t *port, uint8_t c);
+bool io_port_getc(io_thread_t *io, io_port_t *port, uint8_t *c);
+void io_port_kick_tx(io_thread_t *io, io_port_t *port);
+void io_port_wait_begin(io_port_t *port);
+void io_port_wait_end(io_port_t *port);
+
+#endif
@@ -0,0 +1,1851 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "65816.h"
+#include "65816-util.h"
+#include "65816-dispatch.h"
+#include "jit.h"
+
+
+#if defined(__x86_64__)
+
+// The translated code tests the interrupt and crash bits of CPU_t.P
+// with a single 16-bit load
+_Static_assert(sizeof(((CPU_t *)0)->P) == 2, "CPU_t.P must be 16 bits wide");
+
+// Room left in the code buffer before a block is translated
+#define JIT_MAX_BLOCK_BYTES (JIT_MAX_BLOCK_INST * 384 + 256)
+
+// Max number of jumps to the exit of one block
+#define JIT_MAX_FIXUPS (JIT_MAX_BLOCK_INST * 8)
+
+// Max number of jumps from the inline code of an instruction to its
+// slow path
+#define JIT_MAX_SLOW_JUMPS 4
+
+// Cycles one instruction takes at most (without MVN and MVP, which
+// are never translated). A block only runs if all of its instructions
+// fit in the cycle budget.
+#define JIT_MAX_INST_CYCLES 16
+
+// Bits of the status register (see CPU_t.P)
+#define JIT_SR_C 0x01
+#define JIT_SR_I 0x04
+#define JIT_SR_D 0x08
+#define JIT_SR_V 0x40
+
+// Displacements of the fields used by the translated code
+#define JIT_CPU(field) ((uint32_t)offsetof(CPU_t, field))
+#define JIT_CTX(field) ((uint32_t)offsetof(jit_t, field))
+#define JIT_MEM(field) ((uint32_t)offsetof(memory_t, field))
+
+// Appends a string of host code bytes
+#define JIT_CODE(e, s) _jit_bytes((e), (s), sizeof(s) - 1)
+
+// Names of the register width modes in the perf map
+// Keep in the order of CPU_Width_Mode_t
+static const char *jit_mode_names[CPU_WIDTH_COUNT] = {
+    "e", "m8x8", "m8x16", "m16x8", "m16x16"
+};
+
+// Base cycles and addressing mode of an opcode
+typedef struct jit_op_info_t {
+    uint8_t cycles;
+    uint8_t mode;              // CPU_Addr_Mode_t
+} jit_op_info_t;
+
+// Taken from the opcode table of the dispatch engines, so the inline
+// code adds the same cycles as the handlers
+#define OP_I(op, fn)
+#define OP_S(op, fn)
+#define OP_A(op, fn, size, cycles, mode) [op] = { cycles, mode },
+#define OP_M(op, fn, size, cycles, mode, addr_fn) [op] = { cycles, mode },
+#define OP_J(op, fn, cycles, mode, addr_fn) [op] = { cycles, mode },
+static const jit_op_info_t jit_op_info[256] = {
+#include "65816-optable.h"
+};
+#undef OP_I
+#undef OP_S
+#undef OP_A
+#undef OP_M
+#undef OP_J
+
+// How an instruction is translated
+typedef enum jit_op_kind_t {
+    JIT_OP_PLAIN, // Continues with the next instruction
+    JIT_OP_CHAIN, // Ends the block, keeps the width mode and I flag
+    JIT_OP_END,   // Ends the block, may change the width mode or I flag
+    JIT_OP_WIDTH, // REP, SEP: continues in the new width mode unless the I flag changes
+    JIT_OP_NONE   // Never translated (left to the interpreter)
+} jit_op_kind_t;
+
+// Operations of the loads, stores and ALU instructions translated
+// inline. The first 8 are in the order of bits 5-7 of the opcodes of
+// the accumulator group (ORA, AND, ... SBC).
+typedef enum jit_alu_t {
+    JIT_ALU_ORA,
+    JIT_ALU_AND,
+    JIT_ALU_EOR,
+    JIT_ALU_ADC,
+    JIT_ALU_ST,
+    JIT_ALU_LD,
+    JIT_ALU_CMP,
+    JIT_ALU_SBC
+} jit_alu_t;
+
+// The slow path of an instruction translated inline: out of line code
+// which calls the handler when the inline code cannot run it (the
+// memory it accesses is not plain RAM, decimal mode, ...)
+typedef struct jit_slow_t {
+    int jump_count;
+    uint8_t *jumps[JIT_MAX_SLOW_JUMPS]; // rel32 jumps from the inline code
+    uint8_t *back;             // Where the inline code of the instruction ends
+    CPU_Op_Handler_t handler;
+    uint16_t pc;               // PC of the instruction
+    uint32_t before;           // Cycles not yet added before the instruction
+    uint32_t after;            // and after it, on the inline path
+} jit_slow_t;
+
+// Host code being emitted for a block
+typedef struct jit_emit_t {
+    uint8_t *p;
+    uint32_t pending;          // Cycles of inline instructions not yet added to cpu->cycles
+    int fixup_count;
+    uint8_t *fixups[JIT_MAX_FIXUPS]; // rel32 jumps to the block's exit
+    int slow_count;
+    jit_slow_t slow[JIT_MAX_BLOCK_INST];
+} jit_emit_t;
+
+// Signature of jit_t.enter
+typedef void (*jit_enter_t)(CPU_t *cpu, memory_t *mem, jit_t *jit, uint8_t *code);
+
+
+/**
+ * Classify an opcode for the translator
+ *
+ * @param op The opcode
+ * @return How the instruction is translated
+ */
+static jit_op_kind_t _jit_op_kind(uint8_t op)
+{
+    switch (op) {
+    case 0x10: case 0x30: case 0x50: case 0x70: // Bcc
+    case 0x90: case 0xb0: case 0xd0: case 0xf0:
+    case 0x80: case 0x82:                       // BRA, BRL
+    case 0x4c: case 0x5c: case 0x6c: case 0x7c: // JMP, JML
+    case 0xdc:
+    case 0x20: case 0x22: case 0xfc:            // JSR, JSL
+    case 0x60: case 0x6b:                       // RTS, RTL
+        return JIT_OP_CHAIN;
+    case 0x00: case 0x02:                       // BRK, COP
+    case 0x40:                                  // RTI
+    case 0x58: case 0x78:                       // CLI, SEI
+    case 0x28:                                  // PLP
+    case 0xfb:                                  // XCE
+        return JIT_OP_END;
+    case 0xc2: case 0xe2:                       // REP, SEP
+        return JIT_OP_WIDTH;
+    case 0x44: case 0x54:                       // MVP, MVN (run in steps)
+    case 0xcb: case 0xdb:                       // WAI, STP
+        return JIT_OP_NONE;
+    default:
+        return JIT_OP_PLAIN;
+    }
+}
+
+/**
+ * Get the width mode the CPU is in after a REP or SEP
+ *
+ * @param mode The width mode before (CPU_Width_Mode_t)
+ * @param op The opcode (REP or SEP)
+ * @param val The operand (the bits to clear or set)
+ * @return The width mode after
+ */
+static uint8_t _jit_width_after(uint8_t mode, uint8_t op, uint8_t val)
+{
+    bool m8 = mode == CPU_WIDTH_M8X8 || mode == CPU_WIDTH_M8X16;
+    bool x8 = mode == CPU_WIDTH_M8X8 || mode == CPU_WIDTH_M16X8;
+
+    if (mode == CPU_WIDTH_E) {
+        return mode; // M and X stay set
+    }
+    if (val & 0x20) {
+        m8 = op == 0xe2;
+    }
+    if (val & 0x10) {
+        x8 = op == 0xe2;
+    }
+    if (m8) {
+        return x8 ? CPU_WIDTH_M8X8 : CPU_WIDTH_M8X16;
+    }
+    return x8 ? CPU_WIDTH_M16X8 : CPU_WIDTH_M16X16;
+}
+
+static void _jit_bytes(jit_emit_t *e, const char *bytes, size_t n)
+{
+    memcpy(e->p, bytes, n);
+    e->p += n;
+}
+
+static void _jit_u8(jit_emit_t *e, uint8_t v)
+{
+    *e->p++ = v;
+}
+
+static void _jit_u16(jit_emit_t *e, uint16_t v)
+{
+    memcpy(e->p, &v, sizeof(v));
+    e->p += sizeof(v);
+}
+
+static void _jit_u32(jit_emit_t *e, uint32_t v)
+{
+    memcpy(e->p, &v, sizeof(v));
+    e->p += sizeof(v);
+}
+
+static void _jit_u64(jit_emit_t *e, uint64_t v)
+{
+    memcpy(e->p, &v, sizeof(v));
+    e->p += sizeof(v);
+}
+
+/**
+ * Set a rel32 operand to jump to a target
+ *
+ * @param *rel The operand (the instruction ends right after it)
+ * @param *target The address to jump to
+ */
+static void _jit_patch_rel32(uint8_t *rel, uint8_t *target)
+{
+    int32_t offs = (int32_t)(target - (rel + 4));
+    memcpy(rel, &offs, sizeof(offs));
+}
+
+/**
+ * Emit a conditional jump to the exit of the block
+ *
+ * @param *e The code being emitted
+ * @param cc The second opcode byte of the jcc rel32
+ */
+static void _jit_exit_if(jit_emit_t *e, uint8_t cc)
+{
+    _jit_u8(e, 0x0f);
+    _jit_u8(e, cc);
+    e->fixups[e->fixup_count++] = e->p;
+    _jit_u32(e, 0);
+}
+
+/**
+ * Emit an add to cpu->cycles
+ *
+ * @param *e The code being emitted
+ * @param n The cycles to add (nothing is emitted for 0)
+ */
+static void _jit_add_cycles(jit_emit_t *e, uint32_t n)
+{
+    if (n) {
+        JIT_CODE(e, "\x48\x81\x83");         // add qword [rbx + cycles], n
+        _jit_u32(e, JIT_CPU(cycles));
+        _jit_u32(e, n);
+    }
+}
+
+/**
+ * Emit the add of the cycles of the inline instructions so far
+ *
+ * @param *e The code being emitted
+ */
+static void _jit_flush_cycles(jit_emit_t *e)
+{
+    _jit_add_cycles(e, e->pending);
+    e->pending = 0;
+}
+
+/**
+ * Emit a cycle which is only taken unless a condition holds (a page
+ * crossed by an index, DL != 0, ...)
+ *
+ * @param *e The code being emitted
+ * @param cc The opcode of the jcc rel8 which skips the cycle
+ */
+static void _jit_cycle_unless(jit_emit_t *e, uint8_t cc)
+{
+    _jit_u8(e, cc);                          // jcc +8
+    _jit_u8(e, 8);
+    JIT_CODE(e, "\x48\x83\x83");             // add qword [rbx + cycles], 1
+    _jit_u32(e, JIT_CPU(cycles));
+    _jit_u8(e, 1);
+}
+
+/**
+ * Emit a store of the PC
+ *
+ * @param *e The code being emitted
+ * @param pc The PC
+ */
+static void _jit_store_pc(jit_emit_t *e, uint16_t pc)
+{
+    JIT_CODE(e, "\x66\xc7\x83");             // mov word [rbx + PC], pc
+    _jit_u32(e, JIT_CPU(PC));
+    _jit_u16(e, pc);
+}
+
+/**
+ * Start the inline code of an instruction which may need its slow
+ * path (see jit_slow_t). The slow path is only emitted if a jump to it
+ * is (_jit_slow_if()).
+ *
+ * @param *e The code being emitted
+ * @param op The opcode
+ * @param mode The register width mode (CPU_Width_Mode_t)
+ * @param pc The PC of the instruction
+ */
+static void _jit_slow_begin(jit_emit_t *e, uint8_t op, uint8_t mode, uint16_t pc)
+{
+    jit_slow_t *s = &e->slow[e->slow_count];
+
+    s->jump_count = 0;
+    s->handler = cpu_width_dispatch_table[mode][op];
+    s->pc = pc;
+    s->before = e->pending;
+}
+
+/**
+ * Emit a conditional jump to the slow path of the instruction. It must
+ * come before the inline code changes any state.
+ *
+ * @param *e The code being emitted
+ * @param cc The second opcode byte of the jcc rel32
+ */
+static void _jit_slow_if(jit_emit_t *e, uint8_t cc)
+{
+    jit_slow_t *s = &e->slow[e->slow_count];
+
+    _jit_u8(e, 0x0f);
+    _jit_u8(e, cc);
+    s->jumps[s->jump_count++] = e->p;
+    _jit_u32(e, 0);
+}
+
+/**
+ * End the inline code of an instruction started by _jit_slow_begin()
+ *
+ * @param *e The code being emitted
+ */
+static void _jit_slow_end(jit_emit_t *e)
+{
+    jit_slow_t *s = &e->slow[e->slow_count];
+
+    s->back = e->p;
+    s->after = e->pending;
+    if (s->jump_count) {
+        ++e->slow_count;
+    }
+}
+
+/**
+ * Emit the code shared by all blocks: a function which saves the host
+ * registers, loads the CPU, memory, attention bits and instruction
+ * budget into the registers the blocks expect and jumps into a block
+ * (jit_t.enter), and the matching return path (jit_t.exit).
+ *
+ * Register use of the translated code:
+ *  rbx = CPU_t *, r12 = memory_t *, r13 = jit_t *,
+ *  r14d = jit_t.attn, r15 = instructions left of jit_t.budget,
+ *  rbp = memory_t.rd
+ *
+ * @param *jit The translator
+ * @param *e The code being emitted
+ */
+static void _jit_emit_enter(jit_t *jit, jit_emit_t *e)
+{
+    jit->enter = e->p;
+    JIT_CODE(e, "\x55\x53\x41\x54\x41\x55\x41\x56\x41\x57"); // push rbp, rbx, r12-r15
+    JIT_CODE(e, "\x48\x83\xec\x08");                         // sub rsp, 8 (align)
+    JIT_CODE(e, "\x48\x89\xfb");                             // mov rbx, rdi
+    JIT_CODE(e, "\x49\x89\xf4");                             // mov r12, rsi
+    JIT_CODE(e, "\x49\x89\xd5");                             // mov r13, rdx
+    JIT_CODE(e, "\x45\x8b\xb5");                             // mov r14d, [r13 + attn]
+    _jit_u32(e, JIT_CTX(attn));
+    JIT_CODE(e, "\x4d\x8b\xbd");                             // mov r15, [r13 + budget]
+    _jit_u32(e, JIT_CTX(budget));
+    JIT_CODE(e, "\x49\x8b\xac\x24");                         // mov rbp, [r12 + rd]
+    _jit_u32(e, JIT_MEM(rd));
+    JIT_CODE(e, "\xff\xe1");                                 // jmp rcx
+
+    jit->exit = e->p;
+    JIT_CODE(e, "\x4d\x89\xbd");                             // mov [r13 + budget], r15
+    _jit_u32(e, JIT_CTX(budget));
+    JIT_CODE(e, "\x48\x83\xc4\x08");                         // add rsp, 8
+    JIT_CODE(e, "\x41\x5f\x41\x5e\x41\x5d\x41\x5c\x5b\x5d"); // pop r15-r12, rbx, rbp
+    JIT_CODE(e, "\xc3");                                     // ret
+}
+
+/**
+ * Emit the checks which run after an instruction was run by its
+ * handler. The block is left when the instruction raised an interrupt
+ * or crashed the CPU, overwrote translated code, or did not continue
+ * where the translator expected.
+ *
+ * @param *e The code being emitted
+ * @param next_pc The PC the next instruction of the block is at
+ *                (-1 = the instruction ends the block)
+ */
+static void _jit_emit_checks(jit_emit_t *e, int32_t next_pc)
+{
+    JIT_CODE(e, "\x0f\xb7\x83");             // movzx eax, word [rbx + P]
+    _jit_u32(e, JIT_CPU(P));
+    JIT_CODE(e, "\x44\x85\xf0");             // test eax, r14d
+    _jit_exit_if(e, 0x85);                   // jnz exit
+    JIT_CODE(e, "\x41\x80\xbd");             // cmp byte [r13 + flush], 0
+    _jit_u32(e, JIT_CTX(flush));
+    _jit_u8(e, 0x00);
+    _jit_exit_if(e, 0x85);                   // jne exit
+
+    if (next_pc >= 0) {
+        JIT_CODE(e, "\x66\x81\xbb");         // cmp word [rbx + PC], next_pc
+        _jit_u32(e, JIT_CPU(PC));
+        _jit_u16(e, next_pc);
+        _jit_exit_if(e, 0x85);               // jne exit
+    }
+}
+
+/**
+ * Emit a call of an instruction's handler
+ *
+ * @param *e The code being emitted
+ * @param handler The handler
+ */
+static void _jit_emit_call(jit_emit_t *e, CPU_Op_Handler_t handler)
+{
+    JIT_CODE(e, "\x48\x89\xdf");             // mov rdi, rbx
+    JIT_CODE(e, "\x4c\x89\xe6");             // mov rsi, r12
+    JIT_CODE(e, "\x48\xb8");                 // mov rax, handler
+    _jit_u64(e, (uint64_t)(uintptr_t)handler);
+    JIT_CODE(e, "\xff\xd0");                 // call rax
+}
+
+/**
+ * Check if the operand of an addressing mode is translated inline
+ *
+ * @param addr_mode The addressing mode (CPU_Addr_Mode_t)
+ * @param mode The register width mode (CPU_Width_Mode_t)
+ * @return True for immediates and the direct page, absolute and long
+ *         modes without indirection
+ */
+static bool _jit_addr_inline(uint8_t addr_mode, uint8_t mode)
+{
+    switch (addr_mode) {
+    case CPU_ADDR_DPX:
+        return mode != CPU_WIDTH_E; // Wraps within the page when DL = 0
+    case CPU_ADDR_IMMD:
+    case CPU_ADDR_DP:
+    case CPU_ADDR_ABS:
+    case CPU_ADDR_ABSX:
+    case CPU_ADDR_ABSY:
+    case CPU_ADDR_ABSL:
+    case CPU_ADDR_ABSLX:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * Emit the effective address of a data access into esi (as the
+ * addressing mode getters of 65816-util.c compute it)
+ *
+ * @param *e The code being emitted
+ * @param addr_mode The addressing mode (see _jit_addr_inline(), not
+ *                  the immediate mode)
+ * @param operand The operand of the instruction
+ */
+static void _jit_emit_addr(jit_emit_t *e, uint8_t addr_mode, uint32_t operand)
+{
+    uint32_t index = addr_mode == CPU_ADDR_ABSY ? JIT_CPU(Y) : JIT_CPU(X);
+
+    switch (addr_mode) {
+    case CPU_ADDR_DP:
+    case CPU_ADDR_DPX:
+        JIT_CODE(e, "\x0f\xb7\xb3");         // movzx esi, word [rbx + D]
+        _jit_u32(e, JIT_CPU(D));
+        if (addr_mode == CPU_ADDR_DPX) {
+            JIT_CODE(e, "\x0f\xb7\x83");     // movzx eax, word [rbx + X]
+            _jit_u32(e, JIT_CPU(X));
+            JIT_CODE(e, "\x01\xc6");         // add esi, eax
+        }
+        JIT_CODE(e, "\x81\xc6");             // add esi, operand
+        _jit_u32(e, operand & 0xff);
+        JIT_CODE(e, "\x81\xe6");             // and esi, 0xffff (bank 0)
+        _jit_u32(e, 0xffff);
+        return;
+    case CPU_ADDR_ABS:
+    case CPU_ADDR_ABSX:
+    case CPU_ADDR_ABSY:
+        JIT_CODE(e, "\x0f\xb6\xb3");         // movzx esi, byte [rbx + DBR]
+        _jit_u32(e, JIT_CPU(DBR));
+        JIT_CODE(e, "\xc1\xe6\x10");         // shl esi, 16
+        JIT_CODE(e, "\x81\xce");             // or esi, operand
+        _jit_u32(e, operand & 0xffff);
+        break;
+    case CPU_ADDR_ABSL:
+    case CPU_ADDR_ABSLX:
+        _jit_u8(e, 0xbe);                    // mov esi, operand
+        _jit_u32(e, operand & 0xffffff);
+        break;
+    }
+
+    if (addr_mode != CPU_ADDR_ABS && addr_mode != CPU_ADDR_ABSL) {
+        JIT_CODE(e, "\x0f\xb7\x83");         // movzx eax, word [rbx + index]
+        _jit_u32(e, index);
+        JIT_CODE(e, "\x01\xc6");             // add esi, eax
+        JIT_CODE(e, "\x81\xe6");             // and esi, 0xffffff
+        _jit_u32(e, 0xffffff);
+    }
+}
+
+/**
+ * Emit the offset of the address in esi within its page into ecx, and
+ * for words, the jump to the slow path if the word crosses the page
+ *
+ * @param *e The code being emitted
+ * @param word True for a 16-bit access
+ */
+static void _jit_emit_page_offs(jit_emit_t *e, bool word)
+{
+    JIT_CODE(e, "\x89\xf1");                 // mov ecx, esi
+    JIT_CODE(e, "\x81\xe1");                 // and ecx, MEM_PAGE_MASK
+    _jit_u32(e, MEM_PAGE_MASK);
+    if (word) {
+        JIT_CODE(e, "\x81\xf9");             // cmp ecx, MEM_PAGE_MASK
+        _jit_u32(e, MEM_PAGE_MASK);
+        _jit_slow_if(e, 0x84);               // je slow
+    }
+}
+
+/**
+ * Emit a read of plain RAM at the address in esi into eax (zero
+ * extended). Other memory is left to the slow path.
+ *
+ * @param *e The code being emitted
+ * @param word True for a 16-bit read
+ */
+static void _jit_emit_read(jit_emit_t *e, bool word)
+{
+    _Static_assert(MEM_PAGE_BITS == 12, "The translated code assumes 4 KiB pages");
+
+    JIT_CODE(e, "\x89\xf1");                 // mov ecx, esi
+    JIT_CODE(e, "\xc1\xe9\x0c");             // shr ecx, MEM_PAGE_BITS
+    JIT_CODE(e, "\x48\x8b\x44\xcd\x00");     // mov rax, [rbp + rcx * 8] (mem->rd)
+    JIT_CODE(e, "\x48\x85\xc0");             // test rax, rax
+    _jit_slow_if(e, 0x84);                   // jz slow (I/O page)
+    _jit_emit_page_offs(e, word);
+    if (word) {
+        JIT_CODE(e, "\x0f\xb7\x04\x08");     // movzx eax, word [rax + rcx]
+    }
+    else {
+        JIT_CODE(e, "\x0f\xb6\x04\x08");     // movzx eax, byte [rax + rcx]
+    }
+}
+
+/**
+ * Emit a write of eax to plain RAM at the address in esi. Other memory
+ * (I/O, watched or shared pages) is left to the slow path.
+ *
+ * @param *e The code being emitted
+ * @param word True for a 16-bit write
+ */
+static void _jit_emit_write(jit_emit_t *e, bool word)
+{
+    JIT_CODE(e, "\x89\xf1");                 // mov ecx, esi
+    JIT_CODE(e, "\xc1\xe9\x0c");             // shr ecx, MEM_PAGE_BITS
+    JIT_CODE(e, "\x49\x8b\x94\x24");         // mov rdx, [r12 + wr]
+    _jit_u32(e, JIT_MEM(wr));
+    JIT_CODE(e, "\x48\x8b\x14\xca");         // mov rdx, [rdx + rcx * 8]
+    JIT_CODE(e, "\x48\x85\xd2");             // test rdx, rdx
+    _jit_slow_if(e, 0x84);                   // jz slow
+    _jit_emit_page_offs(e, word);
+    if (word) {
+        JIT_CODE(e, "\x66\x89\x04\x0a");     // mov [rdx + rcx], ax
+    }
+    else {
+        JIT_CODE(e, "\x88\x04\x0a");         // mov [rdx + rcx], al
+    }
+}
+
+/**
+ * Emit a store of the result in a register to cpu->nz
+ *
+ * @param *e The code being emitted
+ * @param reg The ModRM reg field of the host register (0 = eax, 1 =
+ *            ecx, 2 = edx), holding the result zero extended
+ * @param word True for a 16-bit result
+ */
+static void _jit_emit_nz(jit_emit_t *e, uint8_t reg, bool word)
+{
+    if (!word) {
+        _jit_u8(e, 0xc1);                    // shl reg, 8 (see CPU_NZ8())
+        _jit_u8(e, 0xe0 | reg);
+        _jit_u8(e, 8);
+    }
+    _jit_u8(e, 0x89);                        // mov [rbx + nz], reg
+    _jit_u8(e, 0x83 | reg << 3);
+    _jit_u32(e, JIT_CPU(nz));
+}
+
+/**
+ * Emit a load of a CPU register into ecx (zero extended)
+ *
+ * @param *e The code being emitted
+ * @param reg The displacement of the register in CPU_t
+ * @param word True for all 16 bits, false for the low byte
+ */
+static void _jit_emit_load_ecx(jit_emit_t *e, uint32_t reg, bool word)
+{
+    if (word) {
+        JIT_CODE(e, "\x0f\xb7\x8b");         // movzx ecx, word [rbx + reg]
+    }
+    else {
+        JIT_CODE(e, "\x0f\xb6\x8b");         // movzx ecx, byte [rbx + reg]
+    }
+    _jit_u32(e, reg);
+}
+
+/**
+ * Emit a store of the P bits C and V from the flags of a compare of
+ * eax with limits (C = eax >= c_limit, V = eax >= v_limit)
+ *
+ * @param *e The code being emitted
+ * @param c_limit The first value C is set for
+ * @param v_limit The first value V is set for
+ */
+static void _jit_emit_adc_flags(jit_emit_t *e, uint32_t c_limit, uint32_t v_limit)
+{
+    JIT_CODE(e, "\x0f\xb6\x93");             // movzx edx, byte [rbx + P]
+    _jit_u32(e, JIT_CPU(P));
+    JIT_CODE(e, "\x83\xe2");                 // and edx, ~(C | V)
+    _jit_u8(e, (uint8_t)~(JIT_SR_C | JIT_SR_V));
+    _jit_u8(e, 0x3d);                        // cmp eax, c_limit
+    _jit_u32(e, c_limit);
+    JIT_CODE(e, "\x0f\x93\xc1");             // setae cl
+    JIT_CODE(e, "\x08\xca");                 // or dl, cl
+    _jit_u8(e, 0x3d);                        // cmp eax, v_limit
+    _jit_u32(e, v_limit);
+    JIT_CODE(e, "\x0f\x93\xc1");             // setae cl
+    JIT_CODE(e, "\xc0\xe1\x06");             // shl cl, 6
+    JIT_CODE(e, "\x08\xca");                 // or dl, cl
+    JIT_CODE(e, "\x88\x93");                 // mov [rbx + P], dl
+    _jit_u32(e, JIT_CPU(P));
+}
+
+/**
+ * Emit the operation of a load, store or ALU instruction on the value
+ * in eax (zero extended), with the results the handlers give
+ *
+ * @param *e The code being emitted
+ * @param alu The operation (JIT_ALU_ST is emitted by the caller)
+ * @param reg The displacement of the register in CPU_t
+ * @param word True for a 16-bit register
+ */
+static void _jit_emit_alu(jit_emit_t *e, jit_alu_t alu, uint32_t reg, bool word)
+{
+    switch (alu) {
+    case JIT_ALU_LD:
+        // An 8-bit load of X or Y clears the high byte
+        if (word || reg != JIT_CPU(C)) {
+            JIT_CODE(e, "\x66\x89\x83");     // mov [rbx + reg], ax
+        }
+        else {
+            JIT_CODE(e, "\x88\x83");         // mov [rbx + reg], al
+        }
+        _jit_u32(e, reg);
+        _jit_emit_nz(e, 0, word);
+        break;
+    case JIT_ALU_ORA:
+    case JIT_ALU_AND:
+    case JIT_ALU_EOR:
+        _jit_emit_load_ecx(e, reg, word);
+        _jit_u8(e, alu == JIT_ALU_ORA ? 0x09 : alu == JIT_ALU_AND ? 0x21 : 0x31);
+        _jit_u8(e, 0xc8);                    // or/and/xor eax, ecx
+        if (word) {
+            JIT_CODE(e, "\x66\x89\x83");     // mov [rbx + reg], ax
+        }
+        else {
+            JIT_CODE(e, "\x88\x83");         // mov [rbx + reg], al
+        }
+        _jit_u32(e, reg);
+        _jit_emit_nz(e, 0, word);
+        break;
+    case JIT_ALU_CMP:
+        // C = !(reg < result), as the handlers compute it
+        _jit_emit_load_ecx(e, reg, word);
+        JIT_CODE(e, "\x89\xca");             // mov edx, ecx
+        JIT_CODE(e, "\x29\xc2");             // sub edx, eax
+        if (word) {
+            JIT_CODE(e, "\x0f\xb7\xd2");     // movzx edx, dx
+        }
+        else {
+            JIT_CODE(e, "\x0f\xb6\xd2");     // movzx edx, dl
+        }
+        JIT_CODE(e, "\x39\xd1");             // cmp ecx, edx
+        JIT_CODE(e, "\x0f\x93\xc0");         // setae al
+        _jit_emit_nz(e, 2, word);
+        JIT_CODE(e, "\x80\xa3");             // and byte [rbx + P], ~C
+        _jit_u32(e, JIT_CPU(P));
+        _jit_u8(e, (uint8_t)~JIT_SR_C);
+        JIT_CODE(e, "\x08\x83");             // or [rbx + P], al
+        _jit_u32(e, JIT_CPU(P));
+        break;
+    case JIT_ALU_ADC:
+        // Binary mode only (the caller checks D)
+        _jit_emit_load_ecx(e, reg, word);
+        JIT_CODE(e, "\x01\xc8");             // add eax, ecx
+        _jit_emit_load_ecx(e, JIT_CPU(P), false);
+        JIT_CODE(e, "\x83\xe1\x01");         // and ecx, C
+        JIT_CODE(e, "\x01\xc8");             // add eax, ecx
+        if (word) {
+            JIT_CODE(e, "\x66\x89\x83");     // mov [rbx + reg], ax
+            _jit_u32(e, reg);
+            JIT_CODE(e, "\x0f\xb7\xd0");     // movzx edx, ax
+        }
+        else {
+            JIT_CODE(e, "\x88\x83");         // mov [rbx + reg], al
+            _jit_u32(e, reg);
+            JIT_CODE(e, "\x0f\xb6\xd0");     // movzx edx, al
+        }
+        _jit_emit_nz(e, 2, word);
+        _jit_emit_adc_flags(e, word ? 0x10000 : 0x100, word ? 0x8000 : 0x80);
+        break;
+    case JIT_ALU_SBC:
+        // Binary mode only (the caller checks D)
+        _jit_emit_load_ecx(e, reg, word);
+        JIT_CODE(e, "\x29\xc1");             // sub ecx, eax
+        JIT_CODE(e, "\x0f\xb6\x83");         // movzx eax, byte [rbx + P]
+        _jit_u32(e, JIT_CPU(P));
+        JIT_CODE(e, "\x83\xe0\x01");         // and eax, C
+        JIT_CODE(e, "\x8d\x4c\x01\xff");     // lea ecx, [rcx + rax - 1] (signed result)
+        if (word) {
+            JIT_CODE(e, "\x66\x89\x8b");     // mov [rbx + reg], cx
+            _jit_u32(e, reg);
+            JIT_CODE(e, "\x0f\xb7\xd1");     // movzx edx, cx
+        }
+        else {
+            JIT_CODE(e, "\x88\x8b");         // mov [rbx + reg], cl
+            _jit_u32(e, reg);
+            JIT_CODE(e, "\x0f\xb6\xd1");     // movzx edx, cl
+        }
+        _jit_emit_nz(e, 2, word);
+        JIT_CODE(e, "\x0f\xb6\x93");         // movzx edx, byte [rbx + P]
+        _jit_u32(e, JIT_CPU(P));
+        JIT_CODE(e, "\x83\xe2");             // and edx, ~(C | V)
+        _jit_u8(e, (uint8_t)~(JIT_SR_C | JIT_SR_V));
+        JIT_CODE(e, "\x85\xc9");             // test ecx, ecx
+        JIT_CODE(e, "\x0f\x98\xc0");         // sets al (C = borrow)
+        JIT_CODE(e, "\x08\xc2");             // or dl, al
+        JIT_CODE(e, "\x8d\x81");             // lea eax, [rcx + half]
+        _jit_u32(e, word ? 0x8000 : 0x80);
+        _jit_u8(e, 0x3d);                    // cmp eax, max
+        _jit_u32(e, word ? 0xffff : 0xff);
+        JIT_CODE(e, "\x0f\x97\xc0");         // seta al (V = signed overflow)
+        JIT_CODE(e, "\xc0\xe0\x06");         // shl al, 6
+        JIT_CODE(e, "\x08\xc2");             // or dl, al
+        JIT_CODE(e, "\x88\x93");             // mov [rbx + P], dl
+        _jit_u32(e, JIT_CPU(P));
+        break;
+    case JIT_ALU_ST:
+        break;
+    }
+}
+
+/**
+ * Emit a load, store or ALU instruction with one of the simple
+ * addressing modes. Accesses to memory other than plain RAM and
+ * decimal mode ADC and SBC go to the slow path.
+ *
+ * @param *e The code being emitted
+ * @param op The opcode
+ * @param mode The register width mode (CPU_Width_Mode_t)
+ * @param pc The PC of the instruction
+ * @param operand The operand of the instruction
+ * @return True if emitted, false if the handler has to be called
+ */
+static bool _jit_emit_data(jit_emit_t *e, uint8_t op, uint8_t mode, uint16_t pc, uint32_t operand)
+{
+    const jit_op_info_t *info = &jit_op_info[op];
+    bool m16 = mode == CPU_WIDTH_M16X8 || mode == CPU_WIDTH_M16X16;
+    bool x16 = mode == CPU_WIDTH_M8X16 || mode == CPU_WIDTH_M16X16;
+    bool dp = info->mode == CPU_ADDR_DP || info->mode == CPU_ADDR_DPX;
+    bool index = info->mode == CPU_ADDR_ABSX || info->mode == CPU_ADDR_ABSY;
+    bool zero = false;
+    uint32_t extra;
+    uint32_t reg;
+    jit_alu_t alu;
+    bool word;
+
+    switch (op & 0x1f) {
+    case 0x05: case 0x09: case 0x0d: case 0x0f: // Accumulator group
+    case 0x15: case 0x19: case 0x1d: case 0x1f:
+        if (op == 0x89) {
+            return false; // BIT #
+        }
+        alu = (jit_alu_t)(op >> 5);
+        reg = JIT_CPU(C);
+        word = m16;
+        if (word && info->mode == CPU_ADDR_IMMD &&
+            (alu == JIT_ALU_ORA || alu == JIT_ALU_AND || alu == JIT_ALU_EOR)) {
+            return false; // The handlers step over 2 bytes only
+        }
+        extra = 1;
+        if ((alu == JIT_ALU_ORA || alu == JIT_ALU_EOR) && !dp && info->mode != CPU_ADDR_IMMD) {
+            extra = 2; // Added twice by the handlers
+        }
+        break;
+    default:
+        switch (op) {
+        case 0xa2: case 0xa6: case 0xae: case 0xbe: // LDX
+            alu = JIT_ALU_LD;
+            reg = JIT_CPU(X);
+            break;
+        case 0xa0: case 0xa4: case 0xb4: case 0xac: case 0xbc: // LDY
+            alu = JIT_ALU_LD;
+            reg = JIT_CPU(Y);
+            break;
+        case 0xe0: case 0xe4: case 0xec: // CPX
+            alu = JIT_ALU_CMP;
+            reg = JIT_CPU(X);
+            break;
+        case 0xc0: case 0xc4: case 0xcc: // CPY
+            alu = JIT_ALU_CMP;
+            reg = JIT_CPU(Y);
+            break;
+        case 0x86: case 0x8e: // STX
+            alu = JIT_ALU_ST;
+            reg = JIT_CPU(X);
+            break;
+        case 0x84: case 0x94: case 0x8c: // STY
+            alu = JIT_ALU_ST;
+            reg = JIT_CPU(Y);
+            break;
+        case 0x64: case 0x74: case 0x9c: case 0x9e: // STZ
+            if (mode == CPU_WIDTH_E) {
+                return false; // The width comes from P.M
+            }
+            alu = JIT_ALU_ST;
+            reg = JIT_CPU(C);
+            zero = true;
+            break;
+        default:
+            return false;
+        }
+        word = zero ? m16 : x16;
+        extra = 1;
+        if (zero) {
+            index = false; // No cycle for a page crossed
+        }
+        break;
+    }
+    if (!_jit_addr_inline(info->mode, mode)) {
+        return false;
+    }
+
+    _jit_slow_begin(e, op, mode, pc);
+
+    if (alu == JIT_ALU_ADC || alu == JIT_ALU_SBC) {
+        JIT_CODE(e, "\xf6\x83");             // test byte [rbx + P], D
+        _jit_u32(e, JIT_CPU(P));
+        _jit_u8(e, JIT_SR_D);
+        _jit_slow_if(e, 0x85);               // jnz slow (decimal mode)
+    }
+
+    if (info->mode == CPU_ADDR_IMMD) {
+        _jit_u8(e, 0xb8);                    // mov eax, operand
+        _jit_u32(e, operand & (word ? 0xffff : 0xff));
+    }
+    else if (alu == JIT_ALU_ST) {
+        _jit_emit_addr(e, info->mode, operand);
+        if (zero) {
+            JIT_CODE(e, "\x31\xc0");         // xor eax, eax
+        }
+        else if (word) {
+            JIT_CODE(e, "\x0f\xb7\x83");     // movzx eax, word [rbx + reg]
+            _jit_u32(e, reg);
+        }
+        else {
+            JIT_CODE(e, "\x0f\xb6\x83");     // movzx eax, byte [rbx + reg]
+            _jit_u32(e, reg);
+        }
+        _jit_emit_write(e, word);
+    }
+    else {
+        _jit_emit_addr(e, info->mode, operand);
+        _jit_emit_read(e, word);
+    }
+
+    _jit_emit_alu(e, alu, reg, word);
+
+    if (dp) {
+        JIT_CODE(e, "\x80\xbb");             // cmp byte [rbx + D], 0 (DL)
+        _jit_u32(e, JIT_CPU(D));
+        _jit_u8(e, 0);
+        _jit_cycle_unless(e, 0x74);          // je: no cycle
+    }
+    if (index) {
+        JIT_CODE(e, "\x89\xf1");             // mov ecx, esi
+        JIT_CODE(e, "\x81\xf1");             // xor ecx, operand
+        _jit_u32(e, operand);
+        JIT_CODE(e, "\xf7\xc1");             // test ecx, 0xff00
+        _jit_u32(e, 0xff00);
+        _jit_cycle_unless(e, 0x74);          // jz: same page, no cycle
+    }
+
+    e->pending += info->cycles + (word ? extra : 0);
+    _jit_slow_end(e);
+    return true;
+}
+
+/**
+ * Emit a push or pull of a register, or a JSR or RTS, in native mode
+ * (the stack is not confined to page 1). Stack memory which is not
+ * plain RAM goes to the slow path.
+ *
+ * @param *e The code being emitted
+ * @param op The opcode
+ * @param mode The register width mode (CPU_Width_Mode_t)
+ * @param pc The PC of the instruction
+ * @param operand The operand of the instruction
+ * @return True if emitted, false if the handler has to be called
+ */
+static bool _jit_emit_stack(jit_emit_t *e, uint8_t op, uint8_t mode, uint16_t pc, uint32_t operand)
+{
+    bool m16 = mode == CPU_WIDTH_M16X8 || mode == CPU_WIDTH_M16X16;
+    bool x16 = mode == CPU_WIDTH_M8X16 || mode == CPU_WIDTH_M16X16;
+    bool push = false;
+    uint32_t reg = 0;
+    bool word = false;
+
+    switch (op) {
+    case 0x48: push = true; /* Fallthrough! */ // PHA
+    case 0x68: reg = JIT_CPU(C); word = m16; break; // PLA
+    case 0xda: push = true; /* Fallthrough! */ // PHX
+    case 0xfa: reg = JIT_CPU(X); word = x16; break; // PLX
+    case 0x5a: push = true; /* Fallthrough! */ // PHY
+    case 0x7a: reg = JIT_CPU(Y); word = x16; break; // PLY
+    case 0x20: push = true; word = true; break; // JSR abs
+    case 0x60: word = true; break; // RTS
+    default:
+        return false;
+    }
+    if (mode == CPU_WIDTH_E) {
+        return false;
+    }
+
+    _jit_slow_begin(e, op, mode, pc);
+
+    JIT_CODE(e, "\x0f\xb7\xb3");             // movzx esi, word [rbx + SP]
+    _jit_u32(e, JIT_CPU(SP));
+    if (push) {
+        if (op == 0x20) {
+            _jit_u8(e, 0xb8);                // mov eax, return address - 1
+            _jit_u32(e, (pc + 2) & 0xffff);
+        }
+        else if (word) {
+            JIT_CODE(e, "\x0f\xb7\x83");     // movzx eax, word [rbx + reg]
+            _jit_u32(e, reg);
+        }
+        else {
+            JIT_CODE(e, "\x0f\xb6\x83");     // movzx eax, byte [rbx + reg]
+            _jit_u32(e, reg);
+        }
+        if (word) {
+            JIT_CODE(e, "\x83\xee\x01");     // sub esi, 1 (the word is below SP)
+            JIT_CODE(e, "\x81\xe6");         // and esi, 0xffff
+            _jit_u32(e, 0xffff);
+        }
+        _jit_emit_write(e, word);
+        JIT_CODE(e, "\x66\x83\xab");         // sub word [rbx + SP], size
+        _jit_u32(e, JIT_CPU(SP));
+        _jit_u8(e, word ? 2 : 1);
+    }
+    else {
+        JIT_CODE(e, "\x83\xc6\x01");         // add esi, 1
+        JIT_CODE(e, "\x81\xe6");             // and esi, 0xffff
+        _jit_u32(e, 0xffff);
+        _jit_emit_read(e, word);
+        JIT_CODE(e, "\x66\x83\x83");         // add word [rbx + SP], size
+        _jit_u32(e, JIT_CPU(SP));
+        _jit_u8(e, word ? 2 : 1);
+    }
+
+    switch (op) {
+    case 0x20:
+        _jit_store_pc(e, operand & 0xffff);
+        e->pending += 6;
+        _jit_flush_cycles(e);
+        break;
+    case 0x60:
+        JIT_CODE(e, "\xff\xc0");             // inc eax
+        JIT_CODE(e, "\x66\x89\x83");         // mov [rbx + PC], ax
+        _jit_u32(e, JIT_CPU(PC));
+        e->pending += 6;
+        _jit_flush_cycles(e);
+        break;
+    default:
+        if (!push) {
+            // An 8-bit pull clears the high byte, even of C
+            JIT_CODE(e, "\x66\x89\x83");     // mov [rbx + reg], ax
+            _jit_u32(e, reg);
+            _jit_emit_nz(e, 0, word);
+        }
+        e->pending += (push ? 3 : 4) + word;
+        break;
+    }
+    _jit_slow_end(e);
+    return true;
+}
+
+/**
+ * Emit a jump or branch which ends a block. The cycles of the block
+ * are added on each path.
+ *
+ * @param *e The code being emitted
+ * @param op The opcode
+ * @param mode The register width mode (CPU_Width_Mode_t)
+ * @param pc The PC of the instruction
+ * @param operand The operand of the instruction
+ * @return True if emitted, false if the handler has to be called
+ */
+static bool _jit_emit_branch(jit_emit_t *e, uint8_t op, uint8_t mode, uint16_t pc, uint32_t operand)
+{
+    uint16_t target = (pc + 2 + (int8_t)operand) & 0xffff;
+    uint32_t taken = 3;
+    uint8_t *skip;
+
+    if (mode == CPU_WIDTH_E && (target & 0xff00) != (pc & 0xff00)) {
+        taken += 1;
+    }
+
+    switch (op) {
+    case 0x4c: // JMP abs
+        _jit_store_pc(e, operand & 0xffff);
+        e->pending += 3;
+        _jit_flush_cycles(e);
+        return true;
+    case 0x5c: // JML long
+        JIT_CODE(e, "\xc6\x83");             // mov byte [rbx + PBR], bank
+        _jit_u32(e, JIT_CPU(PBR));
+        _jit_u8(e, operand >> 16);
+        _jit_store_pc(e, operand & 0xffff);
+        e->pending += 4;
+        _jit_flush_cycles(e);
+        return true;
+    case 0x80: // BRA
+        _jit_store_pc(e, target);
+        e->pending += taken;
+        _jit_flush_cycles(e);
+        return true;
+    case 0x10: case 0x30: // BPL, BMI
+        JIT_CODE(e, "\xf7\x83");             // test dword [rbx + nz], N
+        _jit_u32(e, JIT_CPU(nz));
+        _jit_u32(e, 0x80008000);
+        break;
+    case 0x50: case 0x70: // BVC, BVS
+    case 0x90: case 0xb0: // BCC, BCS
+        JIT_CODE(e, "\xf6\x83");             // test byte [rbx + P], flag
+        _jit_u32(e, JIT_CPU(P));
+        _jit_u8(e, op < 0x90 ? JIT_SR_V : JIT_SR_C);
+        break;
+    case 0xd0: case 0xf0: // BNE, BEQ
+        JIT_CODE(e, "\x66\xf7\x83");         // test word [rbx + nz], 0xffff (zero = Z set)
+        _jit_u32(e, JIT_CPU(nz));
+        _jit_u16(e, 0xffff);
+        break;
+    default:
+        return false;
+    }
+
+    // Taken if the flag is set for BMI, BVS, BCS and BEQ (ZF clear
+    // after the test, except for Z), else if it is clear
+    bool on_set = op & 0x20;
+    bool jump_if_zf = op == 0xf0 ? true : op == 0xd0 ? false : !on_set;
+
+    _jit_u8(e, 0x0f);                        // jcc taken
+    _jit_u8(e, jump_if_zf ? 0x84 : 0x85);
+    skip = e->p;
+    _jit_u32(e, 0);
+    _jit_store_pc(e, (pc + 2) & 0xffff);
+    _jit_add_cycles(e, e->pending + 2);
+    _jit_u8(e, 0xe9);                        // jmp done
+    uint8_t *done = e->p;
+    _jit_u32(e, 0);
+    _jit_patch_rel32(skip, e->p);
+    _jit_store_pc(e, target);
+    _jit_add_cycles(e, e->pending + taken);
+    _jit_patch_rel32(done, e->p);
+    e->pending = 0;
+    return true;
+}
+
+/**
+ * Emit an instruction which is simple enough to be translated inline.
+ * The PC is not updated (the translator knows it); the cycles are
+ * added in e->pending.
+ *
+ * @param *e The code being emitted
+ * @param op The opcode
+ * @param mode The register width mode (CPU_Width_Mode_t)
+ * @param pc The PC of the instruction
+ * @param operand The operand of the instruction
+ * @return True if emitted, false if the handler has to be called
+ */
+static bool _jit_emit_inline(jit_emit_t *e, uint8_t op, uint8_t mode, uint16_t pc, uint32_t operand)
+{
+    bool m16 = mode == CPU_WIDTH_M16X8 || mode == CPU_WIDTH_M16X16;
+    bool x16 = mode == CPU_WIDTH_M8X16 || mode == CPU_WIDTH_M16X16;
+    uint32_t reg;
+    bool inc;
+    bool word;
+
+    switch (op) {
+    case 0x18: // CLC
+    case 0xd8: // CLD
+    case 0xb8: // CLV
+        JIT_CODE(e, "\x80\xa3");             // and byte [rbx + P], ~flag
+        _jit_u32(e, JIT_CPU(P));
+        _jit_u8(e, (uint8_t)~(op == 0x18 ? JIT_SR_C : op == 0xd8 ? JIT_SR_D : JIT_SR_V));
+        break;
+    case 0x38: // SEC
+    case 0xf8: // SED
+        JIT_CODE(e, "\x80\x8b");             // or byte [rbx + P], flag
+        _jit_u32(e, JIT_CPU(P));
+        _jit_u8(e, op == 0x38 ? JIT_SR_C : JIT_SR_D);
+        break;
+    case 0xea: // NOP
+        break;
+    case 0xe8: // INX
+    case 0xc8: // INY
+    case 0xca: // DEX
+    case 0x88: // DEY
+    case 0x1a: // INA
+    case 0x3a: // DEA
+        reg = op == 0xe8 || op == 0xca ? JIT_CPU(X) : op == 0xc8 || op == 0x88 ? JIT_CPU(Y) : JIT_CPU(C);
+        inc = op == 0xe8 || op == 0xc8 || op == 0x1a;
+        word = reg == JIT_CPU(C) ? m16 : x16;
+
+        JIT_CODE(e, "\x0f\xb7\x83");         // movzx eax, word [rbx + reg]
+        _jit_u32(e, reg);
+        if (inc) {
+            JIT_CODE(e, "\xff\xc0");         // inc eax
+        }
+        else {
+            JIT_CODE(e, "\xff\xc8");         // dec eax
+        }
+        _jit_u8(e, 0x25);                    // and eax, width mask
+        _jit_u32(e, word ? 0xffff : 0xff);
+        // An 8-bit C keeps its high byte, X and Y lose it
+        if (word || reg != JIT_CPU(C)) {
+            JIT_CODE(e, "\x66\x89\x83");     // mov [rbx + reg], ax
+        }
+        else {
+            JIT_CODE(e, "\x88\x83");         // mov [rbx + reg], al
+        }
+        _jit_u32(e, reg);
+        _jit_emit_nz(e, 0, word);
+        break;
+    case 0x0a: // ASL A
+        if (!m16) {
+            return false; // The 8-bit handler sets C, not P.C
+        }
+        JIT_CODE(e, "\x0f\xb7\x83");         // movzx eax, word [rbx + C]
+        _jit_u32(e, JIT_CPU(C));
+        JIT_CODE(e, "\xd1\xe0");             // shl eax, 1
+        JIT_CODE(e, "\x66\x89\x83");         // mov [rbx + C], ax
+        _jit_u32(e, JIT_CPU(C));
+        JIT_CODE(e, "\x89\xc1");             // mov ecx, eax
+        JIT_CODE(e, "\xc1\xe9\x10");         // shr ecx, 16 (the bit shifted out)
+        JIT_CODE(e, "\x80\xa3");             // and byte [rbx + P], ~C
+        _jit_u32(e, JIT_CPU(P));
+        _jit_u8(e, (uint8_t)~JIT_SR_C);
+        JIT_CODE(e, "\x08\x8b");             // or [rbx + P], cl
+        _jit_u32(e, JIT_CPU(P));
+        JIT_CODE(e, "\x0f\xb7\xc0");         // movzx eax, ax
+        _jit_emit_nz(e, 0, true);
+        break;
+    default:
+        return _jit_emit_data(e, op, mode, pc, operand) ||
+               _jit_emit_stack(e, op, mode, pc, operand) ||
+               _jit_emit_branch(e, op, mode, pc, operand);
+    }
+
+    e->pending += 2;
+    return true;
+}
+
+/**
+ * Emit the slow paths of the instructions of a block (see jit_slow_t),
+ * after the rest of its code
+ *
+ * @param *e The code being emitted
+ */
+static void _jit_emit_slow(jit_emit_t *e)
+{
+    for (int i = 0; i < e->slow_count; ++i) {
+        jit_slow_t *s = &e->slow[i];
+
+        for (int j = 0; j < s->jump_count; ++j) {
+            _jit_patch_rel32(s->jumps[j], e->p);
+        }
+        _jit_add_cycles(e, s->before);
+        _jit_store_pc(e, s->pc);
+        _jit_emit_call(e, s->handler);
+        _jit_emit_checks(e, -1);
+        if (s->after) {
+            JIT_CODE(e, "\x48\x81\xab");     // sub qword [rbx + cycles], after
+            _jit_u32(e, JIT_CPU(cycles));
+            _jit_u32(e, s->after);
+        }
+        _jit_u8(e, 0xe9);                    // jmp back
+        _jit_patch_rel32(e->p, s->back);
+        e->p += 4;
+    }
+}
+
+/**
+ * Make a range of the code buffer writable or executable (never both)
+ *
+ * @param *start The first byte
+ * @param *end The byte after the last one
+ * @param write True to make the range writable, false to make it
+ *              executable
+ * @return False if the protection could not be changed
+ */
+static bool _jit_protect(uint8_t *start, uint8_t *end, bool write)
+{
+    uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t first = (uintptr_t)start & ~(page_size - 1);
+    uintptr_t last = ((uintptr_t)end + page_size - 1) & ~(page_size - 1);
+
+    return mprotect((void *)first, last - first, write ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+}
+
+/**
+ * Check if the code at an address may be translated
+ *
+ * @param *jit The translator
+ * @param *mem The memory the code is in
+ * @param addr The address of the code
+ * @return False for I/O pages (reading them can have side effects)
+ *         and pages which keep overwriting their code
+ */
+static bool _jit_can_translate(jit_t *jit, memory_t *mem, uint32_t addr)
+{
+    uint32_t page_num = addr >> MEM_PAGE_BITS;
+
+    return mem->rd[page_num] && jit->smc_count[page_num] < JIT_SMC_LIMIT;
+}
+
+/**
+ * Record that a range of bytes was translated, and watch their pages
+ *
+ * @param *jit The translator
+ * @param addr The first byte
+ * @param len The number of bytes (which stay within the bank)
+ * @return False if the page map could not be allocated
+ */
+static bool _jit_mark_code(jit_t *jit, uint32_t addr, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; ++i) {
+        uint32_t page_num = (addr + i) >> MEM_PAGE_BITS;
+        uint32_t offs = (addr + i) & MEM_PAGE_MASK;
+        uint8_t **map = &jit->code_map[page_num];
+
+        if (!*map && !(*map = calloc(MEM_PAGE_SIZE / 8, 1))) {
+            return false;
+        }
+        (*map)[offs >> 3] |= 1 << (offs & 7);
+        _watch_mem_page(jit->mem, jit->watch_id, page_num);
+    }
+    return true;
+}
+
+/**
+ * Called before a byte on a page with translated code is written
+ *
+ * @param *dev The translator
+ * @param addr The address being written
+ * @return True to keep watching the page (the byte is not code)
+ */
+static bool _jit_watch(void *dev, uint32_t addr)
+{
+    jit_t *jit = dev;
+    uint32_t page_num = addr >> MEM_PAGE_BITS;
+    uint32_t offs = addr & MEM_PAGE_MASK;
+    uint8_t *map = jit->code_map[page_num];
+
+    if (!map || !(map[offs >> 3] & (1 << (offs & 7)))) {
+        return true; // Data next to the code
+    }
+
+    // The running block exits after this instruction, then
+    // everything is dropped (see jit_run())
+    jit->flush = 1;
+    if (jit->smc_count[page_num] < JIT_SMC_LIMIT) {
+        ++jit->smc_count[page_num];
+    }
+    return false;
+}
+
+static uint32_t _jit_hash(uint32_t key)
+{
+    return ((key * 2654435761u) >> 16) & (JIT_HASH_SIZE - 1);
+}
+
+/**
+ * Find the translation of a block
+ *
+ * @param *jit The translator
+ * @param key The PC and width mode of the block (see jit_block_t.key)
+ * @return The block, or NULL if it was not translated yet
+ */
+static jit_block_t *_jit_lookup(jit_t *jit, uint32_t key)
+{
+    for (uint32_t i = _jit_hash(key);; i = (i + 1) & (JIT_HASH_SIZE - 1)) {
+        jit_block_t *blk = jit->hash[i];
+
+        if (!blk || blk->key == key) {
+            return blk;
+        }
+    }
+}
+
+/**
+ * Add a translated block to the lookup table
+ *
+ * @param *jit The translator
+ * @param *blk The block
+ */
+static void _jit_insert(jit_t *jit, jit_block_t *blk)
+{
+    uint32_t i = _jit_hash(blk->key);
+
+    while (jit->hash[i]) {
+        i = (i + 1) & (JIT_HASH_SIZE - 1);
+    }
+    jit->hash[i] = blk;
+}
+
+/**
+ * Translate the basic block starting at a PC. It ends at the first
+ * branch, jump, call, return or instruction which changes the I flag
+ * or the width mode (other than by REP and SEP), before a breakpoint,
+ * an instruction which is never translated, or code which cannot be
+ * translated, or after JIT_MAX_BLOCK_INST instructions.
+ *
+ * A block only runs if the instruction and cycle budgets are enough
+ * for all of its instructions, so the instructions translated inline
+ * neither check them nor update the PC, and their cycles are added at
+ * once where the block calls a handler or ends.
+ *
+ * @param *jit The translator
+ * @param *mem The memory the code is in
+ * @param key The PC and width mode of the block (see jit_block_t.key)
+ * @return The block, or NULL if not even the first instruction
+ *         can be translated
+ */
+static jit_block_t *_jit_translate(jit_t *jit, memory_t *mem, uint32_t key)
+{
+    jit_emit_t e;
+    uint32_t addr = key & 0xffffff;
+    uint8_t mode = key >> 24;
+    bool chain = true;
+    bool pc_stale = false;
+    uint16_t next_pc = addr & 0xffff;
+    int count = 0;
+
+    if (jit->block_count >= JIT_MAX_BLOCKS || jit->buf + JIT_CODE_SIZE - jit->code_end < JIT_MAX_BLOCK_BYTES) {
+        jit_flush(jit);
+    }
+
+    jit_block_t *blk = &jit->blocks[jit->block_count];
+    uint8_t *limit = jit->code_end + JIT_MAX_BLOCK_BYTES;
+    e.p = jit->code_end;
+    e.pending = 0;
+    e.fixup_count = 0;
+    e.slow_count = 0;
+
+    if (!_jit_protect(jit->code_end, limit, true)) {
+        return NULL;
+    }
+
+    // Budget checks, patched with the number of instructions
+    JIT_CODE(&e, "\x49\x81\xff");            // cmp r15, count
+    uint8_t *budget_count = e.p;
+    _jit_u32(&e, 0);
+    JIT_CODE(&e, "\x0f\x82");                // jb jit->exit
+    _jit_patch_rel32(e.p, jit->exit);
+    e.p += 4;
+    JIT_CODE(&e, "\x48\x8b\x83");            // mov rax, [rbx + cycles]
+    _jit_u32(&e, JIT_CPU(cycles));
+    JIT_CODE(&e, "\x48\x05");                // add rax, count * JIT_MAX_INST_CYCLES
+    uint8_t *budget_cycles = e.p;
+    _jit_u32(&e, 0);
+    JIT_CODE(&e, "\x49\x3b\x85");            // cmp rax, [r13 + end_cycles]
+    _jit_u32(&e, JIT_CTX(end_cycles));
+    JIT_CODE(&e, "\x0f\x83");                // jae jit->exit
+    _jit_patch_rel32(e.p, jit->exit);
+    e.p += 4;
+
+    while (count < JIT_MAX_BLOCK_INST && _jit_can_translate(jit, mem, addr)) {
+        uint8_t op = _get_mem_byte(mem, addr, false);
+        uint32_t len = _cpu_get_inst_len(op, mode);
+        jit_op_kind_t kind = _jit_op_kind(op);
+        uint16_t pc = addr & 0xffff;
+        uint32_t operand = 0;
+
+        if (kind == JIT_OP_NONE || (count && _test_mem_flags(mem, addr).B)) {
+            break;
+        }
+        if ((addr & 0xffff) + len > 0x10000 || !_jit_can_translate(jit, mem, addr + len - 1)) {
+            break; // Operand wraps around the bank or is on an I/O page
+        }
+        if (!_jit_mark_code(jit, addr, len)) {
+            break;
+        }
+        for (uint32_t i = len - 1; i > 0; --i) {
+            operand = operand << 8 | _get_mem_byte(mem, addr + i, false);
+        }
+        if (kind == JIT_OP_WIDTH) {
+            // SEP reads its operand from bank 0 (see i_sep()), so the
+            // new width mode is only known in bank 0
+            bool known = op == 0xc2 || addr >> 16 == 0;
+            kind = known && !(operand & JIT_SR_I) ? JIT_OP_PLAIN : JIT_OP_END;
+        }
+
+        JIT_CODE(&e, "\x49\xff\xcf");        // dec r15
+        if (_jit_emit_inline(&e, op, mode, pc, operand)) {
+            pc_stale = kind == JIT_OP_PLAIN; // Jumps and branches store it
+        }
+        else {
+            _jit_flush_cycles(&e);
+            _jit_store_pc(&e, pc);
+            _jit_emit_call(&e, cpu_width_dispatch_table[mode][op]);
+            _jit_emit_checks(&e, kind == JIT_OP_PLAIN ? (int32_t)((addr + len) & 0xffff) : -1);
+            pc_stale = false;
+        }
+
+        ++count;
+        next_pc = (addr + len) & 0xffff;
+
+        if (kind != JIT_OP_PLAIN) {
+            chain = kind == JIT_OP_CHAIN;
+            break;
+        }
+        if (op == 0xc2 || op == 0xe2) {
+            mode = _jit_width_after(mode, op, operand);
+        }
+        if ((addr & 0xffff) + len > 0xffff) {
+            break; // The PC wraps around to the start of the bank
+        }
+        addr += len;
+    }
+
+    if (!count) {
+        _jit_protect(jit->code_end, limit, false);
+        return NULL;
+    }
+
+    uint32_t budget = count;
+    memcpy(budget_count, &budget, sizeof(budget));
+    budget *= JIT_MAX_INST_CYCLES;
+    memcpy(budget_cycles, &budget, sizeof(budget));
+
+    if (pc_stale) {
+        _jit_store_pc(&e, next_pc);
+    }
+    _jit_flush_cycles(&e);
+
+    blk->key = key;
+    blk->code = jit->code_end;
+    blk->chain = chain;
+    blk->end_mode = mode;
+    blk->link_count = 0;
+
+    // Chain slots, patched by _jit_link() once the next blocks are known
+    if (chain) {
+        JIT_CODE(&e, "\x0f\xb7\x83");        // movzx eax, word [rbx + PC]
+        _jit_u32(&e, JIT_CPU(PC));
+        JIT_CODE(&e, "\x0f\xb6\x8b");        // movzx ecx, byte [rbx + PBR]
+        _jit_u32(&e, JIT_CPU(PBR));
+        JIT_CODE(&e, "\xc1\xe1\x10");        // shl ecx, 16
+        JIT_CODE(&e, "\x09\xc8");            // or eax, ecx
+        for (int i = 0; i < JIT_LINKS; ++i) {
+            blk->link[i] = e.p;
+            _jit_u8(&e, 0x3d);               // cmp eax, pc (none matches yet)
+            _jit_u32(&e, UINT32_MAX);
+            _jit_exit_if(&e, 0x84);          // je block
+        }
+    }
+
+    // Exit: tell jit_run() where execution left the translated code
+    uint8_t *exit = e.p;
+    JIT_CODE(&e, "\x48\xb8");                // mov rax, blk
+    _jit_u64(&e, (uint64_t)(uintptr_t)blk);
+    JIT_CODE(&e, "\x49\x89\x85");            // mov [r13 + last], rax
+    _jit_u32(&e, JIT_CTX(last));
+    _jit_u8(&e, 0xe9);                       // jmp jit->exit
+    _jit_patch_rel32(e.p, jit->exit);
+    e.p += 4;
+
+    _jit_emit_slow(&e);
+
+    for (int i = 0; i < e.fixup_count; ++i) {
+        _jit_patch_rel32(e.fixups[i], exit);
+    }
+
+    if (!_jit_protect(jit->code_end, limit, false)) {
+        return NULL; // Left unused, the next translation writes over it
+    }
+
+    blk->size = e.p - blk->code;
+    jit->code_end = e.p;
+    ++jit->block_count;
+    ++jit->translated;
+    _jit_insert(jit, blk);
+
+    if (jit->perf_map) {
+        fprintf(jit->perf_map, "%" PRIxPTR " %" PRIx32 " 816:bb_%06" PRIx32 "_%s\n",
+                (uintptr_t)blk->code, blk->size, key & 0xffffff, jit_mode_names[key >> 24]);
+    }
+    return blk;
+}
+
+/**
+ * Chain a block directly to the block which ran after it, if it has a
+ * free chain slot. Only blocks which keep the I flag are chained, so
+ * the attention bits in r14d stay valid, and only to blocks translated
+ * for the width mode the first one ends in.
+ *
+ * @param *from The block which ran first
+ * @param *to The block which ran next
+ */
+static void _jit_link(jit_block_t *from, jit_block_t *to)
+{
+    uint32_t pc = to->key & 0xffffff;
+
+    if (!from->chain || from->end_mode != (to->key >> 24)) {
+        return;
+    }
+    for (int i = 0; i < from->link_count; ++i) {
+        if (memcmp(from->link[i] + 1, &pc, sizeof(pc)) == 0) {
+            return; // Already chained
+        }
+    }
+    if (from->link_count == JIT_LINKS) {
+        return;
+    }
+
+    // The slot is a cmp eax, imm32 and a je rel32 (11 bytes)
+    uint8_t *slot = from->link[from->link_count];
+    if (!_jit_protect(slot, slot + 11, true)) {
+        return;
+    }
+    memcpy(slot + 1, &pc, sizeof(pc));
+    _jit_patch_rel32(slot + 7, to->code);
+    _jit_protect(slot, slot + 11, false);
+    ++from->link_count;
+}
+
+
+/**
+ * Check if the JIT can run on this host
+ *
+ * @return True on x86-64 hosts
+ */
+bool jit_supported(void)
+{
+    return true;
+}
+
+
+/**
+ * Set up a translator for the code in a memory. Set CPU_t.jit to run
+ * a CPU with it (see runCPU()).
+ *
+ * @param *jit The translator to set up
+ * @param *mem The memory the CPU runs from
+ * @param perf_map True to list the translated blocks in
+ *                 /tmp/perf-<pid>.map, so perf can name them
+ * @return False if the host does not support the JIT or memory
+ *         (executable or not) could not be allocated
+ */
+bool jit_init(jit_t *jit, memory_t *mem, bool perf_map)
+{
+    jit_emit_t e;
+    CPU_t probe;
+
+    memset(jit, 0, sizeof(*jit));
+    jit->mem = mem;
+    jit->watch_id = -1;
+
+    // The buffer is never writable and executable at once: each range
+    // is written, then made executable (see _jit_protect())
+    jit->buf = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->buf == MAP_FAILED) {
+        jit->buf = NULL;
+    }
+    jit->blocks = calloc(JIT_MAX_BLOCKS, sizeof(*jit->blocks));
+    jit->hash = calloc(JIT_HASH_SIZE, sizeof(*jit->hash));
+    jit->heat = calloc(JIT_HASH_SIZE, sizeof(*jit->heat));
+    jit->code_map = calloc(MEM_PAGE_COUNT, sizeof(*jit->code_map));
+    jit->smc_count = calloc(MEM_PAGE_COUNT, sizeof(*jit->smc_count));
+
+    if (!jit->buf || !jit->blocks || !jit->hash || !jit->heat || !jit->code_map || !jit->smc_count ||
+        (jit->watch_id = _add_mem_watcher(mem, jit, _jit_watch)) < 0) {
+        jit_free(jit);
+        return false;
+    }
+
+    // Find the interrupt and crash bits (the bit field layout is
+    // up to the compiler)
+    memset(&probe, 0, sizeof(probe));
+    probe.P.NMI = 1;
+    probe.P.CRASH = 1;
+    memcpy(&jit->attn_nmi, &probe.P, sizeof(probe.P));
+    probe.P.IRQ = 1;
+    memcpy(&jit->attn_irq, &probe.P, sizeof(probe.P));
+
+    e.p = jit->buf;
+    e.fixup_count = 0;
+    _jit_emit_enter(jit, &e);
+    jit->code_start = e.p;
+    jit->code_end = e.p;
+
+    if (!_jit_protect(jit->buf, jit->code_start, false)) {
+        jit_free(jit);
+        return false;
+    }
+
+    if (perf_map) {
+        char name[64];
+
+        snprintf(name, sizeof(name), "/tmp/perf-%d.map", (int)getpid());
+        jit->perf_map = fopen(name, "w");
+        if (jit->perf_map) {
+            setvbuf(jit->perf_map, NULL, _IOLBF, 0);
+        }
+    }
+    return true;
+}
+
+
+/**
+ * Release a translator and stop watching its memory
+ *
+ * @param *jit The translator to free
+ */
+void jit_free(jit_t *jit)
+{
+    if (jit->watch_id >= 0) {
+        _remove_mem_watcher(jit->mem, jit->watch_id);
+        jit->watch_id = -1;
+    }
+    if (jit->buf) {
+        munmap(jit->buf, JIT_CODE_SIZE);
+        jit->buf = NULL;
+    }
+    if (jit->code_map) {
+        for (uint32_t i = 0; i < MEM_PAGE_COUNT; ++i) {
+            free(jit->code_map[i]);
+        }
+    }
+    if (jit->perf_map) {
+        fclose(jit->perf_map);
+        jit->perf_map = NULL;
+    }
+    free(jit->blocks);
+    free(jit->hash);
+    free(jit->heat);
+    free(jit->code_map);
+    free(jit->smc_count);
+    jit->blocks = NULL;
+    jit->hash = NULL;
+    jit->heat = NULL;
+    jit->code_map = NULL;
+    jit->smc_count = NULL;
+}
+
+
+/**
+ * Drop all translations (and the watches on their pages). The run
+ * counts are kept, so hot code is translated again right away.
+ *
+ * @param *jit The translator
+ */
+void jit_flush(jit_t *jit)
+{
+    jit->code_end = jit->code_start;
+    jit->block_count = 0;
+    jit->last = NULL;
+    jit->flush = 0;
+    memset(jit->hash, 0, JIT_HASH_SIZE * sizeof(*jit->hash));
+
+    for (uint32_t i = 0; i < MEM_PAGE_COUNT; ++i) {
+        if (jit->code_map[i]) {
+            memset(jit->code_map[i], 0, MEM_PAGE_SIZE / 8);
+        }
+    }
+    _unwatch_mem_pages(jit->mem, jit->watch_id);
+    ++jit->flushes;
+}
+
+
+/**
+ * Run a CPU with translated code, with the same results as the
+ * interpreter (see runCPU() for the parameters). Code which is not hot
+ * yet or cannot be translated is run by the interpreter one instruction
+ * at a time.
+ *
+ * @param *jit The translator, set up for mem
+ */
+uint64_t jit_run(jit_t *jit, CPU_t *cpu, memory_t *mem, uint64_t max_cycles, uint64_t max_inst, CPU_Stop_Reason_t *stop)
+{
+    uint64_t end_cycles = max_cycles ? cpu->cycles + max_cycles : UINT64_MAX;
+    uint64_t count = 0;
+    jit_block_t *prev = NULL;
+    jit_enter_t enter;
+    CPU_Stop_Reason_t reason;
+
+    memcpy(&enter, &jit->enter, sizeof(enter));
+
+    for (;;) {
+        if (max_inst && count >= max_inst) {
+            reason = CPU_STOP_INSTRUCTIONS;
+            break;
+        }
+        if (cpu->cycles >= end_cycles) {
+            reason = CPU_STOP_CYCLES;
+            break;
+        }
+        if (jit->flush) {
+            jit_flush(jit);
+            prev = NULL;
+        }
+
+        jit_block_t *blk = NULL;
+        uint32_t pc = _cpu_get_effective_pc(cpu);
+
+        // Resets, stopped or crashed CPUs, pending interrupts (taken
+        // after the next instruction) and access tracking are left to
+        // the interpreter
+        if (mem == jit->mem && !cpu->P.RST && !cpu->P.STP && !cpu->P.CRASH &&
+            !cpu->P.NMI && !(cpu->P.IRQ && !cpu->P.I) && !(mem->track && cpu->setacc)) {
+            uint32_t key = pc | (uint32_t)cpu->width_mode << 24;
+
+            uint8_t *heat = &jit->heat[_jit_hash(key)];
+
+            blk = _jit_lookup(jit, key);
+            if (!blk && *heat < JIT_HOT_COUNT) {
+                ++*heat; // Not hot yet, interpret it
+            }
+            else if (!blk) {
+                uint64_t flushes = jit->flushes;
+
+                blk = _jit_translate(jit, mem, key);
+                if (jit->flushes != flushes) {
+                    prev = NULL; // Translating made room by dropping everything
+                }
+            }
+        }
+
+        uint64_t ran = 0;
+
+        if (blk) {
+            if (prev) {
+                _jit_link(prev, blk);
+            }
+
+            jit->end_cycles = end_cycles;
+            jit->budget = max_inst ? max_inst - count : UINT64_MAX;
+            jit->attn = cpu->P.I ? jit->attn_nmi : jit->attn_irq;
+            jit->last = NULL;
+
+            uint64_t budget = jit->budget;
+            enter(cpu, mem, jit, blk->code);
+            ran = budget - jit->budget;
+        }
+
+        // Nothing ran when the budgets are too close to their end for
+        // the whole block
+        if (!ran) {
+            count += interpretCPU(cpu, mem, max_cycles ? end_cycles - cpu->cycles : 0, 1, &reason);
+            if (reason != CPU_STOP_INSTRUCTIONS && reason != CPU_STOP_CYCLES) {
+                break;
+            }
+            prev = NULL;
+            continue;
+        }
+
+        if (cpu->P.CRASH) {
+            count += ran - 1; // The crashing instruction does not count
+            reason = CPU_STOP_CRASH;
+            break;
+        }
+        count += ran;
+        prev = jit->last;
+
+        if (cpu->P.NMI || (cpu->P.IRQ && !cpu->P.I)) {
+            _cpu_interrupt(cpu, mem);
+            prev = NULL; // Only the interpreter may enter the handler
+        }
+
+        if (_test_mem_flags(mem, _cpu_get_effective_pc(cpu)).B == 1) {
+            reason = CPU_STOP_BREAKPOINT;
+            break;
+        }
+    }
+
+    if (stop) {
+        *stop = reason;
+    }
+    return count;
+}
+
+#else // No JIT for this host
+
+bool jit_supported(void)
+{
+    return false;
+}
+
+bool jit_init(jit_t *jit, memory_t *mem, bool perf_map)
+{
+    memset(jit, 0, sizeof(*jit));
+    return false;
+}
+
+void jit_free(jit_t *jit)
+{
+}
+
+void jit_flush(jit_t *jit)
+{
+}
+
+uint64_t jit_run(jit_t *jit, CPU_t *cpu, memory_t *mem, uint64_t max_cycles, uint64_t max_inst, CPU_Stop_Reason_t *stop)
+{
+    return interpretCPU(cpu, mem, max_cycles, max_inst, stop);
+}
+
+#endif
@@ -0,0 +1,104 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+#ifndef _JIT_H
+#define _JIT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "65816.h"
+
+// Size of the translated code buffer. When it (or the block table)
+// fills up, all translations are dropped and made again.
+#define JIT_CODE_SIZE (16 * 1024 * 1024)
+
+// Max number of translated blocks
+#define JIT_MAX_BLOCKS 16384
+
+// Slots of the block lookup table (power of 2, > JIT_MAX_BLOCKS)
+#define JIT_HASH_SIZE 32768
+
+// A block is translated once its first instruction was interpreted
+// this many times (code which only runs a few times is not worth it)
+#define JIT_HOT_COUNT 16
+
+// Max number of instructions translated into one block
+#define JIT_MAX_BLOCK_INST 32
+
+// Max number of blocks one block can be chained to directly
+#define JIT_LINKS 2
+
+// A page is no longer translated once its code was overwritten this
+// many times (self-modifying code runs faster in the interpreter)
+#define JIT_SMC_LIMIT 8
+
+// A translated basic block
+typedef struct jit_block_t {
+    uint32_t key;              // 24-bit PC | width mode << 24
+    uint8_t *code;             // Host code of the block
+    uint32_t size;             // Bytes of host code
+    bool chain;                // Ends in an instruction which keeps the width mode and I flag
+    uint8_t end_mode;          // Width mode at the end (REP and SEP in the block change it)
+    int link_count;            // Chain slots in use
+    uint8_t *link[JIT_LINKS];  // The chain slots (patched into the code)
+} jit_block_t;
+
+// Dynamic binary translator of 65816 basic blocks to x86-64 code.
+// Code is interpreted until it gets hot (JIT_HOT_COUNT).
+// Loads, stores, ALU, stack, flag and index register instructions
+// with simple addressing modes, branches and jumps are translated
+// inline; they access plain RAM through memory_t.rd and wr, and call
+// their handler for any other memory. The other instructions call the
+// width specialized handlers of 65816-dispatch.c, which still skips
+// the fetch, decode and dispatch of the interpreter. Blocks which end
+// in a branch, jump, call or return are chained directly to the
+// blocks they went to.
+//
+// The pages holding translated code are watched (_watch_mem_page()),
+// and writing a byte of an instruction which was translated drops all
+// translations. While tracking memory accesses (memory_t.track with
+// CPU_t.setacc), the CPU is only run by the interpreter.
+typedef struct jit_t {
+    // Read and written by the translated code
+    uint64_t end_cycles;       // Blocks exit once cpu->cycles reaches this
+    uint64_t budget;           // Instructions blocks may still run
+    uint32_t attn;             // CPU_t.P bits which end a block
+    uint8_t flush;             // Translated code was overwritten, exit and drop it
+    jit_block_t *last;         // The block which returned to jit_run()
+
+    memory_t *mem;             // The memory the code is translated from
+    int watch_id;              // Watcher id of the code pages in mem
+    uint32_t attn_irq;         // P bits of IRQ, NMI and CRASH
+    uint32_t attn_nmi;         // P bits of NMI and CRASH (IRQ masked)
+
+    uint8_t *buf;              // JIT_CODE_SIZE bytes, each page writable or executable
+    uint8_t *enter;            // Calls a block (see _jit_emit_enter())
+    uint8_t *exit;             // Returns from a block to jit_run()
+    uint8_t *code_start;       // First byte of block code
+    uint8_t *code_end;         // End of the used code
+    int block_count;
+    jit_block_t *blocks;       // JIT_MAX_BLOCKS
+    jit_block_t **hash;        // JIT_HASH_SIZE, open addressing
+    uint8_t *heat;             // JIT_HASH_SIZE run counts of untranslated blocks, by key hash (up to JIT_HOT_COUNT)
+    uint8_t **code_map;        // MEM_PAGE_COUNT bitmaps of translated bytes (NULL = none)
+    uint8_t *smc_count;        // MEM_PAGE_COUNT counts of code overwrites
+
+    FILE *perf_map;            // /tmp/perf-<pid>.map for perf (NULL = off)
+
+    // Statistics
+    uint64_t translated;       // Blocks translated
+    uint64_t flushes;          // Times all translations were dropped
+} jit_t;
+
+
+bool jit_supported(void);
+bool jit_init(jit_t *jit, memory_t *mem, bool perf_map);
+void jit_free(jit_t *jit);
+void jit_flush(jit_t *jit);
+uint64_t jit_run(jit_t *jit, CPU_t *cpu, memory_t *mem, uint64_t max_cycles, uint64_t max_inst, CPU_Stop_Reason_t *stop);
+
+#endif
@@ -0,0 +1,657 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "65816.h"
+#include "65816-util.h"
+#include "prof.h"
+
+// Nodes allocated when a profile starts (power of 2)
+#define PROF_INIT_NODES 1024
+
+// Addresses listed by a report
+#define PROF_REPORT_ADDRS 50
+
+// Longest name of a routine
+#define PROF_NAME_LEN 16
+
+// A routine of a report
+typedef struct prof_routine_t {
+    uint32_t key;
+    uint64_t self;
+    uint64_t total;
+    uint64_t calls;
+} prof_routine_t;
+
+// An address of a report
+typedef struct prof_report_addr_t {
+    uint32_t addr;
+    prof_addr_t counts;
+} prof_report_addr_t;
+
+
+/**
+ * Initialize a profiler, which is not running
+ *
+ * @param *p The profiler
+ */
+void prof_init(prof_t *p)
+{
+    memset(p, 0, sizeof(*p));
+}
+
+
+/**
+ * Free what a profiler counted
+ *
+ * @param *p The profiler, which must not be running
+ */
+void prof_free(prof_t *p)
+{
+    for (int i = 0; i < PROF_PAGE_COUNT; ++i) {
+        free(p->pages[i]);
+        p->pages[i] = NULL;
+    }
+    free(p->nodes);
+    free(p->hash);
+    p->nodes = NULL;
+    p->hash = NULL;
+    p->node_count = 0;
+    p->node_cap = 0;
+    p->hash_len = 0;
+    p->depth = 0;
+}
+
+
+/**
+ * Start a new profile, dropping the last one
+ *
+ * @param *p The profiler
+ * @param *cpu The CPU to profile (set its prof to p afterwards)
+ * @param interval Cycles between samples (0 = count every instruction)
+ * @return False if out of memory
+ */
+bool prof_start(prof_t *p, CPU_t *cpu, uint64_t interval)
+{
+    p->running = false;
+    prof_free(p);
+
+    p->nodes = malloc(PROF_INIT_NODES * sizeof(*p->nodes));
+    p->hash = calloc(PROF_INIT_NODES * 2, sizeof(*p->hash));
+
+    if (!p->nodes || !p->hash) {
+        prof_free(p);
+        return false;
+    }
+    p->node_cap = PROF_INIT_NODES;
+    p->hash_len = PROF_INIT_NODES * 2;
+
+    // The root is never a child, so it is not in the hash table
+    p->nodes[0] = (prof_node_t){
+        .key = PROF_KEY(0, PROF_ROOT),
+        .parent = PROF_NONE,
+        .child = PROF_NONE,
+        .sibling = PROF_NONE,
+        .calls = 1
+    };
+    p->node_count = 1;
+
+    // Above any stack pointer, so it is never returned from
+    p->stack[0] = (prof_frame_t){0, 0x10000};
+    p->depth = 1;
+
+    p->interval = interval;
+    p->next = interval ? cpu->cycles + interval : 0;
+    p->start = cpu->cycles;
+    p->steps = 0;
+    p->cur = NULL;
+    p->pc_mark = cpu->cycles;
+    p->node_mark = cpu->cycles;
+    p->dropped = 0;
+    p->running = true;
+    return true;
+}
+
+
+/**
+ * Get the counts of an address
+ *
+ * @param *p The profiler
+ * @param addr The address
+ * @return Its counts (NULL = out of memory)
+ */
+static prof_addr_t *_prof_addr(prof_t *p, uint32_t addr)
+{
+    prof_addr_t **page = &p->pages[(addr & 0xffffff) / PROF_PAGE_LEN];
+
+    if (!*page) {
+        *page = calloc(PROF_PAGE_LEN, sizeof(prof_addr_t));
+
+        if (!*page) {
+            return NULL;
+        }
+    }
+    return &(*page)[addr % PROF_PAGE_LEN];
+}
+
+
+/**
+ * Get the cycles run since a mark. The cycle count goes back when
+ * the CPU is restored to an earlier point (e.g. by the timeline), and
+ * the cycles in between are not counted again.
+ *
+ * @param cycles The cycle count
+ * @param mark The cycle count of the mark
+ * @return The cycles
+ */
+static inline uint64_t _prof_since(uint64_t cycles, uint64_t mark)
+{
+    return cycles >= mark ? cycles - mark : 0;
+}
+
+
+/**
+ * Count the cycles run since the last call and return to the routine
+ * on top of the stack (exact counting only)
+ *
+ * @param *p The profiler
+ * @param cycles The cycle count
+ */
+static void _prof_count_node(prof_t *p, uint64_t cycles)
+{
+    p->nodes[p->stack[p->depth - 1].node].self += _prof_since(cycles, p->node_mark);
+    p->node_mark = cycles;
+}
+
+
+/**
+ * Count the instruction which is about to run (exact counting), or
+ * take the samples due (sampling). Called by runCPU() before each
+ * instruction once the cycle count reaches prof_t.next.
+ *
+ * @param *p The profiler
+ * @param pc The address of the instruction
+ * @param cycles The cycle count
+ */
+void prof_step(prof_t *p, uint32_t pc, uint64_t cycles)
+{
+    if (p->interval) {
+        // Several samples if an instruction (or a WAI) took more than an interval
+        uint64_t samples = (cycles - p->next) / p->interval + 1;
+        uint64_t sampled = samples * p->interval;
+        prof_addr_t *a = _prof_addr(p, pc);
+
+        if (a) {
+            a->cycles += sampled;
+            a->count += samples;
+        }
+        p->nodes[p->stack[p->depth - 1].node].self += sampled;
+        p->next += sampled;
+        p->steps += samples;
+        return;
+    }
+
+    if (p->cur) {
+        p->cur->cycles += _prof_since(cycles, p->pc_mark);
+    }
+    p->cur = _prof_addr(p, pc);
+    p->pc_mark = cycles;
+    ++p->steps;
+
+    if (p->cur) {
+        ++p->cur->count;
+    }
+}
+
+
+/**
+ * Count the cycles of the instruction being run, so everything run
+ * so far is in the profile
+ *
+ * @param *p The profiler
+ * @param *cpu The CPU being profiled
+ */
+void prof_sync(prof_t *p, CPU_t *cpu)
+{
+    if (!p->running || p->interval) {
+        return;
+    }
+    if (p->cur) {
+        p->cur->cycles += _prof_since(cpu->cycles, p->pc_mark);
+    }
+    p->pc_mark = cpu->cycles;
+    _prof_count_node(p, cpu->cycles);
+}
+
+
+/**
+ * Stop profiling. What was counted is kept until the next profile
+ * starts, or the profiler is freed.
+ *
+ * @param *p The profiler
+ * @param *cpu The CPU being profiled (set its prof to NULL beforehand)
+ */
+void prof_stop(prof_t *p, CPU_t *cpu)
+{
+    prof_sync(p, cpu);
+    p->running = false;
+    p->cur = NULL;
+}
+
+
+/**
+ * Get the slot of the hash table of a child node
+ *
+ * @param parent The parent node
+ * @param key The key of the routine
+ * @param len The length of the table
+ * @return The first slot to look in
+ */
+static inline uint32_t _prof_hash(uint32_t parent, uint32_t key, uint32_t len)
+{
+    uint32_t h = (parent * 0x9e3779b1u) ^ (key * 0x85ebca77u);
+
+    return (h ^ (h >> 15)) & (len - 1);
+}
+
+
+/**
+ * Double the room for nodes
+ *
+ * @param *p The profiler
+ * @return False if out of memory
+ */
+static bool _prof_grow(prof_t *p)
+{
+    uint32_t len = p->hash_len * 2;
+    prof_node_t *nodes = realloc(p->nodes, p->node_cap * 2 * sizeof(*nodes));
+
+    if (!nodes) {
+        return false;
+    }
+    p->nodes = nodes;
+
+    uint32_t *hash = calloc(len, sizeof(*hash));
+
+    if (!hash) {
+        return false;
+    }
+    for (uint32_t n = 1; n < p->node_count; ++n) {
+        uint32_t i = _prof_hash(nodes[n].parent, nodes[n].key, len);
+
+        while (hash[i]) {
+            i = (i + 1) & (len - 1);
+        }
+        hash[i] = n + 1;
+    }
+    free(p->hash);
+    p->hash = hash;
+    p->hash_len = len;
+    p->node_cap *= 2;
+    return true;
+}
+
+
+/**
+ * Get the child of a node for a routine, adding it if it is new
+ *
+ * @param *p The profiler
+ * @param parent The node
+ * @param key The key of the routine
+ * @return The child (PROF_NONE = out of memory)
+ */
+static uint32_t _prof_child(prof_t *p, uint32_t parent, uint32_t key)
+{
+    uint32_t i = _prof_hash(parent, key, p->hash_len);
+
+    while (p->hash[i]) {
+        prof_node_t *node = &p->nodes[p->hash[i] - 1];
+
+        if (node->parent == parent && node->key == key) {
+            return p->hash[i] - 1;
+        }
+        i = (i + 1) & (p->hash_len - 1);
+    }
+
+    if (p->node_count == p->node_cap) {
+        if (!_prof_grow(p)) {
+            return PROF_NONE;
+        }
+        i = _prof_hash(parent, key, p->hash_len);
+
+        while (p->hash[i]) {
+            i = (i + 1) & (p->hash_len - 1);
+        }
+    }
+
+    uint32_t n = p->node_count++;
+
+    p->nodes[n] = (prof_node_t){
+        .key = key,
+        .parent = parent,
+        .child = PROF_NONE,
+        .sibling = p->nodes[parent].child
+    };
+    p->nodes[parent].child = n;
+    p->hash[i] = n + 1;
+    return n;
+}
+
+
+/**
+ * Push the routine the CPU just entered on the shadow call stack
+ * @note Called at the end of the JSR, JSL, BRK and COP handlers,
+ *       and when an interrupt is taken
+ *
+ * @param *p The profiler
+ * @param *cpu The CPU, at the start of the routine
+ * @param pushed The number of bytes pushed to the stack to enter it
+ * @param kind How it was entered
+ */
+void prof_call(prof_t *p, CPU_t *cpu, uint8_t pushed, prof_kind_t kind)
+{
+    if (!p->interval) {
+        _prof_count_node(p, cpu->cycles);
+    }
+    if (p->depth == PROF_MAX_DEPTH) {
+        ++p->dropped;
+        return;
+    }
+
+    uint32_t node = _prof_child(p, p->stack[p->depth - 1].node, PROF_KEY(_cpu_get_effective_pc(cpu), kind));
+
+    if (node == PROF_NONE) {
+        ++p->dropped;
+        return;
+    }
+    ++p->nodes[node].calls;
+
+    // The stack stays in page 1 in emulation mode
+    uint32_t sp = cpu->P.E ? 0x100 | ((cpu->SP + pushed) & 0xff) : (cpu->SP + pushed) & 0xffff;
+
+    p->stack[p->depth++] = (prof_frame_t){node, sp};
+}
+
+
+/**
+ * Pop the routines the CPU just returned from off the shadow call
+ * stack: the ones whose caller's stack pointer is reached again
+ * @note Called at the end of the RTS, RTL and RTI handlers
+ *
+ * @param *p The profiler
+ * @param *cpu The CPU, after returning
+ */
+void prof_return(prof_t *p, CPU_t *cpu)
+{
+    if (!p->interval) {
+        _prof_count_node(p, cpu->cycles);
+    }
+    while (p->depth > 1 && p->stack[p->depth - 1].sp <= cpu->SP) {
+        --p->depth;
+    }
+}
+
+
+/**
+ * Get the cycles a profile counted
+ *
+ * @param *p The profiler
+ * @return The cycles
+ */
+uint64_t prof_total(prof_t *p)
+{
+    uint64_t total = 0;
+
+    for (uint32_t n = 0; n < p->node_count; ++n) {
+        total += p->nodes[n].self;
+    }
+    return total;
+}
+
+
+/**
+ * Get the name of a routine, e.g. 008123, or irq@00c000 for an
+ * interrupt handler
+ *
+ * @param key The key of the routine
+ * @param *buf Set to the name (PROF_NAME_LEN bytes)
+ */
+static void _prof_name(uint32_t key, char *buf)
+{
+    static const char *prefix[] = {"", "irq@", "nmi@", "brk@", "cop@"};
+    prof_kind_t kind = key >> 24;
+
+    if (kind == PROF_ROOT) {
+        strcpy(buf, "root");
+    }
+    else {
+        sprintf(buf, "%s%06x", prefix[kind], key & 0xffffff);
+    }
+}
+
+
+// Also finds a routine by key (the key is its first member)
+static int _prof_cmp_key(const void *a, const void *b)
+{
+    uint32_t ka = *(const uint32_t *)a;
+    uint32_t kb = *(const uint32_t *)b;
+
+    return (ka > kb) - (ka < kb);
+}
+
+
+static int _prof_cmp_routine(const void *a, const void *b)
+{
+    const prof_routine_t *ra = a;
+    const prof_routine_t *rb = b;
+
+    if (ra->self != rb->self) {
+        return ra->self < rb->self ? 1 : -1;
+    }
+    return (ra->key > rb->key) - (ra->key < rb->key);
+}
+
+
+static int _prof_cmp_addr(const void *a, const void *b)
+{
+    const prof_report_addr_t *ra = a;
+    const prof_report_addr_t *rb = b;
+
+    if (ra->counts.cycles != rb->counts.cycles) {
+        return ra->counts.cycles < rb->counts.cycles ? 1 : -1;
+    }
+    return (ra->addr > rb->addr) - (ra->addr < rb->addr);
+}
+
+
+/**
+ * Get the percentage of a profile some cycles are
+ *
+ * @param cycles The cycles
+ * @param total The cycles of the profile
+ * @return The percentage
+ */
+static double _prof_percent(uint64_t cycles, uint64_t total)
+{
+    return total ? cycles * 100.0 / total : 0.0;
+}
+
+
+/**
+ * Write a report of a profile: the routines by the cycles spent in
+ * them (exclusive) and in them and what they called (inclusive),
+ * and the addresses which took the most cycles
+ *
+ * @param *p The profiler, which may be running if prof_sync() was called
+ * @param *fp The file to write to
+ * @return False if out of memory or the file could not be written
+ */
+bool prof_report(prof_t *p, FILE *fp)
+{
+    uint64_t total = prof_total(p);
+    uint32_t count = p->node_count;
+    uint64_t *subtree = malloc((count + 1) * sizeof(*subtree));
+    uint32_t *keys = malloc((count + 1) * sizeof(*keys));
+    prof_routine_t *routines = calloc(count + 1, sizeof(*routines));
+
+    if (!subtree || !keys || !routines) {
+        free(subtree);
+        free(keys);
+        free(routines);
+        return false;
+    }
+
+    // Children come after their parents
+    for (uint32_t n = 0; n < count; ++n) {
+        subtree[n] = p->nodes[n].self;
+        keys[n] = p->nodes[n].key;
+    }
+    for (uint32_t n = count; n > 1; --n) {
+        subtree[p->nodes[n - 1].parent] += subtree[n - 1];
+    }
+
+    // One routine per key
+    qsort(keys, count, sizeof(*keys), _prof_cmp_key);
+
+    uint32_t routine_count = 0;
+
+    for (uint32_t n = 0; n < count; ++n) {
+        if (!routine_count || keys[n] != routines[routine_count - 1].key) {
+            routines[routine_count++].key = keys[n];
+        }
+    }
+
+    for (uint32_t n = 0; n < count; ++n) {
+        prof_node_t *node = &p->nodes[n];
+        prof_routine_t *r = bsearch(&node->key, routines, routine_count, sizeof(*routines), _prof_cmp_key);
+
+        r->self += node->self;
+        r->calls += node->calls;
+
+        // A recursive call is already in the inclusive cycles of the
+        // outermost call
+        uint32_t up = node->parent;
+
+        while (up != PROF_NONE && p->nodes[up].key != node->key) {
+            up = p->nodes[up].parent;
+        }
+        if (up == PROF_NONE) {
+            r->total += subtree[n];
+        }
+    }
+    qsort(routines, routine_count, sizeof(*routines), _prof_cmp_routine);
+
+    if (p->interval) {
+        fprintf(fp, "%" PRIu64 " cycles, %" PRIu64 " samples taken every %" PRIu64 " cycles\n",
+                total, p->steps, p->interval);
+    }
+    else {
+        fprintf(fp, "%" PRIu64 " cycles, %" PRIu64 " instructions counted exactly\n", total, p->steps);
+    }
+    if (p->dropped) {
+        fprintf(fp, "%" PRIu64 " calls were not followed (too deep, or out of memory)\n", p->dropped);
+    }
+
+    fprintf(fp, "\nRoutines by exclusive cycles:\n");
+    fprintf(fp, "%14s %7s %14s %7s %12s  %s\n", "exclusive", "%", "inclusive", "%", "calls", "routine");
+
+    for (uint32_t i = 0; i < routine_count; ++i) {
+        char name[PROF_NAME_LEN];
+
+        _prof_name(routines[i].key, name);
+        fprintf(fp, "%14" PRIu64 " %7.2f %14" PRIu64 " %7.2f %12" PRIu64 "  %s\n",
+                routines[i].self, _prof_percent(routines[i].self, total),
+                routines[i].total, _prof_percent(routines[i].total, total),
+                routines[i].calls, name);
+    }
+    free(subtree);
+    free(keys);
+    free(routines);
+
+    // Addresses, hottest first
+    size_t addr_count = 0;
+
+    for (int i = 0; i < PROF_PAGE_COUNT; ++i) {
+        for (int j = 0; p->pages[i] && j < PROF_PAGE_LEN; ++j) {
+            addr_count += p->pages[i][j].count != 0;
+        }
+    }
+
+    prof_report_addr_t *addrs = malloc((addr_count + 1) * sizeof(*addrs));
+
+    if (!addrs) {
+        return false;
+    }
+    addr_count = 0;
+
+    for (int i = 0; i < PROF_PAGE_COUNT; ++i) {
+        for (int j = 0; p->pages[i] && j < PROF_PAGE_LEN; ++j) {
+            if (p->pages[i][j].count) {
+                addrs[addr_count].addr = i * PROF_PAGE_LEN + j;
+                addrs[addr_count++].counts = p->pages[i][j];
+            }
+        }
+    }
+    qsort(addrs, addr_count, sizeof(*addrs), _prof_cmp_addr);
+
+    fprintf(fp, "\nAddresses by cycles:\n");
+    fprintf(fp, "%14s %7s %14s  %s\n", "cycles", "%", p->interval ? "samples" : "instructions", "address");
+
+    for (size_t i = 0; i < addr_count && i < PROF_REPORT_ADDRS; ++i) {
+        fprintf(fp, "%14" PRIu64 " %7.2f %14" PRIu64 "  %06x\n",
+                addrs[i].counts.cycles, _prof_percent(addrs[i].counts.cycles, total),
+                addrs[i].counts.count, addrs[i].addr);
+    }
+    free(addrs);
+
+    return !ferror(fp);
+}
+
+
+/**
+ * Write the routines on the call stack of a node, from the root
+ *
+ * @param *p The profiler
+ * @param node The node
+ * @param *fp The file to write to
+ */
+static void _prof_folded_stack(prof_t *p, uint32_t node, FILE *fp)
+{
+    char name[PROF_NAME_LEN];
+
+    if (p->nodes[node].parent != PROF_NONE) {
+        _prof_folded_stack(p, p->nodes[node].parent, fp);
+        fputc(';', fp);
+    }
+    _prof_name(p->nodes[node].key, name);
+    fputs(name, fp);
+}
+
+
+/**
+ * Write the call tree of a profile as folded stacks: a line per node
+ * with the routines on its call stack, separated by ';', and the
+ * cycles spent in it (as read by flamegraph.pl, speedscope, ...)
+ *
+ * @param *p The profiler, which may be running if prof_sync() was called
+ * @param *fp The file to write to
+ * @return False if the file could not be written
+ */
+bool prof_folded(prof_t *p, FILE *fp)
+{
+    for (uint32_t n = 0; n < p->node_count; ++n) {
+        if (p->nodes[n].self) {
+            _prof_folded_stack(p, n, fp);
+            fprintf(fp, " %" PRIu64 "\n", p->nodes[n].self);
+        }
+    }
+    return !ferror(fp);
+}
@@ -0,0 +1,115 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+#ifndef _PROF_H
+#define _PROF_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "65816.h"
+
+// Cycle counts of addresses are kept in pages of this many entries (power of 2)
+#define PROF_PAGE_LEN 4096
+#define PROF_PAGE_COUNT (0x1000000 / PROF_PAGE_LEN)
+
+// Deepest call stack followed. Deeper calls are counted in their caller.
+#define PROF_MAX_DEPTH 1024
+
+// No node / no instruction
+#define PROF_NONE 0xffffffff
+
+// How a routine was entered (bits 24 and up of a routine key)
+typedef enum prof_kind_t {
+    PROF_CALL = 0, // JSR or JSL
+    PROF_IRQ,
+    PROF_NMI,
+    PROF_BRK,
+    PROF_COP,
+    PROF_ROOT      // Whatever was running when the profile started
+} prof_kind_t;
+
+// Key of the routine at an address, entered by a prof_kind_t
+#define PROF_KEY(addr, kind) (((uint32_t)(kind) << 24) | ((addr) & 0xffffff))
+
+// What was counted at an address
+typedef struct prof_addr_t {
+    uint64_t cycles;
+    uint64_t count;      // Instructions run (exact) or samples taken there
+} prof_addr_t;
+
+// A node of the call tree: a routine, as called by the routines
+// of its parent nodes
+typedef struct prof_node_t {
+    uint32_t key;        // PROF_KEY() of the routine
+    uint32_t parent;
+    uint32_t child;      // First child, the others follow by sibling
+    uint32_t sibling;
+    uint64_t self;       // Cycles spent in the routine itself (exclusive)
+    uint64_t calls;
+} prof_node_t;
+
+// A routine on the shadow call stack
+typedef struct prof_frame_t {
+    uint32_t node;
+    uint32_t sp;         // SP of the caller, before the call pushed to it
+} prof_frame_t;
+
+// Profile of the code run by runCPU() (see CPU_t.prof). Cycles are
+// counted by address, and by node of a call tree built from a shadow
+// call stack: JSR, JSL, BRK, COP and interrupts push a routine, and
+// RTS, RTL and RTI pop every routine whose caller's stack pointer is
+// reached again, so returns which are really jumps (an address pushed
+// and returned to) do not pop anything.
+//
+// By default every instruction is counted exactly. With a sampling
+// interval, the instruction about to run and the routine on top of
+// the stack get the cycles of an interval each time the cycle count
+// passes one, and runCPU() does nothing else between samples but
+// follow calls and returns.
+typedef struct prof_t {
+    bool running;
+    uint64_t interval;   // Cycles between samples (0 = count every instruction)
+    uint64_t next;       // runCPU() calls prof_step() from this cycle count on
+    uint64_t start;      // Cycle count when the profile started
+    uint64_t steps;      // Instructions (exact) or samples counted
+
+    // Exact counting: the entry of the instruction being run, and the
+    // cycle counts that it and the routine on top of the stack were
+    // counted up to
+    prof_addr_t *cur;
+    uint64_t pc_mark;
+    uint64_t node_mark;
+
+    prof_addr_t *pages[PROF_PAGE_COUNT]; // By address, allocated when first used
+
+    // Call tree, node 0 is the root
+    prof_node_t *nodes;
+    uint32_t node_count;
+    uint32_t node_cap;
+    uint32_t *hash;      // Node + 1 by parent and key (0 = free)
+    uint32_t hash_len;   // Power of 2, at least twice node_cap
+
+    prof_frame_t stack[PROF_MAX_DEPTH];
+    int depth;
+
+    uint64_t dropped;    // Calls not followed (too deep, or out of memory)
+} prof_t;
+
+
+void prof_init(prof_t *p);
+bool prof_start(prof_t *p, CPU_t *cpu, uint64_t interval);
+void prof_stop(prof_t *p, CPU_t *cpu);
+void prof_sync(prof_t *p, CPU_t *cpu);
+void prof_free(prof_t *p);
+void prof_step(prof_t *p, uint32_t pc, uint64_t cycles);
+void prof_call(prof_t *p, CPU_t *cpu, uint8_t pushed, prof_kind_t kind);
+void prof_return(prof_t *p, CPU_t *cpu);
+uint64_t prof_total(prof_t *p);
+bool prof_report(prof_t *p, FILE *fp);
+bool prof_folded(prof_t *p, FILE *fp);
+
+#endif
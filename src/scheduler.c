@@ -0,0 +1,442 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <poll.h>
+
+#include "65816.h"
+#include "scheduler.h"
+
+
+/**
+ * Initialize an empty event queue
+ *
+ * @param *sched The queue to initialize
+ * @param *cpu The CPU the queue runs alongside, whose IRQ line is
+ *             driven by sched_set_irq() (may be NULL)
+ */
+void sched_init(scheduler_t *sched, CPU_t *cpu)
+{
+    sched->now = 0;
+    sched->count = 0;
+    sched->idle_count = 0;
+    sched->host_fd = -1;
+    sched->cpu = cpu;
+    sched->irq = 0;
+}
+
+
+/**
+ * Swap two events in the heap
+ *
+ * @param *sched The queue holding the events
+ * @param a Index of the first event
+ * @param b Index of the second event
+ */
+static void _sched_swap(scheduler_t *sched, int a, int b)
+{
+    sched_event_t tmp = sched->events[a];
+    sched->events[a] = sched->events[b];
+    sched->events[b] = tmp;
+}
+
+
+/**
+ * Move an event towards the root of the heap until it is in order
+ *
+ * @param *sched The queue holding the event
+ * @param i Index of the event
+ */
+static void _sched_sift_up(scheduler_t *sched, int i)
+{
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+
+        if (sched->events[parent].cycle <= sched->events[i].cycle) {
+            break;
+        }
+        _sched_swap(sched, parent, i);
+        i = parent;
+    }
+}
+
+
+/**
+ * Move an event away from the root of the heap until it is in order
+ *
+ * @param *sched The queue holding the event
+ * @param i Index of the event
+ */
+static void _sched_sift_down(scheduler_t *sched, int i)
+{
+    for (;;) {
+        int left = 2 * i + 1;
+        int right = left + 1;
+        int min = i;
+
+        if (left < sched->count && sched->events[left].cycle < sched->events[min].cycle) {
+            min = left;
+        }
+        if (right < sched->count && sched->events[right].cycle < sched->events[min].cycle) {
+            min = right;
+        }
+        if (min == i) {
+            break;
+        }
+        _sched_swap(sched, min, i);
+        i = min;
+    }
+}
+
+
+/**
+ * Remove the event at an index of the heap
+ *
+ * @param *sched The queue holding the event
+ * @param i Index of the event
+ */
+static void _sched_remove(scheduler_t *sched, int i)
+{
+    --sched->count;
+
+    if (i != sched->count) {
+        sched->events[i] = sched->events[sched->count];
+        _sched_sift_down(sched, i);
+        _sched_sift_up(sched, i);
+    }
+}
+
+
+/**
+ * Schedule an event for a device
+ *
+ * @param *sched The queue to add the event to
+ * @param cycle The CPU cycle count to run the event at
+ * @param fn The function to call when the event is due
+ * @param *dev The device, passed to fn
+ * @return True if scheduled, false if the queue is full
+ */
+bool sched_add(scheduler_t *sched, uint64_t cycle, sched_fn_t fn, void *dev)
+{
+    if (sched->count >= SCHED_MAX_EVENTS) {
+        return false;
+    }
+
+    sched_event_t *ev = &sched->events[sched->count];
+    ev->cycle = cycle;
+    ev->fn = fn;
+    ev->dev = dev;
+
+    _sched_sift_up(sched, sched->count++);
+    return true;
+}
+
+
+/**
+ * Let a device wake the CPU while it waits for an interrupt. Without
+ * one, a WAI only skips ahead to the device's next event, which keeps
+ * the host CPU busy if the device polls the host.
+ *
+ * @param *sched The queue to add the device to
+ * @param *dev The device, passed to fn
+ * @param fn Tells if the device is idle and what it waits on
+ * @return True if added, false if there are already SCHED_MAX_IDLE
+ */
+bool sched_add_idle(scheduler_t *sched, void *dev, sched_idle_fn_t fn)
+{
+    if (sched->idle_count >= SCHED_MAX_IDLE) {
+        return false;
+    }
+
+    sched->idle[sched->idle_count].dev = dev;
+    sched->idle[sched->idle_count].fn = fn;
+    ++sched->idle_count;
+    return true;
+}
+
+
+/**
+ * Remove all pending events (and the idle wakeup) of a device
+ *
+ * @param *sched The queue to remove the events from
+ * @param *dev The device which was passed to sched_add()
+ */
+void sched_cancel(scheduler_t *sched, void *dev)
+{
+    int i = 0;
+
+    for (int j = 0; j < sched->idle_count; ++j) {
+        if (sched->idle[j].dev == dev) {
+            sched->idle[j--] = sched->idle[--sched->idle_count];
+        }
+    }
+
+    while (i < sched->count) {
+        if (sched->events[i].dev == dev) {
+            _sched_remove(sched, i);
+            i = 0; // The heap was reordered
+        }
+        else {
+            ++i;
+        }
+    }
+}
+
+
+/**
+ * Drive one device's interrupt output. The CPU's IRQ line is the
+ * wired-OR of all outputs, so it stays asserted until every device
+ * has released it.
+ *
+ * @param *sched The queue of the CPU
+ * @param line The device's line, 0 to SCHED_IRQ_LINES - 1
+ * @param level True to assert the interrupt, false to release it
+ */
+void sched_set_irq(scheduler_t *sched, int line, bool level)
+{
+    if (level) {
+        sched->irq |= (uint32_t)1 << line;
+    }
+    else {
+        sched->irq &= ~((uint32_t)1 << line);
+    }
+
+    if (sched->cpu) {
+        sched->cpu->P.IRQ = sched->irq != 0;
+    }
+}
+
+
+/**
+ * Get the cycle count of the next pending event
+ *
+ * @param *sched The queue to check
+ * @return The cycle of the next event, or UINT64_MAX if there are none
+ */
+uint64_t sched_next(scheduler_t *sched)
+{
+    return sched->count ? sched->events[0].cycle : UINT64_MAX;
+}
+
+
+/**
+ * Get the cycle count the pending events are measured from: the CPU's,
+ * unless it went backwards since the last run (see sched_run_due())
+ *
+ * @param *sched The queue
+ * @return The cycle count
+ */
+static uint64_t _sched_base(scheduler_t *sched)
+{
+    if (sched->cpu && sched->cpu->cycles >= sched->now) {
+        return sched->cpu->cycles;
+    }
+    return sched->now;
+}
+
+
+/**
+ * Find how far away the next event of a device is (e.g. to save it)
+ *
+ * @param *sched The queue to search
+ * @param *dev The device which was passed to sched_add()
+ * @param *delay Set to the number of cycles until the event is due
+ * @return True if the device has an event pending
+ */
+bool sched_find(scheduler_t *sched, void *dev, uint64_t *delay)
+{
+    uint64_t base = _sched_base(sched);
+    bool found = false;
+
+    for (int i = 0; i < sched->count; ++i) {
+        if (sched->events[i].dev == dev) {
+            uint64_t cycle = sched->events[i].cycle;
+            uint64_t d = cycle > base ? cycle - base : 0;
+            if (!found || d < *delay) {
+                *delay = d;
+            }
+            found = true;
+        }
+    }
+    return found;
+}
+
+
+/**
+ * Schedule a callback a number of cycles from now (e.g. to restore an
+ * event found by sched_find())
+ *
+ * @param *sched The queue to add the event to
+ * @param delay The number of CPU cycles until the event is due
+ * @param fn The function to call
+ * @param *dev The device, passed to fn
+ * @return True if added, false if the queue is full
+ */
+bool sched_add_delay(scheduler_t *sched, uint64_t delay, sched_fn_t fn, void *dev)
+{
+    return sched_add(sched, _sched_base(sched) + delay, fn, dev);
+}
+
+
+/**
+ * Run all events which are due. Events scheduled by the
+ * callbacks are run too if they are already due.
+ *
+ * If the cycle count went backwards since the last run (the CPU was
+ * reset or loaded from a file), the pending events are moved along
+ * with it so they stay the same number of cycles away.
+ *
+ * @param *sched The queue to run
+ * @param now The current CPU cycle count
+ */
+void sched_run_due(scheduler_t *sched, uint64_t now)
+{
+    if (now < sched->now) {
+        // Shifting every event by the same amount keeps the heap in order
+        for (int i = 0; i < sched->count; ++i) {
+            uint64_t cycle = sched->events[i].cycle;
+            sched->events[i].cycle = cycle > sched->now ? cycle - sched->now + now : now;
+        }
+    }
+    sched->now = now;
+
+    while (sched->count && sched->events[0].cycle <= now) {
+        sched_event_t ev = sched->events[0];
+
+        _sched_remove(sched, 0);
+        ev.fn(ev.dev, now);
+    }
+}
+
+
+/**
+ * Block the host until something could wake the waiting CPU: one of
+ * the idle devices' file descriptors or the host fd becomes ready.
+ * Nothing is waited on if any pending event belongs to a device which
+ * is not idle, since skipping ahead to that event costs nothing.
+ *
+ * @param *sched The queue of the waiting CPU
+ * @return False if the host fd is ready (the caller has input to
+ *         handle) or there is nothing to wait on at all, true otherwise
+ */
+static bool _sched_wait_idle(scheduler_t *sched)
+{
+    struct pollfd fds[SCHED_MAX_IDLE + 1];
+    int nfds = 0;
+
+    for (int i = 0; i < sched->count; ++i) {
+        int j = 0;
+
+        while (j < sched->idle_count && sched->idle[j].dev != sched->events[i].dev) {
+            ++j;
+        }
+        if (j == sched->idle_count) {
+            return true; // Not a device which can be waited on
+        }
+    }
+
+    for (int i = 0; i < sched->idle_count; ++i) {
+        fds[nfds].fd = -1;
+        fds[nfds].events = 0;
+        fds[nfds].revents = 0;
+
+        if (sched->idle[i].fn(sched->idle[i].dev, &fds[nfds])) {
+            return true;
+        }
+        ++nfds;
+    }
+
+    fds[nfds].fd = sched->host_fd;
+    fds[nfds].events = POLLIN;
+    fds[nfds].revents = 0;
+    ++nfds;
+
+    int waitable = 0;
+    for (int i = 0; i < nfds; ++i) {
+        waitable += fds[i].fd >= 0;
+    }
+    if (!waitable) {
+        return false; // Nothing could ever wake the CPU
+    }
+
+    if (poll(fds, nfds, -1) < 0) {
+        return true; // Interrupted by a signal, check everything again
+    }
+    return !(fds[nfds - 1].revents & POLLIN);
+}
+
+
+/**
+ * Run a CPU with runCPU() in slices which end at the next device
+ * event, so devices only cost anything when they have work to do.
+ * While the CPU waits for an interrupt (WAI), time is skipped ahead
+ * to the next event. If there is no cycle limit and every pending event
+ * (if any) belongs to an idle device (see sched_add_idle()), the host
+ * is blocked in poll() until a device or the host fd has input, instead
+ * of spinning through the events, or returning at once to a caller
+ * which would only call again.
+ *
+ * @param *sched The device events to run alongside the CPU
+ * @param *cpu The CPU to run
+ * @param *mem The memory connected to the CPU
+ * @param max_cycles Return after this many cycles have passed (0 = no limit)
+ * @param max_inst Return after this many instructions have been run (0 = no limit)
+ * @param *stop Set to the reason the CPU stopped running (may be NULL).
+ *              CPU_STOP_WAI is only returned if there are no events
+ *              left which could raise an interrupt, no idle device
+ *              has anything left to wait on, or an idle wait was
+ *              ended by the host fd.
+ * @return The number of instructions executed
+ */
+uint64_t sched_run_cpu(scheduler_t *sched, CPU_t *cpu, memory_t *mem, uint64_t max_cycles, uint64_t max_inst, CPU_Stop_Reason_t *stop)
+{
+    uint64_t end_cycles = max_cycles ? cpu->cycles + max_cycles : UINT64_MAX;
+    uint64_t count = 0;
+    CPU_Stop_Reason_t reason;
+
+    for (;;) {
+        sched_run_due(sched, cpu->cycles);
+
+        if (max_inst && count >= max_inst) {
+            reason = CPU_STOP_INSTRUCTIONS;
+            break;
+        }
+        if (cpu->cycles >= end_cycles) {
+            reason = CPU_STOP_CYCLES;
+            break;
+        }
+
+        uint64_t slice_end = sched_next(sched);
+        if (slice_end > end_cycles) {
+            slice_end = end_cycles;
+        }
+
+        count += runCPU(cpu, mem, slice_end - cpu->cycles, max_inst ? max_inst - count : 0, &reason);
+
+        if (reason == CPU_STOP_CYCLES || reason == CPU_STOP_INSTRUCTIONS) {
+            continue; // Event due or budget used up (checked above)
+        }
+        if (reason == CPU_STOP_WAI && slice_end != UINT64_MAX) {
+            // With a cycle limit, time has to keep moving towards it
+            if (end_cycles == UINT64_MAX && !_sched_wait_idle(sched)) {
+                break; // Host input (or no input can come), still waiting
+            }
+
+            // Nothing happens until the next event
+            cpu->cycles = slice_end;
+            continue;
+        }
+        if (reason == CPU_STOP_WAI && _sched_wait_idle(sched)) {
+            continue; // No events, but the wait was not ended by the host fd
+        }
+        break;
+    }
+
+    if (stop) {
+        *stop = reason;
+    }
+    return count;
+}
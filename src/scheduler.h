@@ -0,0 +1,72 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <poll.h>
+
+#include "65816.h"
+
+// Max number of events which can be pending at once
+#define SCHED_MAX_EVENTS 32
+
+// Max number of devices which can wake an idle CPU
+#define SCHED_MAX_IDLE 8
+
+// Number of interrupt sources which can share the CPU's IRQ line
+#define SCHED_IRQ_LINES 32
+
+// Called when an event is due
+// now is the CPU cycle count the event is run at (which may be
+// slightly after the cycle it was scheduled for)
+typedef void (*sched_fn_t)(void *dev, uint64_t now);
+
+// Called while the CPU waits for an interrupt (WAI)
+// Returns true if the device still has work of its own to do, or false
+// and sets *pfd to the host file descriptor (and poll() events) which
+// has to become ready before the device can do anything (fd -1 = none)
+typedef bool (*sched_idle_fn_t)(void *dev, struct pollfd *pfd);
+
+// A device which can wake an idle CPU
+typedef struct sched_idle_t {
+    void *dev;
+    sched_idle_fn_t fn;
+} sched_idle_t;
+
+// An event for a device at an absolute CPU cycle count
+typedef struct sched_event_t {
+    uint64_t cycle;
+    sched_fn_t fn;
+    void *dev;
+} sched_event_t;
+
+// Device event queue keyed on CPU_t.cycles (binary min-heap)
+typedef struct scheduler_t {
+    uint64_t now; // Cycle count the queue was last run at
+    int count;
+    sched_event_t events[SCHED_MAX_EVENTS];
+    int idle_count;
+    sched_idle_t idle[SCHED_MAX_IDLE];
+    int host_fd; // Ends an idle wait when readable, e.g. the keyboard (-1 = none)
+    CPU_t *cpu;   // CPU the events are run alongside (may be NULL)
+    uint32_t irq; // Bit set per device holding the IRQ line low
+} scheduler_t;
+
+
+void sched_init(scheduler_t *sched, CPU_t *cpu);
+bool sched_add(scheduler_t *sched, uint64_t cycle, sched_fn_t fn, void *dev);
+bool sched_add_idle(scheduler_t *sched, void *dev, sched_idle_fn_t fn);
+void sched_cancel(scheduler_t *sched, void *dev);
+bool sched_find(scheduler_t *sched, void *dev, uint64_t *delay);
+bool sched_add_delay(scheduler_t *sched, uint64_t delay, sched_fn_t fn, void *dev);
+void sched_set_irq(scheduler_t *sched, int line, bool level);
+uint64_t sched_next(scheduler_t *sched);
+void sched_run_due(scheduler_t *sched, uint64_t now);
+uint64_t sched_run_cpu(scheduler_t *sched, CPU_t *cpu, memory_t *mem, uint64_t max_cycles, uint64_t max_inst, CPU_Stop_Reason_t *stop);
+
+#endif
@@ -0,0 +1,488 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+// Whole machine snapshots (see snapshot.h for the file format)
+//
+// Only the pages which do not read as the fill value are written, as
+// they are held in memory, so saving and loading a snapshot costs
+// about as much as copying the memory in use. Pages can optionally be
+// run length encoded, which is fast and shrinks the zeroed or padded
+// pages firmware images are mostly made of.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "snapshot.h"
+#include "65816-util.h"
+
+// Bytes of a record header (tag and length)
+#define SNAP_RECORD_LEN 8
+
+// Bytes of the payload of a SNAP_TAG_CPU record
+#define SNAP_CPU_LEN 25
+
+// Bytes of a PackBits encoded page in the worst case
+#define SNAP_PACKED_MAX (MEM_PAGE_SIZE + MEM_PAGE_SIZE / 128)
+
+// Descriptions of snap_err_t
+static const char *snap_err_msgs[] = {
+    "OK",
+    "Unable to read or write the snapshot file",
+    "Unable to allocate memory for the snapshot",
+    "Not a snapshot file, or the file is damaged",
+    "Snapshot was written by a newer version"
+};
+
+
+/**
+ * Store a little endian number
+ *
+ * @param *buf Receives len bytes
+ * @param val The number
+ * @param len Its size in bytes
+ */
+static void snap_put(uint8_t *buf, uint64_t val, int len)
+{
+    for (int i = 0; i < len; ++i) {
+        buf[i] = val >> (8 * i);
+    }
+}
+
+
+/**
+ * Load a little endian number
+ *
+ * @param *buf The len bytes of the number
+ * @param len Its size in bytes
+ * @return The number
+ */
+static uint64_t snap_get(const uint8_t *buf, int len)
+{
+    uint64_t val = 0;
+    for (int i = 0; i < len; ++i) {
+        val |= (uint64_t)buf[i] << (8 * i);
+    }
+    return val;
+}
+
+
+/**
+ * Run length encode a page (PackBits): a header byte n is followed by
+ * n + 1 literal bytes if n < 128, or by one byte repeated 257 - n
+ * times otherwise (n = 128 is not used)
+ *
+ * @param *src MEM_PAGE_SIZE bytes
+ * @param *dst Receives up to SNAP_PACKED_MAX bytes
+ * @return The encoded length
+ */
+static uint32_t snap_pack(const uint8_t *src, uint8_t *dst)
+{
+    uint32_t out = 0;
+    uint32_t i = 0;
+
+    while (i < MEM_PAGE_SIZE) {
+        uint32_t run = 1;
+        while (i + run < MEM_PAGE_SIZE && run < 128 && src[i + run] == src[i]) {
+            ++run;
+        }
+
+        if (run >= 3) {
+            dst[out++] = 257 - run;
+            dst[out++] = src[i];
+            i += run;
+            continue;
+        }
+
+        // Literals up to the next run of 3
+        uint32_t start = i;
+        while (i < MEM_PAGE_SIZE && i - start < 128) {
+            if (i + 2 < MEM_PAGE_SIZE && src[i] == src[i + 1] && src[i] == src[i + 2]) {
+                break;
+            }
+            ++i;
+        }
+        dst[out++] = i - start - 1;
+        memcpy(dst + out, src + start, i - start);
+        out += i - start;
+    }
+    return out;
+}
+
+
+/**
+ * Decode a page encoded by snap_pack()
+ *
+ * @param *src The encoded page
+ * @param len Its length
+ * @param *dst Receives MEM_PAGE_SIZE bytes (NULL to only check src)
+ * @return False if src does not decode to exactly one page
+ */
+static bool snap_unpack(const uint8_t *src, uint32_t len, uint8_t *dst)
+{
+    uint32_t out = 0;
+    uint32_t i = 0;
+
+    while (i < len) {
+        uint8_t n = src[i++];
+
+        if (n < 128) {
+            uint32_t count = n + 1;
+            if (i + count > len || out + count > MEM_PAGE_SIZE) {
+                return false;
+            }
+            if (dst) {
+                memcpy(dst + out, src + i, count);
+            }
+            i += count;
+            out += count;
+        }
+        else {
+            uint32_t count = 257 - n;
+            if (n == 128 || i >= len || out + count > MEM_PAGE_SIZE) {
+                return false;
+            }
+            if (dst) {
+                memset(dst + out, src[i], count);
+            }
+            ++i;
+            out += count;
+        }
+    }
+    return out == MEM_PAGE_SIZE;
+}
+
+
+/**
+ * Write a record
+ *
+ * @param *fp The file
+ * @param tag The record type
+ * @param *head First part of the payload
+ * @param head_len Its length
+ * @param *data Rest of the payload (may be NULL)
+ * @param data_len Its length
+ * @return False if the file could not be written
+ */
+static bool snap_write(FILE *fp, snap_tag_t tag, const uint8_t *head, uint32_t head_len,
+                       const uint8_t *data, uint32_t data_len)
+{
+    uint8_t rec[SNAP_RECORD_LEN];
+
+    snap_put(rec, tag, 4);
+    snap_put(rec + 4, head_len + data_len, 4);
+
+    return fwrite(rec, 1, sizeof(rec), fp) == sizeof(rec) &&
+        fwrite(head, 1, head_len, fp) == head_len &&
+        (!data_len || fwrite(data, 1, data_len, fp) == data_len);
+}
+
+
+/**
+ * Save the state of the machine to a snapshot file: the CPU, its
+ * options, memory and its access/breakpoint flags, and the registers
+ * and FIFOs of the enabled UARTs
+ *
+ * @param *filename The file to write
+ * @param *cpu The CPU
+ * @param *mem The memory connected to the CPU
+ * @param *uarts The UARTs (may be NULL if uart_count is 0)
+ * @param uart_count Number of UARTs
+ * @param pack True to run length encode the memory pages
+ * @return SNAP_OK, or the error which stopped the save
+ */
+snap_err_t snapshot_save(const char *filename, CPU_t *cpu, memory_t *mem, tl16c750_t *uarts, int uart_count, bool pack)
+{
+    uint8_t head[SNAP_MAGIC_LEN + 4];
+    uint8_t buf[SNAP_CPU_LEN];
+    uint8_t fill[MEM_PAGE_SIZE];
+    uint8_t no_flags[MEM_PAGE_SIZE];
+    uint8_t *packed = NULL;
+    bool ok;
+
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        return SNAP_ERR_IO;
+    }
+    if (pack && !(packed = malloc(SNAP_PACKED_MAX))) {
+        fclose(fp);
+        return SNAP_ERR_OUT_OF_MEM;
+    }
+
+    memcpy(head, SNAP_MAGIC, SNAP_MAGIC_LEN);
+    snap_put(head + SNAP_MAGIC_LEN, SNAP_VERSION, 4);
+    ok = fwrite(head, 1, sizeof(head), fp) == sizeof(head);
+
+    // CPU
+    uint8_t state = cpu->P.E | (cpu->P.RST << 1) | (cpu->P.IRQ << 2) |
+        (cpu->P.NMI << 3) | (cpu->P.STP << 4) | (cpu->P.CRASH << 5);
+    snap_put(buf, cpu->C, 2);
+    snap_put(buf + 2, cpu->X, 2);
+    snap_put(buf + 4, cpu->Y, 2);
+    snap_put(buf + 6, cpu->D, 2);
+    snap_put(buf + 8, cpu->SP, 2);
+    snap_put(buf + 10, cpu->PC, 2);
+    buf[12] = cpu->DBR;
+    buf[13] = cpu->PBR;
+    buf[14] = _cpu_get_sr(cpu);
+    buf[15] = state;
+    snap_put(buf + 16, cpu->cycles, 8);
+    buf[24] = cpu->cop_vect_enable;
+    ok = ok && snap_write(fp, SNAP_TAG_CPU, buf, SNAP_CPU_LEN, NULL, 0);
+
+    // Memory
+    buf[0] = mem->fill;
+    ok = ok && snap_write(fp, SNAP_TAG_MEM, buf, 1, NULL, 0);
+
+    memset(fill, mem->fill, sizeof(fill));
+    memset(no_flags, 0, sizeof(no_flags));
+
+    for (uint32_t i = 0; i < MEM_PAGE_COUNT && ok; ++i) {
+        const uint8_t *page = _get_mem_page(mem, i);
+        const uint8_t *flags = _get_mem_flag_page(mem, i);
+
+        if (page && memcmp(page, fill, MEM_PAGE_SIZE) != 0) {
+            uint32_t len = pack ? snap_pack(page, packed) : MEM_PAGE_SIZE;
+
+            snap_put(buf, i, 4);
+            if (len < MEM_PAGE_SIZE) {
+                buf[4] = SNAP_ENC_PACKBITS;
+                ok = snap_write(fp, SNAP_TAG_PAGE, buf, 5, packed, len);
+            }
+            else {
+                buf[4] = SNAP_ENC_RAW;
+                ok = snap_write(fp, SNAP_TAG_PAGE, buf, 5, page, MEM_PAGE_SIZE);
+            }
+        }
+        if (ok && flags && memcmp(flags, no_flags, MEM_PAGE_SIZE) != 0) {
+            snap_put(buf, i, 4);
+            ok = snap_write(fp, SNAP_TAG_FLAGS, buf, 4, flags, MEM_PAGE_SIZE);
+        }
+    }
+
+    // Devices
+    for (int i = 0; i < uart_count && ok; ++i) {
+        uint8_t uart_buf[5 + UART_STATE_LEN];
+
+        if (uarts[i].enabled) {
+            uart_buf[0] = i;
+            snap_put(uart_buf + 1, uarts[i].addr, 4);
+            save_16c750(&uarts[i], uart_buf + 5);
+            ok = snap_write(fp, SNAP_TAG_UART, uart_buf, sizeof(uart_buf), NULL, 0);
+        }
+    }
+
+    ok = ok && snap_write(fp, SNAP_TAG_END, NULL, 0, NULL, 0);
+
+    free(packed);
+    if (fclose(fp) != 0) {
+        ok = false;
+    }
+    return ok ? SNAP_OK : SNAP_ERR_IO;
+}
+
+
+/**
+ * Check the records of a snapshot before anything is loaded from it
+ *
+ * @param *buf The whole file
+ * @param len Its length
+ * @return SNAP_OK if every record is complete and valid
+ */
+static snap_err_t snap_check(const uint8_t *buf, size_t len)
+{
+    if (len < SNAP_MAGIC_LEN + 4 || memcmp(buf, SNAP_MAGIC, SNAP_MAGIC_LEN) != 0) {
+        return SNAP_ERR_FORMAT;
+    }
+    if (snap_get(buf + SNAP_MAGIC_LEN, 4) > SNAP_VERSION) {
+        return SNAP_ERR_VERSION;
+    }
+
+    size_t pos = SNAP_MAGIC_LEN + 4;
+
+    while (pos + SNAP_RECORD_LEN <= len) {
+        uint32_t tag = snap_get(buf + pos, 4);
+        uint32_t rec_len = snap_get(buf + pos + 4, 4);
+        const uint8_t *rec = buf + pos + SNAP_RECORD_LEN;
+
+        pos += SNAP_RECORD_LEN;
+        if (rec_len > len - pos) {
+            return SNAP_ERR_FORMAT;
+        }
+        pos += rec_len;
+
+        switch (tag) {
+        case SNAP_TAG_END:
+            return SNAP_OK;
+        case SNAP_TAG_CPU:
+            if (rec_len < SNAP_CPU_LEN) {
+                return SNAP_ERR_FORMAT;
+            }
+            break;
+        case SNAP_TAG_MEM:
+            if (rec_len < 1) {
+                return SNAP_ERR_FORMAT;
+            }
+            break;
+        case SNAP_TAG_PAGE:
+            if (rec_len < 5 || snap_get(rec, 4) >= MEM_PAGE_COUNT) {
+                return SNAP_ERR_FORMAT;
+            }
+            if (rec[4] == SNAP_ENC_RAW && rec_len == 5 + MEM_PAGE_SIZE) {
+                break;
+            }
+            if (rec[4] == SNAP_ENC_PACKBITS && snap_unpack(rec + 5, rec_len - 5, NULL)) {
+                break;
+            }
+            return SNAP_ERR_FORMAT;
+        case SNAP_TAG_FLAGS:
+            if (rec_len != 4 + MEM_PAGE_SIZE || snap_get(rec, 4) >= MEM_PAGE_COUNT) {
+                return SNAP_ERR_FORMAT;
+            }
+            break;
+        case SNAP_TAG_UART:
+            if (rec_len != 5 + UART_STATE_LEN || !check_16c750(rec + 5)) {
+                return SNAP_ERR_FORMAT;
+            }
+            break;
+        default: // Added by a later version
+            break;
+        }
+    }
+    return SNAP_ERR_FORMAT; // No SNAP_TAG_END
+}
+
+
+/**
+ * Load the state of the machine from a snapshot file. Memory is
+ * cleared first, so pages which are not in the snapshot read as its
+ * fill value again. The state of a UART in the snapshot is only
+ * restored if the UART with the same index is enabled at the same
+ * base address (its connection on the host is kept).
+ *
+ * @param *filename The file to read
+ * @param *cpu The CPU
+ * @param *mem The memory connected to the CPU
+ * @param *uarts The UARTs (may be NULL if uart_count is 0)
+ * @param uart_count Number of UARTs
+ * @return SNAP_OK, or the error which stopped the load. Nothing is
+ *         changed unless the whole snapshot could be read.
+ */
+snap_err_t snapshot_load(const char *filename, CPU_t *cpu, memory_t *mem, tl16c750_t *uarts, int uart_count)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        return SNAP_ERR_IO;
+    }
+
+    long size;
+    uint8_t *buf = NULL;
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0) {
+        fclose(fp);
+        return SNAP_ERR_IO;
+    }
+    if (!(buf = malloc(size ? size : 1))) {
+        fclose(fp);
+        return SNAP_ERR_OUT_OF_MEM;
+    }
+    if (fread(buf, 1, size, fp) != (size_t)size) {
+        free(buf);
+        fclose(fp);
+        return SNAP_ERR_IO;
+    }
+    fclose(fp);
+
+    snap_err_t err = snap_check(buf, size);
+    if (err != SNAP_OK) {
+        free(buf);
+        return err;
+    }
+
+    // Memory is rebuilt from the records
+    size_t pos = SNAP_MAGIC_LEN + 4;
+    uint8_t page[MEM_PAGE_SIZE];
+    bool cleared = false;
+
+    for (;;) {
+        uint32_t tag = snap_get(buf + pos, 4);
+        uint32_t rec_len = snap_get(buf + pos + 4, 4);
+        const uint8_t *rec = buf + pos + SNAP_RECORD_LEN;
+
+        pos += SNAP_RECORD_LEN + rec_len;
+
+        if (tag == SNAP_TAG_END) {
+            break;
+        }
+        if (!cleared && (tag == SNAP_TAG_MEM || tag == SNAP_TAG_PAGE || tag == SNAP_TAG_FLAGS)) {
+            _clear_mem(mem);
+            cleared = true;
+        }
+
+        switch (tag) {
+        case SNAP_TAG_CPU:
+            cpu->C = snap_get(rec, 2);
+            cpu->X = snap_get(rec + 2, 2);
+            cpu->Y = snap_get(rec + 4, 2);
+            cpu->D = snap_get(rec + 6, 2);
+            cpu->SP = snap_get(rec + 8, 2);
+            cpu->PC = snap_get(rec + 10, 2);
+            cpu->DBR = rec[12];
+            cpu->PBR = rec[13];
+            cpu->P.E = rec[15] & 1;
+            cpu->P.RST = (rec[15] >> 1) & 1;
+            cpu->P.IRQ = (rec[15] >> 2) & 1;
+            cpu->P.NMI = (rec[15] >> 3) & 1;
+            cpu->P.STP = (rec[15] >> 4) & 1;
+            cpu->P.CRASH = (rec[15] >> 5) & 1;
+            _cpu_set_sr(cpu, rec[14]); // Also updates the width mode
+            cpu->cycles = snap_get(rec + 16, 8);
+            cpu->cop_vect_enable = rec[24] & 1;
+            cpu->predecoded = false;
+            break;
+        case SNAP_TAG_MEM:
+            _set_mem_fill(mem, rec[0]);
+            break;
+        case SNAP_TAG_PAGE: {
+            uint32_t page_num = snap_get(rec, 4);
+            const uint8_t *data = rec + 5;
+
+            if (rec[4] == SNAP_ENC_PACKBITS) {
+                snap_unpack(rec + 5, rec_len - 5, page);
+                data = page;
+            }
+            _init_mem_arr(mem, (uint8_t *)data, page_num << MEM_PAGE_BITS, MEM_PAGE_SIZE);
+        }
+            break;
+        case SNAP_TAG_FLAGS:
+            _set_mem_flag_page(mem, snap_get(rec, 4), rec + 4);
+            break;
+        case SNAP_TAG_UART: {
+            int i = rec[0];
+            // load_16c750() can not fail, snap_check() checked the state
+            if (i < uart_count && uarts[i].enabled && uarts[i].addr == snap_get(rec + 1, 4)) {
+                load_16c750(&uarts[i], rec + 5);
+            }
+        }
+            break;
+        default:
+            break;
+        }
+    }
+
+    free(buf);
+    return SNAP_OK;
+}
+
+
+/**
+ * Describe an error of snapshot_save() or snapshot_load()
+ *
+ * @param err The error
+ * @return The description
+ */
+const char *snapshot_strerror(snap_err_t err)
+{
+    return snap_err_msgs[err];
+}
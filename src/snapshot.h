@@ -0,0 +1,55 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "65816.h"
+#include "16C750.h"
+
+// First bytes of a snapshot file (including the terminator)
+#define SNAP_MAGIC "816SNAP"
+#define SNAP_MAGIC_LEN 8
+
+// Format version, increased whenever the layout of a record changes
+#define SNAP_VERSION 1
+
+// A snapshot file is the magic, the version (32-bit) and a list of
+// records, each a 32-bit tag, a 32-bit payload length and the payload.
+// All numbers are little endian. Records with unknown tags are skipped
+// when loading, so newer versions can add records.
+typedef enum snap_tag_t {
+    SNAP_TAG_END = 0,   // Last record (no payload)
+    SNAP_TAG_CPU,       // Registers, flags, cycle count and options
+    SNAP_TAG_MEM,       // Fill value (8-bit)
+    SNAP_TAG_PAGE,      // Page number (32-bit), encoding (8-bit), data
+    SNAP_TAG_FLAGS,     // Page number (32-bit), MEM_PAGE_SIZE flag bytes
+    SNAP_TAG_UART       // UART index (8-bit), UART_STATE_LEN bytes
+} snap_tag_t;
+
+// Encodings of a SNAP_TAG_PAGE record
+typedef enum snap_enc_t {
+    SNAP_ENC_RAW = 0,   // MEM_PAGE_SIZE bytes
+    SNAP_ENC_PACKBITS   // Run length encoded (PackBits)
+} snap_enc_t;
+
+// Errors of snapshot_save() and snapshot_load()
+typedef enum snap_err_t {
+    SNAP_OK = 0,
+    SNAP_ERR_IO,        // The file could not be opened, read or written
+    SNAP_ERR_OUT_OF_MEM,
+    SNAP_ERR_FORMAT,    // Not a snapshot, or a damaged one
+    SNAP_ERR_VERSION    // Written by a newer version of the format
+} snap_err_t;
+
+
+snap_err_t snapshot_save(const char *filename, CPU_t *cpu, memory_t *mem, tl16c750_t *uarts, int uart_count, bool pack);
+snap_err_t snapshot_load(const char *filename, CPU_t *cpu, memory_t *mem, tl16c750_t *uarts, int uart_count);
+const char *snapshot_strerror(snap_err_t err);
+
+#endif
@@ -0,0 +1,427 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "65816.h"
+#include "65816-util.h"
+#include "scheduler.h"
+#include "16C750.h"
+#include "timeline.h"
+
+
+/**
+ * Set up a timeline for a machine (disabled, see timeline_enable())
+ *
+ * @param *tl The timeline to set up
+ * @param *cpu The CPU of the machine
+ * @param *mem Its memory
+ * @param *sched Its device events (run alongside the CPU)
+ * @param *uarts Its UARTs
+ * @param uart_count Number of UARTs (only the first TIMELINE_MAX_UARTS
+ *                   are recorded)
+ */
+void timeline_init(timeline_t *tl, CPU_t *cpu, memory_t *mem, scheduler_t *sched, tl16c750_t *uarts, int uart_count)
+{
+    memset(tl, 0, sizeof(*tl));
+    tl->cpu = cpu;
+    tl->mem = mem;
+    tl->sched = sched;
+    tl->uarts = uarts;
+    tl->uart_count = uart_count < TIMELINE_MAX_UARTS ? uart_count : TIMELINE_MAX_UARTS;
+    tl->interval = TIMELINE_DEFAULT_INTERVAL;
+}
+
+
+/**
+ * Drop all checkpoints of a timeline
+ *
+ * @param *tl The timeline
+ */
+static void _timeline_free_ckpts(timeline_t *tl)
+{
+    for (int i = 0; i < tl->count; ++i) {
+        _free_mem_checkpoint(&tl->ckpt[i].mem);
+    }
+    tl->count = 0;
+}
+
+
+/**
+ * Take a checkpoint of the machine at the point the CPU is at. If all
+ * checkpoints are in use, every other one is dropped first (except the
+ * first) and the interval between them is doubled.
+ *
+ * @param *tl The timeline
+ * @return False if out of memory
+ */
+static bool _timeline_save(timeline_t *tl)
+{
+    if (tl->count == TIMELINE_MAX_CKPTS) {
+        int kept = 1;
+
+        for (int i = 1; i < tl->count; ++i) {
+            if (i % 2 == 0) {
+                tl->ckpt[kept++] = tl->ckpt[i];
+            } else {
+                _free_mem_checkpoint(&tl->ckpt[i].mem);
+            }
+        }
+        tl->count = kept;
+        tl->interval *= 2;
+    }
+
+    timeline_ckpt_t *ckpt = &tl->ckpt[tl->count];
+
+    if (!_save_mem_checkpoint(tl->mem, &ckpt->mem)) {
+        return false;
+    }
+
+    ckpt->inst = tl->inst;
+    ckpt->cpu = *tl->cpu;
+    ckpt->sched = *tl->sched;
+
+    for (int i = 0; i < tl->uart_count; ++i) {
+        if (tl->uarts[i].enabled) {
+            save_16c750(&tl->uarts[i], ckpt->uart[i]);
+        }
+        ckpt->rx_pos[i] = tl->rx_log[i].pos;
+        ckpt->rx_seq[i] = tl->rx_log[i].seq;
+    }
+
+    ++tl->count;
+    return true;
+}
+
+
+/**
+ * Put the machine back to a checkpoint. Chars the UARTs take from then
+ * on come from their logs, and what they send is dropped up to the
+ * furthest point run to (since it was sent already).
+ *
+ * @param *tl The timeline
+ * @param index The checkpoint to restore
+ * @return False if out of memory (the machine is in an unknown state)
+ */
+static bool _timeline_restore(timeline_t *tl, int index)
+{
+    timeline_ckpt_t *ckpt = &tl->ckpt[index];
+    CPU_t *cpu = tl->cpu;
+
+    if (!_load_mem_checkpoint(tl->mem, &ckpt->mem)) {
+        return false;
+    }
+
+    // Options which are not part of the run stay as they are
+    struct jit_t *jit = cpu->jit;
+    struct icache_t *icache = cpu->icache;
+    struct trace_t *trace = cpu->trace;
+    struct prof_t *prof = cpu->prof;
+    int host_fd = tl->sched->host_fd;
+
+    *cpu = ckpt->cpu;
+    cpu->jit = jit;
+    cpu->icache = icache;
+    cpu->trace = trace;
+    cpu->prof = prof;
+    *tl->sched = ckpt->sched;
+    tl->sched->host_fd = host_fd;
+
+    for (int i = 0; i < tl->uart_count; ++i) {
+        if (tl->uarts[i].enabled) {
+            load_16c750(&tl->uarts[i], ckpt->uart[i]);
+        }
+        tl->rx_log[i].pos = ckpt->rx_pos[i];
+        tl->rx_log[i].seq = ckpt->rx_seq[i];
+        tl->rx_log[i].replay_until = tl->end_cycles;
+    }
+
+    tl->inst = ckpt->inst;
+    return true;
+}
+
+
+/**
+ * Start recording a timeline of a machine, from the point it is at
+ *
+ * @param *tl The timeline
+ * @param interval Cycles between checkpoints (0 = TIMELINE_DEFAULT_INTERVAL)
+ * @return False if out of memory (the timeline is left disabled)
+ */
+bool timeline_enable(timeline_t *tl, uint64_t interval)
+{
+    if (!tl->ckpt) {
+        tl->ckpt = malloc(TIMELINE_MAX_CKPTS * sizeof(*tl->ckpt));
+
+        if (!tl->ckpt) {
+            return false;
+        }
+    }
+
+    tl->interval = interval ? interval : TIMELINE_DEFAULT_INTERVAL;
+    tl->enabled = true;
+
+    for (int i = 0; i < tl->uart_count; ++i) {
+        tl->uarts[i].rx_log = &tl->rx_log[i];
+    }
+
+    if (!timeline_reset(tl)) {
+        timeline_disable(tl);
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Stop recording a timeline and free its checkpoints and logs
+ *
+ * @param *tl The timeline
+ */
+void timeline_disable(timeline_t *tl)
+{
+    _timeline_free_ckpts(tl);
+    free(tl->ckpt);
+    tl->ckpt = NULL;
+
+    for (int i = 0; i < tl->uart_count; ++i) {
+        tl->uarts[i].rx_log = NULL;
+        free(tl->rx_log[i].entry);
+        memset(&tl->rx_log[i], 0, sizeof(tl->rx_log[i]));
+    }
+
+    tl->inst = 0;
+    tl->end_inst = 0;
+    tl->enabled = false;
+}
+
+
+/**
+ * Forget everything recorded and start again from the point the CPU is
+ * at. Needed whenever the machine is changed other than by running it.
+ *
+ * @param *tl The timeline
+ * @return False if out of memory (nothing can be gone back to)
+ */
+bool timeline_reset(timeline_t *tl)
+{
+    if (!tl->enabled) {
+        return true;
+    }
+
+    _timeline_free_ckpts(tl);
+
+    for (int i = 0; i < tl->uart_count; ++i) {
+        tl->rx_log[i].len = 0;
+        tl->rx_log[i].pos = 0;
+        tl->rx_log[i].seq = 0;
+        tl->rx_log[i].replay_until = 0;
+    }
+
+    tl->inst = 0;
+    tl->end_inst = 0;
+    tl->end_cycles = tl->cpu->cycles;
+
+    return _timeline_save(tl);
+}
+
+
+/**
+ * Run the CPU with sched_run_cpu(), and take a checkpoint afterwards
+ * if this is further than the timeline got before and the interval
+ * has passed since the last checkpoint
+ *
+ * @param *tl The timeline
+ * @param max_cycles Return after this many cycles have passed (0 = no limit)
+ * @param max_inst Return after this many instructions have been run (0 = no limit)
+ * @param *stop Set to why the CPU stopped (may be NULL)
+ * @return The number of instructions run
+ */
+uint64_t timeline_run(timeline_t *tl, uint64_t max_cycles, uint64_t max_inst, CPU_Stop_Reason_t *stop)
+{
+    uint64_t count = sched_run_cpu(tl->sched, tl->cpu, tl->mem, max_cycles, max_inst, stop);
+
+    if (!tl->enabled) {
+        return count;
+    }
+
+    tl->inst += count;
+
+    if (tl->inst >= tl->end_inst) {
+        tl->end_inst = tl->inst;
+        tl->end_cycles = tl->cpu->cycles;
+
+        // Without a checkpoint (out of memory) try again on the next run
+        if (tl->count == 0 || tl->cpu->cycles - tl->ckpt[tl->count - 1].cpu.cycles >= tl->interval) {
+            _timeline_save(tl);
+        }
+    }
+    return count;
+}
+
+
+/**
+ * Run the CPU forward to a point of the timeline
+ *
+ * @param *tl The timeline
+ * @param inst The point (at or after the CPU)
+ * @return False if the CPU stopped before the point
+ */
+static bool _timeline_run_to(timeline_t *tl, uint64_t inst)
+{
+    CPU_Stop_Reason_t stop;
+
+    while (tl->inst < inst) {
+        uint64_t count = timeline_run(tl, 0, inst - tl->inst, &stop);
+
+        if (count == 0 && stop != CPU_STOP_BREAKPOINT) {
+            return false; // Stopped (STP), or waiting on the host
+        }
+    }
+    return true;
+}
+
+
+/**
+ * Put the machine at a point of the timeline, by restoring the
+ * checkpoint before it and running the CPU up to it. The time this
+ * takes is bounded by the interval between checkpoints.
+ *
+ * @param *tl The timeline
+ * @param inst The point, in instructions since the timeline was
+ *             started (points after the furthest one run to are
+ *             clamped to it)
+ * @return False if the point was not reached
+ */
+bool timeline_seek(timeline_t *tl, uint64_t inst)
+{
+    if (!tl->enabled || tl->count == 0) {
+        return false;
+    }
+    if (inst > tl->end_inst) {
+        inst = tl->end_inst;
+    }
+
+    int i = tl->count - 1;
+    while (i > 0 && tl->ckpt[i].inst > inst) {
+        --i;
+    }
+
+    tl->moved = true;
+
+    // Only go back when running on from here would take longer
+    if (inst < tl->inst || tl->ckpt[i].inst > tl->inst) {
+        if (!_timeline_restore(tl, i)) {
+            return false;
+        }
+    }
+    return _timeline_run_to(tl, inst);
+}
+
+
+/**
+ * Go back to the last time the CPU reached a breakpoint before the
+ * point it is at. Each interval between checkpoints is run again,
+ * going backwards, until one with a breakpoint in it is found.
+ *
+ * @param *tl The timeline
+ * @return False if there was no breakpoint (the machine is put at the
+ *         start of the timeline)
+ */
+bool timeline_reverse_continue(timeline_t *tl)
+{
+    if (!tl->enabled || tl->count == 0) {
+        return false;
+    }
+
+    uint64_t end = tl->inst;
+    int i = tl->count - 1;
+
+    tl->moved = true;
+
+    while (i >= 0) {
+        if (tl->ckpt[i].inst >= end) {
+            --i;
+            continue;
+        }
+        if (!_timeline_restore(tl, i)) {
+            return false;
+        }
+
+        // Find the last breakpoint from the checkpoint up to end
+        uint64_t found = UINT64_MAX;
+        CPU_Stop_Reason_t stop = CPU_STOP_INSTRUCTIONS;
+
+        if (_test_mem_flags(tl->mem, _cpu_get_effective_pc(tl->cpu)).B) {
+            found = tl->inst;
+        }
+        while (tl->inst < end) {
+            uint64_t count = timeline_run(tl, 0, end - tl->inst, &stop);
+
+            if (stop == CPU_STOP_BREAKPOINT && tl->inst < end) {
+                found = tl->inst;
+            }
+            else if (count == 0) {
+                break;
+            }
+        }
+
+        if (found != UINT64_MAX) {
+            return timeline_seek(tl, found);
+        }
+
+        end = tl->ckpt[i].inst;
+        --i;
+    }
+
+    timeline_seek(tl, tl->ckpt[0].inst);
+    return false;
+}
+
+
+/**
+ * Put the machine at the first instruction boundary at or after a
+ * cycle count. Cycle counts past the furthest point run to are run
+ * to (breakpoints do not stop the CPU).
+ *
+ * @param *tl The timeline
+ * @param cycles The CPU cycle count
+ * @return False if the cycle count was not reached (the CPU stopped,
+ *         or it is before the start of the timeline)
+ */
+bool timeline_goto_cycle(timeline_t *tl, uint64_t cycles)
+{
+    CPU_t *cpu = tl->cpu;
+
+    if (!tl->enabled || tl->count == 0) {
+        return false;
+    }
+
+    int i = tl->count - 1;
+    while (i > 0 && tl->ckpt[i].cpu.cycles > cycles) {
+        --i;
+    }
+
+    tl->moved = true;
+
+    if (cycles < cpu->cycles || tl->ckpt[i].cpu.cycles > cpu->cycles) {
+        if (!_timeline_restore(tl, i)) {
+            return false;
+        }
+    }
+
+    while (cpu->cycles < cycles) {
+        CPU_Stop_Reason_t stop;
+        uint64_t count = timeline_run(tl, cycles - cpu->cycles, 0, &stop);
+
+        if (count == 0 && stop != CPU_STOP_CYCLES && stop != CPU_STOP_BREAKPOINT) {
+            return false;
+        }
+    }
+    return tl->ckpt[0].cpu.cycles <= cycles;
+}
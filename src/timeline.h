@@ -0,0 +1,73 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+#ifndef _TIMELINE_H
+#define _TIMELINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "65816.h"
+#include "scheduler.h"
+#include "16C750.h"
+
+// Cycles between checkpoints when a timeline is enabled
+#define TIMELINE_DEFAULT_INTERVAL 1000000
+
+// Max number of checkpoints kept. When full, every other checkpoint
+// is dropped and the interval is doubled.
+#define TIMELINE_MAX_CKPTS 256
+
+// Max number of UARTs whose state and input are kept
+#define TIMELINE_MAX_UARTS 8
+
+// The machine at one point of a timeline
+typedef struct timeline_ckpt_t {
+    uint64_t inst;           // Instructions run before this point
+    CPU_t cpu;
+    scheduler_t sched;
+    mem_checkpoint_t mem;
+    uint8_t uart[TIMELINE_MAX_UARTS][UART_STATE_LEN]; // Enabled UARTs only
+    size_t rx_pos[TIMELINE_MAX_UARTS];
+    uint64_t rx_seq[TIMELINE_MAX_UARTS];
+} timeline_ckpt_t;
+
+// Checkpoints taken while the CPU runs, and the chars the UARTs take
+// from the host. Any earlier point of the run can be gone back to, by
+// restoring the checkpoint before it and running the CPU again up to
+// the point (the run repeats exactly, since the chars are taken from
+// the log). Points are counted in instructions run since the timeline
+// was started.
+// Everything the CPU runs while a timeline is enabled has to go
+// through timeline_run(). After the machine is changed in any other
+// way, timeline_reset() has to be called.
+typedef struct timeline_t {
+    bool enabled;
+    CPU_t *cpu;
+    memory_t *mem;
+    scheduler_t *sched;
+    tl16c750_t *uarts;
+    int uart_count;
+    uint64_t interval;   // Cycles between checkpoints
+    uint64_t inst;       // Point the CPU is at
+    uint64_t end_inst;   // Furthest point run to
+    uint64_t end_cycles; // Cycle count at end_inst
+    bool moved;          // Set when the CPU is moved to another point (cleared by the user)
+    int count;           // Checkpoints in ckpt[] (ordered by point)
+    timeline_ckpt_t *ckpt;
+    uart_rx_log_t rx_log[TIMELINE_MAX_UARTS];
+} timeline_t;
+
+
+void timeline_init(timeline_t *tl, CPU_t *cpu, memory_t *mem, scheduler_t *sched, tl16c750_t *uarts, int uart_count);
+bool timeline_enable(timeline_t *tl, uint64_t interval);
+void timeline_disable(timeline_t *tl);
+bool timeline_reset(timeline_t *tl);
+uint64_t timeline_run(timeline_t *tl, uint64_t max_cycles, uint64_t max_inst, CPU_Stop_Reason_t *stop);
+bool timeline_seek(timeline_t *tl, uint64_t inst);
+bool timeline_reverse_continue(timeline_t *tl);
+bool timeline_goto_cycle(timeline_t *tl, uint64_t cycles);
+
+#endif
@@ -0,0 +1,789 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "65816.h"
+#include "65816-util.h"
+#include "disassembler.h"
+#include "trace.h"
+
+// Longest encoding of a record
+#define TRACE_REC_MAX_LEN 64
+
+// The writer releases ring entries in batches of this many records
+#define TRACE_RELEASE_BATCH 1024
+
+// The CPU thread wakes the writer each time this many records were
+// put in the ring (and when it fills up)
+#define TRACE_WAKE_BATCH (TRACE_RING_LEN / 2)
+
+
+/**
+ * Put a value in a buffer, little endian
+ *
+ * @param *buf The buffer
+ * @param val The value
+ * @param len Its length in bytes
+ */
+static void _trace_put(uint8_t *buf, uint64_t val, int len)
+{
+    for (int i = 0; i < len; ++i) {
+        buf[i] = (val >> (i * 8)) & 0xff;
+    }
+}
+
+
+/**
+ * Put an unsigned varint (7 bits per byte, low bits first) in a buffer
+ *
+ * @param *buf The buffer
+ * @param val The value
+ * @return The number of bytes used
+ */
+static size_t _trace_put_uvar(uint8_t *buf, uint64_t val)
+{
+    size_t len = 0;
+
+    while (val >= 0x80) {
+        buf[len++] = (val & 0x7f) | 0x80;
+        val >>= 7;
+    }
+    buf[len++] = val;
+    return len;
+}
+
+
+/**
+ * Put a signed varint (zigzag encoded, so small negative values are
+ * short too) in a buffer
+ *
+ * @param *buf The buffer
+ * @param val The value
+ * @return The number of bytes used
+ */
+static size_t _trace_put_svar(uint8_t *buf, int64_t val)
+{
+    return _trace_put_uvar(buf, ((uint64_t)val << 1) ^ (uint64_t)(val >> 63));
+}
+
+
+/**
+ * Get an unsigned varint from a buffer
+ *
+ * @param *buf The buffer
+ * @param len Bytes left in it
+ * @param *pos Offset of the varint, moved past it
+ * @param *val Set to the value
+ * @return False if the buffer ends first
+ */
+static bool _trace_get_uvar(const uint8_t *buf, size_t len, size_t *pos, uint64_t *val)
+{
+    *val = 0;
+
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*pos >= len) {
+            return false;
+        }
+        uint8_t b = buf[(*pos)++];
+
+        *val |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Get a signed varint from a buffer
+ *
+ * @see _trace_get_uvar()
+ */
+static bool _trace_get_svar(const uint8_t *buf, size_t len, size_t *pos, int64_t *val)
+{
+    uint64_t u;
+
+    if (!_trace_get_uvar(buf, len, pos, &u)) {
+        return false;
+    }
+    *val = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+    return true;
+}
+
+
+/**
+ * Set up a trace model with nothing seen yet
+ *
+ * @param *m The model
+ * @return False if out of memory
+ */
+bool trace_model_init(trace_model_t *m)
+{
+    memset(&m->last, 0, sizeof(m->last));
+    m->last.ea = TRACE_NO_EA;
+    m->pred = calloc(TRACE_PRED_LEN, sizeof(*m->pred));
+
+    if (!m->pred) {
+        return false;
+    }
+    for (int i = 0; i < TRACE_PRED_LEN; ++i) {
+        m->pred[i].ea = TRACE_NO_EA;
+    }
+    return true;
+}
+
+
+/**
+ * Free the predictions of a trace model
+ *
+ * @param *m The model
+ */
+void trace_model_free(trace_model_t *m)
+{
+    free(m->pred);
+    m->pred = NULL;
+}
+
+
+/**
+ * Get the registers of a record which are kept as changes
+ *
+ * @param *rec The record
+ * @param *reg Set to C, X, Y, SP and D
+ */
+static void _trace_regs(const trace_rec_t *rec, uint16_t *reg)
+{
+    reg[0] = rec->C;
+    reg[1] = rec->X;
+    reg[2] = rec->Y;
+    reg[3] = rec->SP;
+    reg[4] = rec->D;
+}
+
+
+/**
+ * Add a record to a trace model (after it is encoded or decoded)
+ *
+ * @param *m The model
+ * @param *rec The record
+ */
+static void _trace_model_update(trace_model_t *m, const trace_rec_t *rec)
+{
+    trace_pred_t *prev = &m->pred[m->last.pc & (TRACE_PRED_LEN - 1)];
+    trace_pred_t *cur = &m->pred[rec->pc & (TRACE_PRED_LEN - 1)];
+    uint16_t reg[5], last_reg[5];
+
+    _trace_regs(rec, reg);
+    _trace_regs(&m->last, last_reg);
+
+    prev->next_pc = rec->pc;
+    prev->cycles = rec->cycles - m->last.cycles;
+    for (int i = 0; i < 5; ++i) {
+        prev->dreg[i] = reg[i] - last_reg[i];
+    }
+    prev->P = rec->P;
+    prev->DBR = rec->DBR;
+
+    memcpy(cur->inst, rec->inst, sizeof(cur->inst));
+    cur->stride = rec->ea - cur->ea;
+    cur->ea = rec->ea;
+    cur->val = rec->val;
+
+    m->last = *rec;
+}
+
+
+/**
+ * Encode a record, as a mask of the fields the model did not predict
+ * (see trace_field_t) followed by them
+ *
+ * @param *m The model, which the record is added to
+ * @param *rec The record
+ * @param *buf The buffer to encode it to (at least TRACE_REC_MAX_LEN bytes)
+ * @return The number of bytes used
+ */
+size_t trace_encode(trace_model_t *m, const trace_rec_t *rec, uint8_t *buf)
+{
+    const trace_rec_t *last = &m->last;
+    const trace_pred_t *prev = &m->pred[last->pc & (TRACE_PRED_LEN - 1)];
+    const trace_pred_t *cur = &m->pred[rec->pc & (TRACE_PRED_LEN - 1)];
+    uint16_t reg[5], last_reg[5], dreg[5];
+    uint64_t cycles = rec->cycles - last->cycles;
+    uint32_t inst, cur_inst;
+    uint32_t mask;
+
+    _trace_regs(rec, reg);
+    _trace_regs(last, last_reg);
+    for (int i = 0; i < 5; ++i) {
+        dreg[i] = reg[i] - last_reg[i];
+    }
+    memcpy(&inst, rec->inst, sizeof(inst));
+    memcpy(&cur_inst, cur->inst, sizeof(cur_inst));
+
+    // Mostly the same as the last time, so the mask is worked out
+    // without branches first
+    mask = (dreg[0] != prev->dreg[0]) << TRACE_F_C |
+        (cycles != prev->cycles) << TRACE_F_CYCLES |
+        (rec->P != prev->P) << TRACE_F_P |
+        (rec->pc != prev->next_pc) << TRACE_F_PC |
+        (rec->val != cur->val) << TRACE_F_VAL |
+        (rec->ea != cur->ea + cur->stride) << TRACE_F_EA |
+        (dreg[1] != prev->dreg[1]) << TRACE_F_X |
+        (dreg[2] != prev->dreg[2]) << TRACE_F_Y |
+        (dreg[3] != prev->dreg[3]) << TRACE_F_SP |
+        (dreg[4] != prev->dreg[4]) << TRACE_F_D |
+        (rec->DBR != prev->DBR) << TRACE_F_DBR |
+        (inst != cur_inst) << TRACE_F_INST;
+
+    size_t len = _trace_put_uvar(buf, mask);
+
+    // Then the fields which were not predicted, in the order of trace_field_t
+    for (int f = 0; mask >> f; ++f) {
+        if (!(mask & (1 << f))) {
+            continue;
+        }
+        switch (f) {
+        case TRACE_F_C:
+            len += _trace_put_svar(buf + len, (int16_t)dreg[0]);
+            break;
+        case TRACE_F_CYCLES:
+            len += _trace_put_svar(buf + len, (int64_t)cycles);
+            break;
+        case TRACE_F_P:
+            len += _trace_put_uvar(buf + len, rec->P);
+            break;
+        case TRACE_F_PC:
+            len += _trace_put_svar(buf + len, (int32_t)(rec->pc - last->pc));
+            break;
+        case TRACE_F_VAL:
+            len += _trace_put_svar(buf + len, (int16_t)(rec->val - cur->val));
+            break;
+        case TRACE_F_EA:
+            len += _trace_put_svar(buf + len, (int32_t)(rec->ea - cur->ea));
+            break;
+        case TRACE_F_X:
+        case TRACE_F_Y:
+        case TRACE_F_SP:
+        case TRACE_F_D:
+            len += _trace_put_svar(buf + len, (int16_t)dreg[f - TRACE_F_X + 1]);
+            break;
+        case TRACE_F_DBR:
+            buf[len++] = rec->DBR;
+            break;
+        case TRACE_F_INST:
+            memcpy(buf + len, rec->inst, sizeof(rec->inst));
+            len += sizeof(rec->inst);
+            break;
+        }
+    }
+
+    _trace_model_update(m, rec);
+    return len;
+}
+
+
+/**
+ * Decode a record encoded by trace_encode()
+ *
+ * @param *m The model, which the record is added to
+ * @param *buf The encoded record
+ * @param len Bytes left in the buffer
+ * @param *rec Set to the record
+ * @return The number of bytes used (0 if the buffer ends first)
+ */
+size_t trace_decode(trace_model_t *m, const uint8_t *buf, size_t len, trace_rec_t *rec)
+{
+    const trace_rec_t *last = &m->last;
+    const trace_pred_t *prev = &m->pred[last->pc & (TRACE_PRED_LEN - 1)];
+    const trace_pred_t *cur = NULL;
+    uint16_t reg[5], last_reg[5];
+    uint64_t mask, u;
+    int64_t s;
+    size_t pos = 0;
+
+    if (!_trace_get_uvar(buf, len, &pos, &mask)) {
+        return 0;
+    }
+    _trace_regs(last, last_reg);
+
+    // Fields are in the same order as they were encoded in, and the ones
+    // predicted from the record's own address come after the address
+    for (int f = 0; f < TRACE_FIELD_COUNT; ++f) {
+        bool miss = mask & (1 << f);
+
+        switch (f) {
+        case TRACE_F_C:
+        case TRACE_F_X:
+        case TRACE_F_Y:
+        case TRACE_F_SP:
+        case TRACE_F_D: {
+            int i = (f == TRACE_F_C) ? 0 : f - TRACE_F_X + 1;
+
+            if (miss && !_trace_get_svar(buf, len, &pos, &s)) {
+                return 0;
+            }
+            reg[i] = last_reg[i] + (miss ? (uint16_t)s : prev->dreg[i]);
+        }
+            break;
+        case TRACE_F_CYCLES:
+            if (miss && !_trace_get_svar(buf, len, &pos, &s)) {
+                return 0;
+            }
+            rec->cycles = last->cycles + (miss ? (uint64_t)s : prev->cycles);
+            break;
+        case TRACE_F_P:
+            if (miss && !_trace_get_uvar(buf, len, &pos, &u)) {
+                return 0;
+            }
+            rec->P = miss ? u : prev->P;
+            break;
+        case TRACE_F_PC:
+            if (miss && !_trace_get_svar(buf, len, &pos, &s)) {
+                return 0;
+            }
+            rec->pc = miss ? last->pc + (uint32_t)s : prev->next_pc;
+            cur = &m->pred[rec->pc & (TRACE_PRED_LEN - 1)];
+            break;
+        case TRACE_F_VAL:
+            if (miss && !_trace_get_svar(buf, len, &pos, &s)) {
+                return 0;
+            }
+            rec->val = cur->val + (miss ? (uint16_t)s : 0);
+            break;
+        case TRACE_F_EA:
+            if (miss && !_trace_get_svar(buf, len, &pos, &s)) {
+                return 0;
+            }
+            rec->ea = cur->ea + (miss ? (uint32_t)s : cur->stride);
+            break;
+        case TRACE_F_DBR:
+            if (miss && pos >= len) {
+                return 0;
+            }
+            rec->DBR = miss ? buf[pos++] : prev->DBR;
+            break;
+        case TRACE_F_INST:
+            if (miss && pos + sizeof(rec->inst) > len) {
+                return 0;
+            }
+            memcpy(rec->inst, miss ? buf + pos : cur->inst, sizeof(rec->inst));
+            pos += miss ? sizeof(rec->inst) : 0;
+            break;
+        }
+    }
+
+    rec->C = reg[0];
+    rec->X = reg[1];
+    rec->Y = reg[2];
+    rec->SP = reg[3];
+    rec->D = reg[4];
+
+    _trace_model_update(m, rec);
+    return pos;
+}
+
+
+/**
+ * Write the block of records the writer has collected
+ *
+ * @param *tr The trace
+ */
+static void _trace_flush(trace_t *tr)
+{
+    if (tr->block_count == 0) {
+        return;
+    }
+
+    _trace_put(tr->block, tr->block_len, 4);
+    _trace_put(tr->block + 4, tr->block_count, 4);
+
+    if (fwrite(tr->block, TRACE_BLOCK_HEAD_LEN + tr->block_len, 1, tr->fp) != 1) {
+        tr->io_error = true;
+    }
+
+    atomic_fetch_add(&tr->records, tr->block_count);
+    atomic_fetch_add(&tr->bytes, TRACE_BLOCK_HEAD_LEN + tr->block_len);
+    tr->block_len = 0;
+    tr->block_count = 0;
+}
+
+
+/**
+ * Release ring entries the writer is done with, and wake the CPU
+ * thread if it is waiting for them (writer)
+ *
+ * @param *tr The trace
+ * @param tail The new tail of the ring
+ */
+static void _trace_release(trace_t *tr, uint32_t tail)
+{
+    atomic_store(&tr->tail, tail);
+
+    if (atomic_load(&tr->cpu_waiting)) {
+        pthread_mutex_lock(&tr->lock);
+        pthread_cond_signal(&tr->space);
+        pthread_mutex_unlock(&tr->lock);
+    }
+}
+
+
+/**
+ * Wait for the CPU thread to put records in the ring, or to stop the
+ * trace (writer)
+ *
+ * @param *tr The trace
+ * @param tail The tail of the ring (which the head is at)
+ */
+static void _trace_writer_wait(trace_t *tr, uint32_t tail)
+{
+    pthread_mutex_lock(&tr->lock);
+    atomic_store(&tr->writer_idle, true);
+
+    while (atomic_load(&tr->head) == tail && !atomic_load(&tr->stop)) {
+        pthread_cond_wait(&tr->wake, &tr->lock);
+    }
+
+    atomic_store(&tr->writer_idle, false);
+    pthread_mutex_unlock(&tr->lock);
+}
+
+
+/**
+ * Writer thread: encodes the records in the ring and writes them
+ * out, until the trace is stopped and the ring is empty
+ *
+ * @param *arg The trace
+ * @return NULL
+ */
+static void *_trace_write(void *arg)
+{
+    trace_t *tr = arg;
+    uint32_t tail = 0;
+
+    for (;;) {
+        // Stop is checked first, so records put in the ring before it was
+        // set are always seen
+        bool stop = atomic_load(&tr->stop);
+        uint32_t head = atomic_load_explicit(&tr->head, memory_order_acquire);
+
+        if (tail == head) {
+            if (stop) {
+                break;
+            }
+            _trace_writer_wait(tr, tail);
+            continue;
+        }
+
+        while (tail != head) {
+            uint8_t *dst = tr->block + TRACE_BLOCK_HEAD_LEN + tr->block_len;
+
+            tr->block_len += trace_encode(&tr->model, &tr->ring[tail & (TRACE_RING_LEN - 1)], dst);
+            ++tr->block_count;
+            ++tail;
+
+            if (tr->block_len >= TRACE_BLOCK_LEN) {
+                _trace_flush(tr);
+            }
+            if ((tail % TRACE_RELEASE_BATCH) == 0) {
+                _trace_release(tr, tail);
+            }
+        }
+        _trace_release(tr, tail);
+    }
+
+    _trace_flush(tr);
+    return NULL;
+}
+
+
+/**
+ * Set up a trace which is not running, recording every instruction
+ * without memory accesses once started
+ *
+ * @param *tr The trace
+ */
+void trace_init(trace_t *tr)
+{
+    memset(tr, 0, sizeof(*tr));
+    tr->pc_hi = 0xffffff;
+}
+
+
+/**
+ * Start writing a trace to a file. Set CPU_t.trace to the trace
+ * afterwards to record the instructions the CPU runs.
+ *
+ * @param *tr The trace (not running)
+ * @param *filename The file, replaced if it exists
+ * @return False if the file could not be opened (errno is set) or
+ *         out of memory
+ */
+bool trace_start(trace_t *tr, const char *filename)
+{
+    if (tr->running) {
+        return false;
+    }
+
+    tr->ring = malloc(TRACE_RING_LEN * sizeof(*tr->ring));
+    tr->block = malloc(TRACE_BLOCK_HEAD_LEN + TRACE_BLOCK_LEN + TRACE_REC_MAX_LEN);
+
+    if (!tr->ring || !tr->block || !trace_model_init(&tr->model)) {
+        goto fail;
+    }
+
+    tr->fp = fopen(filename, "wb");
+    if (!tr->fp) {
+        goto fail;
+    }
+
+    uint8_t head[TRACE_HEAD_LEN];
+    memcpy(head, TRACE_MAGIC, TRACE_MAGIC_LEN);
+    _trace_put(head + TRACE_MAGIC_LEN, TRACE_VERSION, 2);
+    _trace_put(head + TRACE_MAGIC_LEN + 2, tr->mem ? TRACE_FLAG_MEM : 0, 2);
+
+    if (fwrite(head, sizeof(head), 1, tr->fp) != 1) {
+        fclose(tr->fp);
+        goto fail;
+    }
+
+    atomic_init(&tr->head, 0);
+    atomic_init(&tr->tail, 0);
+    atomic_init(&tr->stop, false);
+    atomic_init(&tr->writer_idle, false);
+    atomic_init(&tr->cpu_waiting, false);
+    atomic_init(&tr->records, 0);
+    atomic_init(&tr->bytes, 0);
+    tr->tail_seen = 0;
+    tr->block_len = 0;
+    tr->block_count = 0;
+    tr->io_error = false;
+    tr->waits = 0;
+
+    pthread_mutex_init(&tr->lock, NULL);
+    pthread_cond_init(&tr->wake, NULL);
+    pthread_cond_init(&tr->space, NULL);
+
+    if (pthread_create(&tr->thread, NULL, _trace_write, tr) != 0) {
+        pthread_mutex_destroy(&tr->lock);
+        pthread_cond_destroy(&tr->wake);
+        pthread_cond_destroy(&tr->space);
+        fclose(tr->fp);
+        goto fail;
+    }
+
+    tr->running = true;
+    return true;
+
+fail:
+    free(tr->ring);
+    free(tr->block);
+    trace_model_free(&tr->model);
+    tr->ring = NULL;
+    tr->block = NULL;
+    return false;
+}
+
+
+/**
+ * Stop a trace, after the writer has written every record to the
+ * file. Clear CPU_t.trace first.
+ *
+ * @param *tr The trace
+ * @return False if the file could not be written
+ */
+bool trace_stop(trace_t *tr)
+{
+    if (!tr->running) {
+        return true;
+    }
+
+    pthread_mutex_lock(&tr->lock);
+    atomic_store(&tr->stop, true);
+    pthread_cond_signal(&tr->wake);
+    pthread_mutex_unlock(&tr->lock);
+    pthread_join(tr->thread, NULL);
+
+    pthread_mutex_destroy(&tr->lock);
+    pthread_cond_destroy(&tr->wake);
+    pthread_cond_destroy(&tr->space);
+
+    if (fclose(tr->fp) != 0) {
+        tr->io_error = true;
+    }
+
+    free(tr->ring);
+    free(tr->block);
+    trace_model_free(&tr->model);
+    tr->ring = NULL;
+    tr->block = NULL;
+    tr->fp = NULL;
+    tr->running = false;
+
+    return !tr->io_error;
+}
+
+
+/**
+ * Get the address of the data an instruction accesses, for the CPU
+ * as it is before running it
+ *
+ * @param *cpu The CPU
+ * @param *mem Its memory
+ * @param op The opcode
+ * @return The address, TRACE_NO_EA if it has none (or is a jump)
+ */
+static uint32_t _trace_ea(CPU_t *cpu, memory_t *mem, uint8_t op)
+{
+    switch (opcode_table[op].inst) {
+    case I_BRK:
+    case I_COP:
+    case I_JMP:
+    case I_JSL:
+    case I_JSR:
+    case I_PEA:
+        return TRACE_NO_EA;
+    default:
+        break;
+    }
+
+    switch (opcode_table[op].addr_mode) {
+    case CPU_ADDR_DP:      return _addrCPU_getDirectPage(cpu, mem, false);
+    case CPU_ADDR_DPX:     return _addrCPU_getDirectPageIndexedX(cpu, mem, false);
+    case CPU_ADDR_DPINDX:  return _addrCPU_getDirectPageIndexedIndirectX(cpu, mem, false);
+    case CPU_ADDR_DPY:     return _addrCPU_getDirectPageIndexedY(cpu, mem, false);
+    case CPU_ADDR_INDDPY:  return _addrCPU_getDirectPageIndirectIndexedY(cpu, mem, false);
+    case CPU_ADDR_INDDPLY: return _addrCPU_getDirectPageIndirectLongIndexedY(cpu, mem, false);
+    case CPU_ADDR_DPIND:   return _addrCPU_getDirectPageIndirect(cpu, mem, false);
+    case CPU_ADDR_DPINDL:  return _addrCPU_getDirectPageIndirectLong(cpu, mem, false);
+    case CPU_ADDR_ABS:     return _addrCPU_getAbsolute(cpu, mem, false);
+    case CPU_ADDR_ABSX:    return _addrCPU_getAbsoluteIndexedX(cpu, mem, false);
+    case CPU_ADDR_ABSY:    return _addrCPU_getAbsoluteIndexedY(cpu, mem, false);
+    case CPU_ADDR_ABSL:    return _addrCPU_getLong(cpu, mem, false);
+    case CPU_ADDR_ABSLX:   return _addrCPU_getLongIndexedX(cpu, mem, false);
+    case CPU_ADDR_SR:      return _addrCPU_getStackRelative(cpu, mem, false);
+    case CPU_ADDR_SRINDY:  return _addrCPU_getStackRelativeIndirectIndexedY(cpu, mem, false);
+    default:               return TRACE_NO_EA;
+    }
+}
+
+
+/**
+ * Wait for the writer to make room in a full ring (CPU thread)
+ *
+ * @param *tr The trace
+ * @param head The head of the ring
+ */
+static void _trace_cpu_wait(trace_t *tr, uint32_t head)
+{
+    ++tr->waits;
+
+    pthread_mutex_lock(&tr->lock);
+    atomic_store(&tr->cpu_waiting, true);
+    pthread_cond_signal(&tr->wake);
+
+    while (head - atomic_load(&tr->tail) == TRACE_RING_LEN) {
+        pthread_cond_wait(&tr->space, &tr->lock);
+    }
+
+    atomic_store(&tr->cpu_waiting, false);
+    tr->tail_seen = atomic_load(&tr->tail);
+    pthread_mutex_unlock(&tr->lock);
+}
+
+
+/**
+ * Start a record of the instruction a CPU is about to run (CPU thread).
+ * Waits for the writer if the ring is full.
+ *
+ * @param *tr The trace (running)
+ * @param *cpu The CPU
+ * @param *mem Its memory
+ * @param pc The address of the instruction
+ * @return The record to pass to trace_end() once the instruction has
+ *         run, NULL if it is not to be recorded
+ */
+trace_rec_t *trace_begin(trace_t *tr, CPU_t *cpu, memory_t *mem, uint32_t pc)
+{
+    if (pc < tr->pc_lo || pc > tr->pc_hi || cpu->cycles < tr->cycles_lo ||
+        (tr->cycles_hi && cpu->cycles >= tr->cycles_hi)) {
+        return NULL;
+    }
+
+    uint32_t head = atomic_load_explicit(&tr->head, memory_order_relaxed);
+
+    if (head - tr->tail_seen == TRACE_RING_LEN) {
+        tr->tail_seen = atomic_load_explicit(&tr->tail, memory_order_acquire);
+
+        if (head - tr->tail_seen == TRACE_RING_LEN) {
+            _trace_cpu_wait(tr, head);
+        }
+    }
+
+    trace_rec_t *rec = &tr->ring[head & (TRACE_RING_LEN - 1)];
+
+    rec->cycles = cpu->cycles;
+    rec->pc = pc;
+    rec->C = cpu->C;
+    rec->X = cpu->X;
+    rec->Y = cpu->Y;
+    rec->SP = cpu->SP;
+    rec->D = cpu->D;
+    rec->DBR = cpu->DBR;
+    rec->P = _cpu_get_sr(cpu) | (cpu->P.E << 8);
+
+    // Operands bank wrap like the program counter does
+    uint8_t *page = mem->rd[pc >> MEM_PAGE_BITS];
+
+    if (page && (pc & MEM_PAGE_MASK) <= MEM_PAGE_MASK - 3) {
+        memcpy(rec->inst, page + (pc & MEM_PAGE_MASK), sizeof(rec->inst));
+    }
+    else {
+        for (int i = 0; i < 4; ++i) {
+            rec->inst[i] = _get_mem_byte(mem, _addr_add_val_bank_wrap(pc, i), false);
+        }
+    }
+
+    rec->ea = tr->mem ? _trace_ea(cpu, mem, rec->inst[0]) : TRACE_NO_EA;
+    rec->val = 0;
+    return rec;
+}
+
+
+/**
+ * Finish a record from trace_begin() after the instruction has run,
+ * and pass it to the writer (CPU thread)
+ *
+ * @param *tr The trace
+ * @param *rec The record
+ * @param *mem The memory of the CPU
+ */
+void trace_end(trace_t *tr, trace_rec_t *rec, memory_t *mem)
+{
+    if (rec->ea != TRACE_NO_EA) {
+        rec->val = _get_mem_word(mem, rec->ea, false);
+    }
+    uint32_t head = atomic_load_explicit(&tr->head, memory_order_relaxed) + 1;
+
+    atomic_store_explicit(&tr->head, head, memory_order_release);
+
+    if ((head % TRACE_WAKE_BATCH) == 0) {
+        // Orders the store of the head before the load of writer_idle
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if (atomic_load(&tr->writer_idle)) {
+            pthread_mutex_lock(&tr->lock);
+            pthread_cond_signal(&tr->wake);
+            pthread_mutex_unlock(&tr->lock);
+        }
+    }
+}
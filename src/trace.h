@@ -0,0 +1,149 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "65816.h"
+
+// Trace file layout (all values little endian):
+//  "816TRACE" | version (2 bytes) | flags (2 bytes)
+// followed by blocks of encoded records:
+//  length in bytes (4) | record count (4) | records
+#define TRACE_MAGIC "816TRACE"
+#define TRACE_MAGIC_LEN 8
+#define TRACE_VERSION 1
+#define TRACE_HEAD_LEN 12
+#define TRACE_BLOCK_HEAD_LEN 8
+
+// Header flags
+#define TRACE_FLAG_MEM 0x0001 // Records have an effective address and value
+
+// Size of the ring between the CPU thread and the writer (records, power of 2)
+#define TRACE_RING_LEN 8192
+
+// Bytes of encoded records the writer collects before writing a block
+#define TRACE_BLOCK_LEN 65536
+
+// Entries of the predictions of a trace model (power of 2)
+#define TRACE_PRED_LEN 65536
+
+// Effective address of a record without one
+#define TRACE_NO_EA 0xffffffff
+
+// One instruction, with the CPU as it was before running it
+typedef struct trace_rec_t {
+    uint64_t cycles;
+    uint32_t pc;         // 24-bit address of the instruction
+    uint32_t ea;         // Address of the data it accesses (TRACE_NO_EA = none)
+    uint16_t C, X, Y, SP, D;
+    uint16_t val;        // Word at ea after the instruction
+    uint16_t P;          // Status register, and E in bit 8
+    uint8_t DBR;
+    uint8_t inst[4];     // The opcode and the 3 bytes after it
+} trace_rec_t;
+
+// Fields of a record in the order of the mask of an encoded record
+// (the ones which are mispredicted most often first)
+typedef enum trace_field_t {
+    TRACE_F_C = 0,
+    TRACE_F_CYCLES,
+    TRACE_F_P,
+    TRACE_F_PC,
+    TRACE_F_VAL,
+    TRACE_F_EA,
+    TRACE_F_X,
+    TRACE_F_Y,
+    TRACE_F_SP,
+    TRACE_F_D,
+    TRACE_F_DBR,
+    TRACE_F_INST,
+    TRACE_FIELD_COUNT
+} trace_field_t;
+
+// What a trace model remembers of the last time the CPU was at an address
+typedef struct trace_pred_t {
+    // Of the record which followed (predicts the changes an instruction makes)
+    uint32_t next_pc;
+    uint32_t cycles;     // Cycles it took
+    uint16_t dreg[5];    // Change of C, X, Y, SP and D
+    uint16_t P;
+    uint8_t DBR;
+
+    // Of the record itself
+    uint8_t inst[4];
+    uint32_t ea;
+    uint32_t stride;     // ea minus the one before it
+    uint16_t val;
+} trace_pred_t;
+
+// State shared by the encoder and the decoder of a trace. A record is
+// encoded as a mask of the fields which differ from what the model
+// predicts, followed by the differences. Loops mostly encode to a
+// single byte, since the CPU does the same things each time around.
+typedef struct trace_model_t {
+    trace_rec_t last;
+    trace_pred_t *pred;  // TRACE_PRED_LEN entries, by address
+} trace_model_t;
+
+// Records instructions the CPU runs to a file. The CPU thread fills
+// records into a ring (see CPU_t.trace), and a writer thread encodes
+// them and writes the file, so the CPU thread never waits on the file
+// unless the ring fills up. The writer sleeps until the ring is half
+// full, so the last records are only written when the trace is
+// stopped. Records can be limited to instructions in a range of
+// addresses and a window of cycle counts.
+typedef struct trace_t {
+    bool running;
+    bool mem;                  // Record effective addresses and values
+    uint32_t pc_lo, pc_hi;     // Record instructions at these addresses (inclusive)
+    uint64_t cycles_lo, cycles_hi; // Record instructions starting in this window (hi = 0 = no end)
+
+    // Ring, head is only written by the CPU thread, tail only by the writer
+    trace_rec_t *ring;
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    uint32_t tail_seen;        // CPU thread: tail when last read
+
+    // Writer thread
+    pthread_t thread;
+    _Atomic bool stop;
+    pthread_mutex_t lock;      // Only taken by a thread to sleep, or to wake the other one
+    pthread_cond_t wake;       // Signaled for the writer when records are waiting
+    pthread_cond_t space;      // Signaled for the CPU thread when the ring has room
+    _Atomic bool writer_idle;
+    _Atomic bool cpu_waiting;
+    FILE *fp;
+    trace_model_t model;
+    uint8_t *block;            // Block being filled (TRACE_BLOCK_HEAD_LEN + TRACE_BLOCK_LEN + a record)
+    uint32_t block_len;
+    uint32_t block_count;
+    bool io_error;
+
+    // Statistics
+    _Atomic uint64_t records;  // Records written
+    _Atomic uint64_t bytes;    // Bytes written (after the header)
+    uint64_t waits;            // Times the CPU thread found the ring full
+} trace_t;
+
+
+void trace_init(trace_t *tr);
+bool trace_start(trace_t *tr, const char *filename);
+bool trace_stop(trace_t *tr);
+trace_rec_t *trace_begin(trace_t *tr, CPU_t *cpu, memory_t *mem, uint32_t pc);
+void trace_end(trace_t *tr, trace_rec_t *rec, memory_t *mem);
+
+bool trace_model_init(trace_model_t *m);
+void trace_model_free(trace_model_t *m);
+size_t trace_encode(trace_model_t *m, const trace_rec_t *rec, uint8_t *buf);
+size_t trace_decode(trace_model_t *m, const uint8_t *buf, size_t len, trace_rec_t *rec);
+
+#endif
@@ -0,0 +1,189 @@
+/**
+ * 65(c)816 simulator/emulator (816CE)
+ * Copyright (C) 2023 Zach Baldwin
+ */
+
+// Prints an execution trace as text (build/tracedump)
+//
+// Each instruction of a trace written by 'trace start' is printed on a
+// line of its own: the cycle count and address it started at, its
+// disassembly, the registers before it ran and, for traces with memory
+// accesses, the address of its data and the word there after it ran:
+//
+//   1234 008003: LDA $7f05      C:0041 X:0000 Y:0000 SP:01ff D:0000 DBR:00 P:30 E:1 [007f05]=0041
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "65816.h"
+#include "65816-util.h"
+#include "disassembler.h"
+#include "trace.h"
+
+
+/**
+ * Print the usage and exit
+ */
+static void tracedump_usage(void)
+{
+    printf(
+        "65816 Simulator (C) Zach Baldwin 2022-2023\n"
+        "USAGE:\n"
+        " $ tracedump (--stats) filename\n"
+        "\n"
+        "Args:\n"
+        " --stats ... Only print the number of records and their encoded size\n"
+        );
+    exit(EXIT_FAILURE);
+}
+
+
+/**
+ * Get a little endian value from a buffer
+ *
+ * @param *buf The buffer
+ * @param len The length of the value in bytes
+ * @return The value
+ */
+static uint64_t tracedump_get(const uint8_t *buf, int len)
+{
+    uint64_t val = 0;
+
+    for (int i = len - 1; i >= 0; --i) {
+        val = (val << 8) | buf[i];
+    }
+    return val;
+}
+
+
+/**
+ * Print a record
+ *
+ * @param *rec The record
+ */
+static void tracedump_print(const trace_rec_t *rec)
+{
+    CPU_t cpu = {0};
+    char buf[40];
+
+    // The disassembler takes the register widths and the address from a CPU
+    initCPU(&cpu);
+    cpu.PC = rec->pc & 0xffff;
+    cpu.PBR = rec->pc >> 16;
+    cpu.P.E = (rec->P >> 8) & 1;
+    _cpu_set_sr(&cpu, rec->P & 0xff);
+    get_opcode_by_bytes((uint8_t *)rec->inst, &cpu, buf);
+
+    printf("%" PRIu64 " %06x: %-14s C:%04x X:%04x Y:%04x SP:%04x D:%04x DBR:%02x P:%02x E:%d",
+           rec->cycles, rec->pc, buf, rec->C, rec->X, rec->Y, rec->SP, rec->D,
+           rec->DBR, rec->P & 0xff, (rec->P >> 8) & 1);
+
+    if (rec->ea != TRACE_NO_EA) {
+        printf(" [%06x]=%04x", rec->ea, rec->val);
+    }
+    putchar('\n');
+}
+
+
+int main(int argc, char *argv[])
+{
+    char *filename = NULL;
+    bool stats = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--stats") == 0) {
+            stats = true;
+        }
+        else if (!filename && argv[i][0] != '-') {
+            filename = argv[i];
+        }
+        else {
+            tracedump_usage();
+        }
+    }
+    if (!filename) {
+        tracedump_usage();
+    }
+
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        printf("Error! Unable to open file '%s':\n%s\n", filename, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    uint8_t head[TRACE_HEAD_LEN];
+    if (fread(head, sizeof(head), 1, fp) != 1 || memcmp(head, TRACE_MAGIC, TRACE_MAGIC_LEN) != 0) {
+        printf("Error! (%s) Not a trace\n", filename);
+        return EXIT_FAILURE;
+    }
+    if (tracedump_get(head + TRACE_MAGIC_LEN, 2) != TRACE_VERSION) {
+        printf("Error! (%s) Unsupported trace version\n", filename);
+        return EXIT_FAILURE;
+    }
+
+    trace_model_t model;
+    uint8_t *block = malloc(TRACE_BLOCK_LEN * 2);
+
+    if (!block || !trace_model_init(&model)) {
+        printf("Unable to allocate memory!\n");
+        return EXIT_FAILURE;
+    }
+
+    uint64_t records = 0;
+    uint64_t bytes = 0;
+    int ret = EXIT_SUCCESS;
+
+    for (;;) {
+        uint8_t block_head[TRACE_BLOCK_HEAD_LEN];
+
+        if (fread(block_head, sizeof(block_head), 1, fp) != 1) {
+            break; // End of the trace
+        }
+
+        uint32_t len = tracedump_get(block_head, 4);
+        uint32_t count = tracedump_get(block_head + 4, 4);
+
+        if (len > TRACE_BLOCK_LEN * 2 || fread(block, len, 1, fp) != 1) {
+            printf("Error! (%s) Trace ends in the middle of a block\n", filename);
+            ret = EXIT_FAILURE;
+            break;
+        }
+
+        size_t pos = 0;
+
+        for (uint32_t i = 0; i < count; ++i) {
+            trace_rec_t rec;
+            size_t used = trace_decode(&model, block + pos, len - pos, &rec);
+
+            if (!used) {
+                printf("Error! (%s) Corrupt block at record %" PRIu64 "\n", filename, records);
+                ret = EXIT_FAILURE;
+                goto done;
+            }
+            pos += used;
+            ++records;
+
+            if (!stats) {
+                tracedump_print(&rec);
+            }
+        }
+        bytes += TRACE_BLOCK_HEAD_LEN + len;
+    }
+
+done:
+    if (stats) {
+        printf("%" PRIu64 " records in %" PRIu64 " bytes (%.2f bytes per record)%s\n",
+               records, bytes, records ? (double)bytes / records : 0.0,
+               (tracedump_get(head + TRACE_MAGIC_LEN + 2, 2) & TRACE_FLAG_MEM) ? ", with memory accesses" : "");
+    }
+
+    trace_model_free(&model);
+    free(block);
+    fclose(fp);
+    return ret;
+}
@@ -0,0 +1,26 @@
+#!/bin/sh
+# Builds a memory image from a hex listing, for the farm's --rom
+#
+# USAGE: hexbin.sh size listing image
+#
+# Each line of the listing is an address and the bytes stored from it
+# on ("8000: 18 fb"), both in hex. '#' starts a comment, and the other
+# bytes of the image are 0.
+
+size=$1
+listing=$2
+image=$3
+
+rm -f "$image"
+dd if=/dev/zero of="$image" bs=1 count=0 seek=$((size)) 2>/dev/null || exit 1
+
+sed 's/#.*//' "$listing" | while read -r addr bytes; do
+    if [ -z "$addr" ]; then
+        continue
+    fi
+    esc=
+    for b in $bytes; do
+        esc="$esc\\$(printf '%03o' "0x$b")"
+    done
+    printf "$esc" | dd of="$image" bs=1 seek=$((0x${addr%:})) conv=notrunc 2>/dev/null || exit 1
+done